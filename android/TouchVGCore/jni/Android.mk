@@ -34,6 +34,7 @@ geom_files := $(core_src)/geom/mgbase.cpp \
               $(core_src)/geom/mgmat.cpp \
               $(core_src)/geom/mgnear.cpp \
               $(core_src)/geom/mgnearbz.cpp \
+              $(core_src)/geom/mgflatten.cpp \
               $(core_src)/geom/fitcurves.cpp \
               $(core_src)/geom/mgvec.cpp \
               $(core_src)/geom/mgpnt.cpp \
@@ -41,9 +42,14 @@ geom_files := $(core_src)/geom/mgbase.cpp \
               $(core_src)/geom/nanosvg.cpp
 
 graph_files := $(core_src)/graph/gigraph.cpp \
-              $(core_src)/graph/gixform.cpp
+              $(core_src)/graph/gixform.cpp \
+              $(core_src)/graph/githread.cpp
 
-json_files := $(core_src)/jsonstorage/mgjsonstorage.cpp
+json_files := $(core_src)/jsonstorage/mgjsonstorage.cpp \
+              $(core_src)/jsonstorage/mgjsonreader.cpp \
+              $(core_src)/jsonstorage/mgjsonwriter.cpp \
+              $(core_src)/jsonstorage/mgbinstorage.cpp \
+              $(core_src)/jsonstorage/mgmapfile.cpp
 
 gshape_files := $(core_src)/gshape/mgarc.cpp \
               $(core_src)/gshape/mgbasesp.cpp \
@@ -107,7 +113,11 @@ view_files := $(core_src)/view/GcGraphView.cpp \
               $(core_src)/view/gicorerecord.cpp \
               $(core_src)/export/svgcanvas.cpp \
               $(core_src)/export/girecordcanvas.cpp \
-              $(core_src)/record/recordshapes.cpp
+              $(core_src)/record/recordshapes.cpp \
+              $(core_src)/record/recordfile.cpp \
+              $(core_src)/record/recordframes.cpp \
+              $(core_src)/record/recordindex.cpp \
+              $(core_src)/record/recordwriter.cpp
 
 include $(CLEAR_VARS)
 LOCAL_MODULE     := libTouchVGCore
@@ -59,10 +59,11 @@ struct MgSnap {
     }
     
 #ifndef SWIG
-    //! 根据当前点捕捉新的坐标
+    //! 根据当前点捕捉新的坐标，整体拖动尚未移动的图形时 moved 为其拖动量
     virtual Point2d snapPoint(const MgMotion* sender, 
                               const Point2d& orignPt, const MgShape* shape,
-                              int hotHandle, int ignoreHandle = -1, const int* ignoreids = NULL) = 0;
+                              int hotHandle, int ignoreHandle = -1, const int* ignoreids = NULL,
+                              const Vector2d& moved = Vector2d::kIdentity()) = 0;
     
     //! 得到捕捉到的图形、控制点序号、源图形上匹配的控制点序号
     virtual bool getSnappedHandle(int& shapeid, int& handleIndex, int& handleIndexSrc) const = 0;
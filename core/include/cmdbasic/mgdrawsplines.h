@@ -7,10 +7,12 @@
 #define TOUCHVG_CMD_DRAW_SPLINES_H_
 
 #include "mgcmddraw.h"
+#include "mgfitter.h"
 
 //! 样条曲线绘图命令类
-/*! \ingroup CORE_COMMAND
-    \see MgSplines
+/*! 随手画时边画边拟合，结果是带切矢量的三次贝塞尔曲线，而不是经过各采样点的样条曲线。
+    \ingroup CORE_COMMAND
+    \see MgSplines, MgCurveFitter
 */
 class MgCmdDrawSplines : public MgCommandDraw
 {
@@ -36,8 +38,16 @@ private:
     
 private:
     bool canAddPoint(const MgMotion* sender, bool ended);
+    void applyTail();
+    static void appendCurve(void* data, const Point2d curve[4]);
+    
+    enum { kFitCapacity = 64 };     //!< 拟合时尾部数据点的最大个数
     
-    bool    m_freehand;
+    bool            m_freehand;
+    int             m_fixed;        //!< 已定型的型值点数
+    MgCurveFitter   m_fitter;       //!< 随手绘时逐点拟合曲线
+    Point2d         m_fitpts[kFitCapacity];
+    double          m_fitparams[kFitCapacity * 2];
 };
 
 //! 用点击绘制样条曲线的命令类
@@ -42,7 +42,27 @@ static void splitBezier(const Point2d* pts, float t, Point2d* pts1, Point2d* pts
 
 //! 返回三次贝塞尔曲线段的长度
 static float lengthOfBezier(const Point2d* pts, float tol);
-    
+
+#ifndef SWIG
+//! 计算三次贝塞尔曲线段折线化所需的等分段数
+/*! 按Wang公式估算，使折线与曲线的最大距离不超过tol
+    \param[in] pts 4个点的数组，为贝塞尔曲线段的控制点
+    \param[in] tol 折线与曲线的最大允许距离，正数
+    \return 等分段数，至少为1，最多为 maxSteps
+    \see flattenBezier
+*/
+static int bezierSteps(const Point2d* pts, float tol, int maxSteps = 512);
+
+//! 用前向差分法计算三次贝塞尔曲线段的等参数折线点
+/*! 使用SIMD指令每步同时累加点坐标和各阶差分，不含起点，最后一点为曲线终点
+    \param[in] pts 4个点的数组，为贝塞尔曲线段的控制点
+    \param[in] steps 等分段数，由 bezierSteps 得到
+    \param[out] outpts 折线点，由外界分配 steps 个点的空间，第i点的参数为(i+1)/steps
+    \see bezierSteps, MgFlattenBeziers
+*/
+static void flattenBezier(const Point2d* pts, int steps, Point2d* outpts);
+#endif
+
 //! 用线上四点构成三次贝塞尔曲线段
 /*! 该贝塞尔曲线段的起点和终点为给定点，中间经过另外两个给定点，
     t=1/3过pt2, t=2/3过pt3。
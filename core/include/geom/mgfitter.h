@@ -0,0 +1,69 @@
+﻿//! \file mgfitter.h
+//! \brief 定义流式曲线拟合类 MgCurveFitter
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+
+#ifndef TOUCHVG_CURVE_FITTER_H_
+#define TOUCHVG_CURVE_FITTER_H_
+
+#include "mgcurv.h"
+
+#ifndef SWIG
+
+//! 流式三次贝塞尔曲线拟合类
+/*! 基于 Schneider 的曲线拟合算法，数据点逐个输入。只对最后一个定型点之后的尾部数据点重新拟合，
+    尾部数据点无法用一段曲线拟合时，将上次的拟合结果定型输出，新的尾部从该段终点开始，
+    其起始切矢量与该段的终止切矢量相同(方向和长度)，以便两段曲线在样条曲线中共用一个型值点切矢量。
+    弦长短于起始切矢量的拟合结果暂不定型，继续添加数据点，以免过长的切矢量传给越来越短的曲线段。
+    定型时会尽量缩短该段的终止切矢量，剩余数据点无法整体拟合时取能拟合的最长前段，不丢弃数据点。
+    所用内存由调用者提供，每输入一个点的计算量与缓冲区容量成正比(定型时另有对数倍的重新拟合)，不分配内存。
+    \ingroup GEOM_CLASS
+    \see mgcurv::fitCurve
+*/
+class MgCurveFitter
+{
+public:
+    MgCurveFitter();
+
+    //! 开始拟合
+    /*!
+        \param points 调用者提供的数据点缓冲区，元素个数为capacity
+        \param params 调用者提供的参数缓冲区，元素个数至少为 2*capacity
+        \param capacity 缓冲区容量，至少为4，尾部数据点达到此数时强制定型
+        \param tol 拟合曲线与数据点的最大允许距离
+        \param fc 输出定型曲线段的回调函数
+        \param data 回调函数的参数
+    */
+    void begin(Point2d* points, double* params, int capacity, float tol,
+               mgcurv::FitCubicCallback fc, void* data);
+
+    //! 添加一个数据点，返回是否有曲线段定型输出
+    bool addPoint(const Point2d& pt);
+
+    //! 结束拟合，输出尾部曲线段，返回是否有输出
+    bool end();
+
+    //! 得到尾部未定型的曲线段，返回是否有此曲线段
+    bool getTail(Point2d curve[4]) const;
+
+    //! 返回尾部数据点的个数
+    int getTailCount() const { return m_count; }
+
+private:
+    bool fitTail(Point2d curve[4], int count, double alpha2 = 0) const;
+    void flush();
+
+    Point2d*    m_points;       //!< 尾部数据点
+    double*     m_params;       //!< 拟合用的参数缓冲区
+    int         m_capacity;     //!< 缓冲区容量
+    int         m_count;        //!< 尾部数据点个数
+    float       m_tol;          //!< 允许误差
+    mgcurv::FitCubicCallback m_fc;
+    void*       m_data;
+    Vector2d    m_startVector;  //!< 尾部起点的切矢量，等于已定型曲线段的终止切矢量，为零则自由拟合
+    Point2d     m_curve[4];     //!< 尾部曲线段
+    int         m_fitCount;     //!< 尾部曲线段拟合的数据点数，小于 m_count 时是暂不定型的上次结果
+};
+
+#endif // SWIG
+#endif // TOUCHVG_CURVE_FITTER_H_
@@ -0,0 +1,111 @@
+﻿//! \file mgflatten.h
+//! \brief 定义曲线折线化缓存类 MgFlattenBeziers
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+
+#ifndef TOUCHVG_FLATTEN_BEZIERS_H_
+#define TOUCHVG_FLATTEN_BEZIERS_H_
+
+#include "mgbox.h"
+
+class MgPath;
+class MgFlattenImpl;
+
+//! 曲线折线化缓存类
+/*! 将贝塞尔曲线序列、三次样条曲线或路径按容差离散为折线，每个折线点记录所在的曲线段序号和段内参数。
+    曲线图形在 update() 中生成本对象，其包络框、点击测试、框选和捕捉求交时直接使用折线结果，
+    避免每次查询都重新计算曲线。查询函数都是常量函数，不修改本对象，可在多个线程中同时调用。
+    \ingroup GEOM_CLASS
+    \see mgcurv::flattenBezier, MgPath
+*/
+class MgFlattenBeziers
+{
+public:
+    MgFlattenBeziers();
+    MgFlattenBeziers(const MgFlattenBeziers& src);
+    ~MgFlattenBeziers();
+    MgFlattenBeziers& operator=(const MgFlattenBeziers& src);
+
+    //! 是否让图形的点击测试等函数使用折线化缓存，默认为true
+    static bool& enabled() {
+        static bool on = true;
+        return on;
+    }
+
+    //! 清除折线数据
+    void clear();
+
+    //! 返回是否有对应于指定版本号的折线数据，且其折线化容差不大于tol
+    bool isValid(long version, float tol) const;
+
+    //! 折线化贝塞尔曲线
+    /*!
+        \param count 点的个数，至少为4，必须为3的倍数加1
+        \param points 控制点和端点的数组，点数为count
+        \param closed 是否闭合，闭合时与 mgnear::beziersBox 一样用光滑曲线段连接首末点
+        \param tol 折线与曲线的最大允许距离，正数
+        \param version 版本号，供调用者判断折线数据是否过期
+        \return 折线点数
+    */
+    int setBeziers(int count, const Point2d* points, bool closed, float tol, long version = 0);
+
+    //! 折线化三次样条曲线
+    /*! 参数见 mgnear::cubicSplinesHit，曲线段序号为型值点序号
+    */
+    int setSplines(int n, const Point2d* knots, const Vector2d* knotvs,
+                   bool closed, bool hermite, float tol, long version = 0);
+
+    //! 接着折线化未闭合的三次样条曲线，只重新折线化从 from 段开始的曲线段
+    /*! 用于逐段增长的曲线，from 之前的曲线段及其型值点和切矢量须与上次折线化时相同，
+        容差和版本号不变。不是由 setSplines 生成的未闭合曲线时不处理，返回0。
+        \return 折线点数
+    */
+    int appendSplines(int n, const Point2d* knots, const Vector2d* knotvs, int from, bool hermite);
+
+    //! 折线化路径，曲线段序号为路径中该段的最末节点序号
+    int setPath(const MgPath& path, float tol, long version = 0);
+
+    //! 返回折线点数
+    int getCount() const;
+
+    //! 返回折线点数组
+    const Point2d* getPoints() const;
+
+    //! 返回到达指定折线点的边所在的曲线段序号
+    int getSegment(int index) const;
+
+    //! 返回指定折线点在其曲线段内的参数，范围为[0, 1]
+    float getParam(int index) const;
+
+    //! 返回折线化容差
+    float getTolerance() const;
+
+    //! 返回版本号
+    long getVersion() const;
+
+    //! 返回包络框，已按折线化容差放大，包含原曲线
+    Box2d getExtent() const;
+
+    //! 判断折线是否与矩形相交，已按折线化容差放大矩形
+    bool intersectBox(const Box2d& box) const;
+
+    //! 计算点到曲线的最近距离
+    /*! 先在折线上找最近边，再用牛顿迭代在原曲线上求精
+        \param[in] pt 曲线外给定的点
+        \param[in] tol 距离公差，正数，超出则不计算最近点
+        \param[out] nearpt 曲线上的最近点
+        \param[out] segment 最近点所在曲线段的序号，负数表示失败
+        \param[out] inside 是否点中闭合图形内部，可为NULL
+        \return 给定的点到最近点的距离，失败时为极大数
+    */
+    float hitTest(const Point2d& pt, float tol, Point2d& nearpt, int& segment,
+                  bool* inside = (bool*)0) const;
+
+    //! 求与另一折线在指定矩形内最靠近矩形中心的交点
+    bool crossWith(const MgFlattenBeziers& other, const Box2d& box, Point2d& ptCross) const;
+
+private:
+    MgFlattenImpl*  m_data;
+};
+
+#endif // TOUCHVG_FLATTEN_BEZIERS_H_
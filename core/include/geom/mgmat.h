@@ -8,6 +8,16 @@
 
 #include "mgpnt.h"
 
+//! 矩阵的变换类型
+/*! \see Matrix2d::kind
+*/
+typedef enum {
+    kMgMatIdentity,     //!< 单位矩阵
+    kMgMatTranslate,    //!< 仅有平移
+    kMgMatScale,        //!< 沿坐标轴方向放缩和平移，无旋转和错切
+    kMgMatAffine,       //!< 一般仿射变换
+} MgMatrixKind;
+
 //! 二维齐次变换矩阵类
 /*!
     \ingroup GEOM_CLASS
@@ -112,6 +122,15 @@ public:
     */
     void transformPoints(int count, Point2d* points) const;
 
+    //! 对多个点进行矩阵变换，按矩阵类型选用简化的计算
+    /*!
+        \param[in] count 点的个数
+        \param[in] points 要变换的点的数组，元素个数为count
+        \param[out] result 变换后的点的数组，元素个数为count，可与points相同
+        \param[in] kind 本矩阵的变换类型 MgMatrixKind，为负数时自动计算
+    */
+    void transformPoints(int count, const Point2d* points, Point2d* result, int kind = -1) const;
+
     //! 对多个矢量进行矩阵变换
     /*! 对矢量进行矩阵变换时，矩阵的平移分量部分不起作用
         \param[in] count 矢量的个数
@@ -163,6 +182,12 @@ public:
     //! 判断矩阵的坐标轴矢量是否分别水平和垂直
     bool isOrtho() const;
 
+    //! 返回矩阵的变换类型 MgMatrixKind
+    /*! 按矩阵元素精确比较，按该类型简化的计算与完整的矩阵乘法结果相同。
+        矩阵元素可直接修改，因此每次调用都重新判断，批量变换前判断一次即可。
+    */
+    int kind() const;
+
     //! 判断矩阵中是否含有对称成分
     bool hasMirror(Vector2d& reflex) const;
     
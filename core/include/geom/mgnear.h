@@ -78,6 +78,21 @@ static bool cubicSplinesIntersectBox(const Box2d& box, int n, const Point2d* kno
                                      const Vector2d* knotvs, bool closed = false, bool hermite = true);
 
 #ifndef SWIG
+//! 计算点到多段三次贝塞尔曲线的最近距离，一次处理多个曲线段
+/*! 先用控制点包络框和控制点凸包到给定点的距离下界剔除曲线段，
+    再对剩余曲线段每四段一组并行做牛顿迭代，所得距离与逐段调用 nearestOnBezier 的结果之差在 Tol 内。
+    \param[in] pt 曲线外给定的点
+    \param[in] count 点的个数，至少为4，必须为3的倍数加1，相邻曲线段共用端点
+    \param[in] points 控制点和端点的数组，点数为count
+    \param[in] tol 距离公差，正数，距离下界超出则不计算该曲线段
+    \param[out] nearpt 曲线上的最近点
+    \param[out] segment 最近点所在曲线段的起点序号，为3的倍数，负数表示失败
+    \return 给定的点到最近点的距离，失败时为极大数
+    \see nearestOnBezier, cubicSplinesHit
+*/
+static float nearestOnBeziers(const Point2d& pt, int count, const Point2d* points,
+                              float tol, Point2d& nearpt, int& segment);
+
 //! 计算点到三次样条曲线的最近距离
 /*!
     \param[in] n 三次样条曲线的型值点的点数
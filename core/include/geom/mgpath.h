@@ -10,6 +10,7 @@
 
 class MgPathImpl;
 class Box2d;
+class MgFlattenBeziers;
 
 //! 矢量路径节点类型
 /*! \see MgPath
@@ -211,6 +212,12 @@ public:
     
     //! 求两个路径的交点
     bool crossWithPath(const MgPath& path, const Box2d& box, Point2d& ptCross) const;
+    
+#ifndef SWIG
+    //! 求两个路径的交点，flat 和 pathFlat 为两路径已有的折线化结果，为NULL时临时折线化
+    bool crossWithPath(const MgPath& path, const Box2d& box, Point2d& ptCross,
+                       const MgFlattenBeziers* flat, const MgFlattenBeziers* pathFlat) const;
+#endif
 
 private:
     MgPathImpl*   m_data;
@@ -0,0 +1,103 @@
+﻿//! \file githread.h
+//! \brief 定义工作线程类 GiThread、事件类 GiEvent、互斥量类 GiMutex 和并行处理函数 giParallelFor
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+
+#ifndef TOUCHVG_GITHREAD_H_
+#define TOUCHVG_GITHREAD_H_
+
+#ifndef SWIG
+
+//! 工作线程类
+/*! 在Windows上用Win32线程实现，其余平台用pthread实现。析构时自动等待线程结束。
+    \ingroup GRAPH_INTERFACE
+ */
+class GiThread
+{
+public:
+    typedef void (*Proc)(void* data);   //!< 线程函数类型
+
+    GiThread();
+    ~GiThread();
+
+    //! 启动线程，已启动过且尚未结束等待时返回false
+    bool start(Proc proc, void* data);
+
+    //! 等待线程结束
+    void join();
+
+    //! 返回线程是否已启动且尚未等待结束
+    bool isStarted() const { return !!_handle; }
+
+private:
+    GiThread(const GiThread&);
+    void operator=(const GiThread&);
+
+    void*   _handle;
+};
+
+//! 自动复位的事件，用于线程间等待和通知
+/*! 在Windows上用事件对象实现，其余平台用pthread的互斥量和条件变量实现。
+    set() 后只唤醒一个等待的线程，没有线程等待时保持有信号直到下次 wait()。
+    \ingroup GRAPH_INTERFACE
+ */
+class GiEvent
+{
+public:
+    GiEvent();
+    ~GiEvent();
+
+    //! 设置为有信号
+    void set();
+
+    //! 等待有信号并复位，ms 为负数时一直等待，返回是否等到信号(否则为超时)
+    bool wait(int ms = -1);
+
+private:
+    GiEvent(const GiEvent&);
+    void operator=(const GiEvent&);
+
+    void*   _handle;
+};
+
+//! 互斥量，等待时让出处理器
+/*! 在Windows上用临界区实现，其余平台用pthread的互斥量实现。不可重入。
+    \ingroup GRAPH_INTERFACE
+ */
+class GiMutex
+{
+public:
+    GiMutex();
+    ~GiMutex();
+
+    //! 加锁，已被其他线程锁住时等待
+    void lock();
+
+    //! 解锁
+    void unlock();
+
+private:
+    GiMutex(const GiMutex&);
+    void operator=(const GiMutex&);
+
+    void*   _handle;
+};
+
+//! 返回可同时运行的处理器个数，至少为1
+/*! 平台不支持原子操作时返回1，此时 giParallelFor 只在调用线程中处理。
+ */
+int giProcessorCount();
+
+//! 并行处理的回调函数类型，处理序号范围为 [from, to)
+typedef void (*GiParallelFunc)(int from, int to, void* data);
+
+//! 将序号范围 [0, count) 分块后由多个线程并行处理，全部完成后返回
+/*! 调用线程也参与处理，各线程按原子计数依次领取下一块，每块至少 minChunk 个。
+    工作线程在首次并行处理时创建并常驻，之后的调用只唤醒所需的工作线程。
+    不足两块、只有一个处理器、在 func 中嵌套调用或其他线程正在并行处理时，直接在调用线程中处理。
+    func 会在多个线程中同时调用，只应修改与其序号范围对应的数据。
+ */
+void giParallelFor(int count, int minChunk, GiParallelFunc func, void* data);
+
+#endif // SWIG
+#endif // TOUCHVG_GITHREAD_H_
@@ -8,6 +8,8 @@
 
 #include "mgbasesp.h"
 
+struct MgSharedPoints;
+
 //! 折线基类
 /*! \ingroup CORE_SHAPE
  */
@@ -36,6 +38,12 @@ public:
     //! 删除一个顶点
     virtual bool removePoint(int index);
     
+    //! 在末尾批量添加顶点，用于回放增量笔迹
+    /*! 顶点数组改为可共享的只增存储，复制的图形共用该存储，在末尾追加时不复制已有顶点。
+        共享时修改顶点会先复制出独占的顶点数组。本函数不重新计算包络框。
+     */
+    virtual bool appendPoints(const Point2d* pts, int n);
+    
     //! 返回边的最大序号
     int maxEdgeIndex() const;
     
@@ -64,11 +72,14 @@ protected:
     bool _hitTestBox(const Box2d& rect) const;
     bool _save(MgStorage* s) const;
     bool _load(MgShapeFactory* factory, MgStorage* s);
+    void _ownPoints(int count);
+    void _releasePoints();
     
 protected:
     Point2d*    _points;
     int      _maxCount;
     int      _count;
+    MgSharedPoints* _shared;    // 共享的只增顶点存储，_points 指向其中的顶点
 };
 
 //! 折线图形类
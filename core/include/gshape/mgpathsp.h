@@ -7,6 +7,7 @@
 #define TOUCHVG_PATH_SHAPE_H_
 
 #include "mgbasesp.h"
+#include "mgflatten.h"
 
 //! 路径图形类
 /*! \ingroup CORE_SHAPE
@@ -28,10 +29,14 @@ public:
     
 #ifndef SWIG
     virtual bool isCurve() const;
+    
+    //! 返回在 update() 中生成的折线化结果，没有时为NULL
+    const MgFlattenBeziers* getFlatten() const;
 #endif
 
 protected:
     bool _isClosed() const;
+    void _clearCachedData();
     bool _hitTestBox(const Box2d& rect) const;
     void _output(MgPath& path) const { path.append(_path); }
     bool _save(MgStorage* s) const;
@@ -39,6 +44,7 @@ protected:
     
 private:
     MgPath _path;
+    MgFlattenBeziers _flat;             //!< 曲线的折线化缓存，在 update() 中生成
 };
 
 #endif // TOUCHVG_PATH_SHAPE_H_
@@ -7,6 +7,7 @@
 #define TOUCHVG_SPLINES_SHAPE_H_
 
 #include "mglines.h"
+#include "mgflatten.h"
 
 //! 二次样条曲线类
 /*! \ingroup CORE_SHAPE
@@ -19,21 +20,37 @@ public:
     bool smooth(const Matrix2d& m2d, float tol);
     int smoothForPoints(int count, const Point2d* points, const Matrix2d& m2d, float tol);
     void clearVectors();
+    
+    //! 添加一段三次贝塞尔曲线，起点与末尾型值点重合时共用该型值点
+    /*! 用于逐段输出拟合曲线，切矢量记在型值点上，原来没有切矢量时原有型值点的切矢量取为零。
+        每个型值点只有一个切矢量，共用型值点时保留其已有的切矢量，因此曲线的起始切矢量
+        (pts[1]-pts[0])应与上一段的终止切矢量相同，MgCurveFitter 逐段拟合的结果满足此条件。
+     */
+    bool addBezier(const Point2d* pts);
+    
+    //! 减少型值点数，保留已有的切矢量和前面曲线段的折线化结果
+    bool trimKnots(int count);
 #ifndef SWIG
     const Vector2d* getVectors() const { return _knotvs; }
+    
+    //! 返回在 update() 中生成的折线化结果，没有时为NULL
+    const MgFlattenBeziers* getFlatten() const;
     virtual bool isCurve() const { return true; }
     virtual bool resize(int count);
     virtual bool addPoint(const Point2d& pt);
     virtual bool insertPoint(int segment, const Point2d& pt);
     virtual bool removePoint(int index);
+    virtual bool appendPoints(const Point2d* pts, int n);
 #endif
 
 protected:
     void _copy(const MgSplines& src);
     bool _equals(const MgSplines& src) const;
+    void _update();
     void _transform(const Matrix2d& mat);
     void _clear();
     void _setPoint(int index, const Point2d& pt);
+    void _clearCachedData();
     float _hitTest(const Point2d& pt, float tol, MgHitResult& res) const;
     bool _hitTestBox(const Box2d& rect) const;
     void _output(MgPath& path) const;
@@ -41,6 +58,10 @@ protected:
     bool _load(MgShapeFactory* factory, MgStorage* s);
     
     Vector2d*   _knotvs;
+    
+private:
+    MgFlattenBeziers _flat;             //!< 曲线的折线化缓存，在 update() 中生成
+    int         _flatKnots;             //!< 折线化缓存中仍有效的曲线段所到的型值点数
 };
 
 #endif // TOUCHVG_SPLINES_SHAPE_H_
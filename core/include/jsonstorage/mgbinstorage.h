@@ -0,0 +1,70 @@
+﻿//! \file mgbinstorage.h
+//! \brief 定义二进制序列化类 MgBinStorage
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+
+#ifndef TOUCHVG_CORE_BINSTORAGE_H_
+#define TOUCHVG_CORE_BINSTORAGE_H_
+
+#include "mgjsonstorage.h"
+
+//! 二进制序列化类
+/*! 节点和字段结构与 MgJsonStorage 的相同，可与JSON文件无损互相转换。
+    文件以版本头开始，每个节点或字段为带类型标记的记录，节点记录带有内容长度以便跳过，
+    名称只在文件末尾的名称表中保存一次(shape12 这类名称保存为 shape 和序号12)，
+    浮点数组按小端字节序原样保存，读写时不用转换为文本。
+    \ingroup CORE_STORAGE
+ */
+class MgBinStorage
+{
+public:
+    MgBinStorage();
+    ~MgBinStorage();
+
+    //! 返回存取接口对象以便开始写数据，写完可调用 save() 或 saveFile()
+    MgStorage* storageForWrite();
+
+    //! 映射给定的二进制文件，返回存取接口对象以便在映射的内容上直接读取，读完后取消映射
+    MgStorage* loadFile(const char* filename);
+
+    //! 写数据到给定的二进制文件
+    bool saveFile(const char* filename);
+
+#ifndef SWIG
+    //! 给定二进制内容，复制后返回存取接口对象以便开始读取，之后不再引用 data
+    MgStorage* storageForRead(const void* data, int size);
+
+    //! 给定以二进制方式打开的文件句柄，读入全部内容后返回存取接口对象
+    MgStorage* storageForRead(FILE* fp);
+
+    //! 写数据到以二进制方式打开的文件
+    bool save(FILE* fp);
+
+    //! 返回写好的二进制内容，size 为字节数
+    const void* getData(int& size);
+
+    //! 给定的内容是否为本类的二进制格式
+    static bool isBinary(const void* data, int size);
+#endif
+
+    //! 清除内存资源
+    void clear();
+
+    //! 返回读写错误，NULL表示没有错误
+    const char* getError();
+
+    //! 给定的文件是否为本类的二进制格式
+    static bool isBinaryFile(const char* filename);
+
+    //! JSON文件转换为二进制文件，返回转换与否
+    static bool jsonToBinary(const char* jsonfile, const char* binfile);
+
+    //! 二进制文件转换为JSON文件，返回转换与否
+    static bool binaryToJson(const char* binfile, const char* jsonfile, bool pretty = false);
+
+private:
+    class Impl;
+    Impl* _impl;
+};
+
+#endif // TOUCHVG_CORE_BINSTORAGE_H_
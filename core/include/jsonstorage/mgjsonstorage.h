@@ -54,13 +54,43 @@ public:
     //! 给定JSON内容，返回存取接口对象以便开始读取
     MgStorage* storageForRead(const char* content);
 
+    //! 给定JSON内容，返回边解析边读取的存取接口对象
+    /*! 不构建整个文档的DOM树，按文档顺序读取节点和字段，读取顺序与保存顺序不一致时
+        跳过的字段缓存在所在节点中，节点读完即释放。内容在读完前须有效。
+     */
+    MgStorage* storageForStreamRead(const char* content);
+
+    //! 给定JSON文件名，映射文件后原地解析，返回存取接口对象以便开始读取
+    /*! 以写时复制方式映射文件，文档中的字符串指向映射的内容，读完后取消映射。
+        原地解析会改写映射的页，这些页与DOM一起占用内存，内存峰值和耗时与 storageForRead(FILE*) 相近，
+        不比它省；要少占内存时用 storageForStreamRead 或二进制文件(见 perftest 的加载对比)。
+     */
+    MgStorage* loadFile(const char* filename);
+
     //! 返回存取接口对象以便开始写数据，写完可调用 stringify()
     MgStorage* storageForWrite();
 
+    //! 返回边写边输出JSON文本的存取接口对象，写完可调用 stringify() 或 save()
+    /*! 不构建DOM树，写字段时不分配堆内存，输出内容与 storageForWrite() 的相同。
+        是否缩进由此处的 pretty 决定，stringify() 和 save() 的 pretty 参数将被忽略。
+        数组模式下与 storageForWrite() 相同。
+     */
+    MgStorage* storageForStreamWrite(bool pretty = false);
+
 #ifndef SWIG
     //! 给定JSON文件句柄，返回存取接口对象以便开始读取
     MgStorage* storageForRead(FILE* fp);
 
+    //! 给定JSON文件句柄，返回边解析边读取的存取接口对象，文件在读完前须保持打开
+    /*! 峰值内存约为DOM方式的三分之一，但加载较慢，且不支持 cloneForRead()，只能在一个线程中加载。
+     */
+    MgStorage* storageForStreamRead(FILE* fp);
+
+    //! 返回边写边输出到给定文件的存取接口对象，写完调用 save() 输出剩余内容
+    /*! 输出缓冲区满就写到文件，文件在调用 save() 前须保持打开。
+     */
+    MgStorage* storageForStreamWrite(FILE* fp, bool pretty = false);
+
     //! 写数据到给定的文件
     bool save(FILE* fp, bool pretty = false);
 #endif
@@ -25,9 +25,22 @@ public:
 #ifndef SWIG
     bool recordStep(long tick, long changeCountOld, long changeCountNew, MgShapeDoc* doc,
                     MgShapes* dynShapes, const std::vector<MgShapes*>& extShapes);
+    
+    // 设置录制线程的队列长度，0表示在调用线程中录制。队列满时 recordStep 等待录制线程取走一步
+    void setWriteQueue(int size);
+    // 等待录制线程写完已入队的步
+    void flush();
+    // 按写出的顺序取出已写完的一步的重做文件名，没有时返回false，不等待录制线程
+    bool takeWrittenFile(std::string& filename);
     std::string getFileName(bool back, int index) const;
     std::string getPath() const;
 #endif
+    // path 以 .vgc 结尾时各步写为该单文件容器中的记录，否则在 path 目录中每步写一个文件
+    bool isContainer() const;
+    // 开始录制时写出初始文档(0.vg 或容器中的0号记录)
+    bool saveFirstFile();
+    // 将容器中的记录导出为以前的目录布局，即 N.vgr、N.vgu、N.vgk 文件和帧索引
+    static bool exportFiles(const char* container, const char* path);
     bool isLoading() const;
     void setLoading(bool loading);
     bool onResume(long ticks);
@@ -35,12 +48,24 @@ public:
     void stopRecordIndex();
     
 #ifndef SWIG
+    // 有入队的步时等录制线程写完再判断
     bool canUndo() const;
     bool canRedo() const;
     bool undo(MgShapeFactory *factory, MgShapeDoc* doc, long* changeCount);
     bool redo(MgShapeFactory *factory, MgShapeDoc* doc, long* changeCount);
     void resetDoc(MgShapeDoc* doc);
     int getMaxFileCount() const;
+    
+    // 设置内存中撤销环的估算字节数上限，超出时最早的步改为从文件撤销重做，0表示不用撤销环
+    void setMemoryBudget(int bytes);
+    int getMemoryBudget() const;
+    
+    // 限制撤销历史的步数、文件字节数和最早一步到最新一步的时长，超出时删除最早的步的文件，0表示不限，负数表示不改变
+    void setHistoryLimit(int steps, int bytes, int ticks);
+    // 在 ticks 时长内连续只改变同一组图形的步合并为一步，0表示不合并
+    void setSquashInterval(int ticks);
+    // 返回最早可撤销的步的文件号，之前的步已丢弃
+    int getFirstIndex() const;
 #endif
     
     bool isPlaying() const;
@@ -51,15 +76,18 @@ public:
     bool applyFirstFile(MgShapeFactory *factory, MgShapeDoc* doc, const char* filename);
     int applyRedoFile(MgShapeFactory *f, MgShapeDoc* doc, MgShapes* dyns, int index);
     int applyUndoFile(MgShapeFactory *f, MgShapeDoc* doc, MgShapes* dyns, int index, long curTick);
+    
+    // 播放时定位到不晚于 tick 的最后一帧，从最近的关键帧开始只应用之后的帧，返回改动标志
+    int seek(MgShapeFactory *f, MgShapeDoc* doc, MgShapes* dyns, int tick);
+    // 录制时每隔 steps 步或增量文件累计 bytes 字节后写一个关键帧(N.vgk)
+    void setKeyframeInterval(int steps, int bytes);
+    // 播放时在后台线程预先解码之后的 frames 帧，applyRedoFile 只需把解码好的图形移入文档和动态图形，0表示在调用线程中解码
+    void setPrefetch(int frames);
 #ifndef SWIG
+    // 读入帧索引(records.idx，或以前录制的 records.json)，每帧依次为文件号、时刻和标志
     static bool loadFrameIndex(std::string path, std::vector<int>& arr);
 #endif
 
-private:
-    static int applyFile(int& tick, MgShapeFactory *f,
-                         MgShapeDoc* doc, MgShapes* dyns, const char* fn,
-                         long* changeCount = NULL, MgShape* lastShape = NULL);
-    
 private:
     struct Impl;
     Impl* _im;
@@ -58,6 +58,9 @@ public:
     //! 从指定的序列化对象加载图形
     virtual bool load(MgShapeFactory* factory, MgStorage* s);
 
+    //! 从指定的序列化对象只加载标记和显示属性，不加载几何数据
+    void loadAttributes(MgStorage* s);
+
     //! 返回图形编号
     virtual int getID() const = 0;
 
@@ -7,6 +7,9 @@
 #define TOUCHVG_MGSHAPES_H_
 
 #include "mgshape.h"
+#ifndef SWIG
+#include <vector>
+#endif
 
 //! 图形列表类
 /*! \ingroup CORE_SHAPE
@@ -60,9 +63,22 @@ public:
 
     bool save(MgStorage* s, int startIndex = 0) const;
     bool saveShape(MgStorage* s, const MgShape* shape, int index) const;
-    int load(MgShapeFactory* factory, MgStorage* s, bool addOnly = false);
+    //! 从指定的序列化对象加载图形，返回加载的图形数，失败时为负数
+    /*! lazy 为true且存取对象支持 cloneForRead() 时延迟加载(不能与 addOnly 同时使用)：
+        先只读入各图形的类型、ID、包络框、标记和显示属性，在通过本列表访问到图形时
+        (遍历、查找、显示或点中可见图形等)才读取其几何数据，有多个处理器时在后台线程中依次加载其余图形。
+     */
+    int load(MgShapeFactory* factory, MgStorage* s, bool addOnly = false, bool lazy = false);
     void setNewShapeID(int sid);
     
+#ifndef SWIG
+    //! 得到改动日志中自 pos 以来增删改过的图形ID(可能重复)，不能由日志得到时返回false
+    /*! journal 和 pos 为上次调用得到的日志标识和位置(初值为0)，返回时都更新为本列表的当前值。
+        浅拷贝出的列表沿用原列表的日志。清除、加载、批量变形或日志过长后须改为比较全部图形。
+     */
+    bool getChangedIDs(long& journal, long& pos, std::vector<int>& ids) const;
+#endif
+    
     //! 删除所有图形
     void clear();
     
@@ -97,14 +113,26 @@ public:
     //! 复制出一个新图形对象
     MgShape* cloneShape(int sid) const;
     
-    //! 对每个图形进行变形
-    void transform(const Matrix2d& mat);
+    //! 对每个图形进行变形，返回变形的图形数
+    /*! 图形较多时分块由多个线程并行克隆、变形并更新包络框，然后一次性替换原图形，
+        期间不逐个发出图形改变通知，调用者完成后只需通知视图重新构建显示一次，见 GiCoreView::scaleShapes。
+     */
+    int transform(const Matrix2d& mat);
+
+    //! 平移每个图形，返回平移的图形数，处理方式同 transform
+    int offset(const Vector2d& vec);
     
     //! 移除一个图形
     bool removeShape(int sid);
 
     //! 将一个图形移到另一个图形列表
     bool moveShapeTo(int sid, MgShapes* dest);
+    
+    //! 将另一个图形列表的图形(不复制)移入本列表，返回移入的图形数，src 将为空
+    /*! replace 为 true 时替换同ID同类型的图形，与 load() 的 addOnly 方式相同，否则都作为新图形添加。
+        用于在其他线程中加载好图形后一次性放入本列表。
+     */
+    int spliceShapes(MgShapes* src, bool replace = true);
 
     //! 将所有图形复制到另一个图形列表
     void copyShapesTo(MgShapes* dest) const;
@@ -38,11 +38,11 @@ public:
     //! 保存图形和放缩状态
     bool saveAll(MgStorage* s, const GiTransform* xform);
 
-    //! 加载图形
-    bool load(MgShapeFactory* factory, MgStorage* s, bool addOnly);
+    //! 加载图形，lazy 为true时延迟加载几何数据，见 MgShapes::load()
+    bool load(MgShapeFactory* factory, MgStorage* s, bool addOnly, bool lazy = false);
     
     //! 加载图形，并自动放缩到之前的状态
-    bool loadAll(MgShapeFactory* factory, MgStorage* s, GiTransform* xform);
+    bool loadAll(MgShapeFactory* factory, MgStorage* s, GiTransform* xform, bool lazy = false);
 
     //! 删除所有图形
     void clear();
@@ -50,6 +50,15 @@ public:
     //! 释放临时数据内存
     void clearCachedData();
 
+    //! 对所有图层的图形进行变形，返回变形的图形数
+    /*! 各图层按 MgShapes::transform 批量并行处理，调用者完成后只需通知视图重新构建显示一次，
+        GiCoreView::scaleShapes 和 offsetShapes 即按此处理
+     */
+    int transform(const Matrix2d& mat);
+
+    //! 平移所有图层的图形，返回平移的图形数
+    int offset(const Vector2d& vec);
+
     //! 显示所有图形
     int draw(GiGraphics& gs) const;
     
@@ -69,6 +69,17 @@ struct MgStorage
 
     //! 设置读写错误描述文字，总是返回false
     virtual bool setError(const char* errdesc) { return !errdesc; }
+
+#ifndef SWIG
+    //! 返回从当前节点开始读取的新存取对象，以便在多个线程中分别读取不同的子节点
+    /*! 新对象与本对象共享已读入的内容，本对象读完或清除后仍保留该内容直到新对象都已释放，
+        用完调用其 release() 释放。可在多个线程中同时调用本函数。
+        不支持(例如边读边解析)时返回NULL，新对象不能再克隆。
+     */
+    virtual MgStorage* cloneForRead() { return (MgStorage*)0; }
+    //! 释放 cloneForRead() 返回的对象
+    virtual void release() {}
+#endif
 };
 
 #endif // TOUCHVG_MGSTORAGE_H_
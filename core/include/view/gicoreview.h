@@ -81,6 +81,11 @@ public:
     bool isZoomEnabled(GiView* view);                               //!< 是否允许放缩显示
     void setZoomEnabled(GiView* view, bool enabled);                //!< 设置是否允许放缩显示
     
+    bool loadFromFile(const char* vgfile, bool readOnly, bool lazy); //!< 从文件中加载，lazy 为true时延迟加载几何数据，选项 streamLoad 为true时边解析边读取JSON以减少内存
+    bool loadShapes(MgStorage* s, bool readOnly, bool lazy);        //!< 从数据源中加载图形，见 MgShapes::load()
+    int scaleShapes(float sx, float sy, float cx, float cy);        //!< 以(cx,cy)为中心放缩全部图形，只通知重新构建显示一次，返回图形数
+    int offsetShapes(float dx, float dy);                           //!< 平移全部图形，只通知重新构建显示一次，返回图形数
+    
     int exportSVG(long doc, long gs, const char* filename);         //!< 导出图形到SVG文件
     int exportSVG(GiView* view, const char* filename);              //!< 导出图形到SVG文件，主线程中用
     bool startRecord(const char* path, long doc,
@@ -97,6 +102,7 @@ public:
     bool onResume(long curTick);                                    //!< 继续
     bool restoreRecord(int type, const char* path, long doc, long changeCount,
                        int index, int count, int tick, long curTick);   //!< 恢复录制
+    int seekFrame(long tick);                                       //!< 播放时定位到给定相对毫秒时刻的帧，返回改动标志
     
     void traverseOptions(MgOptionCallback* c);                      //!< 遍历选项
     void setOptionBool(const char* name, bool value);               //!< 设置或清除布尔选项值
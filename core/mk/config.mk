@@ -70,7 +70,7 @@ endif #APPTYPE
 ifdef IS_WIN
 APPEXT        =.exe
 else
-LIBS         += -ldl
+LIBS         += -ldl -lpthread
 endif
 
 #-------------------------------------------------------------------
@@ -7,7 +7,7 @@
 #include "mgbasicsps.h"
 
 MgCmdDrawSplines::MgCmdDrawSplines(const char* name, bool freehand)
-    : MgCommandDraw(name), m_freehand(freehand)
+    : MgCommandDraw(name), m_freehand(freehand), m_fixed(0)
 {
 }
 
@@ -18,8 +18,11 @@ bool MgCmdDrawSplines::initialize(const MgMotion* sender, MgStorage* s)
 
 bool MgCmdDrawSplines::backStep(const MgMotion* sender)
 {
-    if (m_step > 1) {                   // freehand: 去掉倒数第二个点，倒数第一点是临时动态点
-        ((MgBaseLines*)dynshape()->shape())->removePoint(m_freehand ? m_step - 1 : m_step);
+    if (m_freehand) {                   // 点已拟合为曲线，不能逐点回退
+        return false;
+    }
+    if (m_step > 1) {
+        ((MgBaseLines*)dynshape()->shape())->removePoint(m_step);
         dynshape()->shape()->update();
     }
     
@@ -61,6 +64,12 @@ bool MgCmdDrawSplines::touchBegan(const MgMotion* sender)
         dynshape()->shape()->setPoint(0, pnt);
         if (!m_freehand)
             dynshape()->shape()->setPoint(1, pnt);
+        else {
+            m_fixed = 0;
+            m_fitter.begin(m_fitpts, m_fitparams, kFitCapacity,
+                           sender->displayMmToModel(0.5f), appendCurve, this);
+            m_fitter.addPoint(pnt);
+        }
         dynshape()->shape()->update();
         
         return MgCommandDraw::touchBegan(sender);
@@ -79,7 +88,8 @@ bool MgCmdDrawSplines::touchMoved(const MgMotion* sender)
     
     if (m_freehand) {
         if (canAddPoint(sender, false)) {
-            lines->addPoint(pnt);
+            m_fitter.addPoint(pnt);     // 定型的曲线段在 appendCurve 中输出
+            applyTail();
             m_step++;
         }
     } else {
@@ -102,18 +112,13 @@ bool MgCmdDrawSplines::touchEnded(const MgMotion* sender)
     
     if (m_freehand) {
         Tol tol(sender->displayMmToModel(1.f));
+        
+        // 随手画的结果是逐段拟合的三次贝塞尔曲线(带切矢量的型值点)，而不是经过各采样点的样条曲线，
+        // 型值点比采样点少，与采样点的偏差不超过拟合误差(0.5mm)
+        m_fitter.end();
+        dynshape()->shape()->update();
         if (m_step > 0 && !dynshape()->shape()->getExtent().isEmpty(tol, false)) {
-            MgShape* newsp = addShape(sender);
-            if (newsp) {/*
-                m_step = 0;
-                sender->view->regenAppend(0);
-                newsp = newsp->cloneShape();
-                lines = (MgSplines*)newsp->shape();
-                lines->smooth(sender->view->xform()->modelToDisplay(),
-                              sender->view->xform()->getWorldToDisplayY() * 0.5f);
-                sender->view->shapes()->updateShape(newsp);
-                sender->view->regenAppend(newsp->getID())*/
-            }
+            addShape(sender);
         }
         else {
             click(sender);  // add a point
@@ -137,6 +142,27 @@ bool MgCmdDrawSplines::touchEnded(const MgMotion* sender)
     return MgCommandDraw::touchEnded(sender);
 }
 
+void MgCmdDrawSplines::applyTail()
+{
+    MgSplines* lines = (MgSplines*)dynshape()->shape();
+    Point2d curve[4];
+    
+    if (m_fitter.getTail(curve)) {
+        lines->trimKnots(m_fixed);
+        lines->addBezier(curve);
+    }
+}
+
+void MgCmdDrawSplines::appendCurve(void* data, const Point2d curve[4])
+{
+    MgCmdDrawSplines* cmd = (MgCmdDrawSplines*)data;
+    MgSplines* lines = (MgSplines*)cmd->dynshape()->shape();
+    
+    lines->trimKnots(cmd->m_fixed);
+    lines->addBezier(curve);
+    cmd->m_fixed = lines->getPointCount();
+}
+
 bool MgCmdDrawSplines::cancel(const MgMotion* sender)
 {
     if (!m_freehand && m_step > 1) {
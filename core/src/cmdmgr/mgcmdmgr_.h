@@ -64,7 +64,8 @@ private:
                               const Point2d& perp, const Point2d& c, float len) const;
     virtual Point2d snapPoint(const MgMotion* sender, 
         const Point2d& orignPt, const MgShape* shape,
-        int hotHandle, int ignoreHandle = -1, const int* ignoreids = NULL);
+        int hotHandle, int ignoreHandle = -1, const int* ignoreids = NULL,
+        const Vector2d& moved = Vector2d::kIdentity());
     virtual int getSnappedType() const;
     virtual int getSnappedPoint(Point2d& fromPt, Point2d& toPt) const;
     virtual bool getSnappedHandle(int& shapeid, int& handleIndex, int& handleIndexSrc) const;
@@ -140,6 +140,7 @@ bool MgCmdSelect::backStep(const MgMotion* sender)
             (*it)->release();
         }
         m_clones.clear();
+        m_previewed.clear();
         m_insertPt = false;
         sender->view->redraw();
         return true;
@@ -191,8 +192,17 @@ bool MgCmdSelect::draw(const MgMotion* sender, GiGraphics* gs)
     
     // 外部动态改变图形属性时，或拖动时
     if (!m_showSel || !m_clones.empty()) {
-        for (it = shapes.begin(); it != shapes.end(); ++it) {
-            (*it)->draw(m_showSel ? 2 : 0, *gs, NULL, -1);  // 原样显示
+        // m_dragMat 作用于模型坐标，应先于模型坐标系的变换，即 m_dragMat * modelToWorld
+        Matrix2d premat(gs->xf().worldToModel() * m_dragMat * gs->xf().modelToWorld());
+        
+        for (size_t i = 0; i < shapes.size(); i++) {
+            if (i < m_previewed.size() && m_previewed[i]) { // 预览拖动结果，不改变临时图形
+                GiSaveModelTransform xf(&gs->xf(), premat);
+                shapes[i]->draw(m_showSel ? 2 : 0, *gs, NULL, -1);
+            }
+            else {
+                shapes[i]->draw(m_showSel ? 2 : 0, *gs, NULL, -1);  // 原样显示
+            }
         }
     }
     else if (m_clones.empty()) {                    // 蓝色显示选中的图形
@@ -415,7 +425,8 @@ int MgCmdSelect::hitTestHandles(const MgShape* shape, const Point2d& pointM,
     return handleIndex;
 }
 
-Point2d MgCmdSelect::snapPoint(const MgMotion* sender, const MgShape* shape)
+Point2d MgCmdSelect::snapPoint(const MgMotion* sender, const MgShape* shape,
+                               const Vector2d& moved)
 {
     CmdSubject *subject = sender->view->getCmdSubject();
     int n = (int)m_clones.size();
@@ -428,7 +439,7 @@ Point2d MgCmdSelect::snapPoint(const MgMotion* sender, const MgShape* shape)
     
     MgSnap* snap = sender->cmds()->getSnap();
     Point2d pt(snap->snapPoint(sender, sender->pointM, shape, m_handleIndex - 1,
-                               m_rotateHandle - 1, (const int*)&ignoreids.front()));
+                               m_rotateHandle - 1, (const int*)&ignoreids.front(), moved));
     if (!sender->dragging() && snap->getSnappedType() >= kMgSnapPoint) {
         subject->onPointSnapped(sender, shape);
     }
@@ -607,6 +618,7 @@ bool MgCmdSelect::touchBegan(const MgMotion* sender)
     
     if (m_clones.empty()) {
         m_boxsel = true;
+        m_boxHits.clear();
     }
     m_boxHandle = 99;
     
@@ -749,10 +761,10 @@ bool MgCmdSelect::isDragRectCorner(const MgMotion* sender, Matrix2d& mat)
     return m_boxHandle < 10;
 }
 
-static bool moveIntoLimits(MgBaseShape* shape, const MgMotion* sender)
+static bool moveIntoLimits(MgBaseShape* shape, MgView* view)
 {
-    Box2d limits(sender->view->xform()->getWorldLimits()
-                 * sender->view->xform()->worldToModel());
+    Box2d limits(view->xform()->getWorldLimits()
+                 * view->xform()->worldToModel());
     Box2d rect;
     bool outside = false;
     
@@ -803,11 +815,16 @@ bool MgCmdSelect::touchMoved(const MgMotion* sender)
         }
     }
     
+    if (canPreviewDrag(sender, dragCorner)) {
+        previewDrag(sender, mat, dragCorner);
+    }
+    
     Vector2d minsnap(1e8f, 1e8f);
     int snapindex = -1;
     
     // 拖动多个图形则循环两遍：第一遍在每个选中图形中找捕捉距离最近的点，第二遍应用此最近点拖动
-    for (int t = m_clones.size() > 1 && !dragCorner ? 2 : 1; t > 0; t--) {
+    for (int t = m_previewed.empty() ? (m_clones.size() > 1 && !dragCorner ? 2 : 1) : 0;
+         t > 0; t--) {
         for (size_t i = 0; i < m_clones.size(); i++) {      // 对每个选中图形的临时图形
             MgBaseShape* shape = m_clones[i]->shape();
             const MgShape* basesp = getShape(m_selIds[i], sender); // 对应的原始图形
@@ -883,7 +900,7 @@ bool MgCmdSelect::touchMoved(const MgMotion* sender)
             }
             
             shape->update();
-            moveIntoLimits(shape, sender);                  // 限制图形在视图范围内
+            moveIntoLimits(shape, sender->view);            // 限制图形在视图范围内
             
             if (t == 1) {
                 sender->view->shapeMoved(m_clones[i], segment); // 通知已移动
@@ -901,12 +918,14 @@ bool MgCmdSelect::touchMoved(const MgMotion* sender)
     if (m_clones.empty() && m_boxsel) {    // 没有选中图形时就滑动多选
         Box2d snap(sender->startPtM, sender->pointM);
         MgShapeIterator it(sender->view->shapes());
+        bool intersectMode = isIntersectMode(sender);
+        size_t index = 0;
         
         m_selIds.clear();
         m_id = 0;
         m_hit.segment = -1;
         while (const MgShape* shape = it.getNext()) {
-            if (isIntersectMode(sender) ? shape->shapec()->hitTestBox(snap)
+            if (intersectMode ? boxHitTest(shape, index++, snap)
                 : snap.contains(shape->shapec()->getExtent())) {
                 if (!shape->shapec()->getFlag(kMgLocked) ||
                     !shape->shapec()->getFlag(kMgNoAction)) {
@@ -915,12 +934,155 @@ bool MgCmdSelect::touchMoved(const MgMotion* sender)
                 }
             }
         }
+        m_boxRect = snap;
         sender->view->redraw();
     }
     
     return true;
 }
 
+// 包络框被新旧框选矩形裁剪出的部分相同时，图形与两个矩形的相交结果也相同
+static bool sameClipOfExtent(const Box2d& ext, const Box2d& r1, const Box2d& r2)
+{
+    return (mgMax(ext.xmin, r1.xmin) == mgMax(ext.xmin, r2.xmin)
+            && mgMax(ext.ymin, r1.ymin) == mgMax(ext.ymin, r2.ymin)
+            && mgMin(ext.xmax, r1.xmax) == mgMin(ext.xmax, r2.xmax)
+            && mgMin(ext.ymax, r1.ymax) == mgMin(ext.ymax, r2.ymax));
+}
+
+// 框选时判断图形是否与矩形相交，包络框被新旧矩形裁剪出的部分相同时沿用上次结果，不必逐段测试
+// 没有空间索引，调用者仍需遍历全部图形，只是省去了大部分图形的逐段测试
+bool MgCmdSelect::boxHitTest(const MgShape* shape, size_t index, const Box2d& snap)
+{
+    const Box2d ext(shape->shapec()->getExtent());
+    const int sid = shape->getID();
+    bool hit;
+    
+    if (!ext.isIntersect(snap)) {
+        hit = false;
+    }
+    else if (snap.contains(ext)) {          // 完全在框内，不必逐段测试
+        hit = true;
+    }
+    else if (index < m_boxHits.size() && (m_boxHits[index] == sid || m_boxHits[index] == -sid)
+             && sameClipOfExtent(ext, snap, m_boxRect)) {
+        hit = m_boxHits[index] > 0;
+    }
+    else {
+        hit = shape->shapec()->hitTestBox(snap);
+    }
+    
+    if (index >= m_boxHits.size()) {
+        m_boxHits.resize(index + 1, 0);
+    }
+    m_boxHits[index] = hit ? sid : -sid;
+    
+    return hit;
+}
+
+// 拖动变形框或同时拖动多个图形时，各图形只是整体施加相同的变换，可不必每次都复制图形
+bool MgCmdSelect::canPreviewDrag(const MgMotion* sender, bool dragCorner)
+{
+    return (!isEditMode(sender->view) && !m_insertPt && m_rotateHandle == 0
+            && (dragCorner || m_clones.size() > 1));
+}
+
+// 记下拖动的变换，显示时再施加到临时图形上，在 applyDragPreview 中才实际变换图形。
+// 预览期间临时图形保持在原始位置，捕捉时其控制点按拖动量平移后参与匹配；
+// 因图形未实际移动，shapeMoved 通知推迟到拖动结束时由 applyDragPreview 发出。
+void MgCmdSelect::previewDrag(const MgMotion* sender, const Matrix2d& mat, bool dragCorner)
+{
+    Vector2d minsnap(1e8f, 1e8f);
+    int snapindex = -1;
+    bool snapEnabled = !dragCorner && sender->view->getOptionBool("snapEnabled", true);
+    bool previewed = false;
+    
+    m_previewed.assign(m_clones.size(), false);
+    m_dragCorner = dragCorner;
+    m_dragVec = sender->pointM - m_ptStart;
+    m_dragSnap = Vector2d();
+    
+    for (size_t i = 0; i < m_clones.size(); i++) {
+        MgBaseShape* shape = m_clones[i]->shape();
+        const MgShape* basesp = getShape(m_selIds[i], sender);
+        
+        if (!canTransform(basesp, sender)
+            || (!dragCorner && !sender->view->shapeCanMovedHandle(m_clones[i], -1))) {
+            continue;
+        }
+        m_previewed[i] = true;
+        previewed = true;
+        shape->setFlag(kMgHideContent, false);              // 显示隐藏的图片
+        if (!snapEnabled) {
+            continue;
+        }
+        
+        // 拖动多个图形：在每个选中图形中找捕捉距离最近的点，控制点平移拖动量后参与捕捉
+        Vector2d snapvec(snapPoint(sender, m_clones[i], m_dragVec) - sender->pointM);
+        if (!snapvec.isZeroVector() && minsnap.length() > snapvec.length()) {
+            minsnap = snapvec;
+            snapindex = (int)i;
+        }
+    }
+    
+    if (dragCorner) {
+        m_dragMat = mat;
+    }
+    else {
+        if (snapindex >= 0) {
+            snapPoint(sender, m_clones[snapindex], m_dragVec);  // 切换到对应图形的捕捉状态
+            m_dragSnap = minsnap;                           // 这些图形都移动相同距离
+        }
+        else if (previewed) {
+            snapPoint(sender, m_clones.front(), m_dragVec); // 清除上次的捕捉状态
+        }
+        m_dragMat = Matrix2d::translation(m_dragVec + m_dragSnap);
+    }
+    sender->view->redraw();
+    sender->view->dynamicChanged();
+}
+
+// 按预览时记下的变换实际变换临时图形，与逐次拖动时变换的结果相同，并补发 shapeMoved 通知
+void MgCmdSelect::applyDragPreview(MgView* view)
+{
+    for (size_t i = 0; i < m_clones.size() && i < m_previewed.size(); i++) {
+        MgBaseShape* shape = m_clones[i]->shape();
+        const MgShape* basesp = view->shapes()->findShape(m_selIds[i]);
+        
+        if (!m_previewed[i] || !basesp) {
+            continue;
+        }
+        shape->copy(*basesp->shapec());                     // 先重置为原始位置
+        shape->setFlag(kMgHideContent, false);
+        
+        bool oldFixedLength = shape->getFlag(kMgFixedLength);
+        bool oldFixedSize = shape->getFlag(kMgFixedSize);
+        int segment = -1;
+        
+        shape->setFlag(kMgFixedLength, true);
+        shape->setFlag(kMgFixedSize, true);
+        
+        if (m_dragCorner) {
+            shape->transform(m_dragMat);
+        }
+        else {
+            segment = shape->isKindOf(kMgShapeComposite) ? -1 : m_hit.segment;
+            shape->offset(m_dragVec, segment);
+            if (!m_dragSnap.isZeroVector()) {
+                shape->offset(m_dragSnap, segment);
+            }
+        }
+        
+        shape->update();
+        moveIntoLimits(shape, view);                        // 限制图形在视图范围内
+        view->shapeMoved(m_clones[i], segment);             // 通知已移动
+        
+        shape->setFlag(kMgFixedLength, oldFixedLength);
+        shape->setFlag(kMgFixedSize, oldFixedSize);
+    }
+    m_previewed.clear();
+}
+
 bool MgCmdSelect::isCloneDrag(const MgMotion* sender)
 {
     float dist = sender->pointM.distanceTo(sender->startPtM);
@@ -979,6 +1141,7 @@ void MgCmdSelect::cloneShapes(MgView* view)
         (*it)->release();
     }
     m_clones.clear();
+    m_previewed.clear();
     
     for (sel_iterator its = m_selIds.begin(); its != m_selIds.end(); ++its) {
         const MgShape* shape = view->shapes()->findShape(*its);
@@ -996,6 +1159,10 @@ bool MgCmdSelect::applyCloneShapes(MgView* view, bool apply, bool addNewShapes)
     const bool cloned = !m_clones.empty();
     size_t i;
     
+    if (apply && !m_previewed.empty()) {
+        applyDragPreview(view);
+    }
+    m_previewed.clear();
     if (apply) {
         apply = false;
         for (i = 0; i < m_clones.size() && !apply; i++) {
@@ -69,7 +69,9 @@ private:
     int hitTestHandles(const MgShape* shape, const Point2d& pointM,
                          const MgMotion* sender, float tolmm = 10.f);
     bool isIntersectMode(const MgMotion* sender);
-    Point2d snapPoint(const MgMotion* sender, const MgShape* shape);
+    bool boxHitTest(const MgShape* shape, size_t index, const Box2d& snap);
+    Point2d snapPoint(const MgMotion* sender, const MgShape* shape,
+                      const Vector2d& moved = Vector2d::kIdentity());
     
     typedef std::vector<int>::iterator sel_iterator;
     sel_iterator getSelectedPostion(const MgShape* shape);
@@ -79,6 +81,9 @@ private:
     bool isCloneDrag(const MgMotion* sender);
     void cloneShapes(MgView* view);
     bool applyCloneShapes(MgView* view, bool apply, bool addNewShapes = false);
+    bool canPreviewDrag(const MgMotion* sender, bool dragCorner);
+    void previewDrag(const MgMotion* sender, const Matrix2d& mat, bool dragCorner);
+    void applyDragPreview(MgView* view);    // 拖动结束时变换临时图形，预览期间不发 shapeMoved
     bool canTransform(const MgShape* shape, const MgMotion* sender);
     bool canRotate(const MgShape* shape, const MgMotion* sender);
     void selectionChanged(MgView* view);
@@ -86,6 +91,13 @@ private:
 private:
     std::vector<int>        m_selIds;           // 选中的图形的ID
     std::vector<MgShape*>   m_clones;           // 选中图形的复制对象
+    std::vector<bool>       m_previewed;        // 各临时图形是否以变换矩阵预览拖动结果
+    Matrix2d                m_dragMat;          // 预览时临时图形在显示时附加的变换矩阵
+    Vector2d                m_dragVec;          // 预览拖动整体图形时的拖动量
+    Vector2d                m_dragSnap;         // 预览拖动多个图形时共同的捕捉偏移量
+    bool                    m_dragCorner;       // 预览的是否为拖动变形框
+    std::vector<int>        m_boxHits;          // 框选时各图形上次的相交结果，相交为图形ID，否则为负ID
+    Box2d                   m_boxRect;          // 上次框选的矩形
     int                     m_id;               // 选中图形的ID
     MgHitResult             m_hit;              // 点中结果
     Point2d                 m_ptSnap;           // 捕捉点
@@ -72,14 +72,24 @@ static bool skipShape(const int* ignoreids, const MgShape* sp)
     return skip;
 }
 
+// 取曲线图形已有的折线化结果，供求交点使用
+static const MgFlattenBeziers* flattenOf(const MgBaseShape* shape)
+{
+    if (shape->isKindOf(MgSplines::Type()))
+        return ((const MgSplines*)shape)->getFlatten();
+    if (shape->isKindOf(MgPathShape::Type()))
+        return ((const MgPathShape*)shape)->getFlatten();
+    return (const MgFlattenBeziers*)0;
+}
+
 static bool snapHandle(const MgMotion* sender, const Point2d& orgpt, int mask,
-                       const MgShape* shape, int ignoreHd,
+                       const MgShape* shape, int ignoreHd, const Vector2d& moved,
                        const MgShape* sp, SnapItem& arr0, Point2d* matchpt)
 {
     bool ignored = sp->shapec()->isKindOf(MgSplines::Type()); // 除自由曲线外
     int n = ignored ? 0 : sp->shapec()->getHandleCount();
     bool dragHandle = (!shape || shape->getID() == 0    // 正画的图形:末点动
-                       || orgpt == shape->shapec()->getHandlePoint(ignoreHd)    // 拖已有图形的点
+                       || orgpt == shape->shapec()->getHandlePoint(ignoreHd) + moved  // 拖已有图形的点
                        || n == 1);                      // 点可定位
     bool handleFound = false;
     
@@ -114,7 +124,7 @@ static bool snapHandle(const MgMotion* sender, const Point2d& orgpt, int mask,
         for (; d >= 0; d--) {                           // 整体移动图形，顶点匹配
             if (d == ignoreHd || shape->shapec()->isHandleFixed(d))
                 continue;
-            Point2d ptd (shape->shapec()->getHandlePoint(d));   // 当前图形的顶点
+            Point2d ptd (shape->shapec()->getHandlePoint(d) + moved);   // 当前图形的顶点
             
             dist = pnt.distanceTo(ptd);                 // 当前图形与其他图形顶点匹配
             if (handleType == kMgHandleMidPoint) {      // 交点优先于中点
@@ -184,7 +194,8 @@ static bool snapPerp(const MgMotion* sender, const Point2d& orgpt, const Tol& to
                             path1.lineTo(pt1 + (pt2 - pt1) * 2.f);
                             
                             sp2->shapec()->output(path2);
-                            path1.crossWithPath(path2, Box2d(orgpt, 1e10f, 0), arr0.pt);
+                            path1.crossWithPath(path2, Box2d(orgpt, 1e10f, 0), arr0.pt,
+                                                (const MgFlattenBeziers*)0, flattenOf(sp2->shapec()));
                         } else if (n > 0) {
                             arr0.pt = pt2.distanceTo(orgpt) < pt1.distanceTo(orgpt) ? pt2 : pt1;
                         }
@@ -215,7 +226,7 @@ static bool snapPerp(const MgMotion* sender, const Point2d& orgpt, const Tol& to
 }
 
 static void snapNear(const MgMotion* sender, const Point2d& orgpt,
-                     const MgShape* shape, int ignoreHd, float tolNear,
+                     const MgShape* shape, int ignoreHd, const Vector2d& moved, float tolNear,
                      const MgShape* sp, SnapItem& arr0, Point2d* matchpt)
 {
     if (arr0.type >= kMgSnapGrid && arr0.type < kMgSnapNearPt)
@@ -234,7 +245,7 @@ static void snapNear(const MgMotion* sender, const Point2d& orgpt,
         else {
             if (d - 1 == ignoreHd || shape->shapec()->isHandleFixed(d - 1))
                 continue;
-            ptd = shape->shapec()->getHandlePoint(d - 1);   // 控制点与边匹配
+            ptd = shape->shapec()->getHandlePoint(d - 1) + moved;   // 控制点与边匹配
         }
         float dist = sp->shapec()->hitTest(ptd, tolNear, res);
         
@@ -255,7 +266,7 @@ static void snapNear(const MgMotion* sender, const Point2d& orgpt,
 }
 
 static void snapGrid(const MgMotion*, const Point2d& orgpt,
-                     const MgShape* shape, int ignoreHd,
+                     const MgShape* shape, int ignoreHd, const Vector2d& moved,
                      const MgShape* sp, SnapItem arr[3], Point2d* matchpt)
 {
     if (sp->shapec()->isKindOf(MgGrid::Type())) {
@@ -282,7 +293,7 @@ static void snapGrid(const MgMotion*, const Point2d& orgpt,
             if (d == ignoreHd || shape->shapec()->isHandleFixed(d))
                 continue;
             
-            Point2d ptd (shape->shapec()->getHandlePoint(d));
+            Point2d ptd (shape->shapec()->getHandlePoint(d) + moved);
             dists.set(mgMin(arr[0].dist, arr[1].dist), mgMin(arr[0].dist, arr[2].dist));
             
             newPt = ptd;
@@ -306,7 +317,7 @@ static void snapGrid(const MgMotion*, const Point2d& orgpt,
 }
 
 static bool snapCross(const MgMotion* sender, const Point2d& orgpt,
-                      const int* ignoreids, int ignoreHd,
+                      const int* ignoreids, int ignoreHd, const Vector2d& moved,
                       const MgShape* shape, const MgShape* sp1,
                       SnapItem& arr0, Point2d* matchpt)
 {
@@ -322,7 +333,7 @@ static bool snapCross(const MgMotion* sender, const Point2d& orgpt,
         else {
             if (d - 1 == ignoreHd || shape->shapec()->isHandleFixed(d - 1))
                 continue;
-            ptd = shape->shapec()->getHandlePoint(d - 1);   // 控制点与交点匹配
+            ptd = shape->shapec()->getHandlePoint(d - 1) + moved;   // 控制点与交点匹配
         }
         
         Box2d snapbox(orgpt, 2 * arr0.maxdist, 0);
@@ -347,7 +358,8 @@ static bool snapCross(const MgMotion* sender, const Point2d& orgpt,
             if (n < 0) {
                 MgPath path2;
                 sp2->shapec()->output(path2);
-                n = path1.crossWithPath(path2, snapbox, ptcross) ? 1 : 0;
+                n = path1.crossWithPath(path2, snapbox, ptcross, flattenOf(sp1->shapec()),
+                                        flattenOf(sp2->shapec())) ? 1 : 0;
             } else if (n > 0) {
                 ptcross = pt2.distanceTo(ptd) < pt1.distanceTo(ptd) ? pt2 : pt1;
                 n = snapbox.contains(ptcross) ? 1 : 0;
@@ -379,7 +391,7 @@ static void snapShape(const MgMotion* sender, const Point2d& orgpt,
                       int handleMask, bool needNear, float tolNear,
                       bool needPerp, bool perpOut, const Tol& tolPerp,
                       bool needCross, const Box2d& nearBox, bool needGrid,
-                      const MgShape* sp, const MgShape* shape, int ignoreHd,
+                      const MgShape* sp, const MgShape* shape, int ignoreHd, const Vector2d& moved,
                       const int* ignoreids, SnapItem arr[3], Point2d* matchpt)
 {
     if (skipShape(ignoreids, sp) || sp == shape) {
@@ -395,17 +407,17 @@ static void snapShape(const MgMotion* sender, const Point2d& orgpt,
     }
     if (extent.isIntersect(wndbox)) {
         b |= (handleMask && snapHandle(sender, orgpt, handleMask, shape, ignoreHd,
-                                       sp, arr[0], matchpt));
+                                       moved, sp, arr[0], matchpt));
         b |= (needPerp && snapPerp(sender, orgpt, tolPerp, shape, sp,
                                    arr[0], perpOut, nearBox));
-        b |= (needCross && snapCross(sender, orgpt, ignoreids, ignoreHd,
+        b |= (needCross && snapCross(sender, orgpt, ignoreids, ignoreHd, moved,
                                      shape, sp, arr[0], matchpt));
         if (!b && needNear) {
-            snapNear(sender, orgpt, shape, ignoreHd, tolNear, sp, arr[0], matchpt);
+            snapNear(sender, orgpt, shape, ignoreHd, moved, tolNear, sp, arr[0], matchpt);
         }
     }
     if (!b && needGrid && extent.isIntersect(snapbox)) {
-        snapGrid(sender, orgpt, shape, ignoreHd, sp, arr, matchpt);
+        snapGrid(sender, orgpt, shape, ignoreHd, moved, sp, arr, matchpt);
     }
 }
 
@@ -426,7 +438,7 @@ static inline int getHandleMask(MgView* view)
 }
 
 static void snapPoints(const MgMotion* sender, const Point2d& orgpt,
-                       const MgShape* shape, int ignoreHd,
+                       const MgShape* shape, int ignoreHd, const Vector2d& moved,
                        const int* ignoreids, SnapItem arr[3], Point2d* matchpt)
 {
     if (!sender->view->getOptionBool("snapEnabled", true)
@@ -451,19 +463,21 @@ static void snapPoints(const MgMotion* sender, const Point2d& orgpt,
     Box2d nearBox(orgpt, needNear ? mgMin(tolNear, sender->displayMmToModel(4.f)) : 0.f, 0);
     
     if (shape) {
-        wndbox.unionWith(shape->shapec()->getExtent().inflate(arr[0].dist));
+        wndbox.unionWith((shape->shapec()->getExtent() + moved).inflate(arr[0].dist));
     }
     while (const MgShape* sp = it.getNext()) {
         snapShape(sender, orgpt, xf->displayToModel(2, true), snapbox, wndbox,
                   handleMask, needNear, tolNear, needPerp, perpOut, tolPerp,
                   needCross, nearBox, needGrid,
-                  sp, shape, ignoreHd, ignoreids, arr, matchpt);
+                  sp, shape, ignoreHd, moved, ignoreids, arr, matchpt);
     }
 }
 
 // hotHandle: 绘新图时，起始步骤为-1，后续步骤>0；拖动一个或多个整体图形时为-1，拖动顶点时>=0
+// moved: 整体拖动时图形尚未移动，其控制点平移此量后参与匹配
 Point2d MgCmdManagerImpl::snapPoint(const MgMotion* sender, const Point2d& orgpt, const MgShape* shape,
-                                    int hotHandle, int ignoreHd, const int* ignoreids)
+                                    int hotHandle, int ignoreHd, const int* ignoreids,
+                                    const Vector2d& moved)
 {
     const int ignoreids_tmp[2] = { shape ? shape->getID() : 0, 0 };
     if (!ignoreids) ignoreids = ignoreids_tmp;
@@ -492,7 +506,7 @@ Point2d MgCmdManagerImpl::snapPoint(const MgMotion* sender, const Point2d& orgpt
     bool matchpt = (shape && shape->getID() != 0    // 拖动整个图形
                     && (hotHandle < 0 || (ignoreHd >= 0 && ignoreHd != hotHandle)));
     
-    snapPoints(sender, orgpt, shape, ignoreHd < 0 ? hotHandle : ignoreHd, ignoreids,
+    snapPoints(sender, orgpt, shape, ignoreHd < 0 ? hotHandle : ignoreHd, moved, ignoreids,
                arr, matchpt ? &pnt : NULL);         // 在所有图形中捕捉
     checkResult(arr);
     
@@ -10,6 +10,7 @@
 
 #include "mgpnt.h"
 #include "mgdblpt.h"
+#include "mgfitter.h"
 
 #if !defined(NAN) && defined(_WIN32)
 static const unsigned long __nan[2] = {0xffffffff, 0x7fffffff};
@@ -49,9 +50,10 @@ void                FitCurve(FitCubicCallback fc, void* data, const Point2d *d,
 void      FitCurve2(FitCubicCallback fc, void* data, PtCallback d, void* data2, int nPts, float error);
 static  void        FitCurve_(FitCubicCallback fc, void* data, const PtArr &d, int nPts, float error);
 static  void        FitCubic(FitCubicCallback fc, void* data, const PtArr &d, int first, int &last,
-                             const point_t& tHat1, const point_t& tHat2, double error);
-static  double      *Reparameterize(const PtArr &d, int first, int last, double *u,
-                                    const BezierCurve& bezCurve);
+                             const point_t& tHat1, const point_t& tHat2, double error,
+                             double *u, double *uPrime);
+static  void        Reparameterize(const PtArr &d, int first, int last, const double *u,
+                                   const BezierCurve& bezCurve, double *uPrime);
 static  double      NewtonRaphsonRootFind(const BezierCurve& Q, const point_t& P, double u);
 static  point_t     BezierII(int degree, const point_t *V, double t);
 static  double      B0(double u), B1(double u), B2(double u), B3(double u);
@@ -60,9 +62,10 @@ static  point_t     ComputeRightTangent(const PtArr &d, int end);
 static  point_t     ComputeCenterTangent(const PtArr &d, int center);
 static  double      ComputeMaxError(const PtArr &d, int first, int last,
                                     const BezierCurve& bezCurve, double *u, int &splitPoint);
-static  double      *ChordLengthParameterize(const PtArr &d, int first, int &last);
+static  void        ChordLengthParameterize(const PtArr &d, int first, int &last, double *u);
 static  BezierCurve GenerateBezier(const PtArr &d, int first, int last,
-                                   const double *uPrime, const point_t& tHat1, const point_t& tHat2);
+                                   const double *uPrime, const point_t& tHat1, const point_t& tHat2,
+                                   double alpha1 = 0, double alpha2 = 0);
 
 /*
  *  FitCurve :
@@ -90,6 +93,7 @@ static void FitCurve_(FitCubicCallback fc, void* data, const PtArr &d, int nPts,
     int         last = nPts - 1;
     int         oldlast;
     const Point2d ptbuf[4] = { Point2d(NAN, NAN) };
+    double      *u = new double[nPts * 2];  // Parameter buffers shared by all recursions
     
     tHat1 = ComputeLeftTangent(d, first);
     while (tHat1.isDegenerate() && first < last)
@@ -101,7 +105,7 @@ static void FitCurve_(FitCubicCallback fc, void* data, const PtArr &d, int nPts,
     
     if (first < last) {
         oldlast = last;
-        FitCubic(fc, data, d, first, last, tHat1, tHat2, mgMax(error, 1.1f));
+        FitCubic(fc, data, d, first, last, tHat1, tHat2, mgMax(error, 1.1f), u, u + nPts);
         while (last < oldlast) {
             for (first = last + 1; first < oldlast; first++) {
                 tHat1 = ComputeLeftTangent(d, first);
@@ -111,10 +115,11 @@ static void FitCurve_(FitCubicCallback fc, void* data, const PtArr &d, int nPts,
             last = oldlast;
             if (first < last) {
                 (*fc)(data, ptbuf);
-                FitCubic(fc, data, d, first, last, tHat1, tHat2, mgMax(error, 1.1f));
+                FitCubic(fc, data, d, first, last, tHat1, tHat2, mgMax(error, 1.1f), u, u + nPts);
             }
         }
     }
+    delete[] u;
 }
 
 /*
@@ -124,13 +129,14 @@ static void FitCurve_(FitCubicCallback fc, void* data, const PtArr &d, int nPts,
  *  first, last: Indices of first and last pts in region
  *  tHat1, tHat2: Unit tangent vectors at endpoints
  *  error: User-defined error squared
+ *  u, uPrime: Scratch buffers for parameter values, at least last-first+1 elements each
  */
 static void FitCubic(FitCubicCallback fc, void* data, const PtArr &d, int first, int &last,
-                     const point_t& tHat1, const point_t& tHat2, double error)
+                     const point_t& tHat1, const point_t& tHat2, double error,
+                     double *u, double *uPrime)
 {
     BezierCurve bezCurve;       // Control points of fitted Bezier curve
-    double      *u;             // Parameter values for point
-    double      *uPrime;        // Improved parameter values
+    double      *tmp;
     double      maxError;       // Maximum fitting error
     int         splitPoint;     // Point to split point set at
     double      iterationError; // Error below which you try iterating
@@ -154,13 +160,12 @@ static void FitCubic(FitCubicCallback fc, void* data, const PtArr &d, int first,
     }
 
     // Parameterize points, and attempt to fit curve
-    u = ChordLengthParameterize(d, first, last);
+    ChordLengthParameterize(d, first, last, u);
     bezCurve = GenerateBezier(d, first, last, u, tHat1, tHat2);
 
     // Find max deviation of points to fitted curve
     maxError = ComputeMaxError(d, first, last, bezCurve, u, splitPoint);
     if (maxError < error) {
-        delete[] u;
         (*fc)(data, bezCurve.copy(ptbuf));
         return;
     }
@@ -168,26 +173,25 @@ static void FitCubic(FitCubicCallback fc, void* data, const PtArr &d, int first,
     // If error not too large, try some reparameterization and iteration
     if (maxError < iterationError) {
         for (i = 0; i < maxIterations; i++) {
-            uPrime = Reparameterize(d, first, last, u, bezCurve);
+            Reparameterize(d, first, last, u, bezCurve, uPrime);
             bezCurve = GenerateBezier(d, first, last, uPrime, tHat1, tHat2);
             maxError = ComputeMaxError(d, first, last, bezCurve, uPrime, splitPoint);
             if (maxError < error) {
-                delete[] u;
-                delete[] uPrime;
                 (*fc)(data, bezCurve.copy(ptbuf));
                 return;
             }
-            delete[] u;
+            tmp = u;
             u = uPrime;
+            uPrime = tmp;
         }
     }
 
-    // Fitting failed -- split at max error point and fit recursively
-    delete[] u;
+    // Fitting failed -- split at max error point and fit recursively,
+    // the parameter buffers are free now and reused by the sub-regions
     tHatCenter = ComputeCenterTangent(d, splitPoint);
-    FitCubic(fc, data, d, first, splitPoint, tHat1, tHatCenter, error);
+    FitCubic(fc, data, d, first, splitPoint, tHat1, tHatCenter, error, u, uPrime);
     tHatCenter = point_t(-tHatCenter.x, -tHatCenter.y); // negate
-    FitCubic(fc, data, d, splitPoint, last, tHatCenter, tHat2, error);
+    FitCubic(fc, data, d, splitPoint, last, tHatCenter, tHat2, error, u, uPrime);
 }
 
 
@@ -198,12 +202,15 @@ static void FitCubic(FitCubicCallback fc, void* data, const PtArr &d, int first,
  *  first, last: Indices defining region
  *  uPrime: Parameter values for region
  *  tHat1, tHat2: Unit tangents at endpoints
+ *  alpha1, alpha2: Fixed distances of the control points along tHat1 and tHat2
+ *          if positive, so that adjacent curves can share their tangent vectors
  */
 static BezierCurve GenerateBezier(const PtArr &d, int first, int last,
-                                  const double *uPrime, const point_t& tHat1, const point_t& tHat2)
+                                  const double *uPrime, const point_t& tHat1, const point_t& tHat2,
+                                  double alpha1, double alpha2)
 {
     int     i;
-    point_t *A, *B;                         // Precomputed rhs for eqn
+    point_t A, B;                           // Rhs for eqn
     const int nPts = last - first + 1;      // Number of pts in sub-curve
     double  C[2][2];                        // Matrix C
     double  X[2];                           // Matrix X
@@ -212,14 +219,6 @@ static BezierCurve GenerateBezier(const PtArr &d, int first, int last,
     point_t tmp;                            // Utility variable
     BezierCurve bezCurve;                   // RETURN bezier curve ctl pts
 
-    // Compute the A's
-    A = new point_t[nPts * 2];
-    B = A + nPts;
-    for (i = 0; i < nPts; i++) {
-        A[i] = tHat1.scaledVector(B1(uPrime[i]));
-        B[i] = tHat2.scaledVector(B2(uPrime[i]));
-    }
-
     // Create the C and X matrices
     C[0][0] = 0.0;
     C[0][1] = 0.0;
@@ -229,19 +228,20 @@ static BezierCurve GenerateBezier(const PtArr &d, int first, int last,
     X[1]    = 0.0;
 
     for (i = 0; i < nPts; i++) {
-        C[0][0] += A[i].dotProduct(A[i]);
-        C[0][1] += A[i].dotProduct(B[i]);
+        A = tHat1.scaledVector(B1(uPrime[i]));  // Compute the A's on the fly
+        B = tHat2.scaledVector(B2(uPrime[i]));
+        
+        C[0][0] += A.dotProduct(A);
+        C[0][1] += A.dotProduct(B);
         C[1][0] = C[0][1];
-        C[1][1] += B[i].dotProduct(B[i]);
+        C[1][1] += B.dotProduct(B);
 
         tmp = d[first + i] - (d[first] * B0(uPrime[i]) + d[first] * B1(uPrime[i]) +
                               d[last] * B2(uPrime[i]) + d[last] * B3(uPrime[i]));
         
-        X[0] += A[i].dotProduct(tmp);
-        X[1] += B[i].dotProduct(tmp);
+        X[0] += A.dotProduct(tmp);
+        X[1] += B.dotProduct(tmp);
     }
-    
-    delete[] A;
 
     // Compute the determinants of C and X
     det_C0_C1 = C[0][0] * C[1][1] - C[1][0] * C[0][1];
@@ -249,8 +249,19 @@ static BezierCurve GenerateBezier(const PtArr &d, int first, int last,
     det_X_C1  = X[0]    * C[1][1] - X[1]    * C[0][1];
 
     // Finally, derive alpha values
-    alpha_l = (det_C0_C1 == 0) ? 0.0 : det_X_C1 / det_C0_C1;
-    alpha_r = (det_C0_C1 == 0) ? 0.0 : det_C0_X / det_C0_C1;
+    if (alpha1 > 0 && alpha2 > 0) {
+        alpha_l = alpha1;
+        alpha_r = alpha2;
+    } else if (alpha1 > 0) {                // Only alpha_r is free: C[1][1] * alpha_r = X[1] - C[0][1] * alpha1
+        alpha_l = alpha1;
+        alpha_r = (C[1][1] == 0) ? 0.0 : (X[1] - C[0][1] * alpha1) / C[1][1];
+    } else if (alpha2 > 0) {                // Only alpha_l is free: C[0][0] * alpha_l = X[0] - C[0][1] * alpha2
+        alpha_l = (C[0][0] == 0) ? 0.0 : (X[0] - C[0][1] * alpha2) / C[0][0];
+        alpha_r = alpha2;
+    } else {
+        alpha_l = (det_C0_C1 == 0) ? 0.0 : det_X_C1 / det_C0_C1;
+        alpha_r = (det_C0_C1 == 0) ? 0.0 : det_C0_X / det_C0_C1;
+    }
 
     // If alpha negative, use the Wu/Barsky heuristic (see text)
     // (if alpha is 0, you get coincident control points that lead to
@@ -262,8 +273,8 @@ static BezierCurve GenerateBezier(const PtArr &d, int first, int last,
         double dist = segLength / 3.0;
         bezCurve.set(0, d[first]);
         bezCurve.set(3, d[last]);
-        bezCurve.set(1, bezCurve[0] + tHat1.scaledVector(dist));
-        bezCurve.set(2, bezCurve[3] + tHat2.scaledVector(dist));
+        bezCurve.set(1, bezCurve[0] + tHat1.scaledVector(alpha1 > 0 ? alpha1 : dist));
+        bezCurve.set(2, bezCurve[3] + tHat2.scaledVector(alpha2 > 0 ? alpha2 : dist));
         return bezCurve;
     }
 
@@ -288,16 +299,14 @@ static BezierCurve GenerateBezier(const PtArr &d, int first, int last,
  *  first, last: Indices defining region
  *  u: Current parameter values
  *  bezCurve: Current fitted curve
+ *  uPrime: Output new parameter values
  */
-static double *Reparameterize(const PtArr &d, int first, int last, double *u, const BezierCurve& bezCurve)
+static void Reparameterize(const PtArr &d, int first, int last, const double *u,
+                           const BezierCurve& bezCurve, double *uPrime)
 {
-    double  *uPrime;                // New parameter values
-
-    uPrime = new double[last - first + 1];
     for (int i = first; i <= last; i++) {
         uPrime[i-first] = NewtonRaphsonRootFind(bezCurve, d[i], u[i - first]);
     }
-    return uPrime;
 }
 
 
@@ -425,13 +434,11 @@ static point_t ComputeCenterTangent(const PtArr &d, int center) {
  *  ChordLengthParameterize :
  *  Assign parameter values to digitized points
  *  using relative distances between points.
+ *  u: Output parameterization, at least last-first+1 elements
  */
-static double *ChordLengthParameterize(const PtArr &d, int first, int &last)
+static void ChordLengthParameterize(const PtArr &d, int first, int &last, double *u)
 {
     int     i;
-    double  *u;         // Parameterization
-
-    u = new double[last-first+1];
 
     u[0] = 0.0;
     for (i = first+1; i <= last; i++) {
@@ -445,8 +452,6 @@ static double *ChordLengthParameterize(const PtArr &d, int first, int &last)
     for (i = first + 1; i <= last; i++) {
         u[i-first] = u[i-first] / u[last-first];
     }
-
-    return u;
 }
 
 
@@ -481,3 +486,200 @@ static double ComputeMaxError(const PtArr &d, int first, int last,
     }
     return maxDist;
 }
+
+/*
+ *  MgCurveFitter :
+ *      Streaming variant of FitCurve. Only the open tail after the last
+ *      finalized point is refitted when a point arrives, with one cubic and
+ *      a few reparameterizations. When the tail can no longer be fitted by
+ *      one cubic, the previous fit is finalized and a new tail starts at its
+ *      end point. The first control vector of the new tail equals the last
+ *      one of the finalized curve, so that both curves can share one knot
+ *      vector in MgSplines.
+ */
+MgCurveFitter::MgCurveFitter()
+    : m_points((Point2d*)0), m_params((double*)0), m_capacity(0), m_count(0)
+    , m_tol(0), m_fc((mgcurv::FitCubicCallback)0), m_data((void*)0), m_fitCount(0)
+{
+}
+
+void MgCurveFitter::begin(Point2d* points, double* params, int capacity, float tol,
+                          mgcurv::FitCubicCallback fc, void* data)
+{
+    m_points = points;
+    m_params = params;
+    m_capacity = capacity;
+    m_count = 0;
+    m_tol = tol;
+    m_fc = fc;
+    m_data = data;
+    m_startVector = Vector2d();
+    m_fitCount = 0;
+}
+
+bool MgCurveFitter::addPoint(const Point2d& pt)
+{
+    bool ret = false;
+
+    if (!m_points || m_capacity < 4 || pt.isDegenerate()
+        || (m_count > 0 && m_points[m_count - 1] == pt)) {
+        return false;
+    }
+    if (m_count == m_capacity) {            // Bound the cost of one sample
+        if (m_fitCount > 1) {
+            flush();
+            ret = true;
+        } else {
+            m_points[0] = m_points[m_count - 1];
+            m_count = 1;
+        }
+    }
+    m_points[m_count++] = pt;
+
+    Point2d curve[4];
+
+    if (fitTail(curve, m_count)) {
+        for (int i = 0; i < 4; i++)
+            m_curve[i] = curve[i];
+        m_fitCount = m_count;
+    }
+    else if (m_fitCount > 1
+             && m_points[0].distanceTo(m_points[m_fitCount - 1]) >= m_startVector.length()) {
+        // The last fit excludes the new point. A fit shorter than its inherited
+        // start vector is kept open, otherwise the long vector would be passed on
+        // to ever shorter curves.
+        flush();
+        ret = true;
+    }
+
+    return ret;
+}
+
+bool MgCurveFitter::end()
+{
+    bool ret = false;
+
+    while (m_fitCount > 1 && m_fitCount < m_count) {
+        flush();                            // Output the kept fit and refit the rest
+        ret = true;
+    }
+    if (m_fitCount > 1 && m_fc) {
+        (*m_fc)(m_data, m_curve);
+        ret = true;
+    }
+    m_count = 0;
+    m_fitCount = 0;
+
+    return ret;
+}
+
+bool MgCurveFitter::getTail(Point2d curve[4]) const
+{
+    if (m_fitCount > 1) {
+        for (int i = 0; i < 4; i++)
+            curve[i] = m_curve[i];
+    }
+    return m_fitCount > 1;
+}
+
+// Output the fitted curve, and start a new tail at its end point
+void MgCurveFitter::flush()
+{
+    const int from = m_fitCount - 1;
+    Point2d curve[4];
+    double len = m_curve[3].distanceTo(m_curve[2]);
+
+    // Shorten the end vector as long as the curve still fits, since the next
+    // curve has to start with the same vector whatever its length is
+    for (int i = 0; i < 3 && m_fitCount > 2; i++) {
+        len *= 0.5;
+        if (!fitTail(curve, m_fitCount, len))
+            break;
+        for (int j = 0; j < 4; j++)
+            m_curve[j] = curve[j];
+    }
+    if (m_fc) {
+        (*m_fc)(m_data, m_curve);
+    }
+    m_startVector = m_curve[3] - m_curve[2];
+    for (int i = from; i < m_count; i++) {
+        m_points[i - from] = m_points[i];
+    }
+    m_count -= from;
+    m_fitCount = fitTail(m_curve, m_count) ? m_count : 0;
+
+    // Keep a fit of the leading points, so that they are output instead of being dropped
+    for (int lo = 2, hi = m_count - 1; m_fitCount < m_count && lo <= hi; ) {
+        int mid = (lo + hi) / 2;
+        if (fitTail(curve, mid)) {
+            for (int j = 0; j < 4; j++)
+                m_curve[j] = curve[j];
+            m_fitCount = mid;
+            lo = mid + 1;
+        }
+        else {
+            hi = mid - 1;
+        }
+    }
+}
+
+// Fit the first 'count' points of the tail, with a fixed end vector length if alpha2 is positive
+bool MgCurveFitter::fitTail(Point2d curve[4], int count, double alpha2) const
+{
+    const PtArr d(m_points);
+    const double error = (double)m_tol * m_tol;
+    const int   maxIterations = 4;
+    int         last = count - 1;
+    int         splitPoint;
+    point_t     tHat1(m_startVector.x, m_startVector.y);
+    double      alpha1 = tHat1.length();
+    point_t     tHat2;
+    BezierCurve bezCurve;
+    double      maxError;
+    double      *u = m_params;
+    double      *uPrime = m_params + m_capacity;
+    double      *tmp;
+
+    if (count < 2) {
+        return false;
+    }
+    if (alpha1 < 1e-6) {
+        alpha1 = 0;
+        tHat1 = ComputeLeftTangent(d, 0);
+    } else {
+        tHat1.normalize();
+    }
+    tHat2 = ComputeRightTangent(d, last);
+
+    if (last == 1) {
+        double dist = d[last].distanceTo(d[0]) / 3.0;
+
+        bezCurve.set(0, d[0]);
+        bezCurve.set(3, d[last]);
+        bezCurve.set(1, bezCurve[0] + tHat1.scaledVector(alpha1 > 0 ? alpha1 : dist));
+        bezCurve.set(2, bezCurve[3] + tHat2.scaledVector(alpha2 > 0 ? alpha2 : dist));
+        bezCurve.copy(curve);
+        return true;
+    }
+
+    ChordLengthParameterize(d, 0, last, u);
+    bezCurve = GenerateBezier(d, 0, last, u, tHat1, tHat2, alpha1, alpha2);
+    maxError = ComputeMaxError(d, 0, last, bezCurve, u, splitPoint);
+
+    // Fixed control vectors leave a worse first guess, so always try to improve it
+    for (int i = 0; i < maxIterations && maxError >= error
+         && (maxError < error * 4 || alpha1 > 0 || alpha2 > 0); i++) {
+        Reparameterize(d, 0, last, u, bezCurve, uPrime);
+        bezCurve = GenerateBezier(d, 0, last, uPrime, tHat1, tHat2, alpha1, alpha2);
+        maxError = ComputeMaxError(d, 0, last, bezCurve, uPrime, splitPoint);
+        tmp = u;
+        u = uPrime;
+        uPrime = tmp;
+    }
+    if (maxError < error) {
+        bezCurve.copy(curve);
+        return true;
+    }
+
+    return false;
+}
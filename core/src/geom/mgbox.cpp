@@ -4,6 +4,7 @@
 
 #include "mgbox.h"
 #include "mgmat.h"
+#include "mgsimd.h"
 
 Box2d::Box2d(const Box2d& src, bool bNormalize)
 {
@@ -57,8 +58,34 @@ Box2d& Box2d::set(int count, const Point2d* points)
     if (count < 1 || !points)
         return empty();
 
-    set(points[0], points[0]);
-    for (int i = 0; i < count; i++)
+    int i = 0;
+
+    if (count >= 4) {               // 每次取四个点，按 x,y,x,y 分量求最值
+        const float* p = &points[0].x;
+        mgvec4 a(mgvec4::load(p)), b(mgvec4::load(p + 4));
+        mgvec4 lo(mgvec4::vmin(a, b)), hi(mgvec4::vmax(a, b));
+
+        for (i = 4; i + 4 <= count; i += 4) {
+            a = mgvec4::load(p + 2 * i);
+            b = mgvec4::load(p + 2 * i + 4);
+            lo = mgvec4::vmin(lo, mgvec4::vmin(a, b));
+            hi = mgvec4::vmax(hi, mgvec4::vmax(a, b));
+        }
+        lo = mgvec4::vmin(lo, lo.swapHalves());
+        hi = mgvec4::vmax(hi, hi.swapHalves());
+
+        float f[4];
+        lo.store(f);
+        xmin = f[0];
+        ymin = f[1];
+        hi.store(f);
+        xmax = f[0];
+        ymax = f[1];
+    }
+    else {
+        set(points[0], points[0]);
+    }
+    for (; i < count; i++)
     {
         if (xmin > points[i].x)
             xmin = points[i].x;
@@ -121,6 +148,14 @@ Box2d& Box2d::unionWith(const Box2d& r1, const Box2d& r2)
 
 Box2d Box2d::operator*(const Matrix2d& m) const
 {
+    switch (m.kind()) {
+    case kMgMatIdentity:
+        return Box2d(*this, true);
+    case kMgMatTranslate:
+        return Box2d(xmin + m.dx, ymin + m.dy, xmax + m.dx, ymax + m.dy, true);
+    default:
+        break;
+    }
     if (m.isOrtho())
         return Box2d(leftBottom() * m, rightTop() * m);
     return Box2d(leftBottom() * m, rightTop() * m,
@@ -129,6 +164,14 @@ Box2d Box2d::operator*(const Matrix2d& m) const
 
 Box2d& Box2d::operator*=(const Matrix2d& m)
 {
+    switch (m.kind()) {
+    case kMgMatIdentity:
+        return normalize();
+    case kMgMatTranslate:
+        return set(xmin + m.dx, ymin + m.dy, xmax + m.dx, ymax + m.dy);
+    default:
+        break;
+    }
     if (m.isOrtho())
         return set(leftBottom() * m, rightTop() * m);
     return set(leftBottom() * m, rightTop() * m,
@@ -0,0 +1,572 @@
+// mgflatten.cpp: 实现曲线折线化缓存类 MgFlattenBeziers
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+
+#include "mgflatten.h"
+#include "mgcurv.h"
+#include "mglnrel.h"
+#include "mgpath.h"
+#include "mgsimd.h"
+#include <vector>
+#include <algorithm>
+
+int mgcurv::bezierSteps(const Point2d* pts, float tol, int maxSteps)
+{
+    // Wang's formula: n = sqrt(d(d-1)/8 * M / tol), d = 3
+    float m1 = mgHypot(pts[0].x - 2 * pts[1].x + pts[2].x, pts[0].y - 2 * pts[1].y + pts[2].y);
+    float m2 = mgHypot(pts[1].x - 2 * pts[2].x + pts[3].x, pts[1].y - 2 * pts[2].y + pts[3].y);
+    float n = sqrtf(0.75f * mgMax(m1, m2) / mgMax(tol, _MGZERO));
+
+    return n < 1.f ? 1 : (n >= (float)maxSteps ? maxSteps : 1 + (int)n);
+}
+
+void mgcurv::flattenBezier(const Point2d* pts, int steps, Point2d* outpts)
+{
+    if (steps < 1)
+        return;
+
+    // B(t) = a*t^3 + b*t^2 + c*t + d
+    const float ax = pts[3].x - pts[0].x + 3 * (pts[1].x - pts[2].x);
+    const float ay = pts[3].y - pts[0].y + 3 * (pts[1].y - pts[2].y);
+    const float bx = 3 * (pts[0].x - 2 * pts[1].x + pts[2].x);
+    const float by = 3 * (pts[0].y - 2 * pts[1].y + pts[2].y);
+    const float cx = 3 * (pts[1].x - pts[0].x);
+    const float cy = 3 * (pts[1].y - pts[0].y);
+
+    const float h = 1.f / steps, h2 = h * h, h3 = h2 * h;
+    const float d1x = ax * h3 + bx * h2 + cx * h, d1y = ay * h3 + by * h2 + cy * h;
+    const float d2x = 6 * ax * h3 + 2 * bx * h2,  d2y = 6 * ay * h3 + 2 * by * h2;
+    const float d3x = 6 * ax * h3,                d3y = 6 * ay * h3;
+
+    // 每个矢量的高两位是低两位的下一阶差分，三次累加即前进一步
+    mgvec4 p = mgvec4::make(pts[0].x, pts[0].y, d1x, d1y);
+    mgvec4 d1 = mgvec4::make(d1x, d1y, d2x, d2y);
+    mgvec4 d2 = mgvec4::make(d2x, d2y, d3x, d3y);
+    const mgvec4 d3 = mgvec4::make(d3x, d3y, 0, 0);
+
+    for (int i = 0; i + 1 < steps; i++) {
+        p += d1;
+        d1 += d2;
+        d2 += d3;
+        p.storeLow(&outpts[i].x);
+    }
+    outpts[steps - 1] = pts[3];     // 消除累加误差
+}
+
+//! MgFlattenBeziers的内部数据类
+class MgFlattenImpl
+{
+public:
+    std::vector<Point2d>    points;     //!< 折线点
+    std::vector<int>        segments;   //!< 到达每个折线点的边所在的曲线段序号
+    std::vector<float>      params;     //!< 每个折线点在其曲线段内的参数
+    std::vector<int>        curves;     //!< 到达每个折线点的边所在曲线的控制点序号，直线段为-1
+    std::vector<Point2d>    ctlpts;     //!< 每段曲线的4个控制点
+    std::vector<int>        figures;    //!< 每个图元的起始折线点序号
+    std::vector<char>       closed;     //!< 每个图元是否闭合
+    std::vector<Box2d>      segboxes;   //!< 样条曲线到每段末尾为止的包络框，接着折线化时用
+    Box2d                   box;        //!< 折线点的包络框
+    float                   tol;        //!< 折线化容差
+    long                    version;    //!< 版本号
+
+    MgFlattenImpl() : tol(0), version(0) {}
+
+    void clear() {
+        points.clear();
+        segments.clear();
+        params.clear();
+        curves.clear();
+        ctlpts.clear();
+        figures.clear();
+        closed.clear();
+        segboxes.clear();
+        box.empty();
+    }
+
+    int figureEnd(int f) const {
+        return f + 1 < (int)figures.size() ? figures[f + 1] : (int)points.size();
+    }
+
+    void push(const Point2d& pt, int segment, float t, int curve) {
+        points.push_back(pt);
+        segments.push_back(segment);
+        params.push_back(t);
+        curves.push_back(curve);
+    }
+};
+
+MgFlattenBeziers::MgFlattenBeziers() : m_data((MgFlattenImpl*)0)
+{
+}
+
+MgFlattenBeziers::MgFlattenBeziers(const MgFlattenBeziers& src) : m_data((MgFlattenImpl*)0)
+{
+    operator=(src);
+}
+
+MgFlattenBeziers::~MgFlattenBeziers()
+{
+    delete m_data;
+}
+
+MgFlattenBeziers& MgFlattenBeziers::operator=(const MgFlattenBeziers& src)
+{
+    if (this != &src) {
+        if (src.m_data) {
+            if (!m_data)
+                m_data = new MgFlattenImpl();
+            *m_data = *src.m_data;
+        } else {
+            clear();
+        }
+    }
+    return *this;
+}
+
+void MgFlattenBeziers::clear()
+{
+    if (m_data) {
+        delete m_data;
+        m_data = (MgFlattenImpl*)0;
+    }
+}
+
+bool MgFlattenBeziers::isValid(long version, float tol) const
+{
+    return m_data && !m_data->points.empty() && m_data->version == version
+        && (tol <= 0 || m_data->tol <= tol);
+}
+
+int MgFlattenBeziers::getCount() const
+{
+    return m_data ? (int)m_data->points.size() : 0;
+}
+
+const Point2d* MgFlattenBeziers::getPoints() const
+{
+    return getCount() > 0 ? &m_data->points.front() : (const Point2d*)0;
+}
+
+int MgFlattenBeziers::getSegment(int index) const
+{
+    return index >= 0 && index < getCount() ? m_data->segments[index] : -1;
+}
+
+float MgFlattenBeziers::getParam(int index) const
+{
+    return index >= 0 && index < getCount() ? m_data->params[index] : 0.f;
+}
+
+float MgFlattenBeziers::getTolerance() const
+{
+    return m_data ? m_data->tol : 0.f;
+}
+
+long MgFlattenBeziers::getVersion() const
+{
+    return m_data ? m_data->version : 0;
+}
+
+Box2d MgFlattenBeziers::getExtent() const
+{
+    if (getCount() < 1)
+        return Box2d();
+    Box2d rect(m_data->box);
+    return rect.inflate(m_data->tol);
+}
+
+static MgFlattenImpl* beginBuild(MgFlattenImpl*& d, float tol, long version)
+{
+    if (!d)
+        d = new MgFlattenImpl();
+    d->clear();
+    d->tol = mgMax(tol, _MGZERO);
+    d->version = version;
+    return d;
+}
+
+static void startFigure(MgFlattenImpl* d, const Point2d& pt, int segment)
+{
+    d->figures.push_back((int)d->points.size());
+    d->closed.push_back(0);
+    d->push(pt, segment, 0.f, -1);
+}
+
+static void addLine(MgFlattenImpl* d, const Point2d& pt, int segment)
+{
+    d->push(pt, segment, 1.f, -1);
+}
+
+static void addBezier(MgFlattenImpl* d, const Point2d* pts, int segment)
+{
+    int n = mgcurv::bezierSteps(pts, d->tol);
+    int from = (int)d->points.size();
+    int curve = (int)d->ctlpts.size();
+
+    for (int k = 0; k < 4; k++)
+        d->ctlpts.push_back(pts[k]);
+    d->points.resize(from + n);
+    mgcurv::flattenBezier(pts, n, &d->points[from]);
+
+    for (int i = 1; i <= n; i++) {
+        d->segments.push_back(segment);
+        d->params.push_back((float)i / n);
+        d->curves.push_back(curve);
+    }
+}
+
+static void endFigure(MgFlattenImpl* d, bool closed, int segment)
+{
+    if (!d->figures.empty()) {
+        int from = d->figures.back();
+        int n = (int)d->points.size() - from;
+
+        if (closed && n > 1) {
+            if (d->points.back() != d->points[from])
+                addLine(d, d->points[from], segment);
+            d->closed.back() = 1;
+        }
+    }
+}
+
+static void endBuild(MgFlattenImpl* d)
+{
+    int n = (int)d->points.size();
+
+    d->box.set(n, n > 0 ? &d->points.front() : (const Point2d*)0);
+}
+
+// 从 seg 段开始记下到每段末尾为止的包络框，最后一个即为全部折线点的包络框
+static void endSplines(MgFlattenImpl* d, int seg)
+{
+    const int n = (int)d->points.size();
+    int i = seg > 0 ? (int)(std::lower_bound(d->segments.begin() + 1, d->segments.end(), seg)
+                            - d->segments.begin()) : 0;
+    Box2d box(seg > 0 ? d->segboxes[seg - 1] : Box2d(d->points[0], d->points[0]));
+
+    d->segboxes.resize(seg);
+    for (; i < n; i++) {
+        box.unionWith(d->points[i]);
+        if (i + 1 == n || d->segments[i + 1] != d->segments[i]) {
+            d->segboxes.push_back(box);
+        }
+    }
+    d->box = box;
+}
+
+int MgFlattenBeziers::setBeziers(int count, const Point2d* points, bool closed,
+                                 float tol, long version)
+{
+    MgFlattenImpl* d = beginBuild(m_data, tol, version);
+    if (count > 3 && points) {
+        startFigure(d, points[0], 0);
+        for (int i = 0; i + 3 < count; i += 3) {
+            addBezier(d, points + i, i);
+        }
+        if (closed) {   // 与 mgnear::beziersBox 一致，用光滑曲线段闭合
+            const Point2d pts[4] = { points[count - 1],
+                points[count - 1] * 2 - points[count - 2].asVector(),
+                points[0] * 2 - points[1].asVector(), points[0] };
+            addBezier(d, pts, count - 1);
+        }
+        endFigure(d, closed, count - 1);
+    }
+    endBuild(d);
+    return getCount();
+}
+
+int MgFlattenBeziers::setSplines(int n, const Point2d* knots, const Vector2d* knotvs,
+                                 bool closed, bool hermite, float tol, long version)
+{
+    MgFlattenImpl* d = beginBuild(m_data, tol, version);
+    if (n > 1 && knots && knotvs) {
+        Point2d pts[4];
+        int n2 = closed ? n + 1 : n;
+
+        startFigure(d, knots[0], 0);
+        for (int i = 0; i + 1 < n2; i++) {
+            mgcurv::cubicSplineToBezier(n, knots, knotvs, i, pts, hermite);
+            addBezier(d, pts, i);
+        }
+        endFigure(d, closed, n - 1);
+        endSplines(d, 0);
+    }
+    else {
+        endBuild(d);
+    }
+    return getCount();
+}
+
+int MgFlattenBeziers::appendSplines(int n, const Point2d* knots, const Vector2d* knotvs,
+                                    int from, bool hermite)
+{
+    MgFlattenImpl* d = m_data;
+
+    if (!d || d->figures.size() != 1 || d->closed[0] || from < 1
+        || from > (int)d->segboxes.size() || n < 2 || !knots || !knotvs) {
+        return 0;
+    }
+
+    // 去掉 from 段及之后的折线点，各段的折线点是连续的
+    const int cut = (int)(std::lower_bound(d->segments.begin() + 1, d->segments.end(), from)
+                          - d->segments.begin());
+    Point2d pts[4];
+
+    if (cut < (int)d->points.size()) {
+        d->ctlpts.resize(d->curves[cut]);
+        d->points.resize(cut);
+        d->segments.resize(cut);
+        d->params.resize(cut);
+        d->curves.resize(cut);
+    }
+    for (int i = from; i + 1 < n; i++) {
+        mgcurv::cubicSplineToBezier(n, knots, knotvs, i, pts, hermite);
+        addBezier(d, pts, i);
+    }
+    endSplines(d, from);
+
+    return getCount();
+}
+
+int MgFlattenBeziers::setPath(const MgPath& path, float tol, long version)
+{
+    int n = path.getCount();
+    const Point2d* pts = path.getPoints();
+    const char* types = path.getTypes();
+    Point2d bz[7];
+    bool err = false;
+
+    MgFlattenImpl* d = beginBuild(m_data, tol, version);
+    for (int i = 0; i < n && !err; i++) {
+        int type = types[i] & ~kMgCloseFigure;
+
+        if (type != kMgMoveTo && d->figures.empty()) {
+            startFigure(d, Point2d(), i);
+        }
+        switch (type) {
+            case kMgMoveTo:
+                endFigure(d, false, i);
+                startFigure(d, pts[i], i);
+                break;
+
+            case kMgLineTo:
+                addLine(d, pts[i], i);
+                break;
+
+            case kMgBezierTo:
+                if (i + 2 >= n) {
+                    err = true;
+                    break;
+                }
+                bz[0] = d->points.back();
+                bz[1] = pts[i];
+                bz[2] = pts[i+1];
+                bz[3] = pts[i+2];
+                i += 2;
+                addBezier(d, bz, i);
+                break;
+
+            case kMgQuadTo:
+                if (i + 1 >= n) {
+                    err = true;
+                    break;
+                }
+                bz[0] = d->points.back();
+                bz[1] = pts[i];
+                bz[2] = pts[i+1];
+                i++;
+                mgcurv::quadBezierToCubic(bz, bz + 3);
+                addBezier(d, bz + 3, i);
+                break;
+
+            default:
+                err = true;
+                break;
+        }
+        if (!err && (types[i] & kMgCloseFigure)) {
+            endFigure(d, true, i);
+        }
+    }
+    endBuild(d);
+
+    return getCount();
+}
+
+// 在原曲线上用牛顿迭代求精最近点，初值为折线上最近点对应的参数
+static bool refineOnBezier(const Point2d* c, const Point2d& pt, float t,
+                           Point2d& nearpt, float& dist)
+{
+    double ax = -c[0].x + 3.0 * (c[1].x - c[2].x) + c[3].x;
+    double ay = -c[0].y + 3.0 * (c[1].y - c[2].y) + c[3].y;
+    double bx = 3.0 * (c[0].x - 2.0 * c[1].x + c[2].x);
+    double by = 3.0 * (c[0].y - 2.0 * c[1].y + c[2].y);
+    double cx = 3.0 * (c[1].x - c[0].x);
+    double cy = 3.0 * (c[1].y - c[0].y);
+    double x = 0, y = 0, u = t;
+
+    for (int it = 0; it < 4; it++) {
+        x = ((ax * u + bx) * u + cx) * u + c[0].x - pt.x;
+        y = ((ay * u + by) * u + cy) * u + c[0].y - pt.y;
+        double dx1 = (3 * ax * u + 2 * bx) * u + cx;
+        double dy1 = (3 * ay * u + 2 * by) * u + cy;
+        double dx2 = 6 * ax * u + 2 * bx;
+        double dy2 = 6 * ay * u + 2 * by;
+        double f = x * dx1 + y * dy1;
+        double df = dx1 * dx1 + dy1 * dy1 + x * dx2 + y * dy2;
+
+        if (fabs(df) < 1e-12)
+            break;
+        u -= f / df;
+        u = u < 0 ? 0 : (u > 1 ? 1 : u);
+    }
+    x = ((ax * u + bx) * u + cx) * u + c[0].x;
+    y = ((ay * u + by) * u + cy) * u + c[0].y;
+
+    float d = mgHypot((float)x - pt.x, (float)y - pt.y);
+    if (d < dist) {
+        dist = d;
+        nearpt.set((float)x, (float)y);
+        return true;
+    }
+    return false;
+}
+
+float MgFlattenBeziers::hitTest(const Point2d& pt, float tol, Point2d& nearpt,
+                                int& segment, bool* inside) const
+{
+    float distMin = _FLT_MAX;
+    int best = -1;
+
+    segment = -1;
+    if (inside) {
+        *inside = false;
+    }
+    if (getCount() < 2) {
+        return distMin;
+    }
+
+    const MgFlattenImpl* d = m_data;
+    const Point2d* pts = &d->points.front();
+    const float r = tol + d->tol;
+    const float xmin = pt.x - r, xmax = pt.x + r;
+    const float ymin = pt.y - r, ymax = pt.y + r;
+    Point2d ptTemp;
+    int odd = 0;
+
+    for (int f = 0; f < (int)d->figures.size(); f++) {
+        int end = d->figureEnd(f);
+
+        for (int i = d->figures[f] + 1; i < end; i++) {
+            const Point2d& a = pts[i - 1];
+            const Point2d& b = pts[i];
+
+            if (inside && d->closed[f] && ((a.y > pt.y) != (b.y > pt.y))
+                && pt.x < (b.x - a.x) * (pt.y - a.y) / (b.y - a.y) + a.x) {
+                odd ^= 1;
+            }
+            if (mgMax(a.x, b.x) < xmin || mgMin(a.x, b.x) > xmax
+                || mgMax(a.y, b.y) < ymin || mgMin(a.y, b.y) > ymax) {
+                continue;
+            }
+            float dist = mglnrel::ptToLine(a, b, pt, ptTemp);
+            if (distMin > dist) {
+                distMin = dist;
+                nearpt = ptTemp;
+                best = i;
+            }
+        }
+    }
+    if (inside) {
+        *inside = (odd != 0);
+    }
+
+    if (best > 0) {
+        segment = d->segments[best];
+        if (d->curves[best] >= 0) {
+            const Point2d& a = pts[best - 1];
+            float t0 = d->curves[best - 1] == d->curves[best] ? d->params[best - 1] : 0.f;
+            float t1 = d->params[best];
+            float len = a.distanceTo(pts[best]);
+            float t = len > _MGZERO ? t0 + (t1 - t0) * a.distanceTo(nearpt) / len : t1;
+
+            refineOnBezier(&d->ctlpts[d->curves[best]], pt, t, nearpt, distMin);
+        }
+    }
+
+    return distMin;
+}
+
+bool MgFlattenBeziers::intersectBox(const Box2d& box) const
+{
+    if (getCount() < 1 || !getExtent().isIntersect(box)) {
+        return false;
+    }
+
+    const MgFlattenImpl* d = m_data;
+    const Box2d rect(Box2d(box, true).inflate(d->tol));
+
+    for (int f = 0; f < (int)d->figures.size(); f++) {
+        int end = d->figureEnd(f);
+
+        if (end - d->figures[f] == 1 && rect.contains(d->points[d->figures[f]])) {
+            return true;
+        }
+        for (int i = d->figures[f] + 1; i < end; i++) {
+            Point2d a(d->points[i - 1]), b(d->points[i]);
+            if (mglnrel::clipLine(a, b, rect)) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// 得到与矩形相交的折线边的起点序号
+static void edgesInBox(const MgFlattenImpl* d, const Box2d& box, std::vector<int>& edges)
+{
+    for (int f = 0; f < (int)d->figures.size(); f++) {
+        int end = d->figureEnd(f);
+
+        for (int i = d->figures[f] + 1; i < end; i++) {
+            if (box.isIntersect(Box2d(d->points[i - 1], d->points[i])))
+                edges.push_back(i - 1);
+        }
+    }
+}
+
+bool MgFlattenBeziers::crossWith(const MgFlattenBeziers& other, const Box2d& box,
+                                 Point2d& ptCross) const
+{
+    if (getCount() < 2 || other.getCount() < 2) {
+        return false;
+    }
+
+    std::vector<int> edges1, edges2;
+    const Point2d* pts1 = getPoints();
+    const Point2d* pts2 = other.getPoints();
+    Point2d tmpcross;
+    float mindist = _FLT_MAX;
+
+    edgesInBox(m_data, box, edges1);
+    if (!edges1.empty())
+        edgesInBox(other.m_data, box, edges2);
+
+    for (size_t i = 0; i < edges1.size(); i++) {
+        const Point2d& a = pts1[edges1[i]];
+        const Point2d& b = pts1[edges1[i] + 1];
+
+        for (size_t j = 0; j < edges2.size(); j++) {
+            if (mglnrel::cross2Line(a, b, pts2[edges2[j]], pts2[edges2[j] + 1], tmpcross)
+                && box.contains(tmpcross)) {
+                float dist = tmpcross.distanceTo(box.center());
+                if (mindist > dist) {
+                    mindist = dist;
+                    ptCross = tmpcross;
+                }
+            }
+        }
+    }
+
+    return mindist < box.width();
+}
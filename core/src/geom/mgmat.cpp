@@ -65,8 +65,34 @@ Point2d Point2d::transform(const Matrix2d& m) const
 
 void Matrix2d::transformPoints(int count, Point2d* points) const
 {
-    for (int i = 0; i < count; i++)
-        points[i] *= (*this);
+    transformPoints(count, points, points);
+}
+
+void Matrix2d::transformPoints(int count, const Point2d* points,
+                               Point2d* result, int kind) const
+{
+    int i;
+
+    switch (kind < 0 ? this->kind() : kind) {
+    case kMgMatIdentity:
+        if (result != points) {
+            for (i = 0; i < count; i++)
+                result[i] = points[i];
+        }
+        break;
+    case kMgMatTranslate:
+        for (i = 0; i < count; i++)
+            result[i].set(points[i].x + dx, points[i].y + dy);
+        break;
+    case kMgMatScale:
+        for (i = 0; i < count; i++)
+            result[i].set(points[i].x * m11 + dx, points[i].y * m22 + dy);
+        break;
+    default:
+        for (i = 0; i < count; i++)
+            result[i] = points[i] * (*this);
+        break;
+    }
 }
 
 void Matrix2d::transformVectors(int count, Vector2d* vectors) const
@@ -192,6 +218,15 @@ bool Matrix2d::isOrtho() const
     return mgIsZero(m12) && mgIsZero(m21);
 }
 
+int Matrix2d::kind() const
+{
+    if (m12 != 0.f || m21 != 0.f)
+        return kMgMatAffine;
+    if (m11 != 1.f || m22 != 1.f)
+        return kMgMatScale;
+    return (dx != 0.f || dy != 0.f) ? kMgMatTranslate : kMgMatIdentity;
+}
+
 bool Matrix2d::hasMirror(Vector2d& reflex) const
 {
     Vector2d e0 (m11, m12);
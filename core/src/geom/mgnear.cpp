@@ -6,6 +6,13 @@
 #include "mgcurv.h"
 #include "mglnrel.h"
 
+// 合并包络框，与 Box2d::unionWith 不同的是不忽略宽或高为零的水平或垂直曲线段
+static inline void unionBox(Box2d& box, const Box2d& other)
+{
+    box.unionWith(other.xmin, other.ymin);
+    box.unionWith(other.xmax, other.ymax);
+}
+
 Box2d mgnear::bezierBox1(const Point2d points[4])
 {
     return bezierBox4(points[0], points[1], points[2], points[3]);
@@ -15,12 +22,25 @@ void mgnear::beziersBox(
     Box2d& box, int count, const Point2d* points, bool closed)
 {
     box.empty();
+    if (count < 4) {
+        return;
+    }
 
-    for (int i = 0; i + 3 < count; i += 3) {
-        box.unionWith(bezierBox1(points + i));
+    // 曲线段的包络框介于其端点框和控制点框之间，先取所有端点的范围，
+    // 控制点框已在此范围内的曲线段不会扩大结果，只需对其余曲线段求极值
+    int i;
+
+    box.set(points[0], points[0]);
+    for (i = 3; i < count; i += 3) {
+        box.unionWith(points[i]);
     }
-    if (closed && count > 3) {
-        box.unionWith(bezierBox4(points[count - 1],
+    for (i = 0; i + 3 < count; i += 3) {
+        if (!box.contains(Box2d(4, points + i))) {
+            unionBox(box, bezierBox1(points + i));
+        }
+    }
+    if (closed) {
+        unionBox(box, bezierBox4(points[count - 1],
             points[count - 1] * 2 - points[count - 2].asVector(),
             points[0] * 2 - points[1].asVector(), points[0]));
     }
@@ -89,35 +109,28 @@ float mgnear::cubicSplinesHit(
 {
     Point2d ptTemp;
     float dist, distMin = _FLT_MAX;
-    const Box2d rect (pt, 2 * tol, 2 * tol);
+    int seg;
 
     segment = -1;
     if (knotvs) {
-        Point2d pts[4];
+        const int BATCH = 16;           // 每批转换的曲线段数
+        Point2d pts[3 * BATCH + 1];
         int n2 = (closed && n > 1) ? n + 1 : n;
         
-        for (int i = 0; i + 1 < n2; i++) {
-            mgcurv::cubicSplineToBezier(n, knots, knotvs, i, pts, hermite);
-            if (rect.isIntersect(bezierBox1(pts))) {
-                dist = mgnear::nearestOnBezier(pt, pts, ptTemp);
-                if (dist < distMin) {
-                    distMin = dist;
-                    nearpt = ptTemp;
-                    segment = i;
-                }
+        for (int i = 0; i + 1 < n2; i += BATCH) {
+            int m = mgMin(BATCH, n2 - 1 - i);
+            for (int j = 0; j < m; j++) {
+                mgcurv::cubicSplineToBezier(n, knots, knotvs, i + j, pts + 3 * j, hermite);
             }
-        }
-    } else {
-        for (int i = 0; i + 3 < n; i += 3) {
-            if (rect.isIntersect(bezierBox1(knots + i))) {
-                dist = mgnear::nearestOnBezier(pt, knots + i, ptTemp);
-                if (dist < distMin) {
-                    distMin = dist;
-                    nearpt = ptTemp;
-                    segment = i;
-                }
+            dist = mgnear::nearestOnBeziers(pt, 3 * m + 1, pts, tol, ptTemp, seg);
+            if (dist < distMin) {
+                distMin = dist;
+                nearpt = ptTemp;
+                segment = i + seg / 3;
             }
         }
+    } else {
+        distMin = mgnear::nearestOnBeziers(pt, n, knots, tol, nearpt, segment);
     }
 
     return distMin;
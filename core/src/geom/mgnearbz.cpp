@@ -5,6 +5,7 @@
 #include "mgnear.h"
 #include "mgcurv.h"
 #include "mgdblpt.h"
+#include "mgsimd.h"
 
 static const int DEGREE     = 3;    // Cubic Bezier curve
 static const int W_DEGREE   = 5;    // Degree of eqn to find roots of
@@ -408,3 +409,259 @@ float mgnear::nearestOnBezier(
     nearpt.set((float)nearpt2.x, (float)nearpt2.y);
     return (float)nearpt2.distanceTo(pt2);
 }
+
+// 以下为批量计算点到多段贝塞尔曲线最近点的实现
+
+static const int BATCH_SAMPLES = 16;    // 牛顿迭代前每段的均匀采样数
+
+//! 四个曲线段的多项式系数，按分量分组存放，已平移到以给定点为原点
+struct BezierLanes {
+    float   ax[4], ay[4], bx[4], by[4], cx[4], cy[4], dx[4], dy[4];
+    float   t[4];       //!< 输出的最近点参数
+    float   d2[4];      //!< 输出的距离平方
+    int     segs[4];    //!< 曲线段的起点序号
+    int     n;          //!< 有效的曲线段数
+
+    BezierLanes() : n(0) {
+        for (int i = 0; i < 4; i++) {
+            ax[i] = ay[i] = bx[i] = by[i] = cx[i] = cy[i] = dx[i] = dy[i] = 0;
+        }
+    }
+
+    void add(const Point2d* p, const Point2d& pt, int segment) {
+        ax[n] = p[3].x - p[0].x + 3 * (p[1].x - p[2].x);
+        ay[n] = p[3].y - p[0].y + 3 * (p[1].y - p[2].y);
+        bx[n] = 3 * (p[0].x - 2 * p[1].x + p[2].x);
+        by[n] = 3 * (p[0].y - 2 * p[1].y + p[2].y);
+        cx[n] = 3 * (p[1].x - p[0].x);
+        cy[n] = 3 * (p[1].y - p[0].y);
+        dx[n] = p[0].x - pt.x;
+        dy[n] = p[0].y - pt.y;
+        segs[n++] = segment;
+    }
+};
+
+// 四个曲线段的多项式系数，用于并行求值
+struct LaneCoefs {
+    mgvec4 ax, ay, bx, by, cx, cy, dx, dy;
+
+    mgvec4 distSquare(const mgvec4& u) const {
+        mgvec4 x(((ax * u + bx) * u + cx) * u + dx);
+        mgvec4 y(((ay * u + by) * u + cy) * u + dy);
+        return x * x + y * y;
+    }
+
+    // 在采样点u的相邻区间内做牛顿迭代，迭代点越出区间时取二分点，返回求精后的参数
+    mgvec4 newton(mgvec4 u, float step) const {
+        const mgvec4 zero(mgvec4::splat(0)), one(mgvec4::splat(1));
+        const mgvec4 two(mgvec4::splat(2)), three(mgvec4::splat(3));
+        const mgvec4 half(mgvec4::splat(0.5f)), eps(mgvec4::splat(1e-12f));
+        const mgvec4 ax3(ax * three), ay3(ay * three), bx2(bx * two), by2(by * two);
+        mgvec4 lo(mgvec4::vmax(u - mgvec4::splat(step), zero));
+        mgvec4 hi(mgvec4::vmin(u + mgvec4::splat(step), one));
+
+        for (int it = 0; it < 6; it++) {
+            mgvec4 x(((ax * u + bx) * u + cx) * u + dx);
+            mgvec4 y(((ay * u + by) * u + cy) * u + dy);
+            mgvec4 x1((ax3 * u + bx2) * u + cx);
+            mgvec4 y1((ay3 * u + by2) * u + cy);
+            mgvec4 x2(ax3 * two * u + bx2);
+            mgvec4 y2(ay3 * two * u + by2);
+            mgvec4 f(x * x1 + y * y1);
+            mgvec4 df(x1 * x1 + y1 * y1 + x * x2 + y * y2);
+            mgvec4 m(mgvec4::vless(eps, df));   // 凸的才用牛顿迭代
+
+            lo = mgvec4::blend(mgvec4::vless(f, zero), u, lo);
+            hi = mgvec4::blend(mgvec4::vless(zero, f), u, hi);
+            mgvec4 mid((lo + hi) * half);
+            u = mgvec4::blend(m, u - f / mgvec4::blend(m, df, one), mid);
+            u = mgvec4::blend(mgvec4::vless(u, lo), mid, u);
+            u = mgvec4::blend(mgvec4::vless(hi, u), mid, u);
+        }
+        return u;
+    }
+};
+
+// 对四个曲线段同时计算最近点参数
+// 均匀采样找出距离最小的两个极小值点，分别做牛顿迭代，避免陷入非最近的极小值
+static void nearestOnLanes(BezierLanes& L)
+{
+    LaneCoefs c;
+    c.ax = mgvec4::load(L.ax); c.ay = mgvec4::load(L.ay);
+    c.bx = mgvec4::load(L.bx); c.by = mgvec4::load(L.by);
+    c.cx = mgvec4::load(L.cx); c.cy = mgvec4::load(L.cy);
+    c.dx = mgvec4::load(L.dx); c.dy = mgvec4::load(L.dy);
+
+    const mgvec4 big(mgvec4::splat(_FLT_MAX));
+    const float step = 1.f / BATCH_SAMPLES;
+    mgvec4 prev(big), cur(c.distSquare(mgvec4::splat(0))), next, m, m2, v;
+    mgvec4 b1(big), b2(big), t1(mgvec4::splat(0)), t2(t1), u;
+
+    for (int k = 0; k <= BATCH_SAMPLES; k++) {
+        u = mgvec4::splat(k * step);
+        next = k < BATCH_SAMPLES ? c.distSquare(mgvec4::splat((k + 1) * step)) : big;
+        m = mgvec4::vless(mgvec4::vmin(prev, next), cur);
+        v = mgvec4::blend(m, big, cur);             // 不是极小值的取为极大数
+
+        m = mgvec4::vless(v, b1);                   // 依次插入最小的两个极小值
+        m2 = mgvec4::vless(v, b2);
+        b2 = mgvec4::blend(m, b1, mgvec4::blend(m2, v, b2));
+        t2 = mgvec4::blend(m, t1, mgvec4::blend(m2, u, t2));
+        b1 = mgvec4::blend(m, v, b1);
+        t1 = mgvec4::blend(m, u, t1);
+        prev = cur;
+        cur = next;
+    }
+
+    u = c.newton(t1, step);
+    v = c.distSquare(u);
+    m = mgvec4::vless(v, b1);
+    b1 = mgvec4::blend(m, v, b1);
+    t1 = mgvec4::blend(m, u, t1);
+
+    u = c.newton(t2, step);
+    v = c.distSquare(u);
+    m = mgvec4::vless(v, b1);
+    b1 = mgvec4::blend(m, v, b1);
+    t1 = mgvec4::blend(m, u, t1);
+
+    t1.store(L.t);
+    b1.store(L.d2);
+}
+
+// 点到线段的距离平方
+static float distSquareToLine(const Point2d& a, const Point2d& b, const Point2d& pt)
+{
+    Vector2d ab(b - a), ap(pt - a);
+    float len2 = ab.lengthSquare();
+    float t = len2 > _MGZERO * _MGZERO ? ab.dotProduct(ap) / len2 : 0.f;
+
+    t = t < 0 ? 0 : (t > 1 ? 1 : t);
+    return (ap - ab * t).lengthSquare();
+}
+
+// 点到控制点凸包的距离，在凸包内为0，是曲线段上最近距离的下界
+static float hullDistance(const Point2d* p, const Point2d& pt)
+{
+    static const int tri[4][3] = { {0,1,2}, {0,2,3}, {0,1,3}, {1,2,3} };
+    static const int edge[6][2] = { {0,1}, {1,2}, {2,3}, {3,0}, {0,2}, {1,3} };
+    int i;
+
+    for (i = 0; i < 4; i++) {   // 四个点的凸包为这四个三角形的并集
+        float c1 = (p[tri[i][0]] - pt).crossProduct(p[tri[i][1]] - pt);
+        float c2 = (p[tri[i][1]] - pt).crossProduct(p[tri[i][2]] - pt);
+        float c3 = (p[tri[i][2]] - pt).crossProduct(p[tri[i][0]] - pt);
+        if ((c1 >= 0 && c2 >= 0 && c3 >= 0) || (c1 <= 0 && c2 <= 0 && c3 <= 0))
+            return 0;
+    }
+
+    float d2 = _FLT_MAX;
+    for (i = 0; i < 6; i++) {
+        d2 = mgMin(d2, distSquareToLine(p[edge[i][0]], p[edge[i][1]], pt));
+    }
+    return sqrtf(d2);
+}
+
+// 在原曲线上用双精度牛顿迭代求精，返回是否更近
+static bool polishOnBezier(const Point2d* c, const Point2d& pt, double u,
+                           Point2d& nearpt, float& dist)
+{
+    point_t pts[4], pt2(pt.x, pt.y), p, d1, d2;
+    for (int i = 0; i < 4; i++) {
+        pts[i].x = c[i].x;
+        pts[i].y = c[i].y;
+    }
+    point_t dpts[3], ddpts[2];
+    for (int i = 0; i < 3; i++)
+        dpts[i] = 3.0 * (pts[i+1] - pts[i]);
+    for (int i = 0; i < 2; i++)
+        ddpts[i] = 2.0 * (dpts[i+1] - dpts[i]);
+    
+    for (int it = 0; it < 3; it++) {
+        p = BezierPoint(pts, DEGREE, u, (point_t*)0, (point_t*)0) - pt2;
+        d1 = BezierPoint(dpts, DEGREE - 1, u, (point_t*)0, (point_t*)0);
+        d2 = BezierPoint(ddpts, DEGREE - 2, u, (point_t*)0, (point_t*)0);
+        double df = d1.dotProduct(d1) + p.dotProduct(d2);
+        if (df < 1e-12)
+            break;
+        u -= p.dotProduct(d1) / df;
+        u = u < 0 ? 0 : (u > 1 ? 1 : u);
+    }
+
+    float d = (float)BezierPoint(pts, DEGREE, u, (point_t*)0, (point_t*)0).distanceTo(pt2);
+    if (d < dist) {
+        dist = d;
+        p = BezierPoint(pts, DEGREE, u, (point_t*)0, (point_t*)0);
+        nearpt.set((float)p.x, (float)p.y);
+        return true;
+    }
+    return false;
+}
+
+float mgnear::nearestOnBeziers(const Point2d& pt, int count, const Point2d* points,
+                               float tol, Point2d& nearpt, int& segment)
+{
+    float distMin = _FLT_MAX;
+    float bound = tol;
+    float bestt = 0;
+    BezierLanes lanes;
+    int i;
+
+    segment = -1;
+    if (count < 4 || !points) {
+        return distMin;
+    }
+
+    // 曲线端点在曲线上，其最近距离是上界
+    for (i = 0; i < count; i += 3) {
+        bound = mgMin(bound, pt.distanceTo(points[i]));
+    }
+
+    const mgvec4 ptv(mgvec4::make(pt.x, pt.y, pt.x, pt.y));
+    const mgvec4 zero(mgvec4::splat(0));
+    float gap[4];
+
+    for (i = 0; i + 3 < count || lanes.n > 0; i += 3) {
+        if (i + 3 < count) {
+            // 控制点包络框到给定点的距离下界
+            mgvec4 a(mgvec4::load(&points[i].x));
+            mgvec4 b(mgvec4::load(&points[i + 2].x));
+            mgvec4 lo(mgvec4::vmin(a, b));
+            mgvec4 hi(mgvec4::vmax(a, b));
+            lo = mgvec4::vmin(lo, lo.swapHalves());
+            hi = mgvec4::vmax(hi, hi.swapHalves());
+            mgvec4::vmax(mgvec4::vmax(lo - ptv, ptv - hi), zero).store(gap);
+
+            if (gap[0] > bound || gap[1] > bound
+                || mgHypot(gap[0], gap[1]) > bound
+                || hullDistance(points + i, pt) > bound) {
+                continue;
+            }
+            lanes.add(points + i, pt, i);
+            if (lanes.n < 4) {
+                continue;
+            }
+        }
+
+        nearestOnLanes(lanes);
+        for (int k = 0; k < lanes.n; k++) {
+            float dist = sqrtf(lanes.d2[k]);
+            if (distMin > dist) {
+                distMin = dist;
+                bestt = lanes.t[k];
+                segment = lanes.segs[k];
+                bound = mgMin(bound, dist);
+            }
+        }
+        lanes.n = 0;
+    }
+
+    if (segment >= 0) {
+        const Point2d* c = points + segment;
+        mgcurv::fitBezier(c, bestt, nearpt);
+        distMin = nearpt.distanceTo(pt);
+        polishOnBezier(c, pt, bestt, nearpt, distMin);
+    }
+
+    return distMin;
+}
@@ -3,7 +3,9 @@
 // License: LGPL, https://github.com/rhcad/touchvg
 
 #include "mgpath.h"
+#include "mgmat.h"
 #include "mgcurv.h"
+#include "mgflatten.h"
 #include <vector>
 
 // 返回STL数组(vector)变量的元素个数
@@ -226,8 +228,8 @@ void MgPath::clear()
 
 void MgPath::transform(const Matrix2d& mat)
 {
-    for (unsigned i = 0; i < m_data->points.size(); i++) {
-        m_data->points[i] *= mat;
+    if (!m_data->points.empty()) {
+        mat.transformPoints(getSize(m_data->points), &m_data->points.front());
     }
 }
 
@@ -559,6 +561,12 @@ bool MgPath::genericRoundLines(int count, const Point2d* points,
 #include "mglnrel.h"
 
 bool MgPath::crossWithPath(const MgPath& p, const Box2d& box, Point2d& ptCross) const
+{
+    return crossWithPath(p, box, ptCross, (const MgFlattenBeziers*)0, (const MgFlattenBeziers*)0);
+}
+
+bool MgPath::crossWithPath(const MgPath& p, const Box2d& box, Point2d& ptCross,
+                           const MgFlattenBeziers* flat, const MgFlattenBeziers* pathFlat) const
 {
     if (isLine() && p.isLine()) {
         return (mglnrel::cross2Line(getPoint(0), getPoint(1),
@@ -587,5 +595,22 @@ bool MgPath::crossWithPath(const MgPath& p, const Box2d& box, Point2d& ptCross)
         }
         return mindist < box.width();
     }
+    if (getCount() > 1 && p.getCount() > 1 && MgFlattenBeziers::enabled()) {
+        Box2d rect1(getCount(), getPoints());
+        Box2d rect2(p.getCount(), p.getPoints());
+        float tol = mgMax(mgMin(rect1.width() + rect1.height(),
+                                rect2.width() + rect2.height()) * 1e-3f, _MGZERO);
+        MgFlattenBeziers flat1, flat2;
+        
+        if (!flat) {                                    // 没有图形的折线化缓存才临时计算
+            flat1.setPath(*this, tol);
+            flat = &flat1;
+        }
+        if (!pathFlat) {
+            flat2.setPath(p, tol);
+            pathFlat = &flat2;
+        }
+        return flat->crossWith(*pathFlat, box, ptCross);
+    }
     return false;
 }
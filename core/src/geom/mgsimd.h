@@ -0,0 +1,114 @@
+// mgsimd.h: 几何库内部使用的四路单精度SIMD辅助类型
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+
+#ifndef TOUCHVG_MGSIMD_H
+#define TOUCHVG_MGSIMD_H
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MG_SIMD_SSE
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define MG_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+//! 四个单精度数的矢量，在x86上用SSE、ARM上用NEON实现，否则为普通数组
+/*! 点数组(Point2d)在内存中是 x,y,x,y... 交错排列的，一次可装入两个点。
+ */
+struct mgvec4 {
+#if defined(MG_SIMD_SSE)
+    __m128 v;
+    mgvec4() {}
+    mgvec4(__m128 a) : v(a) {}
+    static mgvec4 load(const float* p) { return _mm_loadu_ps(p); }
+    static mgvec4 splat(float a) { return _mm_set1_ps(a); }
+    static mgvec4 make(float a, float b, float c, float d) { return _mm_setr_ps(a, b, c, d); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+    void storeLow(float* p) const { _mm_storel_pi((__m64*)p, v); }
+    mgvec4 operator+(const mgvec4& b) const { return _mm_add_ps(v, b.v); }
+    mgvec4 operator-(const mgvec4& b) const { return _mm_sub_ps(v, b.v); }
+    mgvec4 operator*(const mgvec4& b) const { return _mm_mul_ps(v, b.v); }
+    mgvec4 operator/(const mgvec4& b) const { return _mm_div_ps(v, b.v); }
+    mgvec4& operator+=(const mgvec4& b) { v = _mm_add_ps(v, b.v); return *this; }
+    static mgvec4 vmin(const mgvec4& a, const mgvec4& b) { return _mm_min_ps(a.v, b.v); }
+    static mgvec4 vmax(const mgvec4& a, const mgvec4& b) { return _mm_max_ps(a.v, b.v); }
+    //! 逐分量比较 a < b，得到供 blend 使用的掩码
+    static mgvec4 vless(const mgvec4& a, const mgvec4& b) { return _mm_cmplt_ps(a.v, b.v); }
+    //! 按掩码逐分量选择，掩码为真取a，否则取b
+    static mgvec4 blend(const mgvec4& mask, const mgvec4& a, const mgvec4& b) {
+        return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); }
+    //! 交换高低两个点: (a,b,c,d) -> (c,d,a,b)
+    mgvec4 swapHalves() const { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)); }
+#elif defined(MG_SIMD_NEON)
+    float32x4_t v;
+    mgvec4() {}
+    mgvec4(float32x4_t a) : v(a) {}
+    static mgvec4 load(const float* p) { return vld1q_f32(p); }
+    static mgvec4 splat(float a) { return vdupq_n_f32(a); }
+    static mgvec4 make(float a, float b, float c, float d) {
+        const float f[4] = { a, b, c, d }; return vld1q_f32(f); }
+    void store(float* p) const { vst1q_f32(p, v); }
+    void storeLow(float* p) const { vst1_f32(p, vget_low_f32(v)); }
+    mgvec4 operator+(const mgvec4& b) const { return vaddq_f32(v, b.v); }
+    mgvec4 operator-(const mgvec4& b) const { return vsubq_f32(v, b.v); }
+    mgvec4 operator*(const mgvec4& b) const { return vmulq_f32(v, b.v); }
+#if defined(__aarch64__)
+    mgvec4 operator/(const mgvec4& b) const { return vdivq_f32(v, b.v); }
+#else
+    mgvec4 operator/(const mgvec4& b) const {       // 倒数估值再迭代两次
+        float32x4_t r = vrecpeq_f32(b.v);
+        r = vmulq_f32(vrecpsq_f32(b.v, r), r);
+        r = vmulq_f32(vrecpsq_f32(b.v, r), r);
+        return vmulq_f32(v, r); }
+#endif
+    mgvec4& operator+=(const mgvec4& b) { v = vaddq_f32(v, b.v); return *this; }
+    static mgvec4 vmin(const mgvec4& a, const mgvec4& b) { return vminq_f32(a.v, b.v); }
+    static mgvec4 vmax(const mgvec4& a, const mgvec4& b) { return vmaxq_f32(a.v, b.v); }
+    static mgvec4 vless(const mgvec4& a, const mgvec4& b) {
+        return vreinterpretq_f32_u32(vcltq_f32(a.v, b.v)); }
+    static mgvec4 blend(const mgvec4& mask, const mgvec4& a, const mgvec4& b) {
+        return vbslq_f32(vreinterpretq_u32_f32(mask.v), a.v, b.v); }
+    mgvec4 swapHalves() const { return vcombine_f32(vget_high_f32(v), vget_low_f32(v)); }
+#else
+    float v[4];
+    mgvec4() {}
+    static mgvec4 load(const float* p) { return make(p[0], p[1], p[2], p[3]); }
+    static mgvec4 splat(float a) { return make(a, a, a, a); }
+    static mgvec4 make(float a, float b, float c, float d) {
+        mgvec4 r; r.v[0] = a; r.v[1] = b; r.v[2] = c; r.v[3] = d; return r; }
+    void store(float* p) const { p[0] = v[0]; p[1] = v[1]; p[2] = v[2]; p[3] = v[3]; }
+    void storeLow(float* p) const { p[0] = v[0]; p[1] = v[1]; }
+    mgvec4 operator+(const mgvec4& b) const {
+        return make(v[0] + b.v[0], v[1] + b.v[1], v[2] + b.v[2], v[3] + b.v[3]); }
+    mgvec4 operator-(const mgvec4& b) const {
+        return make(v[0] - b.v[0], v[1] - b.v[1], v[2] - b.v[2], v[3] - b.v[3]); }
+    mgvec4 operator*(const mgvec4& b) const {
+        return make(v[0] * b.v[0], v[1] * b.v[1], v[2] * b.v[2], v[3] * b.v[3]); }
+    mgvec4 operator/(const mgvec4& b) const {
+        return make(v[0] / b.v[0], v[1] / b.v[1], v[2] / b.v[2], v[3] / b.v[3]); }
+    mgvec4& operator+=(const mgvec4& b) { *this = *this + b; return *this; }
+    static mgvec4 vmin(const mgvec4& a, const mgvec4& b) {
+        return make(a.v[0] < b.v[0] ? a.v[0] : b.v[0], a.v[1] < b.v[1] ? a.v[1] : b.v[1],
+                    a.v[2] < b.v[2] ? a.v[2] : b.v[2], a.v[3] < b.v[3] ? a.v[3] : b.v[3]); }
+    static mgvec4 vmax(const mgvec4& a, const mgvec4& b) {
+        return make(a.v[0] > b.v[0] ? a.v[0] : b.v[0], a.v[1] > b.v[1] ? a.v[1] : b.v[1],
+                    a.v[2] > b.v[2] ? a.v[2] : b.v[2], a.v[3] > b.v[3] ? a.v[3] : b.v[3]); }
+    static mgvec4 vless(const mgvec4& a, const mgvec4& b) {
+        return make(a.v[0] < b.v[0] ? 1.f : 0.f, a.v[1] < b.v[1] ? 1.f : 0.f,
+                    a.v[2] < b.v[2] ? 1.f : 0.f, a.v[3] < b.v[3] ? 1.f : 0.f); }
+    static mgvec4 blend(const mgvec4& mask, const mgvec4& a, const mgvec4& b) {
+        return make(mask.v[0] != 0 ? a.v[0] : b.v[0], mask.v[1] != 0 ? a.v[1] : b.v[1],
+                    mask.v[2] != 0 ? a.v[2] : b.v[2], mask.v[3] != 0 ? a.v[3] : b.v[3]); }
+    mgvec4 swapHalves() const { return make(v[2], v[3], v[0], v[1]); }
+#endif
+
+    //! 取出指定序号的分量
+    float get(int i) const {
+        float f[4];
+        store(f);
+        return f[i];
+    }
+};
+
+#endif // TOUCHVG_MGSIMD_H
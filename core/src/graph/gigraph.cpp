@@ -41,6 +41,7 @@ void GiGraphics::copy(const GiGraphics& src)
         m_impl->maxPenWidth = src.m_impl->maxPenWidth;
         m_impl->drawColors = src.m_impl->drawColors;
         m_impl->xform->copy(src.xf());
+        m_impl->kindZoomTimes = -1;
     }
 }
 
@@ -90,6 +91,7 @@ bool GiGraphics::beginPaint(GiCanvas* canvas, const RECT_2D& clipBox)
     m_impl->rectDrawMaxM = xf().getWndRectM();
     m_impl->rectDrawW = m_impl->rectDrawM * xf().modelToWorld();
     m_impl->rectDrawMaxW = m_impl->rectDrawMaxM * xf().modelToWorld();
+    m_impl->kindZoomTimes = -1;     // 每次绘图重新判断矩阵类型
     
     return true;
 }
@@ -287,6 +289,11 @@ static inline const Matrix2d& S2D(const GiTransform& xf, bool modelUnit)
     return modelUnit ? xf.modelToDisplay() : xf.worldToDisplay();
 }
 
+static inline int S2DKIND(GiGraphicsImpl* p, bool modelUnit)
+{
+    return p->matrixKind(modelUnit);
+}
+
 static inline const Box2d& DRAW_RECT(const GiGraphicsImpl* p, bool modelUnit)
 {
     return modelUnit ? p->rectDrawM : p->rectDrawW;
@@ -428,8 +435,9 @@ bool GiGraphics::drawLines(const GiContext* ctx, int count,
         pxpoints.resize(count);
         Point2d* pxs = &pxpoints.front();
         int n = 0;
+        matD.transformPoints(count, points, pxs, S2DKIND(m_impl, modelUnit));
         for (i = 0; i < count; i++) {
-            pt2 = points[i] * matD;
+            pt2 = pxs[i];
             if (i == 0 || fabsf(pt1.x - pt2.x) > 2 || fabsf(pt1.y - pt2.y) > 2) {
                 pt1 = pt2;
                 pxs[n++] = pt2;
@@ -438,9 +446,8 @@ bool GiGraphics::drawLines(const GiContext* ctx, int count,
         ret = rawLines(ctx, pxs, n);
     } else {                                        // 部分在显示区域内
         pointBuf.resize(count);
-        for (i = 0; i < count; i++)                 // 转换到像素坐标
-            pointBuf[i] = points[i] * matD;
-        Point2d* pts = &pointBuf.front();
+        Point2d* pts = &pointBuf.front();           // 转换到像素坐标
+        matD.transformPoints(count, points, pts, S2DKIND(m_impl, modelUnit));
 
         ptLast = pts[0];
         PolylineAux aux(this, ctx);
@@ -475,21 +482,18 @@ bool GiGraphics::drawBeziers(const GiContext* ctx, int count,
     if (closed) {
         pxpoints.resize(count);
         pxs = &pxpoints.front();
-        for (i = 0; i < count; i++)
-            pxs[i] = points[i] * matD;
+        matD.transformPoints(count, points, pxs, S2DKIND(m_impl, modelUnit));
         ret = rawBeziers(ctx, pxs, count, closed);
     }
     else if (DRAW_MAXR(m_impl, modelUnit).contains(extent)) {   // 全部在显示区域内
         pxpoints.resize(count);
         pxs = &pxpoints.front();
-        for (i = 0; i < count; i++)
-            pxs[i] = points[i] * matD;
+        matD.transformPoints(count, points, pxs, S2DKIND(m_impl, modelUnit));
         ret = rawBeziers(ctx, pxs, count);
     } else {
         pointBuf.resize(count);
-        for (i = 0; i < count; i++)                 // 转换到像素坐标
-            pointBuf[i] = points[i] * matD;
-        Point2d* pts = &pointBuf.front();
+        Point2d* pts = &pointBuf.front();           // 转换到像素坐标
+        matD.transformPoints(count, points, pts, S2DKIND(m_impl, modelUnit));
 
         for (i = 0; i + 3 < count;) {
             for (; i + 3 < count && !m_impl->rectDraw.isIntersect(Box2d(4, &pts[i])); i += 3) ;
@@ -596,7 +600,7 @@ bool GiGraphics::drawArc(const GiContext* ctx,
     Point2d points[16];
     int count = mgcurv::arcToBezier(points, center,
         rx, ry, startAngle, sweepAngle);
-    S2D(xf(), modelUnit).transformPoints(count, points);
+    S2D(xf(), modelUnit).transformPoints(count, points, points, S2DKIND(m_impl, modelUnit));
 
     return count > 3 && rawBeziers(ctx, points, count);
 }
@@ -684,10 +688,10 @@ bool GiGraphics::_drawPolygon(const GiContext* ctx, int count, const Point2d* po
     pxpoints.resize(count);
     Point2d *pxs = &pxpoints.front();
     int n = 0;
+    if (m2d)
+        matD.transformPoints(count, points, pxs, S2DKIND(m_impl, modelUnit));
     for (int i = 0; i < count; i++) {
-        pt2 = points[i];
-        if (m2d)
-            pt2 *= matD;
+        pt2 = m2d ? pxs[i] : points[i];
         if (i == 0 || count <= 4
             || fabsf(pt1.x - pt2.x) > 2
             || fabsf(pt1.y - pt2.y) > 2) {
@@ -780,7 +784,7 @@ bool GiGraphics::drawEllipse(const GiContext* ctx, const Point2d& center,
     } else {
         Point2d pxs[13];
         mgcurv::ellipseToBezier(pxs, center, rx, ry);
-        matD.transformPoints(13, pxs);
+        matD.transformPoints(13, pxs, pxs, S2DKIND(m_impl, modelUnit));
 
         ret = rawBeziers(ctx, pxs, 13, true);
     }
@@ -807,7 +811,7 @@ bool GiGraphics::drawPie(const GiContext* ctx,
         rx, ry, startAngle, sweepAngle);
     if (count < 4)
         return false;
-    S2D(xf(), modelUnit).transformPoints(count, pxs);
+    S2D(xf(), modelUnit).transformPoints(count, pxs, pxs, S2DKIND(m_impl, modelUnit));
     Point2d cen(center * S2D(xf(), modelUnit));
 
     bool ret = rawBeginPath();
@@ -863,7 +867,7 @@ bool GiGraphics::drawRoundRect(const GiContext* ctx,
         Point2d pxs[16];
 
         mgcurv::roundRectToBeziers(pxs, rect, rx, ry);
-        S2D(xf(), modelUnit).transformPoints(16, pxs);
+        S2D(xf(), modelUnit).transformPoints(16, pxs, pxs, S2DKIND(m_impl, modelUnit));
 
         ret = rawBeginPath();
         if (ret) {
@@ -1013,31 +1017,33 @@ bool GiGraphics::drawPath(const GiContext* ctx, const MgPath& path,
     if (n == 0 || isStopping())
         return false;
 
-    Matrix2d matD(S2D(xf(), modelUnit));
-    const Point2d* pts = path.getPoints();
+    vector<Point2d> pxpoints(n);
+    Point2d* pts = &pxpoints.front();
     const char* types = path.getTypes();
     Point2d ends, cp1, cp2;
 
+    S2D(xf(), modelUnit).transformPoints(n, path.getPoints(), pts, S2DKIND(m_impl, modelUnit));
+
     rawBeginPath();
 
     for (int i = 0; i < n; i++) {
         switch (types[i] & ~kMgCloseFigure) {
         case kMgMoveTo:
-            ends = pts[i] * matD;
+            ends = pts[i];
             rawMoveTo(ends.x, ends.y);
             break;
 
         case kMgLineTo:
-            ends = pts[i] * matD;
+            ends = pts[i];
             rawLineTo(ends.x, ends.y);
             break;
 
         case kMgBezierTo:
             if (i + 2 >= n)
                 return false;
-            cp1 = pts[i] * matD;
-            cp2 = pts[i+1] * matD;
-            ends = pts[i+2] * matD;
+            cp1 = pts[i];
+            cp2 = pts[i+1];
+            ends = pts[i+2];
             rawBezierTo(cp1.x, cp1.y, cp2.x, cp2.y, ends.x, ends.y);
             i += 2;
             break;
@@ -1045,8 +1051,8 @@ bool GiGraphics::drawPath(const GiContext* ctx, const MgPath& path,
         case kMgQuadTo:
             if (i + 1 >= n)
                 return false;
-            cp1 = pts[i] * matD;
-            ends = pts[i+1] * matD;
+            cp1 = pts[i];
+            ends = pts[i+1];
             rawQuadTo(cp1.x, cp1.y, ends.x, ends.y);
             i++;
             break;
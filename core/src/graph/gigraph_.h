@@ -36,6 +36,9 @@ public:
     Box2d       rectDrawW;          //!< 剪裁矩形，世界坐标
     Box2d       rectDrawMaxM;       //!< 最大剪裁矩形，模型坐标
     Box2d       rectDrawMaxW;       //!< 最大剪裁矩形，世界坐标
+    int         kindM2D;            //!< 模型坐标到显示坐标的矩阵类型
+    int         kindW2D;            //!< 世界坐标到显示坐标的矩阵类型
+    long        kindZoomTimes;      //!< 计算矩阵类型时的放缩结果改变次数
 
     GiGraphicsImpl(GiTransform* x, bool needFree) : xform(x), needFreeXf(needFree), canvas(NULL)
     {
@@ -47,6 +50,9 @@ public:
         phase = -1;
         maxPenWidth = 100;
         minPenWidth = 1;
+        kindM2D = kMgMatAffine;
+        kindW2D = kMgMatAffine;
+        kindZoomTimes = -1;
     }
 
     ~GiGraphicsImpl()
@@ -66,6 +72,17 @@ public:
         }
     }
 
+    //! 返回到显示坐标的矩阵类型，坐标系改变后(含绘图中途改变模型变换)才重新判断
+    int matrixKind(bool modelUnit)
+    {
+        if (kindZoomTimes != xform->getZoomTimes()) {
+            kindZoomTimes = xform->getZoomTimes();
+            kindM2D = xform->modelToDisplay().kind();
+            kindW2D = xform->worldToDisplay().kind();
+        }
+        return modelUnit ? kindM2D : kindW2D;
+    }
+
 private:
     GiGraphicsImpl();
     void operator=(const GiGraphicsImpl&);
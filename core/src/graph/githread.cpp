@@ -0,0 +1,346 @@
+﻿// githread.cpp: 实现工作线程类 GiThread、事件类 GiEvent、互斥量类 GiMutex 和并行处理函数
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+
+#include "githread.h"
+#include "gilock.h"
+
+#if defined(__WINDOWS__) || defined(WIN32)
+#define GI_WIN32_THREAD
+#include <process.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#endif
+
+// 与 gilock.h 一致，只在有原子操作的平台上使用多线程
+#if defined(_MACOSX) || defined(__APPLE__) || defined(__DARWIN__) \
+    || defined(GI_WIN32_THREAD) || defined(__ANDROID__) || defined(__linux__)
+#define GI_ATOMIC_THREAD
+#endif
+
+//! 传给线程入口函数的参数
+struct GiThreadParam {
+    GiThread::Proc  proc;
+    void*           data;
+};
+
+#ifdef GI_WIN32_THREAD
+static unsigned __stdcall threadEntry(void* p)
+#else
+static void* threadEntry(void* p)
+#endif
+{
+    GiThreadParam param = *(GiThreadParam*)p;
+    delete (GiThreadParam*)p;
+    param.proc(param.data);
+    return 0;
+}
+
+GiThread::GiThread() : _handle(0)
+{
+}
+
+GiThread::~GiThread()
+{
+    join();
+}
+
+bool GiThread::start(Proc proc, void* data)
+{
+    if (_handle || !proc)
+        return false;
+
+    GiThreadParam* param = new GiThreadParam;
+    param->proc = proc;
+    param->data = data;
+
+#ifdef GI_WIN32_THREAD
+    _handle = (void*)_beginthreadex(0, 0, threadEntry, param, 0, 0);
+#else
+    pthread_t* tid = new pthread_t;
+    if (pthread_create(tid, 0, threadEntry, param) == 0) {
+        _handle = tid;
+    } else {
+        delete tid;
+    }
+#endif
+    if (!_handle) {
+        delete param;
+    }
+    return !!_handle;
+}
+
+void GiThread::join()
+{
+    if (_handle) {
+#ifdef GI_WIN32_THREAD
+        WaitForSingleObject((HANDLE)_handle, INFINITE);
+        CloseHandle((HANDLE)_handle);
+#else
+        pthread_join(*(pthread_t*)_handle, 0);
+        delete (pthread_t*)_handle;
+#endif
+        _handle = 0;
+    }
+}
+
+#ifndef GI_WIN32_THREAD
+//! pthread实现的事件数据
+struct GiEventData {
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    bool            signaled;
+};
+#endif
+
+GiEvent::GiEvent()
+{
+#ifdef GI_WIN32_THREAD
+    _handle = CreateEvent(NULL, FALSE, FALSE, NULL);
+#else
+    GiEventData* p = new GiEventData;
+    pthread_mutex_init(&p->mutex, 0);
+    pthread_cond_init(&p->cond, 0);
+    p->signaled = false;
+    _handle = p;
+#endif
+}
+
+GiEvent::~GiEvent()
+{
+#ifdef GI_WIN32_THREAD
+    CloseHandle((HANDLE)_handle);
+#else
+    GiEventData* p = (GiEventData*)_handle;
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->mutex);
+    delete p;
+#endif
+}
+
+void GiEvent::set()
+{
+#ifdef GI_WIN32_THREAD
+    SetEvent((HANDLE)_handle);
+#else
+    GiEventData* p = (GiEventData*)_handle;
+    pthread_mutex_lock(&p->mutex);
+    p->signaled = true;
+    pthread_cond_signal(&p->cond);
+    pthread_mutex_unlock(&p->mutex);
+#endif
+}
+
+bool GiEvent::wait(int ms)
+{
+#ifdef GI_WIN32_THREAD
+    return WaitForSingleObject((HANDLE)_handle, ms < 0 ? INFINITE : (DWORD)ms) == WAIT_OBJECT_0;
+#else
+    GiEventData* p = (GiEventData*)_handle;
+    struct timespec until;
+    int err = 0;
+
+    if (ms >= 0) {
+        struct timeval now;
+        gettimeofday(&now, 0);
+        long nsec = now.tv_usec * 1000L + (ms % 1000) * 1000000L;
+        until.tv_sec = now.tv_sec + ms / 1000 + nsec / 1000000000L;
+        until.tv_nsec = nsec % 1000000000L;
+    }
+    pthread_mutex_lock(&p->mutex);
+    while (!p->signaled && err == 0) {
+        err = ms < 0 ? pthread_cond_wait(&p->cond, &p->mutex)
+            : pthread_cond_timedwait(&p->cond, &p->mutex, &until);
+    }
+    bool ret = p->signaled;
+    p->signaled = false;
+    pthread_mutex_unlock(&p->mutex);
+
+    return ret;
+#endif
+}
+
+GiMutex::GiMutex()
+{
+#ifdef GI_WIN32_THREAD
+    CRITICAL_SECTION* p = new CRITICAL_SECTION;
+    InitializeCriticalSection(p);
+#else
+    pthread_mutex_t* p = new pthread_mutex_t;
+    pthread_mutex_init(p, 0);
+#endif
+    _handle = p;
+}
+
+GiMutex::~GiMutex()
+{
+#ifdef GI_WIN32_THREAD
+    DeleteCriticalSection((CRITICAL_SECTION*)_handle);
+    delete (CRITICAL_SECTION*)_handle;
+#else
+    pthread_mutex_destroy((pthread_mutex_t*)_handle);
+    delete (pthread_mutex_t*)_handle;
+#endif
+}
+
+void GiMutex::lock()
+{
+#ifdef GI_WIN32_THREAD
+    EnterCriticalSection((CRITICAL_SECTION*)_handle);
+#else
+    pthread_mutex_lock((pthread_mutex_t*)_handle);
+#endif
+}
+
+void GiMutex::unlock()
+{
+#ifdef GI_WIN32_THREAD
+    LeaveCriticalSection((CRITICAL_SECTION*)_handle);
+#else
+    pthread_mutex_unlock((pthread_mutex_t*)_handle);
+#endif
+}
+
+int giProcessorCount()
+{
+    static int n = 0;
+
+    if (n < 1) {
+        int count = 1;
+#if defined(GI_ATOMIC_THREAD) && defined(GI_WIN32_THREAD)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        count = (int)info.dwNumberOfProcessors;
+#elif defined(GI_ATOMIC_THREAD) && defined(_SC_NPROCESSORS_ONLN)
+        count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        n = count > 1 ? count : 1;
+    }
+
+    return n;
+}
+
+//! giParallelFor 的共享任务数据，各线程按 next 原子计数领取块
+struct GiParallelTask {
+    GiParallelFunc  func;
+    void*           data;
+    int             count;
+    int             chunk;
+    volatile long   next;
+};
+
+static void runParallelTask(void* p)
+{
+    GiParallelTask* task = (GiParallelTask*)p;
+
+    for (;;) {
+        long i = giAtomicIncrement(&task->next) - 1;
+        if (i >= (task->count + task->chunk - 1) / task->chunk)
+            break;
+        int from = (int)i * task->chunk;
+        int to = from + task->chunk < task->count ? from + task->chunk : task->count;
+        task->func(from, to, task->data);
+    }
+}
+
+static const int kMaxThreads = 16;
+
+//! giParallelFor 的常驻工作线程池，首次并行处理时创建，不析构，进程退出时由系统结束线程
+struct GiParallelPool {
+    struct Worker {
+        GiThread        thread;
+        GiEvent         start;      // 有新任务时设置
+        GiParallelPool* pool;
+    };
+    Worker          workers[kMaxThreads - 1];
+    int             count;          // 已启动的工作线程数
+    GiParallelTask* task;           // 当前任务，在设置 start 前写入
+    volatile long   running;        // 尚未处理完当前任务的工作线程数
+    GiEvent         done;           // 唤醒的工作线程都已处理完当前任务
+};
+
+static GiParallelPool*  _pool = 0;
+static volatile long    _poolBusy = 0;  // 为1时线程池正被某个 giParallelFor 使用
+
+static void poolWorker(void* p)
+{
+    GiParallelPool::Worker* w = (GiParallelPool::Worker*)p;
+
+    for (;;) {
+        w->start.wait();
+        runParallelTask(w->pool->task);
+        if (giAtomicDecrement(&w->pool->running) == 0) {
+            w->pool->done.set();
+        }
+    }
+}
+
+// 在获得 _poolBusy 的线程中调用，因此不需另外加锁
+static GiParallelPool* getParallelPool()
+{
+    if (!_pool) {
+        int n = giProcessorCount();
+        n = n < kMaxThreads ? n : kMaxThreads;
+
+        _pool = new GiParallelPool;
+        _pool->count = 0;
+        _pool->task = 0;
+        _pool->running = 0;
+        for (int i = 0; i < n - 1; i++) {
+            GiParallelPool::Worker& w = _pool->workers[i];
+            w.pool = _pool;
+            if (!w.thread.start(poolWorker, &w))
+                break;
+            _pool->count++;
+        }
+    }
+    return _pool;
+}
+
+void giParallelFor(int count, int minChunk, GiParallelFunc func, void* data)
+{
+    int threads = giProcessorCount();
+
+    if (minChunk < 1)
+        minChunk = 1;
+    if (threads > kMaxThreads)
+        threads = kMaxThreads;
+    if (threads > count / minChunk)
+        threads = count / minChunk;
+
+    // 嵌套调用(在并行回调中调用)或其他线程正在并行处理时，在调用线程中依次处理
+    if (threads < 2 || !giAtomicCompareAndSwap(&_poolBusy, 1, 0)) {
+        if (count > 0)
+            func(0, count, data);
+        return;
+    }
+
+    GiParallelPool* pool = getParallelPool();
+    int workers = threads - 1 < pool->count ? threads - 1 : pool->count;
+
+    if (workers < 1) {
+        giAtomicCompareAndSwap(&_poolBusy, 0, 1);
+        func(0, count, data);
+        return;
+    }
+    threads = workers + 1;
+
+    GiParallelTask task;
+    task.func = func;
+    task.data = data;
+    task.count = count;
+    task.chunk = count / (threads * 4);     // 分得更细以平衡各图形处理时间的差异
+    task.chunk = task.chunk > minChunk ? task.chunk : minChunk;
+    task.next = 0;
+
+    pool->task = &task;
+    pool->running = workers;
+    for (int i = 0; i < workers; i++) {
+        pool->workers[i].start.set();
+    }
+    runParallelTask(&task);
+    pool->done.wait();
+    giAtomicCompareAndSwap(&_poolBusy, 0, 1);
+}
@@ -83,8 +83,7 @@ void MgLine::_update()
 
 void MgLine::_transform(const Matrix2d& mat)
 {
-    _points[0] *= mat;
-    _points[1] *= mat;
+    mat.transformPoints(2, _points);
     __super::_transform(mat);
 }
 
@@ -4,18 +4,87 @@
 
 #include "mglines.h"
 #include "mgshape_.h"
+#include "gilock.h"
+
+//! 共享的只增顶点存储，各图形只读取自己的前 _count 个顶点
+struct MgSharedPoints
+{
+    Point2d*        points;
+    int             capacity;
+    volatile long   count;      // 已占用的顶点数，只有占满的图形才能继续追加
+    volatile long   refcount;
+};
 
 // MgBaseLines
 //
 
-MgBaseLines::MgBaseLines() : _points((Point2d*)0), _maxCount(0), _count(0)
+MgBaseLines::MgBaseLines() : _points((Point2d*)0), _maxCount(0), _count(0), _shared(NULL)
 {
 }
 
 MgBaseLines::~MgBaseLines()
 {
-    if (_points)
+    _releasePoints();
+}
+
+void MgBaseLines::_releasePoints()
+{
+    if (_shared) {
+        if (giAtomicDecrement(&_shared->refcount) == 0) {
+            delete[] _shared->points;
+            delete _shared;
+        }
+        _shared = NULL;
+    }
+    else if (_points) {
         delete[] _points;
+    }
+    _points = (Point2d*)0;
+    _maxCount = 0;
+}
+
+// 共享顶点时改为独占的顶点数组，容量至少为 count 个顶点
+void MgBaseLines::_ownPoints(int count)
+{
+    if (_shared) {
+        int maxCount = (count + 32 - 1) / 32 * 32;
+        Point2d* pts = maxCount > 0 ? new Point2d[maxCount] : (Point2d*)0;
+        
+        for (int i = 0; i < _count && i < count; i++)
+            pts[i] = _points[i];
+        _releasePoints();
+        _points = pts;
+        _maxCount = maxCount;
+    }
+}
+
+bool MgBaseLines::appendPoints(const Point2d* pts, int n)
+{
+    if (!pts || n < 1)
+        return n == 0;
+    
+    // 本图形占满共享存储且有余量时原地追加，否则换为加倍容量的新存储
+    if (!_shared || _count + n > _shared->capacity
+        || !giAtomicCompareAndSwap(&_shared->count, _count + n, _count)) {
+        MgSharedPoints* shared = new MgSharedPoints;
+        
+        shared->capacity = mgMax(32, (_count + n) * 2);
+        shared->points = new Point2d[shared->capacity];
+        shared->count = _count + n;
+        shared->refcount = 1;
+        for (int i = 0; i < _count; i++)
+            shared->points[i] = _points[i];
+        
+        _releasePoints();
+        _shared = shared;
+        _points = shared->points;
+    }
+    for (int i = 0; i < n; i++)
+        _points[_count + i] = pts[i];
+    _count += n;
+    _maxCount = _count;
+    
+    return true;
 }
 
 bool MgBaseLines::_isClosed() const
@@ -37,15 +106,28 @@ Point2d MgBaseLines::_getPoint(int index) const
 void MgBaseLines::_setPoint(int index, const Point2d& pt)
 {
     if (index >= 0 && index < _count) {
+        _ownPoints(_count);
         _points[index] = pt;
     }
 }
 
 void MgBaseLines::_copy(const MgBaseLines& src)
 {
-    resize(src._count);
-    for (int i = 0; i < _count; i++)
-        _points[i] = src._points[i];
+    if (src._shared) {
+        if (_shared != src._shared) {
+            _releasePoints();
+            _shared = src._shared;
+            giAtomicIncrement(&_shared->refcount);
+            _points = _shared->points;
+        }
+        _count = src._count;
+        _maxCount = _count;
+    }
+    else {
+        resize(src._count);
+        for (int i = 0; i < _count; i++)
+            _points[i] = src._points[i];
+    }
 
     __super::_copy(src);
 }
@@ -91,8 +173,8 @@ void MgBaseLines::_update()
 
 void MgBaseLines::_transform(const Matrix2d& mat)
 {
-    for (int i = 0; i < _count; i++)
-        _points[i] *= mat;
+    _ownPoints(_count);
+    mat.transformPoints(_count, _points);
     __super::_transform(mat);
 }
 
@@ -109,6 +191,7 @@ Point2d MgBaseLines::endPoint() const
 
 bool MgBaseLines::resize(int count)
 {
+    _ownPoints(count);
     if (_maxCount < count) {
         _maxCount = (count + 32 - 1) / 32 * 32;
 
@@ -156,6 +239,7 @@ bool MgBaseLines::removePoint(int index)
     bool ret = false;
     
     if (index < _count && _count > 1) {
+        _ownPoints(_count);
         for (int i = index + 1; i < _count; i++)
             _points[i - 1] = _points[i];
         _count--;
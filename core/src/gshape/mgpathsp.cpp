@@ -30,12 +30,14 @@ Point2d MgPathShape::_getPoint(int index) const
 
 void MgPathShape::_setPoint(int index, const Point2d& pt)
 {
+    _flat.clear();
     _path.setPoint(index, pt);
 }
 
 void MgPathShape::_copy(const MgPathShape& src)
 {
     _path.copy(src._path);
+    _flat.clear();
     __super::_copy(src);
 }
 
@@ -53,26 +55,38 @@ bool MgPathShape::_equals(const MgPathShape& src) const
     return true;
 }
 
+// 在此折线化，点击测试等常量函数只读取缓存，不会在多个线程中同时重建
 void MgPathShape::_update()
 {
     _extent.set(_path.getCount(), _path.getPoints());
+    _flat.clear();
+    if (MgFlattenBeziers::enabled() && isCurve()) {
+        _flat.setPath(_path, mgMax((_extent.width() + _extent.height()) * 5e-4f, _MGZERO));
+        _extent = _flat.getExtent();                    // 比控制点的包络框小
+    }
     __super::_update();
 }
 
 void MgPathShape::_transform(const Matrix2d& mat)
 {
-    for (int i = 0; i < _path.getCount(); i++) {
-        _path.setPoint(i, _path.getPoint(i) * mat);
-    }
+    _flat.clear();
+    _path.transform(mat);
     __super::_transform(mat);
 }
 
 void MgPathShape::_clear()
 {
     _path.clear();
+    _flat.clear();
     __super::_clear();
 }
 
+void MgPathShape::_clearCachedData()
+{
+    _flat.clear();
+    __super::_clearCachedData();
+}
+
 bool MgPathShape::_isClosed() const
 {
     return !!(_path.getNodeType(_path.getCount() - 1) & kMgCloseFigure);
@@ -87,8 +101,19 @@ bool MgPathShape::isCurve() const
     return false;
 }
 
+const MgFlattenBeziers* MgPathShape::getFlatten() const
+{
+    return _flat.isValid(0, 0) ? &_flat : (const MgFlattenBeziers*)0;
+}
+
 float MgPathShape::_hitTest(const Point2d& pt, float tol, MgHitResult& res) const
 {
+    if (_flat.isValid(0, tol / 8)) {                    // 折线化缓存足够精确时才用
+        res.dist = _flat.hitTest(pt, tol, res.nearpt, res.segment,
+                                 isClosed() ? &res.inside : (bool*)0);
+        return res.dist;
+    }
+    
     int n = _path.getCount();
     const Point2d* pts = _path.getPoints();
     const char* types = _path.getTypes();
@@ -172,6 +197,8 @@ bool MgPathShape::_hitTestBox(const Box2d& rect) const
 {
     if (!__super::_hitTestBox(rect))
         return false;
+    if (_flat.isValid(0, 0))
+        return _flat.intersectBox(rect);
     
     int n = _path.getCount();
     const Point2d* pts = _path.getPoints();
@@ -61,10 +61,12 @@ void MgBaseRect::_update()
 
 void MgBaseRect::_transform(const Matrix2d& mat)
 {
-    for (int i = 0; i < 4; i++)
-        _points[i] *= mat;
-    Box2d rect(getRect());
-    setRectWithAngle(rect.leftTop(), rect.rightBottom(), getAngle(), rect.center());
+    int kind = mat.kind();
+    mat.transformPoints(4, _points, _points, kind);
+    if (kind > kMgMatTranslate) {   // 平移不改变形状，不必重新规整
+        Box2d rect(getRect());
+        setRectWithAngle(rect.leftTop(), rect.rightBottom(), getAngle(), rect.center());
+    }
     __super::_transform(mat);
 }
 
@@ -4,10 +4,11 @@
 
 #include "mgsplines.h"
 #include "mgshape_.h"
+#include <algorithm>
 
 MG_IMPLEMENT_CREATE(MgSplines)
 
-MgSplines::MgSplines() : _knotvs((Vector2d*)0)
+MgSplines::MgSplines() : _knotvs((Vector2d*)0), _flatKnots(0)
 {
 }
 
@@ -21,6 +22,9 @@ float MgSplines::_hitTest(const Point2d& pt, float tol, MgHitResult& res) const
     if (_count == 2) {
         return mglnrel::ptToLine(_points[0], _points[1], pt, res.nearpt);
     }
+    if (_knotvs && _flat.isValid(0, tol / 8)) {        // 折线化缓存足够精确时才用
+        return _flat.hitTest(pt, tol, res.nearpt, res.segment);
+    }
     if (_knotvs) {
         return mgnear::cubicSplinesHit(_count, _points, _knotvs, isClosed(),
                                        pt, tol, res.nearpt, res.segment, false);
@@ -33,12 +37,20 @@ bool MgSplines::_hitTestBox(const Box2d& rect) const
 {
     if (!__super::_hitTestBox(rect))
         return false;
+    if (_knotvs && _flat.isValid(0, 0)) {
+        return _flat.intersectBox(rect);
+    }
     if (_knotvs) {
         return mgnear::cubicSplinesIntersectBox(rect, _count, _points, _knotvs, isClosed(), false);
     }
     return true;
 }
 
+const MgFlattenBeziers* MgSplines::getFlatten() const
+{
+    return _flat.isValid(0, 0) ? &_flat : (const MgFlattenBeziers*)0;
+}
+
 void MgSplines::_output(MgPath& path) const
 {
     if (_count < 2) {
@@ -78,9 +90,10 @@ void MgSplines::_output(MgPath& path) const
 
 void MgSplines::_copy(const MgSplines& src)
 {
-    __super::_copy(src);    // will clear _knotvs via MgSplines::resize
+    clearVectors();         // 共用顶点存储时不经过 resize
+    __super::_copy(src);
     if (src._knotvs) {
-        _knotvs = new Vector2d[_count];
+        _knotvs = new Vector2d[_maxCount];
         for (int i = 0; i < _count; i++)
             _knotvs[i] = src._knotvs[i];
     }
@@ -101,9 +114,36 @@ bool MgSplines::_equals(const MgSplines& src) const
     return true;
 }
 
+// 在此折线化，点击测试等常量函数只读取缓存，不会在多个线程中同时重建。
+// 随手画时每次只改变末尾的曲线段，前面的折线仍有效且够精确时只折线化改变的曲线段
+void MgSplines::_update()
+{
+    __super::_update();
+    if (_knotvs && _count > 2 && MgFlattenBeziers::enabled()) {
+        const float tol = mgMax((_extent.width() + _extent.height()) * 5e-4f, _MGZERO);
+        
+        if (isClosed() || _flatKnots < 2 || !_flat.isValid(0, tol)
+            || !_flat.appendSplines(_count, _points, _knotvs, _flatKnots - 1, false)) {
+            _flat.setSplines(_count, _points, _knotvs, isClosed(), false, tol);
+        }
+        _flatKnots = _count;
+        _extent = _flat.getExtent();                    // 包含型值点之外凸出的曲线
+    }
+    else {
+        _flat.clear();
+    }
+}
+
+void MgSplines::_clearCachedData()
+{
+    _flat.clear();
+    __super::_clearCachedData();
+}
+
 void MgSplines::_transform(const Matrix2d& mat)
 {
-    if (_knotvs) {
+    _flat.clear();
+    if (_knotvs && mat.kind() > kMgMatTranslate) {  // 平移不改变切矢量
         for (int i = 0; i < _count; i++)
             _knotvs[i] *= mat;
     }
@@ -124,6 +164,7 @@ void MgSplines::_setPoint(int index, const Point2d& pt)
 
 void MgSplines::clearVectors()
 {
+    _flat.clear();
     if (_knotvs) {
         delete[] _knotvs;
         _knotvs = (Vector2d*)0;
@@ -143,7 +184,7 @@ bool MgSplines::_load(MgShapeFactory* factory, MgStorage* s)
 {
     bool ret = __super::_load(factory, s);
     if (ret && _count > 0 && s->readFloatArray("vec") > 0) {
-        _knotvs = new Vector2d[_count];
+        _knotvs = new Vector2d[_maxCount];
         if (s->readFloatArray("vec", (float*)_knotvs, _count * 2) != _count * 2) {
             ret = false;
         }
@@ -158,6 +199,44 @@ bool MgSplines::resize(int count)
     return __super::resize(count);
 }
 
+bool MgSplines::addBezier(const Point2d* pts)
+{
+    bool joined = _count > 0 && _points[_count - 1] == pts[0];
+    int oldCount = _count, oldMax = _maxCount;
+    int valid = _knotvs ? oldCount : 0;             // 之前的曲线段仍不变的型值点数
+    Vector2d* vs = _knotvs;
+    
+    __super::resize(_count + (joined ? 1 : 2));     // 切矢量数组与_points容量相同
+    if (!vs || _maxCount != oldMax) {
+        _knotvs = new Vector2d[_maxCount];
+        for (int i = 0; i < oldCount; i++)
+            _knotvs[i] = vs ? vs[i] : Vector2d();
+        delete[] vs;
+    }
+    if (!joined) {
+        _points[_count - 2] = pts[0];
+        _knotvs[_count - 2] = pts[1] - pts[0];
+    }
+    else if (!vs || _knotvs[_count - 2] == Vector2d()) {  // 共用的型值点原来没有切矢量
+        _knotvs[_count - 2] = pts[1] - pts[0];
+        valid = mgMin(valid, oldCount - 1);         // 其前一段的终止切矢量变了
+    }
+    _points[_count - 1] = pts[3];
+    _knotvs[_count - 1] = pts[3] - pts[2];
+    _flatKnots = mgMin(_flatKnots, valid);
+    
+    return true;
+}
+
+bool MgSplines::trimKnots(int count)
+{
+    if (count < 0 || count > _count)
+        return false;
+    _count = count;
+    _flatKnots = mgMin(_flatKnots, count);
+    return true;
+}
+
 bool MgSplines::addPoint(const Point2d& pt)
 {
     clearVectors();
@@ -176,37 +255,58 @@ bool MgSplines::removePoint(int index)
     return __super::removePoint(index);
 }
 
+bool MgSplines::appendPoints(const Point2d* pts, int n)
+{
+    clearVectors();
+    return __super::appendPoints(pts, n);
+}
+
 bool MgSplines::smooth(const Matrix2d& m2d, float tol)
 {
     return smoothForPoints(_count, _points, m2d, tol) > 0;
 }
 
+struct SmoothHelper {
+    MgSplines*      shape;
+    const Point2d*  points;
+    Matrix2d        m2d;
+    Matrix2d        d2m;
+    
+    static Point2d point(void* data, int i) {       // 在拟合坐标系中取数据点，不另存变换后的点
+        SmoothHelper* p = (SmoothHelper*)data;
+        return p->points[i] * p->m2d;
+    }
+    static void append(void* data, const Point2d curve[4]) {
+        SmoothHelper* p = (SmoothHelper*)data;
+        Point2d pts[4];
+        
+        for (int i = 0; i < 4; i++)
+            pts[i] = curve[i] * p->d2m;
+        p->shape->addBezier(pts);
+    }
+};
+
+// 拟合出的曲线段逐段写入本图形已有的顶点和切矢量数组，容量不足时才重新分配
 int MgSplines::smoothForPoints(int count, const Point2d* points, const Matrix2d& m2d, float tol)
 {
     if (count < 3 || !points || tol < _MGZERO)
         return 0;
     
-    int i, knotCount = count + 1;
-    Point2d* ptx = new Point2d[count];
-    Point2d* knots = new Point2d[knotCount];
-    Vector2d* knotvs = new Vector2d[knotCount];
-    Matrix2d d2m(m2d.inverse());
-    
-    for (i = 0; i < count; i++)
-        ptx[i] = points[i] * m2d;
+    MgSplines src;          // 数据点就是本图形的顶点时先移到此处，拟合结果写回本图形
+    SmoothHelper helper;
     
-    _count = mgcurv::fitCurve(knotCount, knots, knotvs, count, ptx, tol);
-    _maxCount = knotCount;
-    
-    for (i = 0; i < _count; i++) {
-        knots[i] *= d2m;
-        knotvs[i] *= d2m;
+    if (points == _points) {
+        std::swap(_points, src._points);
+        std::swap(_maxCount, src._maxCount);
+        std::swap(_count, src._count);
+        std::swap(_shared, src._shared);
     }
-    delete[] ptx;
-    delete[] _points;
-    _points = knots;
-    delete[] _knotvs;
-    _knotvs = knotvs;
+    trimKnots(0);
+    helper.shape = this;
+    helper.points = points;
+    helper.m2d = m2d;
+    helper.d2m = m2d.inverse();
+    mgcurv::fitCurve4(&SmoothHelper::append, &helper, &SmoothHelper::point, &helper, count, tol);
     update();
     
     return _count;
@@ -0,0 +1,1301 @@
+﻿// mgbinstorage.cpp: 实现二进制序列化类 MgBinStorage
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+
+#include "mgbinstorage.h"
+#include "mgstorage.h"
+#include "mgmapfile.h"
+#include "mglog.h"
+#include "gilock.h"
+#include <vector>
+#include <string>
+#include <map>
+#include <string.h>
+#include "rapidjson/document.h"
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/stringbuffer.h"
+
+using namespace rapidjson;
+
+typedef unsigned char Byte;
+
+// 文件格式，整数和浮点数均为小端字节序:
+//   文件头(16字节): "TVGB", 版本号(32位), 名称表位置(32位), 名称个数(32位)
+//   根节点记录，名称表
+// 记录: 类型(8位，带 kNumbered 时名称有序号), 名称号(16位), [序号(32位)], 内容
+//   kInt/kUInt/kFloat: 32位; kInt64/kDouble: 64位
+//   kString: 字节数(32位), 字节, 零结束符
+//   kFloatArray/kIntArray: 个数(32位), 每个元素32位
+//   kObject/kArray: 内容字节数(32位), 子记录(数组元素的名称号为0，即空名称)
+// 名称表: 每个名称为 长度(16位), 字节, 零结束符
+enum {
+    kNull, kFalse, kTrue, kInt, kUInt, kInt64, kFloat, kDouble,
+    kString, kFloatArray, kIntArray, kObject, kArray,
+    kTagMask = 0x7F, kNumbered = 0x80
+};
+static const Byte kMagic[4] = { 'T', 'V', 'G', 'B' };
+static const unsigned kVersion = 1;
+static const size_t kHeadSize = 16;
+
+static inline unsigned getU16(const Byte* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline unsigned getU32(const Byte* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24);
+}
+
+static inline long long getI64(const Byte* p)
+{
+    return (long long)(getU32(p) | ((unsigned long long)getU32(p + 4) << 32));
+}
+
+static inline float getFloat(const Byte* p)
+{
+    unsigned u = getU32(p);
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+static inline double getDouble(const Byte* p)
+{
+    long long u = getI64(p);
+    double d;
+    memcpy(&d, &u, sizeof(d));
+    return d;
+}
+
+static bool isLittleEndian()
+{
+    const int n = 1;
+    return *(const char*)&n == 1;
+}
+
+//! 将名称拆分为前缀和末尾的序号，例如 shape12 为 shape 和 12
+/*! 没有序号、序号以0开头或超过9位时返回0，len 返回前缀长度。
+ */
+static unsigned splitName(const char* name, unsigned& len)
+{
+    len = name ? (unsigned)strlen(name) : 0;
+
+    unsigned i = len;
+    while (i > 0 && name[i - 1] >= '0' && name[i - 1] <= '9') {
+        i--;
+    }
+    if (i == len || len - i > 9 || name[i] == '0') {
+        return 0;
+    }
+
+    unsigned number = 0;
+    for (unsigned j = i; j < len; j++) {
+        number = number * 10 + (name[j] - '0');
+    }
+    len = i;
+
+    return number;
+}
+
+//! 从二进制内容中解析出的一个记录
+struct MgBinRecord {
+    int         tag;
+    int         nameId;
+    unsigned    number;     // 名称末尾的序号，0表示没有
+    unsigned    count;      // 节点内容字节数、字符串字节数或数组元素个数
+    const Byte* data;       // 内容
+    const Byte* next;       // 下一个记录
+
+    bool parse(const Byte* p, const Byte* end);
+};
+
+bool MgBinRecord::parse(const Byte* p, const Byte* end)
+{
+    if (end - p < 3) {
+        return false;
+    }
+    tag = p[0] & kTagMask;
+    nameId = getU16(p + 1);
+    number = 0;
+    count = 0;
+    if (p[0] & kNumbered) {
+        if (end - p < 7) {
+            return false;
+        }
+        number = getU32(p + 3);
+        p += 4;
+    }
+    p += 3;
+
+    size_t size = 0;
+
+    switch (tag) {
+        case kNull:
+        case kFalse:
+        case kTrue:
+            break;
+        case kInt:
+        case kUInt:
+        case kFloat:
+            size = 4;
+            break;
+        case kInt64:
+        case kDouble:
+            size = 8;
+            break;
+        case kString:
+        case kFloatArray:
+        case kIntArray:
+        case kObject:
+        case kArray:
+            if (end - p < 4) {
+                return false;
+            }
+            count = getU32(p);
+            p += 4;
+            if (tag == kFloatArray || tag == kIntArray) {
+                if ((size_t)(end - p) / 4 < count) {
+                    return false;
+                }
+                size = count * 4;
+            } else {
+                size = tag == kString ? (size_t)count + 1 : count;
+            }
+            break;
+        default:
+            return false;
+    }
+    if ((size_t)(end - p) < size) {
+        return false;
+    }
+    data = p;
+    next = p + size;
+
+    return true;
+}
+
+//! 二进制序列化适配器类，内部实现类
+class MgBinStorage::Impl : public MgStorage
+{
+public:
+    Impl() : _rootData(NULL), _err(NULL), _writing(false), _implicitRoot(false)
+        , _source(NULL), _refcount(1) {}
+    virtual ~Impl() {}
+
+    static void reset(Impl*& impl);
+    void releaseRef() { if (giAtomicDecrement(&_refcount) == 0) delete this; }
+    void clear();
+    bool open(const Byte* data, size_t size);
+    MgStorage* openRead(const Byte* data, size_t size);
+    std::vector<Byte>& buffer() { return _data; }
+    MgMappedFile& file() { return _file; }
+    void startWrite();
+    const Byte* finish(size_t& size);
+    const char* getError() const { return _err; }
+
+    void writeJson(const char* name, const Value& value);
+    template <class Writer> void writeJson(Writer& writer, const MgBinRecord& rec);
+    bool writeJson(FILE* fp, bool pretty);
+
+private:
+    bool readNode(const char* name, int index, bool ended);
+    bool writeNode(const char* name, int index, bool ended);
+    bool setError(const char* err);
+    MgStorage* cloneForRead();
+    void release();
+
+    int readInt(const char* name, int defvalue);
+    bool readBool(const char* name, bool defvalue);
+    float readFloat(const char* name, float defvalue);
+    int readFloatArray(const char* name, float* values, int count, bool report = true);
+    int readString(const char* name, char* value, int count);
+    int readIntArray(const char* name, int* values, int count, bool report = true);
+
+    void writeInt(const char* name, int value);
+    void writeUInt(const char* name, int value);
+    void writeBool(const char* name, bool value);
+    void writeFloat(const char* name, float value);
+    void writeFloatArray(const char* name, const float* values, int count);
+    void writeString(const char* name, const char* value);
+    void writeIntArray(const char* name, const int* values, int count);
+
+private:
+    struct Name {
+        const char* str;
+        unsigned    len;
+    };
+    struct Level {
+        const Byte* begin;
+        const Byte* end;
+        const Byte* cursor;         // 下次查找的起始位置
+        int         cursorIndex;    // 数组中 cursor 处元素的序号
+        bool        isArray;
+    };
+
+    static Level levelOf(const MgBinRecord& rec);
+    bool findRecord(Level& lv, const char* name, MgBinRecord& rec);
+    bool findElement(Level& lv, int index, MgBinRecord& rec);
+    bool findValue(const char* name, MgBinRecord& rec);
+    void getName(const MgBinRecord& rec, std::string& name) const;
+
+    void putU32(unsigned value);
+    void putFloat(float value);
+    void putHead(int tag, const char* name);
+    size_t beginSized();
+    void endSized(size_t pos);
+    void putString(const char* name, const char* value, unsigned len);
+
+private:
+    std::vector<Byte>   _data;          // 写好的内容，或读入的文件内容
+    MgMappedFile        _file;          // loadFile() 映射的文件
+    const Byte*         _rootData;      // 读取时根节点的内容
+    MgBinRecord         _root;
+    std::vector<Name>   _names;         // 读取时的名称表
+    std::vector<Level>  _levels;        // 当前读取的节点栈
+    std::map<std::string, int> _ids;    // 写入时名称对应的名称号
+    std::vector<const std::string*> _idNames;
+    std::vector<size_t> _nodes;         // 写入时各未结束节点的内容字节数的位置
+    const char*         _err;
+    bool                _writing;
+    bool                _implicitRoot;
+    Impl*               _source;        // 由 cloneForRead() 创建时为原对象，内容属于原对象
+    volatile long       _refcount;      // 原对象的引用数，未释放的克隆对象各有一个引用
+};
+
+MgBinStorage::MgBinStorage() : _impl(NULL)
+{
+    _impl = new Impl();
+}
+
+MgBinStorage::~MgBinStorage()
+{
+    _impl->releaseRef();
+}
+
+MgStorage* MgBinStorage::storageForWrite()
+{
+    Impl::reset(_impl);
+    _impl->startWrite();
+    return _impl;
+}
+
+// 复制给定的内容，延迟加载的图形在调用者释放内容后仍可读取几何数据
+MgStorage* MgBinStorage::storageForRead(const void* data, int size)
+{
+    std::vector<Byte> buf;
+
+    if (data && size > 0) {         // 先复制，内容可能是本对象 getData() 返回的
+        buf.assign((const Byte*)data, (const Byte*)data + size);
+    }
+    Impl::reset(_impl);
+    _impl->buffer().swap(buf);
+
+    std::vector<Byte>& content = _impl->buffer();
+    return _impl->openRead(content.empty() ? NULL : &content.front(), content.size());
+}
+
+MgStorage* MgBinStorage::storageForRead(FILE* fp)
+{
+    Impl::reset(_impl);
+
+    std::vector<Byte>& buf = _impl->buffer();
+
+    if (fp) {
+        Byte tmp[16384];
+        size_t n;
+
+        while ((n = fread(tmp, 1, sizeof(tmp), fp)) > 0) {
+            buf.insert(buf.end(), tmp, tmp + n);
+        }
+    }
+
+    return _impl->openRead(buf.empty() ? NULL : &buf.front(), buf.size());
+}
+
+MgStorage* MgBinStorage::loadFile(const char* filename)
+{
+    Impl::reset(_impl);
+
+    MgMappedFile& file = _impl->file();
+
+    if (file.open(filename, false)) {
+        return _impl->openRead((const Byte*)file.data(), file.size());
+    }
+    LOGE("Fail to open file: %s", filename);
+
+    return _impl;
+}
+
+bool MgBinStorage::save(FILE* fp)
+{
+    size_t size = 0;
+    const Byte* data = _impl->finish(size);
+
+    return fp && data && fwrite(data, 1, size, fp) == size;
+}
+
+bool MgBinStorage::saveFile(const char* filename)
+{
+    FILE* fp = mgopenfile(filename, "wb");
+    bool ret = save(fp);
+
+    if (fp) {
+        fclose(fp);
+    }
+    return ret;
+}
+
+const void* MgBinStorage::getData(int& size)
+{
+    size_t n = 0;
+    const Byte* data = _impl->finish(n);
+
+    size = (int)n;
+    return data;
+}
+
+void MgBinStorage::clear()
+{
+    Impl::reset(_impl);
+}
+
+const char* MgBinStorage::getError()
+{
+    return _impl->getError();
+}
+
+bool MgBinStorage::isBinary(const void* data, int size)
+{
+    return data && size >= (int)kHeadSize && memcmp(data, kMagic, sizeof(kMagic)) == 0;
+}
+
+bool MgBinStorage::isBinaryFile(const char* filename)
+{
+    FILE* fp = mgopenfile(filename, "rb");
+    Byte head[kHeadSize];
+    bool ret = fp && fread(head, 1, sizeof(head), fp) == sizeof(head) && isBinary(head, sizeof(head));
+
+    if (fp) {
+        fclose(fp);
+    }
+    return ret;
+}
+
+// 还有克隆对象时保留其内容，改用新的内部对象
+void MgBinStorage::Impl::reset(Impl*& impl)
+{
+    if (impl->_refcount > 1) {
+        impl->releaseRef();
+        impl = new Impl();
+    }
+    else {
+        impl->clear();
+    }
+}
+
+void MgBinStorage::Impl::clear()
+{
+    std::vector<Byte>().swap(_data);
+    _file.close();
+    _names.clear();
+    _levels.clear();
+    _ids.clear();
+    _idNames.clear();
+    _nodes.clear();
+    _rootData = NULL;
+    _err = NULL;
+    _writing = false;
+}
+
+bool MgBinStorage::Impl::setError(const char* err)
+{
+    _err = err;
+    if (err) {
+        LOGE("storage error: %s", err);
+    }
+    return false;
+}
+
+bool MgBinStorage::Impl::open(const Byte* data, size_t size)
+{
+    _names.clear();
+    _levels.clear();
+    _rootData = NULL;
+    _writing = false;
+    _err = NULL;
+
+    if (!MgBinStorage::isBinary(data, (int)size)) {
+        return !!size && setError("not a binary storage");
+    }
+    if (getU32(data + 4) > kVersion) {
+        return setError("unsupported binary storage version");
+    }
+
+    const size_t namesPos = getU32(data + 8);
+    const unsigned count = getU32(data + 12);
+    const Byte* p = data + namesPos;
+    const Byte* end = data + size;
+
+    if (namesPos < kHeadSize || namesPos > size) {
+        return setError("invalid binary storage");
+    }
+    for (unsigned i = 0; i < count; i++) {
+        if (end - p < 3 || (size_t)(end - p) < getU16(p) + 3u || p[2 + getU16(p)] != 0) {
+            _names.clear();
+            return setError("invalid name table");
+        }
+        Name name = { (const char*)p + 2, getU16(p) };
+        _names.push_back(name);
+        p += name.len + 3;
+    }
+    if (!_root.parse(data + kHeadSize, data + namesPos) || _root.tag != kObject) {
+        _names.clear();
+        return setError("invalid root node");
+    }
+    _rootData = data;
+
+    return true;
+}
+
+// 读取本对象拥有的内容，克隆的读取对象和延迟加载的图形持有本对象的引用
+MgStorage* MgBinStorage::Impl::openRead(const Byte* data, size_t size)
+{
+    if (!open(data, size)) {
+        LOGE("binary storage error: %s", getError());
+    }
+    return this;
+}
+
+// 只读取共享的内容，各层的查找位置独立，可在多个线程中同时读取
+MgStorage* MgBinStorage::Impl::cloneForRead()
+{
+    if (_source || !_rootData || _levels.empty()) {
+        return NULL;
+    }
+
+    Impl* p = new Impl();
+    Level lv = _levels.back();
+
+    lv.cursor = lv.begin;
+    lv.cursorIndex = 0;
+    p->_rootData = _rootData;
+    p->_root = _root;
+    p->_names = _names;
+    p->_levels.push_back(lv);
+    p->_source = this;
+    giAtomicIncrement(&_refcount);
+
+    return p;
+}
+
+void MgBinStorage::Impl::release()
+{
+    if (_source) {
+        Impl* source = _source;
+        delete this;
+        source->releaseRef();
+    }
+}
+
+MgBinStorage::Impl::Level MgBinStorage::Impl::levelOf(const MgBinRecord& rec)
+{
+    Level lv;
+
+    lv.begin = rec.data;
+    lv.end = rec.data + rec.count;
+    lv.cursor = lv.begin;
+    lv.cursorIndex = 0;
+    lv.isArray = (rec.tag == kArray);
+
+    return lv;
+}
+
+// 在对象节点中查找记录，从上次找到的记录之后开始查找，到末尾后再从头查找
+bool MgBinStorage::Impl::findRecord(Level& lv, const char* name, MgBinRecord& rec)
+{
+    unsigned len;
+    const unsigned number = splitName(name, len);
+    const Byte* start = lv.cursor < lv.end ? lv.cursor : lv.begin;
+
+    for (int pass = 0; pass < 2; pass++) {
+        const Byte* end = pass ? start : lv.end;
+
+        for (const Byte* p = pass ? lv.begin : start; p < end; p = rec.next) {
+            if (!rec.parse(p, lv.end)) {
+                return setError("invalid binary record");
+            }
+            if (rec.number == number && rec.nameId < (int)_names.size()
+                && _names[rec.nameId].len == len
+                && memcmp(_names[rec.nameId].str, name, len) == 0) {
+                lv.cursor = rec.next;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool MgBinStorage::Impl::findElement(Level& lv, int index, MgBinRecord& rec)
+{
+    if (index < lv.cursorIndex) {
+        lv.cursor = lv.begin;
+        lv.cursorIndex = 0;
+    }
+    for (const Byte* p = lv.cursor; p < lv.end; p = rec.next) {
+        if (!rec.parse(p, lv.end)) {
+            return setError("invalid binary record");
+        }
+        if (lv.cursorIndex++ == index) {
+            lv.cursor = rec.next;
+            return true;
+        }
+    }
+    lv.cursor = lv.end;
+
+    return false;
+}
+
+bool MgBinStorage::Impl::findValue(const char* name, MgBinRecord& rec)
+{
+    return name && !_levels.empty() && !_levels.back().isArray
+        && findRecord(_levels.back(), name, rec);
+}
+
+bool MgBinStorage::Impl::readNode(const char* name, int index, bool ended)
+{
+    if (!_rootData) {
+        return false;
+    }
+    if (!ended) {                       // 开始一个新节点
+        char tmpname[32];
+        MgBinRecord rec;
+
+        if (name && index >= 0) {       // 形成实际节点名称
+#if defined(_MSC_VER) && _MSC_VER >= 1400 // VC8
+            sprintf_s(tmpname, sizeof(tmpname), "%s%d", name, index + 1);
+#else
+            snprintf(tmpname, sizeof(tmpname), "%s%d", name, index + 1);
+#endif
+            name = tmpname;
+        }
+
+        if (_levels.empty()) {
+            if (name && *name) {
+                Level root = levelOf(_root);
+                if (!findRecord(root, name, rec)) {
+                    return false;           // 没有此节点
+                }
+            } else {
+                rec = _root;
+            }
+            _err = NULL;
+        }
+        else {
+            Level &parent = _levels.back();
+            if (parent.isArray ? !findElement(parent, index, rec) : !findRecord(parent, name, rec)) {
+                return false;
+            }
+        }
+        if (rec.tag != kObject && rec.tag != kArray) {
+            return false;
+        }
+        _levels.push_back(levelOf(rec));
+    }
+    else {                              // 当前节点读取完成
+        if (!_levels.empty()) {
+            _levels.pop_back();
+        }
+        if (_levels.empty() && _refcount == 1) {    // 根节点已出栈，且没有克隆对象
+            clear();
+        }
+    }
+
+    return true;
+}
+
+static bool toInt(const MgBinRecord& rec, int& value)
+{
+    switch (rec.tag) {
+        case kFalse:
+        case kTrue:
+            value = rec.tag == kTrue ? 1 : 0;
+            return true;
+        case kInt:
+        case kUInt:
+            value = (int)getU32(rec.data);
+            return true;
+        case kInt64:
+            value = (int)getI64(rec.data);
+            return true;
+        case kFloat:                    // 在JSON中没有小数部分的浮点数也可读为整数
+            value = (int)getFloat(rec.data);
+            return (float)value == getFloat(rec.data);
+        case kDouble:
+            value = (int)getDouble(rec.data);
+            return (double)value == getDouble(rec.data);
+        case kString:
+            return MgJsonStorage::parseInt((const char*)rec.data, value);
+    }
+    return false;
+}
+
+static bool toFloat(const MgBinRecord& rec, float& value)
+{
+    switch (rec.tag) {
+        case kInt:
+            value = (float)(int)getU32(rec.data);
+            return true;
+        case kUInt:
+            value = (float)getU32(rec.data);
+            return true;
+        case kInt64:
+            value = (float)getI64(rec.data);
+            return true;
+        case kFloat:
+            value = getFloat(rec.data);
+            return true;
+        case kDouble:
+            value = (float)getDouble(rec.data);
+            return true;
+        case kString:
+            return MgJsonStorage::parseFloat((const char*)rec.data, value);
+    }
+    return false;
+}
+
+int MgBinStorage::Impl::readInt(const char* name, int defvalue)
+{
+    MgBinRecord rec;
+    int ret = defvalue;
+
+    if (findValue(name, rec) && !toInt(rec, ret)) {
+        LOGD("Invalid value for readInt(%s)", name);
+        ret = defvalue;
+    }
+    return ret;
+}
+
+bool MgBinStorage::Impl::readBool(const char* name, bool defvalue)
+{
+    return !!readInt(name, defvalue ? 1 : 0);
+}
+
+float MgBinStorage::Impl::readFloat(const char* name, float defvalue)
+{
+    MgBinRecord rec;
+    float ret = defvalue;
+
+    if (findValue(name, rec) && !toFloat(rec, ret)) {
+        LOGD("Invalid value for readFloat(%s)", name);
+        ret = defvalue;
+    }
+    return ret;
+}
+
+int MgBinStorage::Impl::readFloatArray(const char* name, float* values, int count, bool report)
+{
+    MgBinRecord rec;
+    int ret = 0;
+
+    report = report && count > 0 && values;
+    if (findValue(name, rec)) {
+        if (rec.tag == kFloatArray || rec.tag == kIntArray) {
+            ret = (int)rec.count;
+            if (values) {
+                int n = ret < count ? ret : count;
+                if (rec.tag == kFloatArray && isLittleEndian()) {
+                    memcpy(values, rec.data, n * sizeof(float));
+                } else {
+                    for (int i = 0; i < n; i++) {
+                        values[i] = (rec.tag == kFloatArray ? getFloat(rec.data + i * 4)
+                                     : (float)(int)getU32(rec.data + i * 4));
+                    }
+                }
+                ret = n;
+            }
+        }
+        else if (rec.tag == kArray) {
+            MgBinRecord item;
+            int i = 0;
+            for (const Byte* p = rec.data; p < rec.data + rec.count
+                 && (!values || i < count) && item.parse(p, rec.data + rec.count); p = item.next, i++) {
+                if (values && toFloat(item, values[ret])) {
+                    ret++;
+                } else if (report) {
+                    LOGD("Invalid value for readFloatArray(%s)", name);
+                }
+            }
+            ret = values ? ret : i;
+        }
+        else if (report) {
+            LOGD("Invalid value for readFloatArray(%s)", name);
+        }
+    }
+    if (values && ret < count && report) {
+        LOGD("readFloatArray(%s, %d): %d", name, count, ret);
+        setError("readFloatArray: lose numbers");
+    }
+
+    return ret;
+}
+
+int MgBinStorage::Impl::readIntArray(const char* name, int* values, int count, bool report)
+{
+    MgBinRecord rec;
+    int ret = 0;
+
+    report = report && count > 0 && values;
+    if (findValue(name, rec)) {
+        if (rec.tag == kFloatArray || rec.tag == kIntArray) {
+            ret = (int)rec.count;
+            if (values) {
+                MgBinRecord item;
+                int n = ret < count ? ret : count;
+
+                item.tag = rec.tag == kFloatArray ? kFloat : kInt;
+                ret = 0;
+                for (int i = 0; i < n; i++) {
+                    item.data = rec.data + i * 4;
+                    if (toInt(item, values[ret])) {     // 浮点数组中只取整数值
+                        ret++;
+                    } else if (report) {
+                        LOGD("Invalid value for readIntArray(%s)", name);
+                    }
+                }
+            }
+        }
+        else if (rec.tag == kArray) {
+            MgBinRecord item;
+            int i = 0;
+            for (const Byte* p = rec.data; p < rec.data + rec.count
+                 && (!values || i < count) && item.parse(p, rec.data + rec.count); p = item.next, i++) {
+                if (values && toInt(item, values[ret])) {
+                    ret++;
+                } else if (report) {
+                    LOGD("Invalid value for readIntArray(%s)", name);
+                }
+            }
+            ret = values ? ret : i;
+        }
+        else if (report) {
+            LOGD("Invalid value for readIntArray(%s)", name);
+        }
+    }
+    if (values && ret < count && report) {
+        LOGD("readIntArray(%s, %d): %d", name, count, ret);
+        setError("readIntArray: lose numbers");
+    }
+
+    return ret;
+}
+
+int MgBinStorage::Impl::readString(const char* name, char* value, int count)
+{
+    MgBinRecord rec;
+    int ret = 0;
+
+    if (findValue(name, rec)) {
+        if (rec.tag == kString) {
+            ret = (int)rec.count;
+            if (value) {
+                ret = ret < count ? ret : count;
+                memcpy(value, rec.data, ret);
+            }
+        }
+        else {
+            LOGD("Invalid value for readString(%s)", name);
+        }
+    }
+    if (value) {
+        value[ret] = 0;
+    }
+
+    return ret;
+}
+
+void MgBinStorage::Impl::startWrite()
+{
+    _data.assign(kHeadSize, 0);
+    _writing = true;
+    _implicitRoot = false;
+    _err = NULL;
+}
+
+const Byte* MgBinStorage::Impl::finish(size_t& size)
+{
+    if (_writing) {
+        while (!_nodes.empty()) {
+            writeNode(NULL, -1, true);
+        }
+        _writing = false;
+        if (_data.size() <= kHeadSize) {
+            _data.clear();
+        } else {
+            const size_t namesPos = _data.size();
+
+            for (size_t i = 0; i < _idNames.size(); i++) {
+                const std::string& name = *_idNames[i];
+                _data.push_back((Byte)(name.size() & 0xFF));
+                _data.push_back((Byte)(name.size() >> 8));
+                _data.insert(_data.end(), name.begin(), name.end());
+                _data.push_back(0);
+            }
+
+            const unsigned head[] = { kVersion, (unsigned)namesPos, (unsigned)_idNames.size() };
+            memcpy(&_data[0], kMagic, sizeof(kMagic));
+            for (int i = 0; i < 3; i++) {
+                for (int j = 0; j < 4; j++) {
+                    _data[4 + i * 4 + j] = (Byte)(head[i] >> (j * 8));
+                }
+            }
+        }
+    }
+    size = _rootData ? 0 : _data.size();
+
+    return size > 0 ? &_data.front() : NULL;
+}
+
+void MgBinStorage::Impl::putU32(unsigned value)
+{
+    const Byte bytes[] = { (Byte)value, (Byte)(value >> 8), (Byte)(value >> 16), (Byte)(value >> 24) };
+    _data.insert(_data.end(), bytes, bytes + 4);
+}
+
+void MgBinStorage::Impl::putFloat(float value)
+{
+    unsigned u;
+    memcpy(&u, &value, sizeof(u));
+    putU32(u);
+}
+
+void MgBinStorage::Impl::putHead(int tag, const char* name)
+{
+    unsigned len;
+    const unsigned number = splitName(name, len);
+    std::string prefix(name ? name : "", len);
+    std::map<std::string, int>::iterator it = _ids.find(prefix);
+
+    if (it == _ids.end()) {
+        if (_idNames.size() > 0xFFFF) {
+            setError("too many names for binary storage");
+        }
+        it = _ids.insert(std::make_pair(prefix, (int)_idNames.size())).first;
+        _idNames.push_back(&it->first);
+    }
+
+    _data.push_back((Byte)(tag | (number ? kNumbered : 0)));
+    _data.push_back((Byte)(it->second & 0xFF));
+    _data.push_back((Byte)(it->second >> 8));
+    if (number) {
+        putU32(number);
+    }
+}
+
+size_t MgBinStorage::Impl::beginSized()
+{
+    _data.resize(_data.size() + 4);
+    return _data.size() - 4;
+}
+
+void MgBinStorage::Impl::endSized(size_t pos)
+{
+    const size_t size = _data.size() - pos - 4;
+
+    for (int j = 0; j < 4; j++) {
+        _data[pos + j] = (Byte)(size >> (j * 8));
+    }
+}
+
+bool MgBinStorage::Impl::writeNode(const char* name, int index, bool ended)
+{
+    if (!_writing) {
+        return false;
+    }
+    if (!ended) {                       // 开始一个新节点
+        char tmpname[32];
+        if (index >= 0) {               // 形成实际节点名称
+#if defined(_MSC_VER) && _MSC_VER >= 1400 // VC8
+            sprintf_s(tmpname, sizeof(tmpname), "%s%d", name, index + 1);
+#else
+            snprintf(tmpname, sizeof(tmpname), "%s%d", name, index + 1);
+#endif
+            name = tmpname;
+        }
+        if (_nodes.empty()) {
+            if (_data.size() > kHeadSize) {
+                return false;           // 只能写一个根节点
+            }
+            _implicitRoot = name && *name;
+            if (_implicitRoot) {        // 根节点有名称，作为匿名对象的成员
+                putHead(kObject, "");
+                _nodes.push_back(beginSized());
+            }
+        }
+        putHead(kObject, name);
+        _nodes.push_back(beginSized());
+    }
+    else if (!_nodes.empty()) {         // 当前节点写完
+        endSized(_nodes.back());
+        _nodes.pop_back();
+        if (_nodes.size() == 1 && _implicitRoot) {
+            endSized(_nodes.back());
+            _nodes.pop_back();
+        }
+    }
+
+    return true;
+}
+
+void MgBinStorage::Impl::writeInt(const char* name, int value)
+{
+    if (!_nodes.empty()) {
+        putHead(kInt, name);
+        putU32((unsigned)value);
+    }
+}
+
+void MgBinStorage::Impl::writeUInt(const char* name, int value)
+{
+    if (!_nodes.empty()) {
+        putHead(kUInt, name);
+        putU32((unsigned)value);
+    }
+}
+
+void MgBinStorage::Impl::writeBool(const char* name, bool value)
+{
+    if (!_nodes.empty()) {
+        putHead(value ? kTrue : kFalse, name);
+    }
+}
+
+void MgBinStorage::Impl::writeFloat(const char* name, float value)
+{
+    if (!_nodes.empty()) {
+        putHead(kFloat, name);
+        putFloat(value);
+    }
+}
+
+void MgBinStorage::Impl::writeFloatArray(const char* name, const float* values, int count)
+{
+    if (!_nodes.empty()) {
+        count = values && count > 0 ? count : 0;
+        putHead(kFloatArray, name);
+        putU32(count);
+        if (isLittleEndian() && count > 0) {
+            const Byte* p = (const Byte*)values;
+            _data.insert(_data.end(), p, p + count * sizeof(float));
+        } else {
+            for (int i = 0; i < count; i++) {
+                putFloat(values[i]);
+            }
+        }
+    }
+}
+
+void MgBinStorage::Impl::writeIntArray(const char* name, const int* values, int count)
+{
+    if (!_nodes.empty()) {
+        count = values && count > 0 ? count : 0;
+        putHead(kIntArray, name);
+        putU32(count);
+        for (int i = 0; i < count; i++) {
+            putU32((unsigned)values[i]);
+        }
+    }
+}
+
+void MgBinStorage::Impl::putString(const char* name, const char* value, unsigned len)
+{
+    putHead(kString, name);
+    putU32(len);
+    _data.insert(_data.end(), (const Byte*)value, (const Byte*)value + len);
+    _data.push_back(0);
+}
+
+void MgBinStorage::Impl::writeString(const char* name, const char* value)
+{
+    if (!_nodes.empty()) {
+        value = value ? value : "";
+        putString(name, value, (unsigned)strlen(value));
+    }
+}
+
+// JSON与二进制格式的转换
+
+//! 非整数的数值转为浮点数保存后，按JSON格式输出的文本是否不变，整数按整数保存
+static bool isFloatText(const Value& v)
+{
+    if (v.IsDouble()) {
+        char text1[32], text2[32];
+#if defined(_MSC_VER) && _MSC_VER >= 1400 // VC8
+        sprintf_s(text1, sizeof(text1), "%g", v.GetDouble());
+        sprintf_s(text2, sizeof(text2), "%g", (double)(float)v.GetDouble());
+#else
+        snprintf(text1, sizeof(text1), "%g", v.GetDouble());
+        snprintf(text2, sizeof(text2), "%g", (double)(float)v.GetDouble());
+#endif
+        return strcmp(text1, text2) == 0;
+    }
+    return false;
+}
+
+//! 能否保存在浮点数组中：文本不变的浮点数，或输出文本不变的小整数(如 [1, 2.5] 中的1)
+static bool isFloatItem(const Value& v)
+{
+    if (v.IsInt()) {
+        return v.GetInt() > -1000000 && v.GetInt() < 1000000;
+    }
+    return isFloatText(v);
+}
+
+void MgBinStorage::Impl::writeJson(const char* name, const Value& value)
+{
+    switch (value.GetType()) {
+        case kNullType:
+            putHead(kNull, name);
+            break;
+        case kFalseType:
+        case kTrueType:
+            putHead(value.IsTrue() ? kTrue : kFalse, name);
+            break;
+        case kObjectType: {
+            putHead(kObject, name);
+            size_t pos = beginSized();
+            for (Value::ConstMemberIterator it = value.MemberBegin(); it != value.MemberEnd(); ++it) {
+                writeJson(it->name.GetString(), it->value);
+            }
+            endSized(pos);
+            break;
+        }
+        case kArrayType: {
+            bool floats = true, ints = true;
+            for (SizeType i = 0; i < value.Size(); i++) {
+                floats = floats && isFloatItem(value[i]);
+                ints = ints && value[i].IsInt();
+            }
+            if (floats || ints) {               // 全为整数时按整数数组保存
+                putHead(ints ? kIntArray : kFloatArray, name);
+                putU32(value.Size());
+                for (SizeType i = 0; i < value.Size(); i++) {
+                    if (ints) {
+                        putU32((unsigned)value[i].GetInt());
+                    } else {
+                        putFloat(value[i].IsInt() ? (float)value[i].GetInt() : (float)value[i].GetDouble());
+                    }
+                }
+            } else {
+                putHead(kArray, name);
+                size_t pos = beginSized();
+                for (SizeType i = 0; i < value.Size(); i++) {
+                    writeJson("", value[i]);
+                }
+                endSized(pos);
+            }
+            break;
+        }
+        case kStringType:
+            putString(name, value.GetString(), value.GetStringLength());
+            break;
+        case kNumberType:
+            if (value.IsInt()) {
+                putHead(kInt, name);
+                putU32((unsigned)value.GetInt());
+            }
+            else if (value.IsInt64()) {
+                long long v = value.GetInt64();
+                putHead(kInt64, name);
+                putU32((unsigned)v);
+                putU32((unsigned)((unsigned long long)v >> 32));
+            }
+            else if (isFloatText(value)) {  // 不能用 writeFloat，转换时没有 _nodes
+                putHead(kFloat, name);
+                putFloat((float)value.GetDouble());
+            }
+            else {
+                double d = value.GetDouble();
+                unsigned u[2];
+                memcpy(u, &d, sizeof(d));
+                putHead(kDouble, name);
+                putU32(isLittleEndian() ? u[0] : u[1]);
+                putU32(isLittleEndian() ? u[1] : u[0]);
+            }
+            break;
+    }
+}
+
+void MgBinStorage::Impl::getName(const MgBinRecord& rec, std::string& name) const
+{
+    name.clear();
+    if (rec.nameId < (int)_names.size()) {
+        name.append(_names[rec.nameId].str, _names[rec.nameId].len);
+    }
+    if (rec.number) {
+        char buf[16];
+#if defined(_MSC_VER) && _MSC_VER >= 1400 // VC8
+        sprintf_s(buf, sizeof(buf), "%u", rec.number);
+#else
+        snprintf(buf, sizeof(buf), "%u", rec.number);
+#endif
+        name += buf;
+    }
+}
+
+template <class Writer>
+void MgBinStorage::Impl::writeJson(Writer& writer, const MgBinRecord& rec)
+{
+    MgBinRecord item;
+    std::string name;
+    unsigned value;
+    char buf[20];
+
+    switch (rec.tag) {
+        case kNull:
+            writer.Null();
+            break;
+        case kFalse:
+        case kTrue:
+            writer.Bool(rec.tag == kTrue);
+            break;
+        case kInt:
+            writer.Int((int)getU32(rec.data));
+            break;
+        case kUInt:                     // 与 MgJsonStorage 的 writeUInt 结果相同
+            value = getU32(rec.data);
+            if (value <= 0xFF) {
+                writer.Int((int)value);
+            } else {
+#if defined(_MSC_VER) && _MSC_VER >= 1400 // VC8
+                sprintf_s(buf, sizeof(buf), "0x%x", value);
+#else
+                snprintf(buf, sizeof(buf), "0x%x", value);
+#endif
+                writer.String(buf, (SizeType)strlen(buf));
+            }
+            break;
+        case kInt64:
+            writer.Int64(getI64(rec.data));
+            break;
+        case kFloat:
+            writer.Double((double)getFloat(rec.data));
+            break;
+        case kDouble:
+            writer.Double(getDouble(rec.data));
+            break;
+        case kString:
+            writer.String((const char*)rec.data, rec.count);
+            break;
+        case kFloatArray:
+        case kIntArray:
+            writer.StartArray();
+            for (unsigned i = 0; i < rec.count; i++) {
+                if (rec.tag == kFloatArray) {
+                    writer.Double((double)getFloat(rec.data + i * 4));
+                } else {
+                    writer.Int((int)getU32(rec.data + i * 4));
+                }
+            }
+            writer.EndArray();
+            break;
+        case kObject:
+        case kArray:
+            if (rec.tag == kObject) {
+                writer.StartObject();
+            } else {
+                writer.StartArray();
+            }
+            for (const Byte* p = rec.data; p < rec.data + rec.count; p = item.next) {
+                if (!item.parse(p, rec.data + rec.count)) {
+                    setError("invalid binary record");
+                    break;
+                }
+                if (rec.tag == kObject) {
+                    getName(item, name);
+                    writer.String(name.c_str(), (SizeType)name.size());
+                }
+                writeJson(writer, item);
+            }
+            if (rec.tag == kObject) {
+                writer.EndObject();
+            } else {
+                writer.EndArray();
+            }
+            break;
+    }
+}
+
+bool MgBinStorage::Impl::writeJson(FILE* fp, bool pretty)
+{
+    if (!_rootData) {
+        return false;
+    }
+
+    StringBuffer buf;
+    Document::AllocatorType allocator;
+
+    if (pretty) {
+        PrettyWriter<StringBuffer> writer(buf, &allocator);
+        writeJson(writer, _root);
+    } else {
+        Writer<StringBuffer> writer(buf, &allocator);
+        writeJson(writer, _root);
+    }
+
+    return !_err && fwrite(buf.GetString(), 1, buf.Size(), fp) == buf.Size();
+}
+
+bool MgBinStorage::jsonToBinary(const char* jsonfile, const char* binfile)
+{
+    FILE* fp = mgopenfile(jsonfile, "rt");
+    std::string content;
+
+    if (!fp) {
+        LOGE("Fail to open file: %s", jsonfile);
+        return false;
+    }
+
+    char tmp[16384];
+    size_t n;
+    while ((n = fread(tmp, 1, sizeof(tmp), fp)) > 0) {
+        content.append(tmp, n);
+    }
+    fclose(fp);
+
+    Document doc;
+    const char* text = content.c_str();
+
+    if (content.compare(0, 3, "\xEF\xBB\xBF") == 0) {   // 跳过UTF-8 BOM
+        text += 3;
+    }
+    doc.Parse<0>(text);
+    if (doc.HasParseError() || !doc.IsObject()) {
+        LOGE("parse error: %s", doc.HasParseError() ? doc.GetParseError() : "not object");
+        return false;
+    }
+
+    MgBinStorage bs;
+    bs._impl->startWrite();
+    bs._impl->writeJson("", doc);
+
+    return bs.saveFile(binfile);
+}
+
+bool MgBinStorage::binaryToJson(const char* binfile, const char* jsonfile, bool pretty)
+{
+    MgBinStorage bs;
+    bs.loadFile(binfile);
+    if (bs.getError()) {
+        return false;
+    }
+
+    FILE* fp = mgopenfile(jsonfile, "wt");
+    bool ret = fp && bs._impl->writeJson(fp, pretty);
+
+    if (fp) {
+        fclose(fp);
+    }
+    return ret;
+}
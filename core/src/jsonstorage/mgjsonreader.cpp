@@ -0,0 +1,561 @@
+﻿// mgjsonreader.cpp: 实现边解析边读取的JSON存取类 MgJsonStreamReader
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+
+#include "mgjsonreader.h"
+#include "mglog.h"
+#include "rapidjson/reader.h"
+#include <string.h>
+
+using namespace rapidjson;
+
+typedef MemoryPoolAllocator<> JsonAllocator;
+
+//! 带缓冲的输入源，可为文件或内存中的JSON内容
+class MgJsonSource
+{
+public:
+    MgJsonSource() : _fp(NULL), _start(NULL), _pos(NULL), _end(NULL), _offset(0) {}
+
+    void open(FILE* fp) {
+        _fp = fp;
+        _start = _pos = _end = _buf;
+        _offset = 0;
+    }
+    void open(const char* content) {
+        _fp = NULL;
+        _start = _pos = content;
+        _end = content + strlen(content);
+        _offset = 0;
+    }
+    void close() {
+        _fp = NULL;
+        _start = _pos = _end = NULL;
+    }
+
+    char peek() { return (_pos < _end || fill()) ? *_pos : '\0'; }
+    char take() { char c = peek(); if (c) _pos++; return c; }
+    size_t tell() const { return _offset + (_pos - _start); }
+
+private:
+    bool fill() {
+        if (!_fp)
+            return false;
+        _offset += _end - _start;
+        _start = _pos = _buf;
+        _end = _buf + fread(_buf, 1, sizeof(_buf), _fp);
+        return _pos < _end;
+    }
+
+    FILE*       _fp;
+    const char* _start;
+    const char* _pos;
+    const char* _end;
+    size_t      _offset;
+    char        _buf[16384];
+};
+
+//! 供 rapidjson::Reader 解析单个值的输入流
+/*! Reader 要求根节点为对象或数组，且其后不能有其他内容，因此在值的前后补上[和]，
+    值解析完成(phase为2)后不再从输入源取字符。复制后的流共用同一状态。
+ */
+struct MgJsonValueStream
+{
+    typedef char Ch;
+
+    MgJsonSource*   src;
+    int*            phase;      // 0:未读[，1:正读取值，2:值已完整待读]，3:结束
+
+    Ch Peek() const {
+        switch (*phase) {
+            case 0: return '[';
+            case 1: return src->peek();
+            case 2: return ']';
+        }
+        return '\0';
+    }
+    Ch Take() {
+        switch (*phase) {
+            case 0: *phase = 1; return '[';
+            case 1: return src->take();
+            case 2: *phase = 3; return ']';
+        }
+        return '\0';
+    }
+    size_t Tell() const { return src->tell(); }
+    void Put(Ch) {}
+    Ch* PutBegin() { return 0; }
+    size_t PutEnd(Ch*) { return 0; }
+};
+
+//! 接收SAX事件构建单个值的DOM子树，没有分配器时只跳过该值
+class MgJsonValueBuilder
+{
+public:
+    int     phase;
+    Reader  reader;
+
+    void begin(Value* out, JsonAllocator* alloc, std::string* str) {
+        _out = out;
+        _alloc = out ? alloc : NULL;
+        _str = str;
+        _depth = 0;
+        _stack.clear();
+        _expectKey.clear();
+        phase = 0;
+    }
+
+    void Null() { Value v; add(v, false); }
+    void Bool(bool b) { Value v(b); add(v, false); }
+    void Int(int i) { Value v(i); add(v, false); }
+    void Uint(unsigned u) { Value v(u); add(v, false); }
+    void Int64(int64_t i) { Value v(i); add(v, false); }
+    void Uint64(uint64_t u) { Value v(u); add(v, false); }
+    void Double(double d) { Value v(d); add(v, false); }
+
+    void String(const char* s, SizeType len, bool) {
+        if (_depth == 1 && _str) {
+            _str->assign(s, len);
+        }
+        if (_alloc && !_stack.empty() && _expectKey.back()) {
+            _key.SetString(s, len, *_alloc);
+            _expectKey.back() = false;
+            return;
+        }
+        Value v;
+        if (_alloc) {
+            v.SetString(s, len, *_alloc);
+        }
+        add(v, false);
+    }
+
+    void StartObject() { Value v(kObjectType); add(v, true); }
+    void EndObject(SizeType) { end(); }
+    void StartArray() {
+        if (_depth == 0) {      // 补上的数组
+            _depth = 1;
+            return;
+        }
+        Value v(kArrayType);
+        add(v, true);
+    }
+    void EndArray(SizeType) { end(); }
+
+private:
+    void add(Value& v, bool container) {
+        if (_alloc) {
+            Value* dst;
+
+            if (_depth == 1) {
+                *_out = v;
+                dst = _out;
+            }
+            else if (_stack.back()->IsArray()) {
+                _stack.back()->PushBack(v, *_alloc);
+                dst = _stack.back()->End() - 1;
+            }
+            else {
+                _stack.back()->AddMember(_key, v, *_alloc);
+                dst = &(_stack.back()->MemberEnd() - 1)->value;
+                _expectKey.back() = true;
+            }
+            if (container) {
+                _stack.push_back(dst);
+                _expectKey.push_back(dst->IsObject());
+            }
+        }
+        if (container) {
+            _depth++;
+        }
+        else if (_depth == 1) {
+            phase = 2;
+        }
+    }
+
+    void end() {
+        if (--_depth == 0)      // 补上的数组结束
+            return;
+        if (_alloc) {
+            _stack.pop_back();
+            _expectKey.pop_back();
+        }
+        if (_depth == 1) {
+            phase = 2;
+        }
+    }
+
+    Value*              _out;
+    JsonAllocator*      _alloc;
+    std::string*        _str;
+    int                 _depth;
+    std::vector<Value*> _stack;
+    std::vector<bool>   _expectKey;
+    Value               _key;
+};
+
+//! 读取中的节点
+struct MgJsonStreamReader::Level
+{
+    Value*          node;       // 已解析为DOM的节点，为NULL表示在输入流中读取的节点
+    bool            isArray;    // 流式节点是否为数组
+    bool            atEnd;      // 流式节点是否已读到结束符
+    bool            implicit;   // 是否为按名称读取根对象成员时隐含进入的根对象
+    int             index;      // 流式节点中已读取的成员数
+    SizeType        cursor;     // 下次查找成员的起始位置，流式节点用于 buffered
+    Value           buffered;   // 流式节点中已解析的成员，数组元素以序号为名
+    JsonAllocator*  alloc;      // 解析成员用的分配器，节点读完即释放
+
+    JsonAllocator& allocator() {
+        if (!alloc) {
+            alloc = new JsonAllocator(4096);
+        }
+        return *alloc;
+    }
+};
+
+MgJsonStreamReader::MgJsonStreamReader()
+    : _src(new MgJsonSource), _builder(new MgJsonValueBuilder), _err(NULL), _opened(false)
+{
+}
+
+MgJsonStreamReader::~MgJsonStreamReader()
+{
+    close();
+    for (size_t i = 0; i < _unused.size(); i++) {
+        delete _unused[i];
+    }
+    delete _builder;
+    delete _src;
+}
+
+void MgJsonStreamReader::open(FILE* fp)
+{
+    close();
+    _err = NULL;
+    if (fp) {
+        _src->open(fp);
+        _opened = true;
+    }
+}
+
+void MgJsonStreamReader::open(const char* content)
+{
+    close();
+    _err = NULL;
+    if (content) {
+        _src->open(content);
+        _opened = true;
+    }
+}
+
+void MgJsonStreamReader::close()
+{
+    while (!_levels.empty()) {
+        popLevel();
+    }
+    _src->close();
+    _opened = false;
+}
+
+bool MgJsonStreamReader::setError(const char* err)
+{
+    _err = err;
+    if (err) {
+        LOGE("storage error: %s", err);
+    }
+    return false;
+}
+
+MgJsonStreamReader::Level* MgJsonStreamReader::pushLevel(Value* node, bool isArray)
+{
+    Level* lv;
+
+    if (_unused.empty()) {
+        lv = new Level();
+        lv->alloc = NULL;
+    } else {
+        lv = _unused.back();
+        _unused.pop_back();
+    }
+    lv->node = node;
+    lv->isArray = isArray;
+    lv->atEnd = false;
+    lv->implicit = false;
+    lv->index = 0;
+    lv->cursor = 0;
+    lv->buffered.SetObject();
+    _levels.push_back(lv);
+
+    return lv;
+}
+
+void MgJsonStreamReader::popLevel()
+{
+    Level* lv = _levels.back();
+
+    _levels.pop_back();
+    lv->buffered.SetNull();
+    delete lv->alloc;
+    lv->alloc = NULL;
+    _unused.push_back(lv);
+}
+
+char MgJsonStreamReader::peekToken()
+{
+    char c = _src->peek();
+
+    while (c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+        _src->take();
+        c = _src->peek();
+    }
+    return c;
+}
+
+bool MgJsonStreamReader::parseValue(Level* lv, Value* out)
+{
+    MgJsonValueStream stream = { _src, &_builder->phase };
+
+    _builder->begin(out, out ? &lv->allocator() : NULL, out ? NULL : &_key);
+    if (!_builder->reader.Parse<0>(stream, *_builder)) {
+        LOGE("parse error at %d: %s", (int)_src->tell(), _builder->reader.GetParseError());
+        _opened = false;
+        return setError(_builder->reader.GetParseError());
+    }
+    return true;
+}
+
+bool MgJsonStreamReader::nextMember(Level* lv)
+{
+    if (!_opened || lv->node || lv->atEnd) {
+        return false;
+    }
+
+    char c = peekToken();
+
+    if (c == ',' && lv->index > 0) {
+        _src->take();
+        c = peekToken();
+    }
+    if (c == (lv->isArray ? ']' : '}')) {
+        _src->take();
+        lv->atEnd = true;
+        return false;
+    }
+    if (lv->isArray) {
+#if defined(_MSC_VER) && _MSC_VER >= 1400 // VC8
+        sprintf_s(_index, sizeof(_index), "%d", lv->index);
+#else
+        sprintf(_index, "%d", lv->index);
+#endif
+        _key = _index;
+    }
+    else {
+        if (c != '"' || !parseValue(lv, NULL)) {    // 成员名由 MgJsonValueBuilder 存到 _key
+            _opened = false;
+            return setError("Expect a member name");
+        }
+        if (peekToken() != ':') {
+            _opened = false;
+            return setError("Expect a colon after a member name");
+        }
+        _src->take();
+    }
+    lv->index++;
+
+    return true;
+}
+
+MgJsonStreamReader::Value* MgJsonStreamReader::bufferValue(Level* lv)
+{
+    JsonAllocator& alloc = lv->allocator();
+    Value v;
+
+    if (!parseValue(lv, &v)) {
+        return NULL;
+    }
+
+    Value name(_key.c_str(), (SizeType)_key.size(), alloc);
+    lv->buffered.AddMember(name, v, alloc);
+
+    return &(lv->buffered.MemberEnd() - 1)->value;
+}
+
+MgJsonStreamReader::Value* MgJsonStreamReader::findBuffered(Level* lv, const char* key)
+{
+    return (key && lv->buffered.MemberBegin() != lv->buffered.MemberEnd()) ?
+        MgJsonValue::findMember(lv->buffered, lv->cursor, key) : NULL;
+}
+
+bool MgJsonStreamReader::skipRest(Level* lv)
+{
+    while (nextMember(lv)) {
+        if (!parseValue(lv, NULL))
+            return false;
+    }
+    return lv->atEnd;
+}
+
+// 先在已解析的成员中查找，再沿输入流向后读取，跳过的成员解析后缓存在节点中，
+// 没有此成员时会缓存到节点末尾的全部成员，见类的说明
+MgJsonStreamReader::Value* MgJsonStreamReader::findMember(const char* name)
+{
+    if (_levels.empty() || !name) {
+        return NULL;
+    }
+
+    Level* lv = _levels.back();
+
+    if (lv->node) {
+        return lv->node->IsObject() ? MgJsonValue::findMember(*lv->node, lv->cursor, name) : NULL;
+    }
+    if (lv->isArray) {
+        return NULL;
+    }
+
+    Value* item = findBuffered(lv, name);
+
+    while (!item && nextMember(lv)) {
+        Value* v = bufferValue(lv);
+        if (!v)
+            break;
+        if (_key == name)
+            item = v;
+    }
+
+    return item;
+}
+
+bool MgJsonStreamReader::readNode(const char* name, int index, bool ended)
+{
+    if (ended) {                        // 当前节点读取完成
+        if (!_levels.empty()) {
+            if (!_levels.back()->node) {
+                skipRest(_levels.back());
+            }
+            popLevel();                 // 出栈
+        }
+        if (_levels.size() == 1 && _levels.back()->implicit) {
+            skipRest(_levels.back());
+            popLevel();
+        }
+        if (_levels.empty()) {          // 根节点已出栈
+            close();
+        }
+        return true;
+    }
+    if (!_opened) {
+        return false;
+    }
+
+    char tmpname[32];
+
+    if (name && index >= 0) {           // 形成实际节点名称
+#if defined(_MSC_VER) && _MSC_VER >= 1400 // VC8
+        sprintf_s(tmpname, sizeof(tmpname), "%s%d", name, index + 1);
+#else
+        sprintf(tmpname, "%s%d", name, index + 1);
+#endif
+        name = tmpname;
+    }
+
+    if (_levels.empty()) {
+        char c = peekToken();
+
+        if (c != '{' && c != '[') {
+            return setError("Expect either an object or array at root");
+        }
+        if (!name || !*name) {
+            _src->take();
+            pushLevel(NULL, c == '[');
+            _err = NULL;
+            return true;
+        }
+        if (c != '{') {
+            return false;               // 没有此节点
+        }
+        _src->take();
+        pushLevel(NULL, false)->implicit = true;
+        _err = NULL;
+    }
+
+    Level* parent = _levels.back();
+    Value* node = NULL;
+
+    if (parent->node) {
+        if (parent->node->IsArray()) {
+            if (index >= 0 && index < (int)parent->node->Size()) {
+                node = &(*parent->node)[index];
+            }
+        }
+        else if (name && parent->node->IsObject()) {
+            node = MgJsonValue::findMember(*parent->node, parent->cursor, name);
+        }
+    }
+    else if (!parent->isArray || index >= 0) {
+        if (parent->isArray) {
+#if defined(_MSC_VER) && _MSC_VER >= 1400 // VC8
+            sprintf_s(tmpname, sizeof(tmpname), "%d", index);
+#else
+            sprintf(tmpname, "%d", index);
+#endif
+            name = tmpname;
+        }
+        node = findBuffered(parent, name);
+
+        while (!node && name && nextMember(parent)) {
+            if (_key == name) {
+                char c = peekToken();
+                if (c == '{' || c == '[') { // 子节点直接在输入流中读取
+                    _src->take();
+                    pushLevel(NULL, c == '[');
+                    return true;
+                }
+                node = bufferValue(parent);
+                break;
+            }
+            if (!bufferValue(parent))
+                break;
+        }
+    }
+
+    if (!node) {
+        if (_levels.size() == 1 && parent->implicit) {
+            popLevel();
+            close();
+        }
+        return false;
+    }
+    pushLevel(node, false);
+
+    return true;
+}
+
+int MgJsonStreamReader::readInt(const char* name, int defvalue)
+{
+    return MgJsonValue::toInt(findMember(name), name, defvalue);
+}
+
+bool MgJsonStreamReader::readBool(const char* name, bool defvalue)
+{
+    return !!readInt(name, defvalue ? 1 : 0);
+}
+
+float MgJsonStreamReader::readFloat(const char* name, float defvalue)
+{
+    return MgJsonValue::toFloat(findMember(name), name, defvalue);
+}
+
+int MgJsonStreamReader::readFloatArray(const char* name, float* values, int count, bool report)
+{
+    return MgJsonValue::toFloatArray(findMember(name), name, values, count, report, this);
+}
+
+int MgJsonStreamReader::readIntArray(const char* name, int* values, int count, bool report)
+{
+    return MgJsonValue::toIntArray(findMember(name), name, values, count, report, this);
+}
+
+int MgJsonStreamReader::readString(const char* name, char* value, int count)
+{
+    return MgJsonValue::toString(findMember(name), name, value, count);
+}
@@ -0,0 +1,101 @@
+﻿// mgjsonreader.h: 定义边解析边读取的JSON存取类 MgJsonStreamReader
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+
+#ifndef TOUCHVG_JSONREADER_H_
+#define TOUCHVG_JSONREADER_H_
+
+#include "mgstorage.h"
+#include <cstdio>
+#include <vector>
+#include <string>
+#include "rapidjson/document.h"
+
+//! 从JSON值取出存取接口所需类型的数据，供DOM读取和流式读取共用
+struct MgJsonValue
+{
+    typedef rapidjson::Value Value;
+
+    static int toInt(const Value* item, const char* name, int defvalue);
+    static float toFloat(const Value* item, const char* name, float defvalue);
+    static int toFloatArray(const Value* item, const char* name, float* values,
+                            int count, bool report, MgStorage* s);
+    static int toIntArray(const Value* item, const char* name, int* values,
+                          int count, bool report, MgStorage* s);
+    static int toString(const Value* item, const char* name, char* value, int count);
+
+    //! 在对象节点中查找成员，从上次找到的成员之后开始查找，到末尾后再从头查找
+    static Value* findMember(Value& node, rapidjson::SizeType& cursor, const char* name);
+};
+
+class MgJsonSource;
+class MgJsonValueBuilder;
+
+//! 边解析边读取的JSON存取类，不构建整个文档的DOM树
+/*! 用 rapidjson 的SAX解析器按文档顺序解析，readNode 进入的对象或数组节点直接在输入流中读取，
+    只有跳过的成员(读取顺序与保存顺序不一致时)才解析为小的DOM子树缓存在所在节点中，节点读完即释放。
+    读取的名称在当前节点中不存在时，要读到节点末尾才能确定，其后的全部兄弟成员都会解析并缓存，
+    因此峰值内存取决于此时剩余兄弟成员的大小。应按保存顺序读取，并先读取小的成员再读取大的子节点。
+    不支持 cloneForRead()，不能多线程加载。
+ */
+class MgJsonStreamReader : public MgStorage
+{
+public:
+    typedef rapidjson::Value Value;
+
+    MgJsonStreamReader();
+    virtual ~MgJsonStreamReader();
+
+    //! 从文件读取，文件句柄在读完前须保持打开
+    void open(FILE* fp);
+
+    //! 从JSON内容读取，内容在读完前须有效
+    void open(const char* content);
+
+    //! 结束读取，释放缓存
+    void close();
+
+    //! 返回解析错误，NULL表示没有错误
+    const char* getError() const { return _err; }
+
+public:
+    virtual bool readNode(const char* name, int index, bool ended);
+    virtual bool writeNode(const char*, int, bool) { return false; }
+    virtual bool readBool(const char* name, bool defvalue);
+    virtual float readFloat(const char* name, float defvalue);
+    virtual void writeBool(const char*, bool) {}
+    virtual void writeFloat(const char*, float) {}
+    virtual void writeString(const char*, const char*) {}
+    virtual int readFloatArray(const char* name, float* values, int count, bool report = true);
+    virtual int readString(const char* name, char* value, int count);
+    virtual void writeFloatArray(const char*, const float*, int) {}
+    virtual int readIntArray(const char* name, int* values, int count, bool report = true);
+    virtual void writeIntArray(const char*, const int*, int) {}
+    virtual int readInt(const char* name, int defvalue);
+    virtual bool setError(const char* err);
+
+private:
+    struct Level;
+
+    Level* pushLevel(Value* node, bool isArray);
+    void popLevel();
+    bool nextMember(Level* lv);
+    bool parseValue(Level* lv, Value* out);
+    Value* bufferValue(Level* lv);
+    Value* findBuffered(Level* lv, const char* key);
+    Value* findMember(const char* name);
+    bool skipRest(Level* lv);
+    char peekToken();
+
+private:
+    MgJsonSource*       _src;
+    MgJsonValueBuilder* _builder;
+    std::vector<Level*> _levels;        // 当前读取的节点栈
+    std::vector<Level*> _unused;        // 已出栈待复用的节点
+    std::string         _key;           // 流式节点中当前成员的名称，数组元素为序号
+    char                _index[16];
+    const char*         _err;
+    bool                _opened;
+};
+
+#endif // TOUCHVG_JSONREADER_H_
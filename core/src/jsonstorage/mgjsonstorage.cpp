@@ -1,7 +1,10 @@
 ﻿#include "mgjsonstorage.h"
-#include "mgstorage.h"
+#include "mgjsonreader.h"
+#include "mgjsonwriter.h"
+#include "mgmapfile.h"
 #include <vector>
 #include "mglog.h"
+#include "gilock.h"
 #include "utf8_unchecked.h"
 #include "rapidjson/document.h"     // rapidjson's DOM-style API
 #include "rapidjson/prettywriter.h" // for stringify JSON
@@ -14,22 +17,33 @@ using namespace rapidjson;
 class MgJsonStorage::Impl : public MgStorage
 {
 public:
-    Impl() : _fs(NULL), _err(NULL), _arrmode(false), _numAsStr(false) {}
+    Impl() : _fs(NULL), _err(NULL), _arrmode(false), _numAsStr(false)
+        , _source(NULL), _refcount(1) {}
+    Impl(Impl* source, Value* node);
     virtual ~Impl() { if (_fs) delete(_fs); }
     
+    static void reset(Impl*& impl);
+    void releaseRef() { if (giAtomicDecrement(&_refcount) == 0) delete this; }
     void clear();
     const char* stringify(bool pretty);
     Document& document() { return _doc; }
-    const char* getError() { return _err ? _err : _doc.GetParseError(); }
+    MgJsonStreamReader& reader() { return _reader; }
+    MgJsonStreamWriter& writer() { return _writer; }
+    bool isArrayMode() const { return _arrmode; }
+    const char* getError() {
+        return _err ? _err : _reader.getError() ? _reader.getError()
+            : _writer.getError() ? _writer.getError() : _doc.GetParseError(); }
     FileStream& createStream(FILE* fp);
+    MgMappedFile& file() { return _file; }
     bool save(FILE* fp, bool pretty);
     void setArrayMode(bool arr) { _arrmode = arr; }
-    void saveNumberAsString(bool str) { _numAsStr = str; }
+    void saveNumberAsString(bool str) { _numAsStr = str; _writer.saveNumberAsString(str); }
     
 private:
     bool readNode(const char* name, int index, bool ended);
     bool writeNode(const char* name, int index, bool ended);
     bool setError(const char* err);
+    Value* findMember(const char* name);
     
     int readInt(const char* name, int defvalue);
     bool readBool(const char* name, bool defvalue);
@@ -46,11 +60,18 @@ private:
     int readIntArray(const char* name, int* values, int count, bool report = true);
     void writeIntArray(const char* name, const int* values, int count);
     
+    MgStorage* cloneForRead();
+    void release();
+    
     bool hasNum(const char* name) { return strspn(name, "01234567890") > 0; }
     
 private:
     Document _doc;
+    MgJsonStreamReader _reader;
+    MgJsonStreamWriter _writer;
+    MgMappedFile _file;                 // loadFile() 映射的文件，_doc 中的字符串指向其内容
     std::vector<Value*> _stack;
+    std::vector<SizeType> _cursors;     // 与读取时的 _stack 对应，各节点下次查找成员的起始位置
     std::vector<Value*> _created;
     StringBuffer _strbuf;
     FileStream  *_fs;
@@ -58,8 +79,49 @@ private:
     int _nodeCount;
     bool _arrmode;
     bool _numAsStr;
+    Impl* _source;                      // 由 cloneForRead() 创建时为原对象，只读取 _stack 中的节点
+    volatile long _refcount;            // 原对象的引用数，未释放的克隆对象各有一个引用
 };
 
+MgJsonStorage::Impl::Impl(Impl* source, Value* node)
+    : _fs(NULL), _err(NULL), _nodeCount(0), _arrmode(false), _numAsStr(false)
+    , _source(source), _refcount(1)
+{
+    giAtomicIncrement(&source->_refcount);
+    _stack.push_back(node);
+    _cursors.push_back(0);
+}
+
+// 只读取DOM树，各对象的查找位置独立，可在多个线程中同时读取
+MgStorage* MgJsonStorage::Impl::cloneForRead()
+{
+    return _source || _stack.empty() ? NULL : new Impl(this, _stack.back());
+}
+
+void MgJsonStorage::Impl::release()
+{
+    if (_source) {
+        Impl* source = _source;
+        delete this;
+        source->releaseRef();
+    }
+}
+
+// 还有克隆对象时保留其内容，改用新的内部对象
+void MgJsonStorage::Impl::reset(Impl*& impl)
+{
+    if (impl->_refcount > 1) {
+        Impl* p = new Impl();
+        p->_arrmode = impl->_arrmode;
+        p->saveNumberAsString(impl->_numAsStr);
+        impl->releaseRef();
+        impl = p;
+    }
+    else {
+        impl->clear();
+    }
+}
+
 MgJsonStorage::MgJsonStorage() : _impl(NULL)
 {
     _impl = new Impl();
@@ -67,7 +129,7 @@ MgJsonStorage::MgJsonStorage() : _impl(NULL)
 
 MgJsonStorage::~MgJsonStorage()
 {
-    delete _impl;
+    _impl->releaseRef();
 }
 
 const char* MgJsonStorage::stringify(bool pretty)
@@ -77,7 +139,7 @@ const char* MgJsonStorage::stringify(bool pretty)
 
 bool MgJsonStorage::save(FILE* fp, bool pretty)
 {
-    return fp && !_impl->document().IsNull() && _impl->save(fp, pretty);
+    return fp && _impl->save(fp, pretty);
 }
 
 void MgJsonStorage::setArrayMode(bool arr)
@@ -92,7 +154,7 @@ void MgJsonStorage::saveNumberAsString(bool str)
 
 MgStorage* MgJsonStorage::storageForRead(const char* content)
 {
-    _impl->clear();
+    Impl::reset(_impl);
     if (content && *content) {
         _impl->document().Parse<0>(content);
         if (_impl->getError()) {
@@ -103,14 +165,38 @@ MgStorage* MgJsonStorage::storageForRead(const char* content)
     return _impl;
 }
 
+MgStorage* MgJsonStorage::loadFile(const char* filename)
+{
+    Impl::reset(_impl);
+    if (_impl->file().open(filename, true)) {
+        char* content = _impl->file().data();
+        if (utf8::starts_with_bom(content, content + _impl->file().size())) {
+            content += 3;
+        }
+        _impl->document().ParseInsitu<0>(content);
+        if (_impl->getError()) {
+            LOGE("parse error: %s", _impl->getError());
+        }
+    } else {
+        LOGE("Fail to open file: %s", filename);
+    }
+    
+    return _impl;
+}
+
+static void skipUtf8Bom(FILE* fp)
+{
+    utf8::uint8_t head[3];
+    fread(head, 1, sizeof(head), fp);
+    if (!utf8::starts_with_bom(head, head + sizeof(head)))
+        fseek(fp, 0, SEEK_SET);
+}
+
 MgStorage* MgJsonStorage::storageForRead(FILE* fp)
 {
-    _impl->clear();
+    Impl::reset(_impl);
     if (fp) {
-        utf8::uint8_t head[3];
-        fread(head, 1, sizeof(head), fp);
-        if (!utf8::starts_with_bom(head, head + sizeof(head)))
-            fseek(fp, 0, SEEK_SET);
+        skipUtf8Bom(fp);
         _impl->document().ParseStream<0>(_impl->createStream(fp));
         if (_impl->getError()) {
             LOGE("parse error: %s", _impl->getError());
@@ -120,9 +206,26 @@ MgStorage* MgJsonStorage::storageForRead(FILE* fp)
     return _impl;
 }
 
+MgStorage* MgJsonStorage::storageForStreamRead(const char* content)
+{
+    Impl::reset(_impl);
+    _impl->reader().open(content);
+    return &_impl->reader();
+}
+
+MgStorage* MgJsonStorage::storageForStreamRead(FILE* fp)
+{
+    Impl::reset(_impl);
+    if (fp) {
+        skipUtf8Bom(fp);
+    }
+    _impl->reader().open(fp);
+    return &_impl->reader();
+}
+
 void MgJsonStorage::clear()
 {
-    _impl->clear();
+    Impl::reset(_impl);
 }
 
 const char* MgJsonStorage::getParseError()
@@ -132,14 +235,33 @@ const char* MgJsonStorage::getParseError()
 
 MgStorage* MgJsonStorage::storageForWrite()
 {
-    _impl->clear();
+    Impl::reset(_impl);
     return _impl;
 }
 
+MgStorage* MgJsonStorage::storageForStreamWrite(bool pretty)
+{
+    return storageForStreamWrite(NULL, pretty);
+}
+
+MgStorage* MgJsonStorage::storageForStreamWrite(FILE* fp, bool pretty)
+{
+    Impl::reset(_impl);
+    if (_impl->isArrayMode()) {         // 数组模式下节点已写的字段可能被替换，仍构建DOM
+        return _impl;
+    }
+    _impl->writer().open(fp, pretty);
+    return &_impl->writer();
+}
+
 void MgJsonStorage::Impl::clear()
 {
     _doc.SetNull();
+    _reader.close();
+    _writer.clear();
+    _file.close();
     _stack.clear();
+    _cursors.clear();
     _strbuf.Clear();
     _nodeCount = 0;
     if (_fs) {
@@ -170,7 +292,7 @@ bool MgJsonStorage::Impl::setError(const char* err)
 
 bool MgJsonStorage::Impl::readNode(const char* name, int index, bool ended)
 {
-    if (_doc.IsNull()) {
+    if (_doc.IsNull() && _stack.empty()) {
         return false;
     }
     if (!ended) {                       // 开始一个新节点
@@ -187,33 +309,47 @@ bool MgJsonStorage::Impl::readNode(const char* name, int index, bool ended)
         
         if (_stack.empty()) {
             if (name && *name) {
-                if (!_doc.IsObject() || !_doc.HasMember(name)) {
+                SizeType cursor = 0;
+                Value *node = MgJsonValue::findMember(_doc, cursor, name);
+                if (!node) {
                     return false;           // 没有此节点
                 }
-                _stack.push_back(&_doc[name]);  // 当前JSON对象压栈
+                _stack.push_back(node);     // 当前JSON对象压栈
             } else {
                 _stack.push_back(&_doc);
             }
+            _cursors.assign(1, 0);
             _err = NULL;
         }
         else {
             Value &parent = *_stack.back();
-            if (parent.IsArray() && index >= 0 && index < (int)parent.Size()) {
-                _stack.push_back(&parent[index]);
-            }
-            else if (parent.IsObject() && parent.HasMember(name)) {
-                _stack.push_back(&parent[name]);
+            Value *node = NULL;
+            
+            if (parent.IsArray()) {
+                if (index >= 0 && index < (int)parent.Size()) {
+                    node = &parent[index];
+                }
             }
             else {
+                if (index > 0 && _cursors.size() == _stack.size() && _cursors.back() == 0) {
+                    _cursors.back() = (SizeType)index;  // 首次查找时从大致位置开始，例如克隆的对象
+                }
+                node = findMember(name);
+            }
+            if (!node) {
                 return false;
             }
+            _stack.push_back(node);
+            _cursors.resize(_stack.size() - 1, 0);
+            _cursors.push_back(0);
         }
     }
     else {                              // 当前节点读取完成
         if (!_stack.empty()) {
             _stack.pop_back();          // 出栈
+            _cursors.resize(_stack.size(), 0);
         }
-        if (_stack.empty()) {           // 根节点已出栈
+        if (_stack.empty() && _refcount == 1) { // 根节点已出栈，且没有克隆对象
             clear();
         }
         _nodeCount++;
@@ -222,6 +358,42 @@ bool MgJsonStorage::Impl::readNode(const char* name, int index, bool ended)
     return true;
 }
 
+// 在对象节点中查找成员，从上次找到的成员之后开始查找，到末尾后再从头查找。
+// 读取顺序一般与保存顺序相同，按序读取大量 shapeN 子节点时不必每次从头扫描。
+Value* MgJsonValue::findMember(Value& node, SizeType& cursor, const char* name)
+{
+    if (!name || !node.IsObject()) {
+        return NULL;
+    }
+    
+    const SizeType len = (SizeType)strlen(name);
+    const SizeType count = (SizeType)(node.MemberEnd() - node.MemberBegin());
+    Value::MemberIterator members = node.MemberBegin();
+    SizeType i = cursor < count ? cursor : 0;
+    
+    for (SizeType n = 0; n < count; n++) {
+        const Value &key = members[i].name;
+        if (key.GetStringLength() == len && memcmp(key.GetString(), name, len) == 0) {
+            cursor = i + 1;
+            return &members[i].value;
+        }
+        if (++i == count) {
+            i = 0;
+        }
+    }
+    
+    return NULL;
+}
+
+Value* MgJsonStorage::Impl::findMember(const char* name)
+{
+    if (_stack.empty()) {
+        return NULL;
+    }
+    _cursors.resize(_stack.size(), 0);
+    return MgJsonValue::findMember(*_stack.back(), _cursors.back(), name);
+}
+
 bool MgJsonStorage::Impl::writeNode(const char* name, int index, bool ended)
 {
     if (!ended) {                       // 开始一个新节点
@@ -279,6 +451,12 @@ bool MgJsonStorage::Impl::writeNode(const char* name, int index, bool ended)
 
 const char* MgJsonStorage::Impl::stringify(bool pretty)
 {
+    if (_writer.isOpened()) {           // 已边写边输出到缓冲区
+        _writer.close();
+    }
+    if (*_writer.getString()) {
+        return _writer.getString();
+    }
     if (_strbuf.Size() == 0 && !_doc.IsNull()) {
         Document::AllocatorType allocator;
         
@@ -299,6 +477,13 @@ const char* MgJsonStorage::Impl::stringify(bool pretty)
 
 bool MgJsonStorage::Impl::save(FILE* fp, bool pretty)
 {
+    if (_writer.isOpened()) {           // 边写边输出的，只需输出剩余内容
+        return _writer.close(fp);
+    }
+    if (_doc.IsNull()) {
+        return false;
+    }
+    
     Document::AllocatorType allocator;
     
     if (_nodeCount < 100) {
@@ -336,12 +521,16 @@ bool MgJsonStorage::parseInt(const char* str, int& value)
 }
 
 int MgJsonStorage::Impl::readInt(const char* name, int defvalue)
+{
+    return MgJsonValue::toInt(findMember(name), name, defvalue);
+}
+
+int MgJsonValue::toInt(const Value* found, const char* name, int defvalue)
 {
     int ret = defvalue;
-    Value *node = _stack.empty() ? NULL : _stack.back();
     
-    if (node && node->HasMember(name)) {
-        const Value &item = (*node)[name];
+    if (found) {
+        const Value &item = *found;
         
         if (item.IsInt()) {
             ret = item.GetInt();
@@ -376,12 +565,16 @@ bool MgJsonStorage::parseFloat(const char* str, float& value)
 }
 
 float MgJsonStorage::Impl::readFloat(const char* name, float defvalue)
+{
+    return MgJsonValue::toFloat(findMember(name), name, defvalue);
+}
+
+float MgJsonValue::toFloat(const Value* found, const char* name, float defvalue)
 {
     float ret = defvalue;
-    Value *node = _stack.empty() ? NULL : _stack.back();
     
-    if (node && node->HasMember(name)) {
-        const Value &item = node->GetMember(name);
+    if (found) {
+        const Value &item = *found;
         
         if (item.IsDouble()) {
             ret = (float)item.GetDouble();
@@ -402,13 +595,18 @@ float MgJsonStorage::Impl::readFloat(const char* name, float defvalue)
 
 int MgJsonStorage::Impl::readFloatArray(const char* name, float* values,
                                         int count, bool report)
+{
+    return MgJsonValue::toFloatArray(findMember(name), name, values, count, report, this);
+}
+
+int MgJsonValue::toFloatArray(const Value* found, const char* name, float* values,
+                              int count, bool report, MgStorage* s)
 {
     int ret = 0;
-    Value *node = _stack.empty() ? NULL : _stack.back();
     
     report = report && count > 0 && values;
-    if (node && node->HasMember(name)) {
-        const Value &item = node->GetMember(name);
+    if (found) {
+        const Value &item = *found;
         
         if (item.IsArray()) {
             ret = item.Size();
@@ -439,19 +637,23 @@ int MgJsonStorage::Impl::readFloatArray(const char* name, float* values,
     }
     if (values && ret < count && report) {
         LOGD("readFloatArray(%s, %d): %d", name, count, ret);
-        setError("readFloatArray: lose numbers");
+        s->setError("readFloatArray: lose numbers");
     }
     
     return ret;
 }
 
 int MgJsonStorage::Impl::readString(const char* name, char* value, int count)
+{
+    return MgJsonValue::toString(findMember(name), name, value, count);
+}
+
+int MgJsonValue::toString(const Value* found, const char* name, char* value, int count)
 {
     int ret = 0;
-    Value *node = _stack.empty() ? NULL : _stack.back();
     
-    if (node && node->HasMember(name)) {
-        const Value &item = node->GetMember(name);
+    if (found) {
+        const Value &item = *found;
         
         if (item.IsString()) {
             ret = item.GetStringLength();
@@ -567,13 +769,18 @@ void MgJsonStorage::Impl::writeString(const char* name, const char* value)
 }
 
 int MgJsonStorage::Impl::readIntArray(const char* name, int* values, int count, bool report)
+{
+    return MgJsonValue::toIntArray(findMember(name), name, values, count, report, this);
+}
+
+int MgJsonValue::toIntArray(const Value* found, const char* name, int* values,
+                            int count, bool report, MgStorage* s)
 {
     int ret = 0;
-    Value *node = _stack.empty() ? NULL : _stack.back();
     
     report = report && count > 0 && values;
-    if (node && node->HasMember(name)) {
-        const Value &item = node->GetMember(name);
+    if (found) {
+        const Value &item = *found;
         
         if (item.IsArray()) {
             ret = item.Size();
@@ -586,7 +793,7 @@ int MgJsonStorage::Impl::readIntArray(const char* name, int* values, int count,
                     if (v.IsInt()) {
                         values[ret++] = v.GetInt();
                     }
-                    else if (v.IsString() && parseInt(v.GetString(), values[ret])) {
+                    else if (v.IsString() && MgJsonStorage::parseInt(v.GetString(), values[ret])) {
                         ret++;
                     }
                     else if (report) {
@@ -601,7 +808,7 @@ int MgJsonStorage::Impl::readIntArray(const char* name, int* values, int count,
     }
     if (values && ret < count && report) {
         LOGD("readIntArray(%s, %d): %d", name, count, ret);
-        setError("readIntArray: lose numbers");
+        s->setError("readIntArray: lose numbers");
     }
     
     return ret;
@@ -0,0 +1,282 @@
+﻿// mgjsonwriter.cpp: 实现边写边输出的JSON存取类 MgJsonStreamWriter
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+
+#include "mgjsonwriter.h"
+#include "mglog.h"
+#include "rapidjson/prettywriter.h"
+#include <string.h>
+
+using namespace rapidjson;
+
+static const size_t kFlushSize = 64 * 1024;    // 给定文件时缓冲区超过此长度就写到文件
+
+//! 输出JSON事件的接口，屏蔽 Writer 和 PrettyWriter 的差异
+class MgJsonEmitter
+{
+public:
+    virtual ~MgJsonEmitter() {}
+    virtual void startObject() = 0;
+    virtual void endObject() = 0;
+    virtual void startArray() = 0;
+    virtual void endArray() = 0;
+    virtual void string(const char* str, SizeType length) = 0;
+    virtual void intValue(int value) = 0;
+    virtual void boolValue(bool value) = 0;
+    virtual void doubleValue(double value) = 0;
+};
+
+template <class W>
+class MgJsonEmitterT : public MgJsonEmitter
+{
+public:
+    MgJsonEmitterT(StringBuffer& buf)
+        : _allocator(_levels, sizeof(_levels)), _writer(buf, &_allocator) {}
+
+    virtual void startObject() { _writer.StartObject(); }
+    virtual void endObject() { _writer.EndObject(); }
+    virtual void startArray() { _writer.StartArray(); }
+    virtual void endArray() { _writer.EndArray(); }
+    virtual void string(const char* str, SizeType length) { _writer.String(str, length); }
+    virtual void intValue(int value) { _writer.Int(value); }
+    virtual void boolValue(bool value) { _writer.Bool(value); }
+    virtual void doubleValue(double value) { _writer.Double(value); }
+
+private:
+    char    _levels[1024];              // Writer 的节点层次栈所用内存，层次很深时才另外分配
+    MemoryPoolAllocator<> _allocator;
+    W       _writer;
+};
+
+//! 在p处格式化无符号数，返回结束位置，与 sprintf 的 %u 或 %x 结果相同
+static char* formatNumber(char* p, unsigned value, unsigned base)
+{
+    char digits[12];
+    int n = 0;
+
+    do {
+        digits[n++] = "0123456789abcdef"[value % base];
+        value /= base;
+    } while (value > 0);
+    while (n > 0) {
+        *p++ = digits[--n];
+    }
+    *p = 0;
+
+    return p;
+}
+
+//! 与 sprintf(buf, "%d", value) 结果相同，返回结束位置
+static char* formatInt(char* buf, int value)
+{
+    if (value < 0) {
+        *buf++ = '-';
+        return formatNumber(buf, 0u - (unsigned)value, 10);
+    }
+    return formatNumber(buf, (unsigned)value, 10);
+}
+
+MgJsonStreamWriter::MgJsonStreamWriter()
+    : _emitter(NULL), _buf(NULL), _fp(NULL), _err(NULL), _depth(0)
+    , _implicitRoot(false), _started(false), _ended(false), _numAsStr(false)
+{
+}
+
+MgJsonStreamWriter::~MgJsonStreamWriter()
+{
+    clear();
+}
+
+void MgJsonStreamWriter::open(FILE* fp, bool pretty)
+{
+    delete _emitter;
+    if (!_buf) {
+        _buf = new StringBuffer;
+    }
+    _buf->Clear();
+    if (pretty) {
+        _emitter = new MgJsonEmitterT<PrettyWriter<StringBuffer> >(*_buf);
+    } else {
+        _emitter = new MgJsonEmitterT<Writer<StringBuffer> >(*_buf);
+    }
+    _fp = fp;
+    _err = NULL;
+    _depth = 0;
+    _implicitRoot = false;
+    _started = false;
+    _ended = false;
+}
+
+bool MgJsonStreamWriter::close(FILE* fp)
+{
+    if (_emitter) {
+        while (_depth > 0) {
+            writeNode(NULL, -1, true);
+        }
+        delete _emitter;
+        _emitter = NULL;
+    }
+    if (fp) {
+        _fp = fp;
+    }
+    if (_fp && _buf) {
+        flush(true);
+    }
+    _fp = NULL;
+
+    return _started && !_err;
+}
+
+const char* MgJsonStreamWriter::getString() const
+{
+    return _buf ? _buf->GetString() : "";
+}
+
+void MgJsonStreamWriter::clear()
+{
+    delete _emitter;
+    _emitter = NULL;
+    delete _buf;
+    _buf = NULL;
+    _fp = NULL;
+    _started = false;
+}
+
+void MgJsonStreamWriter::flush(bool all)
+{
+    if (_buf->Size() > 0 && (all || _buf->Size() >= kFlushSize)) {
+        if (fwrite(_buf->GetString(), 1, _buf->Size(), _fp) != _buf->Size()) {
+            setError("fail to write JSON file");
+        }
+        _buf->Clear();
+    }
+}
+
+bool MgJsonStreamWriter::setError(const char* err)
+{
+    _err = err;
+    if (err) {
+        LOGE("storage error: %s", err);
+    }
+    return false;
+}
+
+bool MgJsonStreamWriter::writeNode(const char* name, int index, bool ended)
+{
+    if (!_emitter) {
+        return false;
+    }
+    if (!ended) {                       // 开始一个新节点
+        char tmpname[32];
+        if (index >= 0) {               // 形成实际节点名称
+            size_t len = name ? strlen(name) : 0;
+            len = len < sizeof(tmpname) - 12 ? len : sizeof(tmpname) - 12;
+            memcpy(tmpname, name, len);
+            formatInt(tmpname + len, index + 1);
+            name = tmpname;
+        }
+        if (_ended) {                   // 只能写一个根节点
+            return false;
+        }
+        if (_depth == 0) {
+            _started = true;
+            _implicitRoot = name && *name;
+            if (_implicitRoot) {        // 根节点有名称，作为匿名对象的成员
+                _emitter->startObject();
+                _emitter->string(name, (SizeType)strlen(name));
+            }
+        } else {
+            _emitter->string(name, (SizeType)strlen(name));
+        }
+        _emitter->startObject();
+        _depth++;
+    }
+    else if (_depth > 0) {              // 当前节点写完
+        _emitter->endObject();
+        if (--_depth == 0) {
+            if (_implicitRoot) {
+                _emitter->endObject();
+            }
+            _ended = true;
+        }
+        if (_fp) {
+            flush(false);
+        }
+    }
+
+    return true;
+}
+
+void MgJsonStreamWriter::writeInt(const char* name, int value)
+{
+    if (_depth > 0) {
+        _emitter->string(name, (SizeType)strlen(name));
+        if (_numAsStr) {
+            char buf[20];
+            _emitter->string(buf, (SizeType)(formatInt(buf, value) - buf));
+        } else {
+            _emitter->intValue(value);
+        }
+    }
+}
+
+void MgJsonStreamWriter::writeUInt(const char* name, int value)
+{
+    if (_depth > 0) {
+        _emitter->string(name, (SizeType)strlen(name));
+        if (value >= 0 && value <= 0xFF && !_numAsStr) {
+            _emitter->intValue(value);
+        } else {
+            char buf[20] = "0x";
+            _emitter->string(buf, (SizeType)(formatNumber(buf + 2, (unsigned)value, 16) - buf));
+        }
+    }
+}
+
+void MgJsonStreamWriter::writeBool(const char* name, bool value)
+{
+    if (_depth > 0) {
+        _emitter->string(name, (SizeType)strlen(name));
+        _emitter->boolValue(value);
+    }
+}
+
+void MgJsonStreamWriter::writeFloat(const char* name, float value)
+{
+    if (_depth > 0) {
+        _emitter->string(name, (SizeType)strlen(name));
+        _emitter->doubleValue((double)value);
+    }
+}
+
+void MgJsonStreamWriter::writeFloatArray(const char* name, const float* values, int count)
+{
+    if (_depth > 0) {
+        _emitter->string(name, (SizeType)strlen(name));
+        _emitter->startArray();
+        for (int i = 0; i < count; i++) {
+            _emitter->doubleValue((double)values[i]);
+        }
+        _emitter->endArray();
+    }
+}
+
+void MgJsonStreamWriter::writeIntArray(const char* name, const int* values, int count)
+{
+    if (_depth > 0) {
+        _emitter->string(name, (SizeType)strlen(name));
+        _emitter->startArray();
+        for (int i = 0; i < count; i++) {
+            _emitter->intValue(values[i]);
+        }
+        _emitter->endArray();
+    }
+}
+
+void MgJsonStreamWriter::writeString(const char* name, const char* value)
+{
+    if (_depth > 0) {
+        _emitter->string(name, (SizeType)strlen(name));
+        _emitter->string(value ? value : "", value ? (SizeType)strlen(value) : 0);
+    }
+}
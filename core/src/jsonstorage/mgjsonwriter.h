@@ -0,0 +1,83 @@
+﻿// mgjsonwriter.h: 定义边写边输出的JSON存取类 MgJsonStreamWriter
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+
+#ifndef TOUCHVG_JSONWRITER_H_
+#define TOUCHVG_JSONWRITER_H_
+
+#include "mgstorage.h"
+#include <cstdio>
+#include "rapidjson/stringbuffer.h"
+
+class MgJsonEmitter;
+
+//! 边写边输出的JSON存取类，不构建DOM树
+/*! 节点和字段按写入顺序直接由 rapidjson 的 Writer 或 PrettyWriter 输出到缓冲区，
+    输出内容与 MgJsonStorage 先构建DOM再输出的结果相同。给定文件时缓冲区满即写入文件。
+    写字段时不分配堆内存，节点名和数值文本在栈上格式化，缓冲区在多次写之间复用。
+    不支持数组模式(数组模式下节点已写的字段可能被替换为数组)。
+ */
+class MgJsonStreamWriter : public MgStorage
+{
+public:
+    MgJsonStreamWriter();
+    virtual ~MgJsonStreamWriter();
+
+    //! 开始写，fp为NULL时只输出到内部缓冲区
+    void open(FILE* fp, bool pretty);
+
+    //! 结束写，自动结束未写完的节点，将缓冲区中剩余内容写到文件
+    /*! fp为NULL时写到 open() 给定的文件，都为NULL时内容留在缓冲区中由 getString() 取出。
+        返回是否写出了根节点且没有出错。
+     */
+    bool close(FILE* fp = NULL);
+
+    //! 返回是否已开始写且尚未结束
+    bool isOpened() const { return !!_emitter; }
+
+    //! 返回缓冲区中尚未写到文件的JSON内容
+    const char* getString() const;
+
+    //! 结束写并释放缓冲区
+    void clear();
+
+    //! 设置是否在保存数值键值时加上引号
+    void saveNumberAsString(bool str) { _numAsStr = str; }
+
+    //! 返回写出错误，NULL表示没有错误
+    const char* getError() const { return _err; }
+
+public:
+    virtual bool readNode(const char*, int, bool) { return false; }
+    virtual bool writeNode(const char* name, int index, bool ended);
+    virtual bool readBool(const char*, bool defvalue) { return defvalue; }
+    virtual float readFloat(const char*, float defvalue) { return defvalue; }
+    virtual void writeBool(const char* name, bool value);
+    virtual void writeFloat(const char* name, float value);
+    virtual void writeString(const char* name, const char* value);
+    virtual int readFloatArray(const char*, float*, int, bool = true) { return 0; }
+    virtual int readString(const char*, char*, int) { return 0; }
+    virtual void writeFloatArray(const char* name, const float* values, int count);
+    virtual int readIntArray(const char*, int*, int, bool = true) { return 0; }
+    virtual void writeIntArray(const char* name, const int* values, int count);
+    virtual int readInt(const char*, int defvalue) { return defvalue; }
+    virtual void writeInt(const char* name, int value);
+    virtual void writeUInt(const char* name, int value);
+    virtual bool setError(const char* err);
+
+private:
+    void flush(bool all);
+
+private:
+    MgJsonEmitter*          _emitter;   // 当前使用的 Writer 或 PrettyWriter
+    rapidjson::StringBuffer* _buf;
+    FILE*                   _fp;
+    const char*             _err;
+    int                     _depth;     // 已开始且未结束的节点数
+    bool                    _implicitRoot;  // 根节点有名称，外面还有一层匿名对象
+    bool                    _started;   // 已开始写根节点
+    bool                    _ended;     // 根节点已结束
+    bool                    _numAsStr;
+};
+
+#endif // TOUCHVG_JSONWRITER_H_
@@ -0,0 +1,140 @@
+﻿// mgmapfile.cpp: 实现映射到内存的只读文件类 MgMappedFile
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+
+#include "mgmapfile.h"
+#include "mgjsonstorage.h"
+#include <stdlib.h>
+
+#if defined(__WINDOWS__) || defined(WIN32)
+#define MG_WIN32_MAP
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MgMappedFile::MgMappedFile() : _map(NULL), _data(NULL), _size(0)
+{
+}
+
+MgMappedFile::~MgMappedFile()
+{
+    close();
+}
+
+bool MgMappedFile::open(const char* filename, bool terminated)
+{
+    close();
+    return filename && (map(filename, terminated) || read(filename));
+}
+
+void MgMappedFile::close()
+{
+    if (_map) {
+#ifdef MG_WIN32_MAP
+        UnmapViewOfFile(_map);
+#else
+        munmap(_map, _size);
+#endif
+        _map = NULL;
+    }
+    else if (_data) {
+        free(_data);
+    }
+    _data = NULL;
+    _size = 0;
+}
+
+#ifdef MG_WIN32_MAP
+
+bool MgMappedFile::map(const char* filename, bool terminated)
+{
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    SYSTEM_INFO info;
+    LARGE_INTEGER size;
+
+    GetSystemInfo(&info);
+    if (GetFileSizeEx(file, &size) && size.HighPart == 0 && size.LowPart > 0
+        && (!terminated || size.LowPart % info.dwPageSize != 0)) {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+        if (mapping) {
+            _map = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+            CloseHandle(mapping);       // 映射视图会保持映射对象
+        }
+        if (_map) {
+            _data = (char*)_map;
+            _size = size.LowPart;
+        }
+    }
+    CloseHandle(file);
+
+    return !!_map;
+}
+
+#else
+
+bool MgMappedFile::map(const char* filename, bool terminated)
+{
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    const long pagesize = sysconf(_SC_PAGESIZE);
+
+    // 映射区末页中文件长度之后的内容为零，因此 terminated 时只需文件长度不是页面的整数倍
+    if (fstat(fd, &st) == 0 && st.st_size > 0
+        && (!terminated || (pagesize > 0 && st.st_size % pagesize != 0))) {
+        void* p = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            _map = p;
+            _data = (char*)p;
+            _size = (size_t)st.st_size;
+        }
+    }
+    ::close(fd);
+
+    return !!_map;
+}
+
+#endif // MG_WIN32_MAP
+
+// 不能映射时将文件读入内存，末尾加上零结束符
+bool MgMappedFile::read(const char* filename)
+{
+    FILE* fp = mgopenfile(filename, "rb");
+    if (!fp) {
+        return false;
+    }
+
+    size_t capacity = 0;
+    size_t n = 1;
+
+    while (n > 0) {
+        if (_size + 1 >= capacity) {
+            capacity = capacity ? capacity * 2 : 16384;
+            char* p = (char*)realloc(_data, capacity);
+            if (!p) {
+                break;
+            }
+            _data = p;
+        }
+        n = fread(_data + _size, 1, capacity - _size - 1, fp);
+        _size += n;
+    }
+    fclose(fp);
+
+    if (_data) {
+        _data[_size] = 0;
+    }
+    return !!_data;
+}
@@ -0,0 +1,50 @@
+﻿// mgmapfile.h: 定义映射到内存的只读文件类 MgMappedFile
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+
+#ifndef TOUCHVG_MAPPEDFILE_H_
+#define TOUCHVG_MAPPEDFILE_H_
+
+#include <stddef.h>
+
+//! 映射到内存的只读文件，用于原地解析文件内容
+/*! 以写时复制方式映射，可原地修改映射的内容(例如 rapidjson 的 ParseInsitu)而不写回文件。
+    不能映射时改为将文件读入内存。
+ */
+class MgMappedFile
+{
+public:
+    MgMappedFile();
+    ~MgMappedFile();
+
+    //! 映射给定的文件，terminated 为true时保证内容后有零结束符
+    /*! 文件长度正好是页面大小的整数倍时映射区后没有零，此时改为将文件读入内存。
+     */
+    bool open(const char* filename, bool terminated);
+
+    //! 取消映射，释放内存
+    void close();
+
+    //! 返回文件内容
+    char* data() const { return _data; }
+
+    //! 返回文件内容的字节数
+    size_t size() const { return _size; }
+
+    //! 返回是否为映射的内容，false表示已读入内存或未打开
+    bool isMapped() const { return !!_map; }
+
+private:
+    bool map(const char* filename, bool terminated);
+    bool read(const char* filename);
+
+    MgMappedFile(const MgMappedFile&);
+    void operator=(const MgMappedFile&);
+
+private:
+    void*   _map;       // 映射区的起始地址
+    char*   _data;
+    size_t  _size;
+};
+
+#endif // TOUCHVG_MAPPEDFILE_H_
@@ -0,0 +1,557 @@
+﻿// recordfile.cpp: 实现录制步的单文件容器类 MgRecordFile
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+
+#include "recordfile.h"
+#include "mgjsonstorage.h"
+#include "mglog.h"
+#include <string.h>
+#include <limits.h>
+
+#if defined(__WINDOWS__) || defined(WIN32)
+#include <io.h>
+#define truncateFile(fp, size)  _chsize(_fileno(fp), size)
+#else
+#include <unistd.h>
+#define truncateFile(fp, size)  ftruncate(fileno(fp), size)
+#endif
+
+static const char HEAD_MAGIC[] = "VGRC";    // 文件头，后跟版本号、录制类型和保留字
+static const char TAIL_MAGIC[] = "VGRE";    // 文件尾，后跟索引记录的位置、版本号和保留字
+static const int VERSION = 1;
+static const int HEAD_SIZE = 16;
+static const int TAIL_SIZE = 16;
+static const int RECORD_HEAD = 24;          // 记录头：长度、文件号、种类、时刻、标志、校验和
+static const int INDEX_ITEM = 28;           // 索引中的一个记录：文件号、种类、位置、长度、时刻、标志、校验和
+static const int KIND_REMOVED = 0x100;      // 删除记录的种类位
+static const int KIND_INDEX = 0xFF;
+static const long COMPACT_BYTES = 1024 * 1024;  // 删除的记录超过此字节数且多于有效记录时关闭时重写
+
+// 每个文件号至少有一个记录头，文件号超过此数的记录视为损坏，避免按文件号分配过大的数组
+static long maxIndex(long fileSize)
+{
+    return fileSize / RECORD_HEAD;
+}
+
+static void putInt(unsigned char* p, int value)
+{
+    for (int i = 0; i < 4; i++) {
+        p[i] = (unsigned char)(((unsigned)value >> (i * 8)) & 0xFF);
+    }
+}
+
+static int getInt(const unsigned char* p)
+{
+    return (int)(p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24));
+}
+
+// FNV-1a 校验和，用于发现末尾写了一半的记录
+static unsigned checksum(const char* data, int size)
+{
+    unsigned h = 2166136261u;
+    for (int i = 0; i < size; i++) {
+        h = (h ^ (unsigned char)data[i]) * 16777619u;
+    }
+    return h;
+}
+
+MgRecordFile::MgRecordFile() : _fp(NULL), _forWrite(false), _type(0)
+    , _end(0), _liveBytes(0), _deadBytes(0)
+{
+}
+
+MgRecordFile::~MgRecordFile()
+{
+    close();
+}
+
+bool MgRecordFile::open(const char* filename, bool forWrite, int type)
+{
+    unsigned char head[HEAD_SIZE];
+
+    close();
+    _fp = filename ? mgopenfile(filename, forWrite ? "r+b" : "rb") : NULL;
+    if (!_fp) {
+        return forWrite && filename && create(filename, type);
+    }
+    _filename = filename;
+    _forWrite = forWrite;
+
+    if (fread(head, 1, HEAD_SIZE, _fp) != HEAD_SIZE || memcmp(head, HEAD_MAGIC, 4) != 0
+        || getInt(head + 4) > VERSION) {
+        LOGE("Not a record container: %s", filename);
+        reset();
+        return false;
+    }
+    _type = getInt(head + 8);
+
+    fseek(_fp, 0, SEEK_END);
+    long fileSize = ftell(_fp);
+
+    const bool indexed = loadIndex(fileSize);
+
+    if (!indexed) {
+        _end = scan(HEAD_SIZE, fileSize);
+        if (_end < fileSize) {
+            LOGD("Recover record container %s: %ld bytes dropped", filename, fileSize - _end);
+        }
+    }
+    if (forWrite && _end < fileSize) {      // 去掉索引和文件尾或写了一半的记录，之后接着追加
+        fflush(_fp);
+        if (truncateFile(_fp, _end) != 0) {
+            LOGE("Fail to truncate file: %s", filename);
+            reset();
+            return false;
+        }
+    }
+    if (!forWrite && indexed) {
+        _end = fileSize;                    // 已由文件尾读入全部记录
+    }
+
+    return true;
+}
+
+bool MgRecordFile::create(const char* filename, int type)
+{
+    unsigned char head[HEAD_SIZE];
+
+    reset();
+    _fp = mgopenfile(filename, "w+b");
+    if (!_fp) {
+        LOGE("Fail to save file: %s", filename);
+        return false;
+    }
+    _filename = filename;
+    _forWrite = true;
+    _type = type;
+
+    memset(head, 0, sizeof(head));
+    memcpy(head, HEAD_MAGIC, 4);
+    putInt(head + 4, VERSION);
+    putInt(head + 8, type);
+    _end = HEAD_SIZE;
+
+    return fwrite(head, 1, HEAD_SIZE, _fp) == HEAD_SIZE && fflush(_fp) == 0;
+}
+
+// 由文件尾找到索引记录并读入，成功时 _end 为索引记录的位置
+bool MgRecordFile::loadIndex(long fileSize)
+{
+    unsigned char tail[TAIL_SIZE];
+    unsigned char head[RECORD_HEAD];
+
+    if (fileSize < HEAD_SIZE + RECORD_HEAD + TAIL_SIZE
+        || fseek(_fp, fileSize - TAIL_SIZE, SEEK_SET) != 0
+        || fread(tail, 1, TAIL_SIZE, _fp) != TAIL_SIZE
+        || memcmp(tail, TAIL_MAGIC, 4) != 0) {
+        return false;
+    }
+
+    const long offset = (long)(unsigned)getInt(tail + 4);
+
+    if (offset < HEAD_SIZE || offset + RECORD_HEAD > fileSize - TAIL_SIZE
+        || fseek(_fp, offset, SEEK_SET) != 0
+        || fread(head, 1, RECORD_HEAD, _fp) != RECORD_HEAD
+        || getInt(head + 8) != KIND_INDEX
+        || offset + RECORD_HEAD + getInt(head) != fileSize - TAIL_SIZE) {
+        return false;
+    }
+
+    const int size = getInt(head);
+    std::string data(size, 0);
+
+    if (size % INDEX_ITEM != 0 || (size > 0 && fread(&data[0], 1, size, _fp) != (size_t)size)
+        || checksum(data.c_str(), size) != (unsigned)getInt(head + 20)) {
+        return false;
+    }
+
+    const unsigned char* p = (const unsigned char*)data.c_str();
+
+    for (int i = 0; i < size / INDEX_ITEM; i++, p += INDEX_ITEM) {
+        const int index = getInt(p);
+        const int kind = getInt(p + 4);
+
+        if (index < 0 || index > maxIndex(fileSize) || kind < 0 || kind >= KINDS) {
+            continue;
+        }
+        if ((int)_entries[kind].size() <= index) {
+            Entry e = { 0, 0, 0, 0, 0 };
+            _entries[kind].resize(index + 1, e);
+        }
+        Entry& e = _entries[kind][index];
+        e.offset = (long)(unsigned)getInt(p + 8);
+        e.size = getInt(p + 12);
+        e.tick = getInt(p + 16);
+        e.flags = getInt(p + 20);
+        e.checksum = (unsigned)getInt(p + 24);
+        _liveBytes += RECORD_HEAD + e.size;
+    }
+    _end = offset;
+    _deadBytes = offset - HEAD_SIZE - _liveBytes;
+
+    return true;
+}
+
+// 从 from 开始逐个读入记录，返回最后一个完整记录之后的位置
+long MgRecordFile::scan(long from, long fileSize)
+{
+    unsigned char head[RECORD_HEAD];
+    std::string data;
+    long pos = from;
+
+    while (pos + RECORD_HEAD <= fileSize && fseek(_fp, pos, SEEK_SET) == 0
+           && fread(head, 1, RECORD_HEAD, _fp) == RECORD_HEAD)
+    {
+        const int size = getInt(head);
+        const int index = getInt(head + 4);
+        const int kind = getInt(head + 8) & ~KIND_REMOVED;
+
+        if (size < 0 || index < 0 || index > maxIndex(fileSize) || pos + RECORD_HEAD + size > fileSize
+            || (kind >= KINDS && kind != KIND_INDEX)) {
+            break;
+        }
+        data.resize(size);
+        if ((size > 0 && fread(&data[0], 1, size, _fp) != (size_t)size)
+            || checksum(data.c_str(), size) != (unsigned)getInt(head + 20)) {
+            break;
+        }
+
+        const long bytes = RECORD_HEAD + size;
+
+        if (getInt(head + 8) & KIND_REMOVED) {
+            _deadBytes += bytes;
+        }
+        if (kind < KINDS) {
+            Entry* e = find(index, kind);
+            if (e && e->offset) {
+                _liveBytes -= RECORD_HEAD + e->size;
+                _deadBytes += RECORD_HEAD + e->size;
+                e->offset = 0;
+            }
+            if (!(getInt(head + 8) & KIND_REMOVED)) {
+                if ((int)_entries[kind].size() <= index) {
+                    Entry e0 = { 0, 0, 0, 0, 0 };
+                    _entries[kind].resize(index + 1, e0);
+                }
+                Entry& e1 = _entries[kind][index];
+                e1.offset = pos + RECORD_HEAD;
+                e1.size = size;
+                e1.tick = getInt(head + 12);
+                e1.flags = getInt(head + 16);
+                e1.checksum = (unsigned)getInt(head + 20);
+                _liveBytes += bytes;
+            }
+        }
+        pos += bytes;
+    }
+
+    return pos;
+}
+
+MgRecordFile::Entry* MgRecordFile::find(int index, int kind)
+{
+    return (kind >= 0 && kind < KINDS && index >= 0 && index < (int)_entries[kind].size()
+            ? &_entries[kind][index] : NULL);
+}
+
+void MgRecordFile::close()
+{
+    if (_fp && _forWrite) {
+        if (_deadBytes > COMPACT_BYTES && _deadBytes > _liveBytes && compact()) {
+            LOGD("Compact record container %s", _filename.c_str());
+        }
+        else if (_fp && !writeIndex()) {
+            LOGE("Fail to save index of record container: %s", _filename.c_str());
+        }
+    }
+    reset();
+}
+
+void MgRecordFile::reset()
+{
+    if (_fp) {
+        fclose(_fp);
+        _fp = NULL;
+    }
+    for (int k = 0; k < KINDS; k++) {
+        _entries[k].clear();
+    }
+    _end = 0;
+    _liveBytes = 0;
+    _deadBytes = 0;
+}
+
+bool MgRecordFile::append(int index, int kind, const char* data, int size, int tick, int flags)
+{
+    unsigned char head[RECORD_HEAD];
+
+    // 位置在索引和文件尾中是32位整数，追加后还要能写下文件尾
+    if (size > INT_MAX - RECORD_HEAD - TAIL_SIZE || _end > INT_MAX - RECORD_HEAD - TAIL_SIZE - size) {
+        LOGE("Record container is full: %s", _filename.c_str());
+        return false;
+    }
+
+    const unsigned sum = checksum(data, size);
+
+    putInt(head, size);
+    putInt(head + 4, index);
+    putInt(head + 8, kind);
+    putInt(head + 12, tick);
+    putInt(head + 16, flags);
+    putInt(head + 20, (int)sum);
+
+    // 每个记录都刷新到文件，录制中断时已写的记录仍可读出
+    bool ret = (fseek(_fp, _end, SEEK_SET) == 0
+                && fwrite(head, 1, RECORD_HEAD, _fp) == RECORD_HEAD
+                && (size == 0 || fwrite(data, 1, size, _fp) == (size_t)size)
+                && fflush(_fp) == 0);
+
+    if (!ret) {
+        LOGE("Fail to write record %d of %s", index, _filename.c_str());
+        fflush(_fp);
+        truncateFile(_fp, _end);
+        return false;
+    }
+
+    const int k = kind & ~KIND_REMOVED;
+    Entry* e = find(index, k);
+
+    if (e && e->offset) {
+        _liveBytes -= RECORD_HEAD + e->size;
+        _deadBytes += RECORD_HEAD + e->size;
+        e->offset = 0;
+    }
+    if (kind & KIND_REMOVED) {
+        _deadBytes += RECORD_HEAD;
+    }
+    else if (k < KINDS) {
+        if ((int)_entries[k].size() <= index) {
+            Entry e0 = { 0, 0, 0, 0, 0 };
+            _entries[k].resize(index + 1, e0);
+        }
+        Entry& e1 = _entries[k][index];
+        e1.offset = _end + RECORD_HEAD;
+        e1.size = size;
+        e1.tick = tick;
+        e1.flags = flags;
+        e1.checksum = sum;
+        _liveBytes += RECORD_HEAD + size;
+    }
+    _end += RECORD_HEAD + size;
+
+    return true;
+}
+
+bool MgRecordFile::write(int index, int kind, const char* data, int size, int tick, int flags)
+{
+    if (!_fp || !_forWrite || index < 0 || kind < 0 || kind >= KINDS || size < 0
+        || index > maxIndex(_end + RECORD_HEAD + size)) {
+        return false;
+    }
+
+    _mutex.lock();
+    bool ret = append(index, kind, data, size, tick, flags);
+    _mutex.unlock();
+
+    return ret;
+}
+
+bool MgRecordFile::remove(int index, int kind)
+{
+    bool ret = false;
+
+    if (_fp && _forWrite) {
+        _mutex.lock();
+        Entry* e = find(index, kind);
+        ret = e && e->offset && append(index, kind | KIND_REMOVED, NULL, 0, 0, 0);
+        _mutex.unlock();
+    }
+    return ret;
+}
+
+bool MgRecordFile::removeFrom(int index)
+{
+    bool ret = !!_fp && _forWrite;
+
+    if (ret) {
+        _mutex.lock();
+        for (int k = 0; k < KINDS; k++) {
+            for (int i = index < 0 ? 0 : index; i < (int)_entries[k].size(); i++) {
+                if (_entries[k][i].offset) {
+                    ret = append(i, k | KIND_REMOVED, NULL, 0, 0, 0) && ret;
+                }
+            }
+        }
+        _mutex.unlock();
+    }
+    return ret;
+}
+
+// 只读打开时接着扫描其他实例新追加的记录
+void MgRecordFile::refresh()
+{
+    if (_fp && !_forWrite && fseek(_fp, 0, SEEK_END) == 0) {
+        long fileSize = ftell(_fp);
+        if (fileSize > _end) {
+            _end = scan(_end, fileSize);
+        }
+    }
+}
+
+bool MgRecordFile::read(int index, int kind, std::string& data)
+{
+    bool ret = false;
+
+    if (!_fp)
+        return false;
+
+    _mutex.lock();
+    Entry* e = find(index, kind);
+    if (!e || !e->offset) {
+        refresh();
+        e = find(index, kind);
+    }
+    if (e && e->offset) {
+        data.resize(e->size);
+        ret = (fseek(_fp, e->offset, SEEK_SET) == 0
+               && (e->size == 0 || fread(&data[0], 1, e->size, _fp) == (size_t)e->size)
+               && checksum(data.c_str(), e->size) == e->checksum);
+        if (!ret) {
+            LOGE("Fail to read record %d of %s", index, _filename.c_str());
+        }
+    }
+    _mutex.unlock();
+
+    return ret;
+}
+
+long MgRecordFile::getSize(int index, int kind)
+{
+    long size = -1;
+
+    if (_fp) {
+        _mutex.lock();
+        Entry* e = find(index, kind);
+        if (!e || !e->offset) {
+            refresh();
+            e = find(index, kind);
+        }
+        if (e && e->offset) {
+            size = e->size;
+        }
+        _mutex.unlock();
+    }
+    return size;
+}
+
+bool MgRecordFile::getInfo(int index, int kind, int* tick, int* flags)
+{
+    bool ret = false;
+
+    if (_fp) {
+        _mutex.lock();
+        Entry* e = find(index, kind);
+        if (!e || !e->offset) {
+            refresh();
+            e = find(index, kind);
+        }
+        if (e && e->offset) {
+            if (tick)
+                *tick = e->tick;
+            if (flags)
+                *flags = e->flags;
+            ret = true;
+        }
+        _mutex.unlock();
+    }
+    return ret;
+}
+
+int MgRecordFile::getCount(int kind)
+{
+    int n = 0;
+
+    if (_fp && kind >= 0 && kind < KINDS) {
+        _mutex.lock();
+        refresh();
+        for (n = (int)_entries[kind].size(); n > 0 && !_entries[kind][n - 1].offset; n--) {}
+        _mutex.unlock();
+    }
+    return n;
+}
+
+// 在末尾追加索引记录和文件尾，索引记录不计入 _end，之后写打开时截掉
+bool MgRecordFile::writeIndex()
+{
+    std::string data;
+    unsigned char item[INDEX_ITEM];
+
+    for (int k = 0; k < KINDS; k++) {
+        for (int i = 0; i < (int)_entries[k].size(); i++) {
+            const Entry& e = _entries[k][i];
+            if (e.offset) {
+                putInt(item, i);
+                putInt(item + 4, k);
+                putInt(item + 8, (int)e.offset);
+                putInt(item + 12, e.size);
+                putInt(item + 16, e.tick);
+                putInt(item + 20, e.flags);
+                putInt(item + 24, (int)e.checksum);
+                data.append((const char*)item, INDEX_ITEM);
+            }
+        }
+    }
+
+    const long offset = _end;
+    unsigned char tail[TAIL_SIZE];
+
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, TAIL_MAGIC, 4);
+    putInt(tail + 4, (int)offset);
+    putInt(tail + 8, VERSION);
+
+    bool ret = append(0, KIND_INDEX, data.c_str(), (int)data.size(), 0, 0)
+        && fwrite(tail, 1, TAIL_SIZE, _fp) == TAIL_SIZE && fflush(_fp) == 0;
+    _end = offset;
+
+    return ret;
+}
+
+// 只复制有效的记录到新文件，再替换原文件
+bool MgRecordFile::compact()
+{
+    std::string tmpname(_filename + ".tmp");
+    std::string data;
+    MgRecordFile tmp;
+    bool ret = tmp.create(tmpname.c_str(), _type);
+
+    for (int k = 0; ret && k < KINDS; k++) {
+        for (int i = 0; ret && i < (int)_entries[k].size(); i++) {
+            const Entry& e = _entries[k][i];
+            if (e.offset) {
+                data.resize(e.size);
+                ret = (fseek(_fp, e.offset, SEEK_SET) == 0
+                       && (e.size == 0 || fread(&data[0], 1, e.size, _fp) == (size_t)e.size)
+                       && tmp.append(i, k, data.c_str(), e.size, e.tick, e.flags));
+            }
+        }
+    }
+    tmp.close();
+
+    if (ret) {
+        fclose(_fp);
+        _fp = NULL;
+#if defined(__WINDOWS__) || defined(WIN32)
+        ::remove(_filename.c_str());        // rename 不能覆盖已有文件
+#endif
+        ret = rename(tmpname.c_str(), _filename.c_str()) == 0;
+        if (!ret) {
+            LOGE("Fail to replace file: %s", _filename.c_str());
+        }
+    }
+    if (!ret) {
+        ::remove(tmpname.c_str());
+    }
+
+    return ret;
+}
@@ -0,0 +1,99 @@
+﻿// recordfile.h: 定义录制步的单文件容器类 MgRecordFile
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+
+#ifndef TOUCHVG_RECORDFILE_H_
+#define TOUCHVG_RECORDFILE_H_
+
+#include "githread.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+//! 录制步的单文件容器，代替目录中每步一个的重做、撤销和关键帧文件
+/*! 文件头后依次追加记录，每个记录为24字节的记录头(长度、文件号、种类、时刻、标志、校验和)和内容。
+    同一文件号和种类的记录以最后写的为准，删除时追加长度为零的删除记录。
+    关闭时追加索引记录和16字节的文件尾，打开时由文件尾直接读入索引；
+    没有有效的文件尾(录制中断)时逐个扫描记录，写打开时截掉末尾不完整的记录。
+    只读打开时找不到记录会接着扫描新追加的记录，可播放正在录制的容器。
+ */
+class MgRecordFile
+{
+public:
+    enum { REDO, UNDO, KEY, KINDS };    //!< 记录种类，对应以前的 .vgr、.vgu 和 .vgk 文件，0号重做记录为初始文档
+
+    MgRecordFile();
+    ~MgRecordFile();
+
+    //! 打开容器，forWrite 为true时不存在就新建，type 为新建时记下的录制类型
+    bool open(const char* filename, bool forWrite, int type = 0);
+
+    //! 新建容器用于写，清空已有的同名文件
+    bool create(const char* filename, int type);
+
+    //! 写打开时写出索引和文件尾，删除的记录较多时重写为紧凑的文件
+    void close();
+
+    bool isOpen() const { return !!_fp; }
+
+    //! 返回新建时记下的录制类型
+    int getType() const { return _type; }
+
+    //! 追加一个记录，代替已有的同号记录
+    /*! 文件号应按步号递增，不能超过写入后的文件长度除以24(记录头长度)；
+        文件长度不能超过2G，超过时返回false
+     */
+    bool write(int index, int kind, const char* data, int size, int tick = 0, int flags = 0);
+
+    //! 删除一个记录
+    bool remove(int index, int kind);
+
+    //! 删除文件号不小于 index 的全部记录
+    bool removeFrom(int index);
+
+    //! 读出一个记录的内容，校验和不符时返回false
+    bool read(int index, int kind, std::string& data);
+
+    //! 返回记录的字节数，-1表示没有该记录
+    long getSize(int index, int kind);
+
+    //! 取记录头中的时刻和标志
+    bool getInfo(int index, int kind, int* tick, int* flags);
+
+    //! 返回该种记录的最大文件号加1
+    int getCount(int kind);
+
+private:
+    struct Entry {
+        long    offset;     // 记录内容的位置，0表示没有该记录
+        int     size;
+        int     tick;
+        int     flags;
+        unsigned checksum;
+    };
+
+    void reset();
+    bool loadIndex(long fileSize);
+    long scan(long from, long fileSize);
+    void refresh();
+    bool append(int index, int kind, const char* data, int size, int tick, int flags);
+    bool writeIndex();
+    bool compact();
+    Entry* find(int index, int kind);
+
+    MgRecordFile(const MgRecordFile&);
+    void operator=(const MgRecordFile&);
+
+private:
+    FILE*           _fp;
+    std::string     _filename;
+    bool            _forWrite;
+    int             _type;
+    long            _end;           // 已扫描或已写到的位置
+    long            _liveBytes;     // 有效记录的字节数
+    long            _deadBytes;     // 已被代替或删除的记录的字节数
+    std::vector<Entry> _entries[KINDS];     // 按文件号的记录位置
+    GiMutex         _mutex;         // 录制线程写、播放线程读时锁定
+};
+
+#endif // TOUCHVG_RECORDFILE_H_
@@ -0,0 +1,389 @@
+﻿// recordframes.cpp: 实现播放时解码的帧 MgPlayFrame 和预解码线程 MgFramePrefetcher
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+
+#include "recordframes.h"
+#include "recordshapes.h"
+#include "mgshapedoc.h"
+#include "mglayer.h"
+#include "mglines.h"
+#include "mgspfactory.h"
+#include "mgjsonstorage.h"
+#include "mgstorage.h"
+#include "mgvector.h"
+#include <limits.h>
+#include <sstream>
+
+static const int FRAME_UNSET = INT_MIN;     // 帧文件中没有该字段
+
+MgShape* MgPlayFrame::moveDynShape(const MgShape* old, const Vector2d& vec)
+{
+    MgShape* sp = old->cloneShape();
+    sp->shape()->transform(Matrix2d::translation(vec));
+    return sp;
+}
+
+MgShape* MgPlayFrame::setDynPoints(const MgShape* old, int from, const Point2d* pts, int n)
+{
+    if (from < 0 || from + n > old->shapec()->getPointCount())
+        return NULL;
+    
+    MgShape* sp = old->cloneShape();
+    for (int i = 0; i < n; i++) {
+        sp->shape()->setPoint(from + i, pts[i]);
+    }
+    sp->shape()->update();
+    return sp;
+}
+
+// 播放端解码动态图形增量的一个图形，old 为上一帧同序号的图形
+static MgShape* applyDynDelta(MgShapeFactory *f, MgStorage* s, const MgShape* old)
+{
+    MgShape* sp = NULL;
+    int op = s->readInt("op", MgPlayFrame::DYN_SHAPE);
+    
+    if (op == MgPlayFrame::DYN_SAME && old) {
+        sp = old->cloneShape();
+    }
+    else if (op == MgPlayFrame::DYN_MOVE && old) {
+        Vector2d vec;
+        if (s->readFloatArray("vec", &vec.x, 2) == 2)
+            sp = MgPlayFrame::moveDynShape(old, vec);
+    }
+    else if (op == MgPlayFrame::DYN_POINTS && old) {
+        int n = s->readFloatArray("pts", NULL, 0);
+        mgvector<float> buf(n);
+        
+        if (n > 1 && s->readFloatArray("pts", buf.address(), n) == n) {
+            sp = MgPlayFrame::setDynPoints(old, s->readInt("from", 0), (const Point2d*)buf.address(), n / 2);
+        }
+    }
+    else if (op == MgPlayFrame::DYN_SHAPE && s->readNode("shape", 0, false)) {
+        Box2d rect;
+        sp = f->createShape(s->readInt("type", 0));
+        s->readFloatArray("extent", &rect.xmin, 4, false);
+        if (sp) {
+            sp->shape()->setExtent(rect);
+            if (!sp->load(f, s))
+                MgObject::release_pointer(sp);
+        }
+        s->readNode("shape", 0, true);
+    }
+    
+    return sp;
+}
+
+MgPlayFrame::MgPlayFrame() : index(0), ret(0), tick(FRAME_UNSET), flags(0)
+    , changeCount(FRAME_UNSET), hasXform(false), hasExtent(false), viewScale(0)
+    , shapes(NULL), dyns(NULL), dynReplace(false)
+{
+}
+
+MgPlayFrame::~MgPlayFrame()
+{
+    MgObject::release_pointer(shapes);
+    MgObject::release_pointer(dyns);
+}
+
+MgPlayFrame* MgPlayFrame::load(MgShapeFactory *f, MgStorage* s,
+                               const MgShapes* layer, const MgShapes* dynsLike,
+                               const MgShape* lastShape, const MgShapes* lastDyns)
+{
+    MgPlayFrame* frame = NULL;
+    
+    if (s && s->readNode("record", -1, false)) {
+        frame = new MgPlayFrame();
+        if (layer) {
+            frame->hasXform = s->readFloatArray("transform", &frame->xform.m11, 6, false) == 6;
+            if (frame->hasXform) {
+                frame->hasExtent = s->readFloatArray("pageExtent", &frame->pageRect.xmin, 4) == 4;
+                frame->viewScale = s->readFloat("viewScale", 0);
+            }
+            
+            frame->flags = s->readInt("flags", 0);
+            if (frame->flags & (MgRecordShapes::ADD|MgRecordShapes::EDIT)) {
+                frame->shapes = MgShapes::create(layer->getOwner(), layer->getIndex());
+                if (frame->shapes->load(f, s, true) > 0) {
+                    frame->ret |= (frame->flags == MgRecordShapes::ADD)
+                        ? MgRecordShapes::SHAPE_APPEND : MgRecordShapes::DOC_CHANGED;
+                } else {
+                    MgObject::release_pointer(frame->shapes);
+                }
+            }
+            
+            if (s->readNode("delete", -1, false)) {
+                for (int i = 0; ; i++) {
+                    std::stringstream ss;
+                    ss << "d" << i;
+                    int sid = s->readInt(ss.str().c_str(), 0);
+                    if (sid == 0)
+                        break;
+                    frame->delids.push_back(sid);
+                }
+                s->readNode("delete", -1, true);
+            }
+            if (!frame->delids.empty()) {   // 假定删除的图形都在，应用时再核对
+                frame->ret |= MgRecordShapes::DOC_CHANGED;
+            }
+        }
+        if (dynsLike) {
+            frame->dyns = MgShapes::create(dynsLike->getOwner(), dynsLike->getIndex());
+        }
+        if (dynsLike && s->readNode("dynamic", -1, false)) {
+            if (frame->dyns->load(f, s) >= 0) {
+                frame->dynReplace = true;
+                frame->ret |= MgRecordShapes::DYN_CHANGED;
+            }
+            s->readNode("dynamic", -1, true);
+        } else if (dynsLike && lastDyns && s->readNode("dyndelta", -1, false)) {
+            std::vector<const MgShape*> olds;
+            MgShapeIterator it(lastDyns);
+            int n = s->readInt("count", 0);
+            
+            while (const MgShape* sp = it.getNext()) {
+                olds.push_back(sp);
+            }
+            for (int i = 0; i < n && s->readNode("d", i, false); i++) {
+                MgShape* sp = applyDynDelta(f, s, i < (int)olds.size() ? olds[i] : NULL);
+                s->readNode("d", i, true);
+                if (sp) {
+                    frame->dyns->addShapeDirect(sp, true);
+                }
+            }
+            s->readNode("dyndelta", -1, true);
+            frame->ret |= MgRecordShapes::DYN_CHANGED;
+        } else if (dynsLike && lastShape
+                   && lastShape->shapec()->isKindOf(MgBaseLines::Type())) {
+            int n = s->readFloatArray("dyninc", NULL, 0);
+            mgvector<float> buf(n);
+            
+            if (n > 0 && s->readFloatArray("dyninc", buf.address(), n) == n) {
+                MgShape* sp = lastShape->cloneShape();
+                MgBaseLines* lines = (MgBaseLines*)sp->shape();
+                
+                // 复制的图形共用只增的顶点存储，只追加本帧的增量
+                lines->appendPoints((const Point2d*)buf.address(), n / 2);
+                frame->dyns->addShapeDirect(sp, true);
+                frame->ret |= MgRecordShapes::DYN_CHANGED;
+            }
+        }
+        frame->tick = s->readInt("tick", FRAME_UNSET);
+        frame->changeCount = s->readInt("changeCount", FRAME_UNSET);
+        
+        s->readNode("record", -1, true);
+    }
+    
+    return frame;
+}
+
+int MgPlayFrame::apply(int& curTick, MgShapeDoc* doc, MgShapes* curDyns, long* curChangeCount)
+{
+    int changed = 0;
+    
+    if (doc) {
+        if (hasXform) {
+            Box2d rect(hasExtent ? pageRect : doc->getPageRectW());
+            doc->modelTransform() = xform;
+            doc->setPageRectW(rect, viewScale > 0 ? viewScale : doc->getViewScale());
+        }
+        
+        MgShapes* stds = doc->getCurrentLayer();
+        
+        if (shapes && stds->spliceShapes(shapes) > 0) {
+            changed |= ret & (MgRecordShapes::SHAPE_APPEND | MgRecordShapes::DOC_CHANGED);
+        }
+        for (size_t i = 0; i < delids.size(); i++) {
+            if (stds->removeShape(delids[i])) {
+                changed |= MgRecordShapes::DOC_CHANGED;
+                //LOGD("removeShape id=%d", delids[i]);
+            }
+        }
+    }
+    if (curDyns && dyns && (ret & MgRecordShapes::DYN_CHANGED)) {
+        if (dynReplace) {
+            curDyns->clear();
+        }
+        curDyns->spliceShapes(dyns, false);
+        changed |= MgRecordShapes::DYN_CHANGED;
+    }
+    if (changed && tick != FRAME_UNSET) {
+        curTick = tick;
+    }
+    if (changed && curChangeCount && changeCount != FRAME_UNSET) {
+        *curChangeCount = changeCount;
+    }
+    
+    return changed;
+}
+
+MgFramePrefetcher::MgFramePrefetcher(ReadProc proc, void* owner)
+    : _proc(proc), _owner(owner), _limit(0), _index(0), _gen(0), _lastDyns(NULL)
+    , _layerLike(NULL), _dynsLike(NULL), _factory(NULL), _fetching(false), _stopping(false)
+{
+}
+
+MgFramePrefetcher::~MgFramePrefetcher()
+{
+    stop();
+    MgObject::release_pointer(_lastDyns);
+    MgObject::release_pointer(_layerLike);
+    MgObject::release_pointer(_dynsLike);
+}
+
+void MgFramePrefetcher::setLimit(int frames)
+{
+    _mutex.lock();
+    clearFrames();
+    _limit = frames > 0 ? frames : 0;
+    _mutex.unlock();
+}
+
+void MgFramePrefetcher::clearFrames()
+{
+    while (!_frames.empty()) {
+        delete _frames.front();
+        _frames.pop_front();
+    }
+    _gen++;
+    _index = 0;
+}
+
+// 复制动态图形供预解码线程使用，不与播放端共用图形对象
+static MgShapes* copyDyns(const MgShapes* dyns)
+{
+    MgShapes* p = NULL;
+    
+    if (dyns && dyns->getShapeCount() > 0) {
+        p = MgShapes::create(dyns->getOwner(), dyns->getIndex());
+        p->copyShapes(dyns, true);
+    }
+    return p;
+}
+
+// 增量按当前的动态图形解码
+void MgFramePrefetcher::start(MgShapeFactory *f, const MgShapes* layer, const MgShapes* dyns,
+                              const MgShapes* lastDyns, int index)
+{
+    _mutex.lock();
+    clearFrames();
+    _index = index;
+    _factory = f;
+    MgObject::release_pointer(_lastDyns);
+    _lastDyns = copyDyns(lastDyns);
+    MgObject::release_pointer(_layerLike);
+    _layerLike = MgShapes::create(layer->getOwner(), layer->getIndex());
+    MgObject::release_pointer(_dynsLike);
+    _dynsLike = MgShapes::create(dyns->getOwner(), dyns->getIndex());
+    _mutex.unlock();
+    
+    if (!_thread.isStarted()) {
+        _stopping = false;
+        _thread.start(fetchFrames, this);
+    }
+    _wake.set();
+}
+
+void MgFramePrefetcher::cancel()
+{
+    _mutex.lock();
+    clearFrames();
+    _mutex.unlock();
+}
+
+MgPlayFrame* MgFramePrefetcher::take(int index)
+{
+    MgPlayFrame* frame = NULL;
+    
+    _mutex.lock();
+    while (_frames.empty() && _fetching && _index == index) {
+        _mutex.unlock();                        // 正在解码这一帧时等它解码完，比重新解码快
+        _done.wait(50);
+        _mutex.lock();
+    }
+    if (!_frames.empty() && _frames.front()->index == index) {
+        frame = _frames.front();
+        _frames.pop_front();
+    }
+    _mutex.unlock();
+    
+    if (!frame) {
+        cancel();
+    }
+    return frame;
+}
+
+void MgFramePrefetcher::fetchFrames(void* data)
+{
+    MgFramePrefetcher* p = (MgFramePrefetcher*)data;
+    
+    while (!p->_stopping) {
+        p->_mutex.lock();
+        const int index = (int)p->_frames.size() < p->_limit ? p->_index : 0;
+        const long gen = p->_gen;
+        MgShapes* lastDyns = p->_lastDyns;
+        MgShapes* layer = p->_layerLike;
+        MgShapes* dynsLike = p->_dynsLike;
+        MgShapeFactory* f = p->_factory;
+        
+        if (index > 0) {
+            p->_fetching = true;
+            if (lastDyns)
+                lastDyns->addRef();
+            layer->addRef();
+            dynsLike->addRef();
+        }
+        p->_mutex.unlock();
+        
+        if (index == 0) {
+            p->_wake.wait();
+            continue;
+        }
+        
+        MgJsonStorage js;
+        MgPlayFrame* frame = MgPlayFrame::load(f, p->_proc(p->_owner, js, index), layer, dynsLike,
+                                               lastDyns ? lastDyns->getLastShape() : NULL, lastDyns);
+        MgShapes* nextDyns = NULL;
+        
+        if (frame && frame->ret) {      // 播放端应用后保留本帧的动态图形
+            nextDyns = copyDyns(frame->dyns);
+        }
+        
+        p->_mutex.lock();
+        const bool current = gen == p->_gen;
+        const bool missing = !frame;
+        p->_fetching = false;
+        if (frame && current) {
+            frame->index = index;
+            p->_frames.push_back(frame);
+            p->_index = index + 1;
+            if (frame->ret) {
+                MgObject::release_pointer(p->_lastDyns);
+                p->_lastDyns = nextDyns;
+                nextDyns = NULL;
+            }
+            frame = NULL;
+        }
+        p->_mutex.unlock();
+        
+        MgObject::release_pointer(lastDyns);
+        MgObject::release_pointer(layer);
+        MgObject::release_pointer(dynsLike);
+        MgObject::release_pointer(nextDyns);
+        p->_done.set();
+        
+        delete frame;                   // 已重新开始时丢弃
+        if (current && missing) {
+            p->_wake.wait();            // 文件尚未写出，等下次取帧时再试
+        }
+    }
+}
+
+void MgFramePrefetcher::stop()
+{
+    if (_thread.isStarted()) {
+        _stopping = true;
+        _wake.set();
+        _thread.join();
+    }
+    cancel();
+}
@@ -0,0 +1,119 @@
+﻿// recordframes.h: 定义播放时解码的帧 MgPlayFrame 和预解码线程 MgFramePrefetcher
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+
+#ifndef TOUCHVG_RECORDFRAMES_H_
+#define TOUCHVG_RECORDFRAMES_H_
+
+#include "mgmat.h"
+#include "mgbox.h"
+#include "githread.h"
+#include <vector>
+#include <deque>
+
+class MgShape;
+class MgShapes;
+class MgShapeDoc;
+class MgShapeFactory;
+class MgStorage;
+class MgJsonStorage;
+
+//! 播放时解码好的一帧，应用时只需把图形移入文档和动态图形
+struct MgPlayFrame
+{
+    //! 动态图形增量(dyndelta)中每个图形相对上一帧同序号图形的改变方式
+    enum { DYN_SAME, DYN_MOVE, DYN_POINTS, DYN_SHAPE };
+    
+    int                 index;      // 文件号
+    int                 ret;        // 按文件内容预计的改动标志，应用时删除的图形可能已不在
+    int                 tick;
+    int                 flags;
+    int                 changeCount;
+    bool                hasXform;
+    bool                hasExtent;
+    Matrix2d            xform;
+    Box2d               pageRect;
+    float               viewScale;  // 0表示未记录
+    MgShapes*           shapes;     // 新增或改变的图形
+    std::vector<int>    delids;     // 删除的图形的ID
+    MgShapes*           dyns;       // 本帧得到的动态图形
+    bool                dynReplace; // 替换原动态图形，否则添加到原动态图形
+    
+    MgPlayFrame();
+    ~MgPlayFrame();
+    
+    //! 解码一个帧文件，layer 和 dynsLike 只用于创建同序号的图形列表，为NULL时不解码相应部分
+    static MgPlayFrame* load(MgShapeFactory *f, MgStorage* s,
+                             const MgShapes* layer, const MgShapes* dynsLike,
+                             const MgShape* lastShape, const MgShapes* lastDyns);
+    
+    //! 将解码好的图形移入文档和动态图形，返回改动标志
+    int apply(int& curTick, MgShapeDoc* doc, MgShapes* curDyns, long* curChangeCount);
+    
+    //! 平移上一帧的图形，录制端用来得到与播放端相同的解码结果
+    static MgShape* moveDynShape(const MgShape* old, const Vector2d& vec);
+    
+    //! 改变上一帧图形从 from 开始的 n 个点，超出点数时返回NULL
+    static MgShape* setDynPoints(const MgShape* old, int from, const Point2d* pts, int n);
+};
+
+//! 播放时在后台线程中预解码之后的帧
+/*! 从给定的文件号开始连续解码，增量按预解码到的上一帧的动态图形解码。
+    帧文件通过回调函数读入，取帧不是下一帧或重新开始时丢弃已解码的帧。
+ */
+class MgFramePrefetcher
+{
+public:
+    //! 读入 index 号重做记录的函数，在预解码线程中调用
+    typedef MgStorage* (*ReadProc)(void* owner, MgJsonStorage& js, int index);
+
+    MgFramePrefetcher(ReadProc proc, void* owner);
+    ~MgFramePrefetcher();
+
+    //! 设置预解码的帧数上限，0表示不预解码，丢弃已解码的帧
+    void setLimit(int frames);
+    int getLimit() const { return _limit; }
+
+    //! 从文件号 index 开始预解码，layer 和 dyns 只用于创建同序号的图形列表，lastDyns 为当前的动态图形
+    void start(MgShapeFactory *f, const MgShapes* layer, const MgShapes* dyns,
+               const MgShapes* lastDyns, int index);
+
+    //! 停止预解码并丢弃已解码的帧，线程仍在等待
+    void cancel();
+
+    //! 取出给定文件号的预解码帧，不是下一帧时返回NULL并停止预解码
+    MgPlayFrame* take(int index);
+
+    //! 取走帧后通知预解码线程接着解码
+    void resume() { _wake.set(); }
+
+    //! 结束预解码线程
+    void stop();
+
+private:
+    static void fetchFrames(void* data);
+    void clearFrames();
+
+    MgFramePrefetcher(const MgFramePrefetcher&);
+    void operator=(const MgFramePrefetcher&);
+
+private:
+    ReadProc        _proc;
+    void*           _owner;
+    std::deque<MgPlayFrame*> _frames;   // 预解码好的帧，文件号连续
+    int             _limit;         // 预解码的帧数上限，0表示在调用线程中解码
+    int             _index;         // 下一个要预解码的文件号，0表示不预解码
+    long            _gen;           // 每次重新开始预解码时递增，丢弃此前解码的帧
+    MgShapes        *_lastDyns;     // 预解码到的上一帧的动态图形，用于解码增量
+    MgShapes        *_layerLike;    // 只用其序号创建解码用的图形列表
+    MgShapes        *_dynsLike;
+    MgShapeFactory  *_factory;
+    GiMutex         _mutex;         // 保护预解码的数据
+    GiThread        _thread;
+    GiEvent         _wake;          // 取走了帧、重新开始或要结束
+    GiEvent         _done;          // 解码完一帧
+    volatile bool   _fetching;      // 正在解码 _index 帧
+    volatile bool   _stopping;
+};
+
+#endif // TOUCHVG_RECORDFRAMES_H_
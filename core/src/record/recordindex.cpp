@@ -0,0 +1,229 @@
+﻿// recordindex.cpp: 实现录制的帧索引类 MgFrameIndex
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+
+#include "recordindex.h"
+#include "recordfile.h"
+#include "mgjsonstorage.h"
+#include "mgstorage.h"
+#include "mglog.h"
+#include "../jsonstorage/mgmapfile.h"
+#include <string.h>
+
+static const bool VG_PRETTY = false;
+static const int KEYFRAME_STEPS = 100;
+static const int KEYFRAME_BYTES = 1024 * 1024;
+static const char INDEX_MAGIC[] = "VGRX";   // records.idx 的文件头，后跟版本号
+static const int INDEX_VERSION = 1;
+static const int INDEX_KEY = 0x10000;       // 帧索引标志中表示有关键帧文件的位
+
+static void putIndexInt(unsigned char* p, int value)
+{
+    for (int i = 0; i < 4; i++) {
+        p[i] = (unsigned char)((unsigned)value >> (i * 8));
+    }
+}
+
+static int getIndexInt(const unsigned char* p)
+{
+    return (int)(p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24));
+}
+
+// records.idx 由8字节的文件头和每帧8字节的时刻、标志组成(小端)，序号为文件号减1
+static bool loadIndexFile(const std::string& filename, std::vector<MgFrameEntry>& arr)
+{
+    MgMappedFile file;
+    
+    if (!file.open(filename.c_str(), false) || file.size() < 8
+        || memcmp(file.data(), INDEX_MAGIC, 4) != 0) {
+        return false;
+    }
+    
+    const unsigned char* p = (const unsigned char*)file.data() + 8;
+    const size_t n = (file.size() - 8) / 8;
+    
+    arr.resize(n);
+    for (size_t i = 0; i < n; i++, p += 8) {
+        int flags = getIndexInt(p + 4);
+        arr[i].tick = getIndexInt(p);
+        arr[i].flags = flags & ~INDEX_KEY;
+        arr[i].key = !!(flags & INDEX_KEY);
+    }
+    
+    return true;
+}
+
+MgFrameIndex::MgFrameIndex()
+    : _file(NULL), _keySteps(KEYFRAME_STEPS), _keyBytes(KEYFRAME_BYTES)
+    , _stepsSinceKey(0), _bytesSinceKey(0)
+{
+}
+
+MgFrameIndex::~MgFrameIndex()
+{
+    if (_file) {
+        fclose(_file);
+    }
+}
+
+bool MgFrameIndex::load(std::string path, std::vector<MgFrameEntry>& arr)
+{
+    if (*path.rbegin() != '/' && *path.rbegin() != '\\')
+        path += '/';
+    arr.clear();
+    if (loadIndexFile(path + "records.idx", arr))
+        return true;
+    path += "records.json";
+    
+    FILE *fp = mgopenfile(path.c_str(), "rt");
+    if (!fp) {
+        LOGE("Fail to read file: %s", path.c_str());
+        return false;
+    }
+    
+    MgJsonStorage js;
+    MgStorage* s = js.storageForRead(fp);
+    
+    fclose(fp);
+    s->readNode("records", -1, false);
+    
+    for (int i = 0; s->readNode("r", i, false); i++) {
+        MgFrameEntry entry = { s->readInt("tick", 0), s->readInt("flags", 0), s->readBool("key", false) };
+        arr.push_back(entry);
+        s->readNode("r", i, true);
+    }
+    
+    return s->readNode("records", -1, true);
+}
+
+// 有关键帧记录的帧可从此开始播放
+bool MgFrameIndex::load(MgRecordFile& file, std::vector<MgFrameEntry>& arr)
+{
+    const int n = file.getCount(MgRecordFile::REDO);
+    
+    arr.clear();
+    for (int i = 1; i < n; i++) {
+        MgFrameEntry entry = { 0, 0, file.getSize(i, MgRecordFile::KEY) >= 0 };
+        if (!file.getInfo(i, MgRecordFile::REDO, &entry.tick, &entry.flags))
+            break;
+        arr.push_back(entry);
+    }
+    
+    return n > 0;
+}
+
+void MgFrameIndex::setKeyInterval(int steps, int bytes)
+{
+    _keySteps = steps > 0 ? steps : KEYFRAME_STEPS;
+    _keyBytes = bytes > 0 ? bytes : KEYFRAME_BYTES;
+}
+
+// 已有的帧一次写入，之后每帧只追加8字节
+bool MgFrameIndex::open(const std::string& path, const std::vector<MgFrameEntry>& entries)
+{
+    std::string filename(path + "records.idx");
+    unsigned char head[8];
+    
+    if (_file) {
+        fclose(_file);
+    }
+    _path = path;
+    _file = mgopenfile(filename.c_str(), "wb");
+    if (!_file) {
+        LOGE("Fail to save file: %s", filename.c_str());
+        return false;
+    }
+    memcpy(head, INDEX_MAGIC, 4);
+    putIndexInt(head + 4, INDEX_VERSION);
+    fwrite(head, 1, sizeof(head), _file);
+    for (size_t i = 0; i < entries.size(); i++) {
+        putIndexInt(head, entries[i].tick);
+        putIndexInt(head + 4, entries[i].flags | (entries[i].key ? INDEX_KEY : 0));
+        fwrite(head, 1, sizeof(head), _file);
+    }
+    
+    return fflush(_file) == 0;
+}
+
+bool MgFrameIndex::append(int tick, int flags, bool key)
+{
+    unsigned char entry[8];
+    
+    putIndexInt(entry, tick);
+    putIndexInt(entry + 4, flags | (key ? INDEX_KEY : 0));
+    
+    return fwrite(entry, 1, sizeof(entry), _file) == sizeof(entry)
+        && fflush(_file) == 0;
+}
+
+bool MgFrameIndex::close(bool saveJson)
+{
+    if (!_file)
+        return false;
+    fclose(_file);
+    _file = NULL;
+    
+    return saveJson && saveJsonFile();
+}
+
+// 供只认 records.json 的播放端使用
+bool MgFrameIndex::saveJsonFile()
+{
+    std::vector<MgFrameEntry> entries;
+    
+    if (!loadIndexFile(_path + "records.idx", entries)) {
+        return false;
+    }
+    
+    std::string filename(_path + "records.json");
+    FILE *fp = mgopenfile(filename.c_str(), "wt");
+    bool ret = false;
+    
+    if (!fp) {
+        LOGE("Fail to save file: %s", filename.c_str());
+    } else {
+        MgJsonStorage js;
+        MgStorage* s = js.storageForStreamWrite(fp, VG_PRETTY);
+        
+        s->writeNode("records", -1, false);
+        for (size_t i = 0; i < entries.size(); i++) {
+            s->writeNode("r", (int)i, false);
+            s->writeInt("tick", entries[i].tick);
+            s->writeInt("flags", entries[i].flags);
+            if (entries[i].key) {
+                s->writeBool("key", true);
+            }
+            s->writeNode("r", (int)i, true);
+        }
+        s->writeNode("records", -1, true);
+        ret = js.save(fp, VG_PRETTY);
+        if (!ret) {
+            LOGE("Fail to save records: %s", filename.c_str());
+        }
+        fclose(fp);
+    }
+    
+    return ret;
+}
+
+bool MgFrameIndex::loadFrames(MgRecordFile* container, const std::string& path)
+{
+    bool ret = container ? load(*container, _frames) : load(path, _frames);
+    return ret && !_frames.empty();
+}
+
+int MgFrameIndex::findFrame(int tick, int& from) const
+{
+    int lo = 0, hi = (int)_frames.size();
+    
+    while (lo < hi) {               // 帧的时刻是递增的
+        int mid = (lo + hi) / 2;
+        if (_frames[mid].tick <= tick)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (from = lo; from > 0 && !_frames[from - 1].key; from--) {}
+    
+    return lo;
+}
@@ -0,0 +1,85 @@
+﻿// recordindex.h: 定义录制的帧索引类 MgFrameIndex
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+
+#ifndef TOUCHVG_RECORDINDEX_H_
+#define TOUCHVG_RECORDINDEX_H_
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+class MgRecordFile;
+
+//! 帧索引中的一帧，序号为文件号减1
+struct MgFrameEntry
+{
+    int     tick;
+    int     flags;
+    bool    key;        // 是否有关键帧文件
+};
+
+//! 录制的帧索引和关键帧间隔
+/*! 录制到目录时每帧向 records.idx 追加8字节，停止时由它生成一次 records.json；
+    容器由各帧的重做记录得到帧索引。定位时按时刻二分查找帧，从之前最近的关键帧开始应用。
+ */
+class MgFrameIndex
+{
+public:
+    MgFrameIndex();
+    ~MgFrameIndex();
+
+    //! 读入目录中的帧索引，没有 records.idx 时读以前录制的 records.json
+    static bool load(std::string path, std::vector<MgFrameEntry>& arr);
+
+    //! 由容器中各帧的重做记录得到帧索引
+    static bool load(MgRecordFile& file, std::vector<MgFrameEntry>& arr);
+
+    //! 设置每隔多少步或增量文件累计多少字节后写关键帧，0表示默认值
+    void setKeyInterval(int steps, int bytes);
+
+    //! 累计写出的增量文件的字节数
+    void addBytes(long bytes) { _bytesSinceKey += bytes; }
+
+    //! 写完一帧后判断是否该写关键帧
+    bool needKeyframe() { return ++_stepsSinceKey >= _keySteps || _bytesSinceKey >= _keyBytes; }
+
+    //! 写出关键帧后重新计数
+    void keySaved() { _stepsSinceKey = 0; _bytesSinceKey = 0; }
+
+    //! 在目录 path 中新建 records.idx 并写入已有的帧
+    bool open(const std::string& path, const std::vector<MgFrameEntry>& entries);
+
+    bool isOpen() const { return !!_file; }
+
+    //! 追加一帧并刷新到文件，录制中断时已写的帧仍可播放和定位
+    bool append(int tick, int flags, bool key);
+
+    //! 关闭 records.idx，saveJson 为true时由它生成 records.json，返回是否生成了
+    bool close(bool saveJson);
+
+    //! 播放时读入帧索引，container 为NULL时从目录 path 读入
+    bool loadFrames(MgRecordFile* container, const std::string& path);
+
+    bool hasFrames() const { return !_frames.empty(); }
+
+    //! 返回不晚于 tick 的最后一帧的文件号，from 为之前最近的有关键帧的文件号，0表示从首帧开始
+    int findFrame(int tick, int& from) const;
+
+private:
+    bool saveJsonFile();
+
+    MgFrameIndex(const MgFrameIndex&);
+    void operator=(const MgFrameIndex&);
+
+private:
+    FILE            *_file;         // 录制时追加写的 records.idx
+    std::string     _path;          // records.idx 所在的目录，以分隔符结尾
+    int             _keySteps;      // 每隔多少步写关键帧
+    int             _keyBytes;      // 增量文件累计多少字节后写关键帧
+    int             _stepsSinceKey;
+    long            _bytesSinceKey;
+    std::vector<MgFrameEntry> _frames;  // 播放时读入的帧索引
+};
+
+#endif // TOUCHVG_RECORDINDEX_H_
@@ -3,6 +3,10 @@
 // License: LGPL, https://github.com/rhcad/touchvg
 
 #include "recordshapes.h"
+#include "recordfile.h"
+#include "recordframes.h"
+#include "recordindex.h"
+#include "recordwriter.h"
 #include "mgshapedoc.h"
 #include "mglayer.h"
 #include "mglines.h"
@@ -10,57 +14,193 @@
 #include "mgstorage.h"
 #include "mgvector.h"
 #include "mglog.h"
+#include "githread.h"
+#include "gilock.h"
+#include <stdlib.h>
 #include <sstream>
 #include <map>
+#include <deque>
+#include <set>
+#include <algorithm>
 
 static const bool VG_PRETTY = false;
+static const int UNDO_MEMORY_BUDGET = 16 * 1024 * 1024;
+static const int UNDO_MAX_STEPS = 1000;
+static const int UNDO_MAX_BYTES = 64 * 1024 * 1024;
+static const char CONTAINER_EXT[] = ".vgc"; // 以此结尾的路径为单文件容器，否则为每步一个文件的目录
+
+static bool isContainerPath(const std::string& path)
+{
+    const size_t n = sizeof(CONTAINER_EXT) - 1;
+    return path.size() > n && path.compare(path.size() - n, n, CONTAINER_EXT) == 0;
+}
+
+// 读入目录或容器的帧索引
+static bool loadFrameEntries(const std::string& path, std::vector<MgFrameEntry>& arr)
+{
+    if (isContainerPath(path)) {
+        MgRecordFile file;
+        return file.open(path.c_str(), false) && MgFrameIndex::load(file, arr);
+    }
+    return MgFrameIndex::load(path, arr);
+}
+
+//! 内存中撤销环的一步，引用改变前后的图形而不复制
+struct MgRecordStep
+{
+    std::vector<MgShape*>   newsps;     // 新增或改变后的图形，重做时放入
+    std::vector<MgShape*>   oldsps;     // 改变前或已删除的图形，撤销时放回
+    std::vector<int>        newids;     // 新增图形的ID，撤销时删除
+    std::vector<int>        delids;     // 已删除图形的ID，重做时删除
+    Matrix2d                xform;
+    Box2d                   pageRect;
+    float                   viewScale;
+    int                     tick;
+    long                    changeOld;  // 撤销后的改变计数
+    long                    changeNew;  // 重做后的改变计数
+    int                     bytes;      // 估算的内存字节数
+    
+    MgRecordStep() : viewScale(0), tick(0), changeOld(0), changeNew(0), bytes(sizeof(MgRecordStep)) {}
+    ~MgRecordStep() {
+        for (size_t i = 0; i < newsps.size(); i++)
+            newsps[i]->release();
+        for (size_t i = 0; i < oldsps.size(); i++)
+            oldsps[i]->release();
+    }
+    void addShape(std::vector<MgShape*>& arr, const MgShape* sp) {
+        if (sp) {
+            arr.push_back(const_cast<MgShape*>(sp));
+            arr.back()->addRef();
+            bytes += (int)sizeof(MgShape) * 4 + sp->shapec()->getPointCount() * (int)sizeof(Point2d);
+        }
+    }
+    void addID(std::vector<int>& arr, int sid) {
+        arr.push_back(sid);
+        bytes += (int)sizeof(int);
+    }
+};
 
 struct MgRecordShapes::Impl
 {
+    typedef std::map<int, MgRecordStep*> Ring;
+    typedef MgRecordWriter::Task Task;
+    struct History {            // 撤销历史中的一步，序号为文件号
+        int         index;
+        long        redoBytes;
+        long        undoBytes;
+        int         tick;
+    };
+    
     std::string     path;
     int             type;
     std::map<int, long>  id2ver;
+    long            journalId;  // 图形列表改动日志的标识和已比较到的位置，见 MgShapes::getChangedIDs
+    long            journalPos;
     volatile int    fileCount;
     volatile int    maxCount;
     volatile long   loading;
     MgShapeDoc      *lastDoc;
     MgShape         *lastShape;
+    MgShapes        *lastDyns;  // 播放端在上一帧得到的动态图形，写增量时与之比较
     volatile long   startTick;
     int             tick, lastTick;
     int             flags[2];
     int             shapeCount;
-    MgJsonStorage   *js[3];
-    MgStorage       *s[3];
+    MgJsonStorage   *js[2];
+    MgStorage       *s[2];
+    bool            indexing;   // 要写帧索引，开始录制或恢复录制时才打开，以免清掉要恢复的帧
+    MgRecordFile    *container; // 单文件容器，NULL表示每步写一个文件
+    Ring            ring;       // 内存中的撤销环，按 fileCount-1 序号，超出预算的步改从文件撤销重做
+    MgRecordStep    *step;      // 正在录制的步
+    int             ringBytes;
+    int             budget;
+    MgRecordWriter  writer;     // 录制线程的队列
+    MgFrameIndex    frameIndex; // 帧索引和关键帧间隔
+    std::deque<History> history;    // 可撤销和重做的步，超出限制时丢弃最早的步
+    int             firstIndex;     // 最早可撤销的步的文件号
+    int             maxSteps;
+    long            maxBytes;
+    int             maxAge;         // 最早的步与最新的步的时间间隔上限，0表示不限
+    long            historyBytes;
+    int             squashTicks;    // 在此时长内连续改变相同图形时合并为一步，0表示不合并
+    bool            squash;         // 本步合并到上一步
+    std::vector<int> edits;         // 本步改变的图形ID(不含增删)
+    std::vector<int> lastEdits;     // 上一步改变的图形ID，为空表示上一步不能合并
+    long            fileBytes[2];   // 本步写出的重做和撤销文件的字节数
+    MgFramePrefetcher prefetcher;   // 播放时预解码之后的帧
     
-    Impl(long curTick) : fileCount(0), maxCount(0), loading(0), lastDoc(NULL)
-        , lastShape(NULL), startTick(curTick), tick(0), lastTick(0)
+    Impl(long curTick) : journalId(0), journalPos(0), fileCount(0), maxCount(0), loading(0), lastDoc(NULL)
+        , lastShape(NULL), lastDyns(NULL), startTick(curTick), tick(0), lastTick(0)
+        , indexing(false), container(NULL), step(NULL), ringBytes(0), budget(UNDO_MEMORY_BUDGET)
+        , writer(writeStep, this)
+        , firstIndex(1), maxSteps(UNDO_MAX_STEPS), maxBytes(UNDO_MAX_BYTES), maxAge(0)
+        , historyBytes(0), squashTicks(0), squash(false)
+        , prefetcher(readFrame, this)
     {
         memset(flags, 0, sizeof(flags));
         memset(js, 0, sizeof(js));
         memset(s, 0, sizeof(s));
     }
     ~Impl() {
+        trimSteps(0);
+        delete step;
         MgObject::release_pointer(lastDoc);
         MgObject::release_pointer(lastShape);
+        MgObject::release_pointer(lastDyns);
+        delete container;
     }
     
     void beginJsonFile();
     bool saveJsonFile();
     std::string getFileName(bool back, int index = -1) const;
+    std::string getKeyFileName(int index) const;
+    std::string getRecordName(int kind, int index) const;
+    bool writeRecord(int kind, int index, MgJsonStorage& js, int flags, long& bytes);
+    MgStorage* readRecord(MgJsonStorage& js, int kind, int index);
+    MgRecordFile* openContainer();
+    long getRecordSize(int kind, int index);
+    void removeRecord(int kind, int index);
+    int applyFile(int kind, int index, MgShapeFactory *f, MgShapeDoc* doc, MgShapes* dyns,
+                  long* changeCount = NULL, MgShape* lastShape = NULL, const MgShapes* lastDyns = NULL);
+    bool saveKeyframe(const MgShapes* dynShapes);
+    bool loadKeyframe(MgShapeFactory *f, MgShapeDoc* doc, MgShapes* dyns, int index);
     void resetVersion(const MgShapes* shapes);
     void startRecord();
     void stopRecordIndex();
-    bool saveIndexFile(bool ended);
+    bool openIndex(const std::vector<MgFrameEntry>& entries);
     void recordShapes(const MgShapes* shapes);
     bool forUndo() const { return type == 0; }
     bool incrementRecord(MgShapes* dynShapes);
+    bool deltaRecord(const MgShapes* dynShapes, MgShapes*& decoded);
+    void keepDyns(const MgShapes* dyns);
+    
+    bool recordStep(const Task& task);
+    static bool writeStep(void* owner, const Task& task) { return ((Impl*)owner)->recordStep(task); }
+    
+    void pushStep(long changeCountOld, long changeCountNew);
+    void squashStep(long changeCountNew);
+    bool canSquash() const;
+    void addHistory(int maxCountOld);
+    void trimHistory();
+    void removeFiles(int index);
+    void restoreHistory(int tick);
+    void trimSteps(int from);
+    void fitBudget();
+    bool applyStep(MgShapeDoc* doc, bool undo, long* changeCount);
+    
+    static MgStorage* readFrame(void* owner, MgJsonStorage& js, int index) {
+        return ((Impl*)owner)->readRecord(js, MgRecordFile::REDO, index);
+    }
 };
 
 MgRecordShapes::MgRecordShapes(const char* path, MgShapeDoc* doc, bool forUndo, long curTick)
 {
     _im = new Impl(curTick);
     _im->path = path;
-    if (*_im->path.rbegin() != '/' && *_im->path.rbegin() != '\\') {
+    if (isContainerPath(_im->path)) {
+        _im->container = new MgRecordFile();    // 用到时再打开，见 Impl::openContainer
+    }
+    else if (*_im->path.rbegin() != '/' && *_im->path.rbegin() != '\\') {
         _im->path += '/';
     }
     _im->type = forUndo ? 0 : doc ? 1 : 2;
@@ -73,12 +213,15 @@ MgRecordShapes::MgRecordShapes(const char* path, MgShapeDoc* doc, bool forUndo,
 
 MgRecordShapes::~MgRecordShapes()
 {
+    _im->prefetcher.stop();
+    _im->writer.stop();
     _im->stopRecordIndex();
     delete _im;
 }
 
 void MgRecordShapes::stopRecordIndex()
 {
+    _im->writer.flush();
     _im->stopRecordIndex();
 }
 
@@ -124,21 +267,7 @@ bool MgRecordShapes::onResume(long ticks)
 bool MgRecordShapes::recordStep(long tick, long changeCountOld, long changeCountNew, MgShapeDoc* doc,
                                 MgShapes* dynShapes, const std::vector<MgShapes*>& extShapes)
 {
-    _im->beginJsonFile();
-    _im->tick = (int)tick;
-    
-    bool needDyn = _im->lastDoc && !_im->forUndo();
-    if (doc) {
-        if (_im->lastDoc) {     // undo() set lastDoc as null
-            _im->recordShapes(doc->getCurrentLayer());
-            MgObject::release_pointer(_im->lastDoc);
-            if (_im->flags[0])
-                MgObject::release_pointer(_im->lastShape);
-        }
-        _im->lastDoc = doc;
-    }
-    
-    if (!extShapes.empty()) {
+    if (!extShapes.empty()) {   // 调用者随后释放 extShapes，先合并引用
         MgShapes* newsp = MgShapes::create();
         newsp->copyShapes(dynShapes, false, false);
         for (size_t i = 0; i < extShapes.size(); i++) {
@@ -147,35 +276,121 @@ bool MgRecordShapes::recordStep(long tick, long changeCountOld, long changeCount
         MgObject::release_pointer(dynShapes);
         dynShapes = newsp;
     }
+    
+    Impl::Task task = { tick, changeCountOld, changeCountNew, doc, dynShapes };
+    
+    return _im->writer.push(task);
+}
+
+bool MgRecordShapes::Impl::recordStep(const Task& task)
+{
+    MgShapeDoc* doc = task.doc;
+    MgShapes* dynShapes = task.dynShapes;
+    
+    beginJsonFile();
+    tick = (int)task.tick;
+    if (forUndo() && budget > 0) {
+        step = new MgRecordStep();
+    }
+    
+    bool needDyn = lastDoc && !forUndo();
+    if (doc) {
+        if (lastDoc) {          // undo() set lastDoc as null
+            recordShapes(doc->getCurrentLayer());
+            MgObject::release_pointer(lastDoc);
+            if (flags[0])
+                MgObject::release_pointer(lastShape);
+        }
+        lastDoc = doc;
+    }
+    
+    MgShapes* decoded = NULL;   // 播放端按增量得到的动态图形
+    
     if (needDyn && dynShapes && dynShapes->getShapeCount() > 0) {
-        if (!_im->incrementRecord(dynShapes)) {
-            _im->flags[0] |= DYN;
-            _im->s[0]->writeNode("dynamic", -1, false);
-            dynShapes->save(_im->s[0]);
-            _im->s[0]->writeNode("dynamic", -1, true);
+        if (!incrementRecord(dynShapes) && !deltaRecord(dynShapes, decoded)) {
+            flags[0] |= DYN;
+            s[0]->writeNode("dynamic", -1, false);
+            dynShapes->save(s[0]);
+            s[0]->writeNode("dynamic", -1, true);
         }
     }
-    MgObject::release_pointer(dynShapes);
     
-    _im->s[0]->writeInt("flags", _im->flags[0]);
-    if (_im->flags[0] != DYN) {
-        _im->s[0]->writeInt("changeCount", (int)changeCountNew);
-        _im->s[1]->writeInt("changeCount", (int)changeCountOld);
+    s[0]->writeInt("flags", flags[0]);
+    if (flags[0] != DYN) {
+        s[0]->writeInt("changeCount", (int)task.changeCountNew);
+        s[1]->writeInt("changeCount", (int)task.changeCountOld);
     }
     
-    bool ret = _im->saveJsonFile();
+    std::sort(edits.begin(), edits.end());
+    squash = forUndo() && canSquash();
     
-    if (ret && _im->s[2]) {
-        _im->s[2]->writeNode("r", _im->fileCount - 2, false);
-        _im->s[2]->writeInt("tick", _im->tick);
-        _im->s[2]->writeInt("flags", _im->flags[0]);
-        _im->s[2]->writeNode("r", _im->fileCount - 2, true);
-        
-        if (_im->fileCount % 10 == 0 || _im->flags[0] != MgRecordShapes::DYN) {
-            _im->saveIndexFile(false);
+    const int maxCountOld = maxCount;
+    bool ret = saveJsonFile();
+    
+    if (ret && !squash) {
+        writer.addWritten(fileCount - 1);
+    }
+    if (ret && step && lastDoc) {
+        if (squash)
+            squashStep(task.changeCountNew);
+        else
+            pushStep(task.changeCountOld, task.changeCountNew);
+    }
+    delete step;
+    step = NULL;
+    
+    if (ret && forUndo()) {
+        addHistory(maxCountOld);
+        lastEdits.clear();
+        if (flags[0] == EDIT && flags[1] == EDIT) {
+            lastEdits.swap(edits);
         }
+        trimHistory();
     }
+    squash = false;
     
+    if (ret && needDyn) {       // 丢弃的帧不改变播放端的动态图形
+        MgObject::release_pointer(lastDyns);
+        if (flags[0] & DYN) {
+            lastDyns = decoded ? decoded : dynShapes->shallowCopy();
+            decoded = NULL;
+        }
+    }
+    MgObject::release_pointer(decoded);
+    
+    bool key = ret && !forUndo() && lastDoc && frameIndex.needKeyframe() && saveKeyframe(lastDyns);
+    MgObject::release_pointer(dynShapes);
+    
+    if (ret && indexing && (frameIndex.isOpen() || openIndex(std::vector<MgFrameEntry>()))) {
+        frameIndex.append(tick, flags[0], key);
+    }
+    
+    return ret;
+}
+
+void MgRecordShapes::setWriteQueue(int size)
+{
+    _im->writer.setQueueSize(size);
+}
+
+void MgRecordShapes::setKeyframeInterval(int steps, int bytes)
+{
+    _im->frameIndex.setKeyInterval(steps, bytes);
+}
+
+void MgRecordShapes::flush()
+{
+    _im->writer.flush();
+}
+
+bool MgRecordShapes::takeWrittenFile(std::string& filename)
+{
+    int index;
+    bool ret = _im->writer.takeWritten(index);
+    
+    if (ret) {
+        filename = getFileName(false, index);
+    }
     return ret;
 }
 
@@ -210,64 +425,328 @@ bool MgRecordShapes::Impl::incrementRecord(MgShapes* dynShapes)
     return ret;
 }
 
+// 按JSON文件中保存的精度(%g)舍入，使录制端按增量得到的图形与播放端的相同
+static float savedFloat(float value)
+{
+    char buf[32];
+#if defined(_MSC_VER) && _MSC_VER >= 1400 // VC8
+    sprintf_s(buf, sizeof(buf), "%g", (double)value);
+#else
+    sprintf(buf, "%g", (double)value);
+#endif
+    return (float)atof(buf);
+}
+
+// 动态图形与上一帧的按序号逐个比较，只写平移量、改变的点段或整个新图形
+bool MgRecordShapes::Impl::deltaRecord(const MgShapes* dynShapes, MgShapes*& decoded)
+{
+    if (!lastDyns)
+        return false;
+    
+    struct Delta {
+        int op;
+        int from;
+        Vector2d vec;
+        std::vector<Point2d> pts;
+    };
+    std::vector<const MgShape*> olds;
+    std::vector<Delta> deltas;
+    MgShapeIterator oldit(lastDyns);
+    MgShapeIterator it(dynShapes);
+    int reused = 0;
+    
+    while (const MgShape* sp = oldit.getNext()) {
+        olds.push_back(sp);
+    }
+    
+    decoded = MgShapes::create();
+    deltas.resize(dynShapes->getShapeCount());
+    for (size_t i = 0; i < deltas.size(); i++) {
+        const MgShape* sp = it.getNext();
+        const MgShape* old = i < olds.size() ? olds[i] : NULL;
+        const int n = sp->shapec()->getPointCount();
+        Delta& d = deltas[i];
+        MgShape* newsp = NULL;
+        
+        d.op = MgPlayFrame::DYN_SHAPE;
+        d.from = 0;
+        if (old && old->getType() == sp->getType() && old->shapec()->getPointCount() == n) {
+            if (old->equals(*sp)) {
+                d.op = MgPlayFrame::DYN_SAME;
+                newsp = old->cloneShape();
+            }
+            else if (n > 0) {
+                Vector2d vec(sp->shapec()->getPoint(0) - old->shapec()->getPoint(0));
+                
+                d.vec.set(savedFloat(vec.x), savedFloat(vec.y));
+                newsp = MgPlayFrame::moveDynShape(old, d.vec);
+                if (newsp->equals(*sp)) {
+                    d.op = MgPlayFrame::DYN_MOVE;
+                } else {
+                    MgObject::release_pointer(newsp);
+                    
+                    int to = -1;
+                    for (int j = 0; j < n; j++) {
+                        if (sp->shapec()->getPoint(j) != old->shapec()->getPoint(j)) {
+                            d.from = to < 0 ? j : d.from;
+                            to = j;
+                        }
+                    }
+                    for (int j = d.from; j <= to; j++) {
+                        Point2d pt(sp->shapec()->getPoint(j));
+                        d.pts.push_back(Point2d(savedFloat(pt.x), savedFloat(pt.y)));
+                    }
+                    if (!d.pts.empty()) {
+                        newsp = MgPlayFrame::setDynPoints(old, d.from, &d.pts.front(), (int)d.pts.size());
+                    }
+                    if (newsp && newsp->equals(*sp)) {
+                        d.op = MgPlayFrame::DYN_POINTS;
+                    } else {
+                        MgObject::release_pointer(newsp);
+                    }
+                }
+            }
+        }
+        if (!newsp) {
+            newsp = sp->cloneShape();
+        }
+        decoded->addShapeDirect(newsp, true);
+        reused += d.op != MgPlayFrame::DYN_SHAPE ? 1 : 0;
+    }
+    
+    if (reused == 0) {          // 全是新图形时写完整的动态图形
+        MgObject::release_pointer(decoded);
+        return false;
+    }
+    
+    flags[0] |= DYN;
+    s[0]->writeNode("dyndelta", -1, false);
+    s[0]->writeInt("count", (int)deltas.size());
+    
+    MgShapeIterator wit(dynShapes);
+    for (int i = 0; const MgShape* sp = wit.getNext(); i++) {
+        const Delta& d = deltas[i];
+        
+        s[0]->writeNode("d", i, false);
+        s[0]->writeInt("op", d.op);
+        if (d.op == MgPlayFrame::DYN_MOVE) {
+            s[0]->writeFloatArray("vec", &d.vec.x, 2);
+        }
+        else if (d.op == MgPlayFrame::DYN_POINTS) {
+            s[0]->writeInt("from", d.from);
+            s[0]->writeFloatArray("pts", &d.pts.front().x, (int)d.pts.size() * 2);
+        }
+        else if (d.op == MgPlayFrame::DYN_SHAPE) {
+            dynShapes->saveShape(s[0], sp, 0);
+        }
+        s[0]->writeNode("d", i, true);
+    }
+    s[0]->writeNode("dyndelta", -1, true);
+    
+    return true;
+}
+
+// 播放端记下应用一帧后的动态图形，以便解码下一帧的增量
+void MgRecordShapes::Impl::keepDyns(const MgShapes* dyns)
+{
+    MgObject::release_pointer(lastShape);
+    MgObject::release_pointer(lastDyns);
+    if (dyns && dyns->getShapeCount() > 0) {
+        lastShape = const_cast<MgShape*>(dyns->getLastShape());
+        lastShape->addRef();
+        lastDyns = dyns->shallowCopy();
+    }
+}
+
 void MgRecordShapes::resetDoc(MgShapeDoc* doc)
 {
+    _im->writer.flush();
+    _im->lastEdits.clear();
     if (doc) {
         MgObject::release_pointer(_im->lastDoc);
         _im->lastDoc = doc;
     }
 }
 
+void MgRecordShapes::setMemoryBudget(int bytes)
+{
+    _im->budget = bytes > 0 ? bytes : 0;
+    _im->fitBudget();
+}
+
+int MgRecordShapes::getMemoryBudget() const
+{
+    return _im->budget;
+}
+
+void MgRecordShapes::setHistoryLimit(int steps, int bytes, int ticks)
+{
+    _im->writer.flush();
+    _im->maxSteps = steps >= 0 ? steps : _im->maxSteps;
+    _im->maxBytes = bytes >= 0 ? bytes : _im->maxBytes;
+    _im->maxAge = ticks >= 0 ? ticks : _im->maxAge;
+    _im->trimHistory();
+}
+
+void MgRecordShapes::setSquashInterval(int ticks)
+{
+    _im->writer.flush();
+    _im->squashTicks = ticks > 0 ? ticks : 0;
+}
+
+int MgRecordShapes::getFirstIndex() const
+{
+    return _im->firstIndex;
+}
+
+static long getFileSize(const std::string& filename)
+{
+    FILE *fp = mgopenfile(filename.c_str(), "rb");
+    long size = -1;
+    
+    if (fp) {
+        fseek(fp, 0, SEEK_END);
+        size = ftell(fp);
+        fclose(fp);
+    }
+    return size;
+}
+
+// 继续上次的撤销历史，向前找到还在的最早一步，时长从恢复时算起
+void MgRecordShapes::Impl::restoreHistory(int tick)
+{
+    history.clear();
+    historyBytes = 0;
+    lastEdits.clear();
+    
+    for (firstIndex = fileCount; firstIndex > 1; firstIndex--) {
+        if (getRecordSize(MgRecordFile::UNDO, firstIndex - 1) < 0)
+            break;
+    }
+    for (int i = firstIndex; i < maxCount; i++) {
+        History h = { i, getRecordSize(MgRecordFile::REDO, i), getRecordSize(MgRecordFile::UNDO, i), tick };
+        h.redoBytes = h.redoBytes > 0 ? h.redoBytes : 0;
+        h.undoBytes = h.undoBytes > 0 ? h.undoBytes : 0;
+        history.push_back(h);
+        historyBytes += h.redoBytes + h.undoBytes;
+    }
+    trimHistory();
+}
+
 void MgRecordShapes::restore(int index, int count, int tick, long curTick)
 {
-    std::vector<int> arr;
+    std::vector<MgFrameEntry> arr;
     
-    if (_im->s[2] && loadFrameIndex(_im->path, arr)) {
-        for (unsigned i = 0; i + 2 < arr.size(); i += 3) {
-            _im->s[2]->writeNode("r", i / 3, false);
-            _im->s[2]->writeInt("tick", arr[i + 1]);
-            _im->s[2]->writeInt("flags", arr[i + 2]);
-            _im->s[2]->writeNode("r", i / 3, true);
-        }
+    _im->writer.flush();
+    _im->prefetcher.cancel();
+    if (_im->container && _im->container->open(_im->path.c_str(), _im->type < 2, _im->type)
+        && _im->type == 1) {
+        _im->container->removeFrom(mgMax(index, 1));    // 之后的帧将重新录制
+    }
+    if (_im->indexing) {
+        MgFrameEntry entry = { 0, 0, false };
+        loadFrameEntries(_im->path, arr);
+        arr.resize(mgMax(index - 1, 0), entry);     // 之后的帧将重新录制，缺的帧补齐以对应文件号
+        _im->openIndex(arr);
     }
     _im->fileCount = index;
     _im->maxCount = count ? count : index;
     _im->startTick = curTick - tick;
+    _im->trimSteps(0);
+    if (_im->forUndo()) {
+        _im->restoreHistory(tick);
+    }
+    MgObject::release_pointer(_im->lastDyns);
     LOGD("restore fileCount=%d, maxCount=%d, startTick=%d, frames=%d",
-         _im->fileCount, _im->maxCount, tick, (int)arr.size() / 3);
+         _im->fileCount, _im->maxCount, tick, (int)arr.size());
 }
 
-bool MgRecordShapes::loadFrameIndex(std::string path, std::vector<int>& arr)
+bool MgRecordShapes::exportFiles(const char* container, const char* path)
 {
-    if (*path.rbegin() != '/' && *path.rbegin() != '\\')
-        path += '/';
-    path += "records.json";
+    MgRecordFile file;
+    Impl im(0);
+    std::string data;
+    bool ret = file.open(container, false);
     
-    FILE *fp = mgopenfile(path.c_str(), "rt");
-    if (!fp) {
-        LOGE("Fail to read file: %s", path.c_str());
-        return false;
+    im.path = path ? path : "";
+    if (!im.path.empty() && *im.path.rbegin() != '/' && *im.path.rbegin() != '\\') {
+        im.path += '/';
+    }
+    for (int k = 0; ret && k < MgRecordFile::KINDS; k++) {
+        const int n = file.getCount(k);
+        
+        for (int i = 0; ret && i < n; i++) {
+            if (file.read(i, k, data)) {
+                std::string filename(im.getRecordName(k, i));
+                FILE *fp = mgopenfile(filename.c_str(), "wt");
+                
+                ret = fp && fwrite(data.c_str(), 1, data.size(), fp) == data.size();
+                if (fp) {
+                    fclose(fp);
+                }
+                if (!ret) {
+                    LOGE("Fail to save file: %s", filename.c_str());
+                }
+            }
+        }
+    }
+    if (ret && file.getType() == 1) {       // 录制的容器还要写出帧索引
+        std::vector<MgFrameEntry> arr;
+        
+        MgFrameIndex::load(file, arr);
+        ret = im.openIndex(arr);
+        im.fileCount = (int)arr.size() + 1;
+        im.stopRecordIndex();
     }
     
-    MgJsonStorage js;
-    MgStorage* s = js.storageForRead(fp);
-    
-    fclose(fp);
-    s->readNode("records", -1, false);
+    return ret;
+}
+
+bool MgRecordShapes::loadFrameIndex(std::string path, std::vector<int>& arr)
+{
+    std::vector<MgFrameEntry> entries;
     
-    for (int i = 0; s->readNode("r", i, false); i++) {
-        arr.push_back(i + 1);
-        arr.push_back(s->readInt("tick", 0));
-        arr.push_back(s->readInt("flags", 0));
-        s->readNode("r", i, true);
+    if (!loadFrameEntries(path, entries))
+        return false;
+    for (size_t i = 0; i < entries.size(); i++) {
+        arr.push_back((int)i + 1);
+        arr.push_back(entries[i].tick);
+        arr.push_back(entries[i].flags);
     }
     
-    return s->readNode("records", -1, true);
+    return true;
 }
 
 std::string MgRecordShapes::getFileName(bool back, int index) const
 {
-    return _im->getFileName(back, index);
+    return _im->container ? _im->path : _im->getFileName(back, index);
+}
+
+bool MgRecordShapes::isContainer() const
+{
+    return !!_im->container;
+}
+
+bool MgRecordShapes::saveFirstFile()
+{
+    MgJsonStorage js;
+    MgStorage* s = js.storageForStreamWrite(VG_PRETTY);
+    long bytes = 0;
+    
+    _im->writer.flush();
+    if (_im->container) {
+        _im->container->close();    // 重新录制时清空已有的容器
+    }
+    if (_im->indexing) {
+        _im->openIndex(std::vector<MgFrameEntry>());
+    }
+    bool ret = (_im->lastDoc && _im->lastDoc->save(s, 0)
+                && _im->writeRecord(MgRecordFile::REDO, 0, js, 0, bytes));
+    if (!ret) {
+        LOGE("Fail to save the first file: %s", getFileName(false, 0).c_str());
+    }
+    
+    return ret;
 }
 
 std::string MgRecordShapes::getPath() const
@@ -280,13 +759,16 @@ bool MgRecordShapes::isLoading() const
     return _im->loading > 0;
 }
 
+// 入队的步写出后才知道是否有改动、是否写成功，先等录制线程写完
 bool MgRecordShapes::canUndo() const
 {
-    return _im->fileCount > 1 && !_im->loading;
+    _im->writer.flush();
+    return _im->fileCount > _im->firstIndex && !_im->loading;
 }
 
 bool MgRecordShapes::canRedo() const
 {
+    _im->writer.flush();
     return _im->fileCount < _im->maxCount && !_im->loading;
 }
 
@@ -300,19 +782,27 @@ void MgRecordShapes::setLoading(bool loading)
 
 bool MgRecordShapes::undo(MgShapeFactory *factory, MgShapeDoc* doc, long* changeCount)
 {
-    if (_im->loading > 1 || !_im->lastDoc)
+    _im->writer.flush();
+    if (_im->loading > 1 || !_im->lastDoc || _im->fileCount <= _im->firstIndex)
         return false;
     
+    _im->lastEdits.clear();
     giAtomicIncrement(&_im->loading);
     
-    std::string fn(_im->getFileName(true, _im->fileCount - 1));
-    int ret = applyFile(_im->tick, factory, doc, NULL, fn.c_str(), changeCount);
+    std::string fn;
+    int ret = _im->applyStep(doc, true, changeCount) ? DOC_CHANGED : 0;
     
+    if (!ret) {
+        fn = _im->getFileName(true, _im->fileCount - 1);
+        ret = _im->applyFile(MgRecordFile::UNDO, _im->fileCount - 1, factory, doc, NULL, changeCount);
+        if (ret) {
+            _im->resetVersion(doc->getCurrentLayer());
+        }
+    }
     if (ret) {
         _im->fileCount--;
-        _im->resetVersion(doc->getCurrentLayer());
         MgObject::release_pointer(_im->lastDoc);
-        LOGD("Undo with %s", fn.c_str());
+        LOGD("Undo with %s", fn.empty() ? "memory" : fn.c_str());
     }
     giAtomicDecrement(&_im->loading);
     
@@ -321,19 +811,27 @@ bool MgRecordShapes::undo(MgShapeFactory *factory, MgShapeDoc* doc, long* change
 
 bool MgRecordShapes::redo(MgShapeFactory *factory, MgShapeDoc* doc, long* changeCount)
 {
+    _im->writer.flush();
     if (_im->loading > 1)
         return false;
     
+    _im->lastEdits.clear();
     giAtomicIncrement(&_im->loading);
     
-    std::string fn(_im->getFileName(false, _im->fileCount));
-    int ret = applyFile(_im->tick, factory, doc, NULL, fn.c_str(), changeCount);
+    std::string fn;
+    int ret = _im->applyStep(doc, false, changeCount) ? DOC_CHANGED : 0;
     
+    if (!ret) {
+        fn = _im->getFileName(false, _im->fileCount);
+        ret = _im->applyFile(MgRecordFile::REDO, _im->fileCount, factory, doc, NULL, changeCount);
+        if (ret) {
+            _im->resetVersion(doc->getCurrentLayer());
+        }
+    }
     if (ret) {
         _im->fileCount++;
-        _im->resetVersion(doc->getCurrentLayer());
         MgObject::release_pointer(_im->lastDoc);
-        LOGD("Redo with %s", fn.c_str());
+        LOGD("Redo with %s", fn.empty() ? "memory" : fn.c_str());
     }
     giAtomicDecrement(&_im->loading);
     
@@ -342,17 +840,51 @@ bool MgRecordShapes::redo(MgShapeFactory *factory, MgShapeDoc* doc, long* change
 
 void MgRecordShapes::Impl::recordShapes(const MgShapes* shapes)
 {
-    MgShapeIterator it(shapes);
-    std::map<int, long> tmpids(id2ver);
     std::map<int, long>::iterator i;
     int i2 = 0;
     int sid;
-    std::vector<int> newids;
+    std::vector<int> newids, delids, ids;
+    std::vector<const MgShape*> changed;                        // 新增或改变的图形
+    
+    if (shapes->getChangedIDs(journalId, journalPos, ids)) {    // 只比较改动日志中的图形
+        std::set<int> done;
+        
+        for (size_t k = 0; k < ids.size(); k++) {
+            sid = ids[k];
+            if (!done.insert(sid).second)
+                continue;
+            const MgShape* sp = shapes->findShape(sid);
+            i = id2ver.find(sid);
+            if (sp && (i == id2ver.end() || i->second != sp->shapec()->getChangeCount()))
+                changed.push_back(sp);
+            else if (!sp && i != id2ver.end())
+                delids.push_back(sid);
+        }
+        std::sort(delids.begin(), delids.end());
+    } else {                                                    // 比较全部图形
+        MgShapeIterator it(shapes);
+        std::map<int, long> tmpids(id2ver);
+        
+        while (const MgShape* sp = it.getNext()) {
+            i = tmpids.find(sp->getID());
+            if (i == tmpids.end()) {
+                changed.push_back(sp);
+            } else {
+                if (i->second != sp->shapec()->getChangeCount())
+                    changed.push_back(sp);
+                tmpids.erase(i);                                // 标记是已有图形
+            }
+        }
+        for (i = tmpids.begin(); i != tmpids.end(); ++i) {
+            delids.push_back(i->first);
+        }
+    }
     
     s[0]->writeNode("shapes", shapes->getIndex(), false);
     s[1]->writeNode("shapes", shapes->getIndex(), false);
     
-    while (const MgShape* sp = it.getNext()) {
+    for (size_t k = 0; k < changed.size(); k++) {
+        const MgShape* sp = changed[k];
         sid = sp->getID();
         i = id2ver.find(sid);                                   // 查找是否之前已存在
         
@@ -360,35 +892,46 @@ void MgRecordShapes::Impl::recordShapes(const MgShapes* shapes)
             newids.push_back(sid);
             id2ver[sid] = sp->shapec()->getChangeCount();       // 增加记录版本
             shapes->saveShape(s[0], sp, shapeCount++);          // 写图形节点
+            if (step) {
+                step->addShape(step->newsps, sp);
+                step->addID(step->newids, sid);
+            }
             flags[0] |= flags[0] ? EDIT : ADD;
         } else {
-            tmpids.erase(tmpids.find(sid));                     // 标记是已有图形
             if (i->second != sp->shapec()->getChangeCount()) {  // 改变的图形
                 i->second = sp->shapec()->getChangeCount();
                 id2ver[sid] = sp->shapec()->getChangeCount();   // 更新版本
                 shapes->saveShape(s[0], sp, shapeCount++);
+                edits.push_back(sid);
                 flags[0] |= EDIT;
                 i2 += shapes->saveShape(s[1], lastDoc->findShape(sid), i2) ? 1 : 0;
+                if (step) {
+                    step->addShape(step->newsps, sp);
+                    step->addShape(step->oldsps, lastDoc->findShape(sid));
+                }
                 flags[1] |= EDIT;
             }
         }
     }
     s[0]->writeNode("shapes", shapes->getIndex(), true);
-    s[0]->writeInt("count", shapeCount += (int)tmpids.size());
+    s[0]->writeInt("count", shapeCount += (int)delids.size());
     
-    if (!tmpids.empty()) {                                      // 之前存在，现在已删除
+    if (!delids.empty()) {                                      // 之前存在，现在已删除
         flags[0] |= DEL;
         s[0]->writeNode("delete", -1, false);
-        int j = 0;
-        for (i = tmpids.begin(); i != tmpids.end(); ++i) {
-            sid = i->first;
+        for (size_t j = 0; j < delids.size(); j++) {
+            sid = delids[j];
             id2ver.erase(id2ver.find(sid));
             
             std::stringstream ss;
-            ss << "d" << j++;
+            ss << "d" << j;
             s[0]->writeInt(ss.str().c_str(), sid);              // 记下删除的图形的ID
             flags[1] |= ADD;
             i2 += shapes->saveShape(s[1], lastDoc->findShape(sid), i2) ? 1 : 0;
+            if (step) {
+                step->addShape(step->oldsps, lastDoc->findShape(sid));
+                step->addID(step->delids, sid);
+            }
         }
         s[0]->writeNode("delete", -1, true);
     }
@@ -409,23 +952,187 @@ void MgRecordShapes::Impl::recordShapes(const MgShapes* shapes)
     s[1]->writeInt("count", i2 + (int)newids.size());
 }
 
+void MgRecordShapes::Impl::pushStep(long changeCountOld, long changeCountNew)
+{
+    trimSteps(fileCount - 1);       // 新的一步使之后的重做步失效
+    
+    step->xform = lastDoc->modelTransform();
+    step->pageRect = lastDoc->getPageRectW();
+    step->viewScale = lastDoc->getViewScale();
+    step->tick = tick;
+    step->changeOld = changeCountOld;
+    step->changeNew = changeCountNew;
+    ring[fileCount - 1] = step;
+    ringBytes += step->bytes;
+    step = NULL;
+    fitBudget();
+}
+
+// 本步和上一步都只改变了同一组图形，间隔不长，且上一步之后没有重做步
+bool MgRecordShapes::Impl::canSquash() const
+{
+    return squashTicks > 0 && flags[0] == EDIT && flags[1] == EDIT
+        && !lastEdits.empty() && edits == lastEdits
+        && fileCount == maxCount && fileCount - 1 >= firstIndex
+        && !history.empty() && history.back().index == fileCount - 1
+        && tick - history.back().tick <= squashTicks;
+}
+
+void MgRecordShapes::Impl::addHistory(int maxCountOld)
+{
+    if (squash) {
+        History& h = history.back();
+        historyBytes += fileBytes[0] - h.redoBytes;
+        h.redoBytes = fileBytes[0];
+        h.tick = tick;
+        return;
+    }
+    
+    const int index = fileCount - 1;
+    
+    while (!history.empty() && history.back().index >= index) {
+        historyBytes -= history.back().redoBytes + history.back().undoBytes;
+        history.pop_back();
+    }
+    for (int i = index + 1; i < maxCountOld; i++) {     // 新的一步使之后的重做步失效
+        removeFiles(i);
+    }
+    
+    History h = { index, fileBytes[0], fileBytes[1], tick };
+    history.push_back(h);
+    historyBytes += h.redoBytes + h.undoBytes;
+}
+
+// 超出步数、字节数或时长时丢弃最早的可撤销步，不丢弃重做步和最新的一步
+void MgRecordShapes::Impl::trimHistory()
+{
+    while (history.size() > 1 && history.front().index < fileCount - 1
+           && ((maxSteps > 0 && (int)history.size() > maxSteps)
+               || (maxBytes > 0 && historyBytes > maxBytes)
+               || (maxAge > 0 && history.back().tick - history.front().tick > maxAge)))
+    {
+        const History& h = history.front();
+        Ring::iterator it = ring.find(h.index);
+        
+        if (it != ring.end()) {
+            ringBytes -= it->second->bytes;
+            delete it->second;
+            ring.erase(it);
+        }
+        removeFiles(h.index);
+        firstIndex = h.index + 1;
+        historyBytes -= h.redoBytes + h.undoBytes;
+        history.pop_front();
+    }
+}
+
+void MgRecordShapes::Impl::removeFiles(int index)
+{
+    removeRecord(MgRecordFile::REDO, index);
+    removeRecord(MgRecordFile::UNDO, index);
+}
+
+// 重做文件已改写为合并后的，内存中的步只换为改变后的图形，保留改变前的图形
+void MgRecordShapes::Impl::squashStep(long changeCountNew)
+{
+    Ring::iterator it = ring.find(fileCount - 1);
+    if (it == ring.end())
+        return;
+    
+    MgRecordStep* p = it->second;
+    
+    ringBytes -= p->bytes;
+    for (size_t i = 0; i < p->newsps.size(); i++) {
+        p->bytes -= (int)sizeof(MgShape) * 4 + p->newsps[i]->shapec()->getPointCount() * (int)sizeof(Point2d);
+        p->newsps[i]->release();
+    }
+    p->newsps.clear();
+    for (size_t i = 0; i < step->newsps.size(); i++) {
+        p->addShape(p->newsps, step->newsps[i]);
+    }
+    p->xform = lastDoc->modelTransform();
+    p->pageRect = lastDoc->getPageRectW();
+    p->viewScale = lastDoc->getViewScale();
+    p->tick = tick;
+    p->changeNew = changeCountNew;
+    ringBytes += p->bytes;
+    fitBudget();
+}
+
+void MgRecordShapes::Impl::trimSteps(int from)
+{
+    Ring::iterator it = ring.lower_bound(from);
+    
+    while (it != ring.end()) {
+        ringBytes -= it->second->bytes;
+        delete it->second;
+        ring.erase(it++);
+    }
+}
+
+void MgRecordShapes::Impl::fitBudget()
+{
+    while (!ring.empty() && ringBytes > budget) {   // 溢出最早的步，改为从文件撤销
+        ringBytes -= ring.begin()->second->bytes;
+        delete ring.begin()->second;
+        ring.erase(ring.begin());
+    }
+}
+
+bool MgRecordShapes::Impl::applyStep(MgShapeDoc* doc, bool undo, long* changeCount)
+{
+    Ring::const_iterator it = ring.find(undo ? fileCount - 1 : fileCount);
+    if (it == ring.end()) {
+        return false;
+    }
+    
+    const MgRecordStep* p = it->second;
+    const std::vector<MgShape*>& sps = undo ? p->oldsps : p->newsps;
+    const std::vector<int>& ids = undo ? p->newids : p->delids;
+    MgShapes* shapes = doc->getCurrentLayer();
+    
+    doc->modelTransform() = p->xform;
+    doc->setPageRectW(p->pageRect, p->viewScale);
+    
+    for (size_t i = 0; i < sps.size(); i++) {       // 复制后放入，记录的图形可能还被其他文档共用
+        MgShape* sp = sps[i]->cloneShape();
+        
+        if (shapes->findShape(sp->getID())) {
+            shapes->updateShape(sp);
+        } else {
+            sp->release();
+            sp = shapes->addShape(*sps[i]);
+        }
+        id2ver[sp->getID()] = sp->shapec()->getChangeCount();   // 只更新改变的图形的版本
+    }
+    for (size_t i = 0; i < ids.size(); i++) {
+        shapes->removeShape(ids[i]);
+        id2ver.erase(ids[i]);
+    }
+    tick = p->tick;
+    if (changeCount) {
+        *changeCount = undo ? p->changeOld : p->changeNew;
+    }
+    
+    return true;
+}
+
 void MgRecordShapes::Impl::resetVersion(const MgShapes* shapes)
 {
     MgShapeIterator it(shapes);
     
+    std::vector<int> ids;
+    
     id2ver.clear();
     while (const MgShape* sp = it.getNext()) {
         id2ver[sp->getID()] = sp->shapec()->getChangeCount();
     }
+    shapes->getChangedIDs(journalId, journalPos, ids);     // 之后只需比较日志中的图形
 }
 
 void MgRecordShapes::Impl::startRecord()
 {
-    if (!forUndo()) {
-        js[2] = new MgJsonStorage();
-        s[2] = js[2]->storageForWrite();
-        s[2]->writeNode("records", -1, false);
-    }
+    indexing = !forUndo() && !container;    // 容器由各帧的重做记录得到帧索引
     fileCount = 1;
     maxCount = 1;
 }
@@ -438,10 +1145,12 @@ void MgRecordShapes::Impl::beginJsonFile()
     flags[0] = 0;
     flags[1] = 0;
     shapeCount = 0;
+    fileBytes[0] = fileBytes[1] = 0;
+    edits.clear();
     
     for (int i = 0; i < 2; i++) {
         js[i] = new MgJsonStorage();
-        s[i] = js[i]->storageForWrite();
+        s[i] = js[i]->storageForStreamWrite(VG_PRETTY);
         s[i]->writeNode("record", -1, false);
         s[i]->writeInt("tick", tick);
     }
@@ -456,6 +1165,139 @@ std::string MgRecordShapes::Impl::getFileName(bool back, int index) const
     return ss.str();
 }
 
+std::string MgRecordShapes::Impl::getKeyFileName(int index) const
+{
+    std::stringstream ss;
+    ss << path << index << ".vgk";
+    return ss.str();
+}
+
+std::string MgRecordShapes::Impl::getRecordName(int kind, int index) const
+{
+    return kind == MgRecordFile::KEY ? getKeyFileName(index) : getFileName(kind == MgRecordFile::UNDO, index);
+}
+
+// 录制时新建容器，续录时已由 restore 打开已有的容器，播放时只读打开
+MgRecordFile* MgRecordShapes::Impl::openContainer()
+{
+    if (container && !container->isOpen()) {
+        if (type > 1)
+            container->open(path.c_str(), false);
+        else
+            container->create(path.c_str(), type);
+    }
+    return container;
+}
+
+// 写出一步的重做、撤销文件或关键帧文件，用容器时追加为容器中的记录
+bool MgRecordShapes::Impl::writeRecord(int kind, int index, MgJsonStorage& js, int flags, long& bytes)
+{
+    if (container) {
+        const char* text = js.stringify(VG_PRETTY);
+        bytes = (long)strlen(text);
+        return openContainer()->write(index, kind, text, (int)bytes, tick, flags);
+    }
+    
+    std::string filename(getRecordName(kind, index));
+    FILE *fp = mgopenfile(filename.c_str(), "wt");
+    
+    if (!fp) {
+        LOGE("Fail to save file: %s", filename.c_str());
+        return false;
+    }
+    bool ret = js.save(fp, VG_PRETTY);
+    bytes = ftell(fp);
+    fclose(fp);
+    
+    return ret;
+}
+
+// 读入一个记录，没有该记录时返回NULL
+MgStorage* MgRecordShapes::Impl::readRecord(MgJsonStorage& js, int kind, int index)
+{
+    if (container) {
+        std::string text;
+        return openContainer()->read(index, kind, text) ? js.storageForRead(text.c_str()) : NULL;
+    }
+    
+    std::string filename(getRecordName(kind, index));
+    FILE *fp = mgopenfile(filename.c_str(), "rt");
+    MgStorage* s = fp ? js.storageForRead(fp) : NULL;
+    
+    if (fp) {
+        fclose(fp);
+    }
+    return s;
+}
+
+long MgRecordShapes::Impl::getRecordSize(int kind, int index)
+{
+    return container ? openContainer()->getSize(index, kind) : getFileSize(getRecordName(kind, index));
+}
+
+void MgRecordShapes::Impl::removeRecord(int kind, int index)
+{
+    if (container) {
+        openContainer()->remove(index, kind);
+    } else {
+        remove(getRecordName(kind, index).c_str());
+    }
+}
+
+// 关键帧为刚写出的帧之后的完整文档和动态图形，播放时可从此开始而不必应用之前的全部帧
+bool MgRecordShapes::Impl::saveKeyframe(const MgShapes* dynShapes)
+{
+    MgJsonStorage js;
+    MgStorage* s = js.storageForStreamWrite(VG_PRETTY);
+    long bytes = 0;
+    
+    s->writeNode("keyframe", -1, false);
+    s->writeInt("tick", tick);
+    s->writeInt("flags", flags[0]);
+    lastDoc->save(s, 0);
+    if (dynShapes) {
+        s->writeNode("dynamic", -1, false);
+        dynShapes->save(s);
+        s->writeNode("dynamic", -1, true);
+    }
+    bool ret = (s->writeNode("keyframe", -1, true)
+                && writeRecord(MgRecordFile::KEY, fileCount - 1, js, flags[0], bytes));
+    
+    if (ret) {
+        frameIndex.keySaved();
+    } else {
+        LOGE("Fail to save keyframe: %s", getKeyFileName(fileCount - 1).c_str());
+    }
+    
+    return ret;
+}
+
+bool MgRecordShapes::Impl::loadKeyframe(MgShapeFactory *f, MgShapeDoc* doc, MgShapes* dyns, int index)
+{
+    MgJsonStorage js;
+    MgStorage* s = readRecord(js, MgRecordFile::KEY, index);
+    bool ret = false;
+    
+    if (!s) {
+        LOGE("Fail to read file: %s", getKeyFileName(index).c_str());
+        return false;
+    }
+    if (s->readNode("keyframe", -1, false)) {
+        tick = s->readInt("tick", 0);
+        ret = doc->load(f, s, false);
+        if (ret && dyns) {
+            dyns->clear();
+            if (s->readNode("dynamic", -1, false)) {
+                dyns->load(f, s);
+                s->readNode("dynamic", -1, true);
+            }
+        }
+        s->readNode("keyframe", -1, true);
+    }
+    
+    return ret;
+}
+
 bool MgRecordShapes::Impl::saveJsonFile()
 {
     bool ret = false;
@@ -472,18 +1314,15 @@ bool MgRecordShapes::Impl::saveJsonFile()
             s[i]->writeFloatArray("pageExtent", &lastDoc->getPageRectW().xmin, 4);
             s[i]->writeFloat("viewScale", lastDoc->getViewScale());
         }
-        if (flags[i] != 0) {
-            filename = getFileName(i > 0);
-            FILE *fp = mgopenfile(filename.c_str(), "wt");
+        if (flags[i] != 0 && !(squash && i > 0)) {     // 合并时保留上一步的撤销文件
+            const int index = squash ? fileCount - 1 : fileCount;
             
-            if (!fp) {
-                LOGE("Fail to save file: %s", filename.c_str());
-            } else {
-                ret = s[i]->writeNode("record", -1, true) && js[i]->save(fp, VG_PRETTY);
-                fclose(fp);
-                if (!ret) {
-                    LOGE("Fail to record shapes: %s", filename.c_str());
-                }
+            ret = (s[i]->writeNode("record", -1, true)
+                   && writeRecord(i > 0 ? MgRecordFile::UNDO : MgRecordFile::REDO,
+                                  index, *js[i], flags[i], fileBytes[i]));
+            frameIndex.addBytes(i > 0 ? 0 : fileBytes[i]);
+            if (!ret) {
+                LOGE("Fail to record shapes: %s", getFileName(i > 0, index).c_str());
             }
         }
         delete js[i];
@@ -499,131 +1338,60 @@ bool MgRecordShapes::Impl::saveJsonFile()
             LOGD("Record %03d: tick=%d, flags=%d, count=%d, filesize=%ld",
                  fileCount, tick, flags[0], shapeCount, (long)stat1.st_size);
         }*/
-        maxCount = ++fileCount;
+        if (!squash) {
+            maxCount = ++fileCount;
+        }
         lastTick = tick;
     }
     
     return ret;
 }
 
-bool MgRecordShapes::Impl::saveIndexFile(bool ended)
+bool MgRecordShapes::Impl::openIndex(const std::vector<MgFrameEntry>& entries)
 {
-    std::string filename(path + "records.json");
-    FILE *fp = mgopenfile(filename.c_str(), "wt");
-    bool ret = false;
-    
-    if (!fp) {
-        LOGE("Fail to save file: %s", filename.c_str());
-    } else {
-        if (ended) {
-            s[2]->writeNode("records", -1, true);
-        }
-        ret = js[2]->save(fp, VG_PRETTY);
-        if (!ret) {
-            LOGE("Fail to save records: %s", filename.c_str());
-        }
-        fclose(fp);
-    }
-    
-    return ret;
+    return frameIndex.open(path, entries);
 }
 
 void MgRecordShapes::Impl::stopRecordIndex()
 {
-    if (js[2]) {
-        if (fileCount > 1 && saveIndexFile(true)) {
-            LOGD("Save records.json in %s", path.c_str());
-        }
-        delete js[2];
-        js[2] = NULL;
-        s[2] = NULL;
+    if (frameIndex.close(fileCount > 1)) {   // 停止录制时生成 records.json
+        LOGD("Save records.json in %s", path.c_str());
     }
     MgObject::release_pointer(lastShape);
+    MgObject::release_pointer(lastDyns);
 }
 
-int MgRecordShapes::applyFile(int& tick, MgShapeFactory *f,
-                              MgShapeDoc* doc, MgShapes* dyns, const char* fn,
-                              long* changeCount, MgShape* lastShape)
+int MgRecordShapes::Impl::applyFile(int kind, int index, MgShapeFactory *f, MgShapeDoc* doc, MgShapes* dyns,
+                                    long* changeCount, MgShape* lastShape, const MgShapes* lastDyns)
 {
-    FILE *fp = mgopenfile(fn, "rt");
-    if (!fp) {
-        //LOGE("Fail to read file: %s", fn);
-        return 0;
-    }
-    
     MgJsonStorage js;
-    MgStorage* s = js.storageForRead(fp);
-    int ret = 0;
-    
-    fclose(fp);
-    if (s->readNode("record", -1, false)) {
-        if (doc) {
-            if (s->readFloatArray("transform", &doc->modelTransform().m11, 6, false) == 6) {
-                Box2d rect(doc->getPageRectW());
-                s->readFloatArray("pageExtent", &rect.xmin, 4);
-                float viewScale = s->readFloat("viewScale", doc->getViewScale());
-                doc->setPageRectW(rect, viewScale);
-            }
-            
-            MgShapes* stds = doc->getCurrentLayer();
-            int flags = s->readInt("flags", 0);
-            
-            if ((flags & (ADD|EDIT)) && stds->load(f, s, true) > 0) {
-                ret |= (flags == ADD) ? SHAPE_APPEND : DOC_CHANGED;
-            }
-            
-            if (s->readNode("delete", -1, false)) {
-                for (int i = 0; ; i++) {
-                    std::stringstream ss;
-                    ss << "d" << i;
-                    int sid = s->readInt(ss.str().c_str(), 0);
-                    if (sid == 0)
-                        break;
-                    if (stds->removeShape(sid)) {
-                        ret |= DOC_CHANGED;
-                        //LOGD("removeShape id=%d", sid);
-                    }
-                }
-                s->readNode("delete", -1, true);
-            }
-        }
-        if (dyns && s->readNode("dynamic", -1, false)) {
-            if (dyns->load(f, s) >= 0)
-                ret |= DYN_CHANGED;
-            s->readNode("dynamic", -1, true);
-        } else if (dyns && lastShape
-                   && lastShape->shapec()->isKindOf(MgBaseLines::Type())) {
-            int n = s->readFloatArray("dyninc", NULL, 0);
-            mgvector<float> buf(n);
-            
-            if (n > 0 && s->readFloatArray("dyninc", buf.address(), n) == n) {
-                MgShape* sp = lastShape->cloneShape();
-                MgBaseLines* lines = (MgBaseLines*)sp->shape();
-                
-                for (int i = 0; i + 1 < n; i += 2) {
-                    lines->addPoint(Point2d(buf.get(i), buf.get(i + 1)));
-                }
-                dyns->addShapeDirect(sp, true);
-                ret |= DYN_CHANGED;
-            }
-        }
-        if (ret) {
-            tick = s->readInt("tick", tick);
-        }
-        if (ret && changeCount) {
-            *changeCount = s->readInt("changeCount", (int)*changeCount);
-        }
-        
-        s->readNode("record", -1, true);
-    }
+    MgPlayFrame* frame = MgPlayFrame::load(f, readRecord(js, kind, index), doc ? doc->getCurrentLayer() : NULL,
+                                           dyns, lastShape, lastDyns);
+    int ret = frame ? frame->apply(tick, doc, dyns, changeCount) : 0;
     
+    delete frame;
     return ret;
 }
 
 bool MgRecordShapes::applyFirstFile(MgShapeFactory *factory, MgShapeDoc* doc)
 {
-    std::string filename(_im->getFileName(false, 0));
-    return applyFirstFile(factory, doc, filename.c_str());
+    if (!_im->container) {
+        std::string filename(_im->getFileName(false, 0));
+        return applyFirstFile(factory, doc, filename.c_str());
+    }
+    
+    MgJsonStorage js;
+    MgStorage* s = _im->readRecord(js, MgRecordFile::REDO, 0);
+    
+    if (!s) {
+        LOGE("Fail to read the first record: %s", _im->path.c_str());
+        return false;
+    }
+    _im->prefetcher.cancel();
+    _im->fileCount = 1;
+    _im->keepDyns(NULL);
+    
+    return doc->load(factory, s, false);
 }
 
 bool MgRecordShapes::applyFirstFile(MgShapeFactory *factory, MgShapeDoc* doc, const char* filename)
@@ -638,32 +1406,104 @@ bool MgRecordShapes::applyFirstFile(MgShapeFactory *factory, MgShapeDoc* doc, co
     MgStorage* s = js.storageForRead(fp);
     
     fclose(fp);
+    _im->prefetcher.cancel();
     _im->fileCount = 1;
-    MgObject::release_pointer(_im->lastShape);
+    _im->keepDyns(NULL);
     
     return doc->load(factory, s, false);
 }
 
+int MgRecordShapes::seek(MgShapeFactory *f, MgShapeDoc* doc, MgShapes* dyns, int tick)
+{
+    if (!_im->frameIndex.hasFrames()
+        && !_im->frameIndex.loadFrames(_im->container ? _im->openContainer() : NULL, _im->path))
+        return 0;
+    
+    int from;                       // 从最近的关键帧开始
+    int target = _im->frameIndex.findFrame(tick, from);  // 最后一个不晚于 tick 的帧的文件号
+    
+    int ret = DOC_CHANGED | DYN_CHANGED;
+    
+    if (_im->fileCount > from && _im->fileCount <= target + 1) {
+        from = _im->fileCount - 1;  // 向后定位且之间没有关键帧时，接着当前帧应用
+        ret = 0;
+    }
+    else if (from > 0 && _im->loadKeyframe(f, doc, dyns, from)) {
+        _im->prefetcher.cancel();
+        _im->fileCount = from + 1;
+        _im->keepDyns(dyns);
+    }
+    else if (applyFirstFile(f, doc)) {
+        from = 0;
+        _im->tick = 0;
+        _im->flags[0] = 0;
+        if (dyns) {
+            dyns->clear();
+        }
+    }
+    else {
+        return 0;
+    }
+    
+    const int prefetch = _im->prefetcher.getLimit();
+    
+    if (from < target) {            // 定位中不预解码，以免每帧都重新开始预解码并复制动态图形
+        _im->prefetcher.setLimit(0);
+    }
+    for (int i = from + 1; i <= target; i++) {
+        if (dyns) {
+            dyns->clear();
+        }
+        ret |= applyRedoFile(f, doc, dyns, i);
+    }
+    _im->fileCount = target + 1;
+    if (from < target && prefetch > 0) {
+        _im->prefetcher.setLimit(prefetch);
+        if (doc && dyns) {
+            _im->prefetcher.start(f, doc->getCurrentLayer(), dyns, _im->lastDyns, target + 1);
+        }
+    }
+    
+    return ret;
+}
+
 int MgRecordShapes::applyRedoFile(MgShapeFactory *f, MgShapeDoc* doc, MgShapes* dyns, int index)
 {
     if (index <= 0)
         index = _im->fileCount;
     
-    std::string filename(_im->getFileName(false, index));
-    int ret = applyFile(_im->tick, f, doc, dyns, filename.c_str(), NULL, _im->lastShape);
+    // 预解码时按播放端每帧前清空动态图形来解码增量，未清空时在调用线程中解码
+    const bool usable = _im->prefetcher.getLimit() > 0 && doc && dyns && dyns->getShapeCount() == 0;
+    MgPlayFrame* frame = usable ? _im->prefetcher.take(index) : NULL;
+    int ret;
+    
+    if (frame) {
+        ret = frame->apply(_im->tick, doc, dyns, NULL);
+    } else {
+        ret = _im->applyFile(MgRecordFile::REDO, index, f, doc, dyns, NULL, _im->lastShape, _im->lastDyns);
+    }
     
     if (ret) {
         _im->fileCount = index + 1;
-        MgObject::release_pointer(_im->lastShape);
-        if (dyns) {
-            _im->lastShape = const_cast<MgShape*>(dyns->getLastShape());
-            if (_im->lastShape)
-                _im->lastShape->addRef();
-        }
+        _im->keepDyns(dyns);
+    }
+    if (!usable) {
+        _im->prefetcher.cancel();
+    } else if (!frame || !ret != !frame->ret) {     // 是否保留动态图形与预计的不同时重新解码
+        _im->prefetcher.start(f, doc->getCurrentLayer(), dyns, _im->lastDyns, index + 1);
+    } else {
+        _im->prefetcher.resume();
     }
+    delete frame;
+    
     return ret;
 }
 
+void MgRecordShapes::setPrefetch(int frames)
+{
+    _im->prefetcher.setLimit(frames);
+}
+
 int MgRecordShapes::applyUndoFile(MgShapeFactory *f, MgShapeDoc* doc,
                                   MgShapes* dyns, int index, long curTick)
 {
@@ -672,26 +1512,20 @@ int MgRecordShapes::applyUndoFile(MgShapeFactory *f, MgShapeDoc* doc,
     if (index <= 0)
         return 0;
     
+    _im->prefetcher.cancel();
     if (index == 1) {
         _im->fileCount = 0;
         _im->startTick = curTick;
         return DYN_CHANGED;
     }
     
-    std::string filename(_im->getFileName(true, index - 1));
-    int ret = applyFile(_im->tick, f, doc, NULL, filename.c_str());
+    int ret = _im->applyFile(MgRecordFile::UNDO, index - 1, f, doc, NULL);
     
-    filename = _im->getFileName(false, index - 1);
-    ret |= applyFile(_im->tick, f, NULL, dyns, filename.c_str()) | DYN_CHANGED;
+    ret |= _im->applyFile(MgRecordFile::REDO, index - 1, f, NULL, dyns) | DYN_CHANGED;
     
     if (ret) {
         _im->fileCount = index - 1;
-        MgObject::release_pointer(_im->lastShape);
-        if (dyns) {
-            _im->lastShape = const_cast<MgShape*>(dyns->getLastShape());
-            if (_im->lastShape)
-                _im->lastShape->addRef();
-        }
+        _im->keepDyns(dyns);
     }
     return ret;
 }
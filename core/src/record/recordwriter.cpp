@@ -0,0 +1,123 @@
+﻿// recordwriter.cpp: 实现录制步的后台写出队列 MgRecordWriter
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+
+#include "recordwriter.h"
+#include "gilock.h"
+
+static const size_t WRITTEN_MAX = 100;      // 没有取走时只保留最近写完的这些步
+
+MgRecordWriter::MgRecordWriter(WriteProc proc, void* owner)
+    : _proc(proc), _owner(owner), _queueSize(0), _pending(0), _stopping(false)
+{
+}
+
+MgRecordWriter::~MgRecordWriter()
+{
+    stop();
+}
+
+void MgRecordWriter::setQueueSize(int size)
+{
+    flush();
+    _queueSize = size > 0 ? size : 0;
+}
+
+bool MgRecordWriter::push(const Task& task)
+{
+    if (_queueSize == 0) {
+        return _proc(_owner, task);
+    }
+    
+    _mutex.lock();
+    if ((int)_tasks.size() >= _queueSize) {
+        while ((int)_tasks.size() >= _queueSize) {
+            _mutex.unlock();
+            _done.wait();
+            _mutex.lock();
+        }
+        _done.set();                // 其他线程可能也在等待
+    }
+    _tasks.push_back(task);
+    giAtomicIncrement(&_pending);
+    _mutex.unlock();
+    
+    if (!_thread.isStarted()) {
+        _stopping = false;
+        _thread.start(writeTasks, this);
+    }
+    _wake.set();
+    
+    return true;
+}
+
+void MgRecordWriter::writeTasks(void* data)
+{
+    MgRecordWriter* p = (MgRecordWriter*)data;
+    
+    for (;;) {
+        p->_mutex.lock();
+        bool empty = p->_tasks.empty();
+        Task task = empty ? Task() : p->_tasks.front();
+        if (!empty) {
+            p->_tasks.pop_front();
+        }
+        p->_mutex.unlock();
+        
+        if (!empty) {
+            p->_done.set();         // 腾出了队列位置
+            p->_proc(p->_owner, task);
+            giAtomicDecrement(&p->_pending);
+            p->_done.set();
+        }
+        else if (p->_stopping) {
+            break;
+        }
+        else {
+            p->_wake.wait();
+        }
+    }
+}
+
+void MgRecordWriter::flush()
+{
+    if (_pending > 0) {
+        while (_pending > 0) {
+            _done.wait();
+        }
+        _done.set();                // 其他线程可能也在等待
+    }
+}
+
+void MgRecordWriter::stop()
+{
+    if (_thread.isStarted()) {
+        flush();
+        _stopping = true;
+        _wake.set();
+        _thread.join();
+    }
+}
+
+void MgRecordWriter::addWritten(int index)
+{
+    _mutex.lock();
+    if (_written.size() >= WRITTEN_MAX) {
+        _written.pop_front();
+    }
+    _written.push_back(index);
+    _mutex.unlock();
+}
+
+bool MgRecordWriter::takeWritten(int& index)
+{
+    _mutex.lock();
+    bool ret = !_written.empty();
+    if (ret) {
+        index = _written.front();
+        _written.pop_front();
+    }
+    _mutex.unlock();
+    
+    return ret;
+}
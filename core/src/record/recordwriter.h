@@ -0,0 +1,72 @@
+﻿// recordwriter.h: 定义录制步的后台写出队列 MgRecordWriter
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+
+#ifndef TOUCHVG_RECORDWRITER_H_
+#define TOUCHVG_RECORDWRITER_H_
+
+#include "githread.h"
+#include <deque>
+
+class MgShapeDoc;
+class MgShapes;
+
+//! 录制步的后台写出队列，在录制线程中按入队顺序调用写出函数
+/*! 队列长度为0时在调用线程中直接写出。队列满时 push 等录制线程取走一步，不丢弃录制步。
+    录制线程取走或写完一步时都发出信号，等待的线程不必轮询。
+ */
+class MgRecordWriter
+{
+public:
+    //! 一步的参数，doc 和 dynShapes 由写出函数释放
+    struct Task {
+        long        tick;
+        long        changeCountOld;
+        long        changeCountNew;
+        MgShapeDoc  *doc;
+        MgShapes    *dynShapes;
+    };
+    typedef bool (*WriteProc)(void* owner, const Task& task);
+
+    MgRecordWriter(WriteProc proc, void* owner);
+    ~MgRecordWriter();
+
+    //! 设置队列长度，0表示在调用线程中写出，先等已入队的步写完
+    void setQueueSize(int size);
+
+    //! 写出一步，有队列时入队后返回true
+    bool push(const Task& task);
+
+    //! 等待已入队的步写完，不能在写出函数中调用
+    void flush();
+
+    //! 等已入队的步写完并结束录制线程
+    void stop();
+
+    //! 记下写完的一步的文件号，没有取走时只保留最近的若干步
+    void addWritten(int index);
+
+    //! 按写出的顺序取出写完的一步的文件号，没有时返回false
+    bool takeWritten(int& index);
+
+private:
+    static void writeTasks(void* data);
+
+    MgRecordWriter(const MgRecordWriter&);
+    void operator=(const MgRecordWriter&);
+
+private:
+    WriteProc       _proc;
+    void*           _owner;
+    std::deque<Task> _tasks;        // 待录制线程写出的步
+    std::deque<int> _written;       // 已写完的步的文件号
+    int             _queueSize;     // 队列长度上限，0表示在调用线程中写出
+    volatile long   _pending;       // 已入队且尚未写完的步数
+    GiMutex         _mutex;         // 保护 _tasks 和 _written
+    volatile bool   _stopping;
+    GiThread        _thread;
+    GiEvent         _wake;          // 有新的步或要结束
+    GiEvent         _done;          // 取走或写完了一步
+};
+
+#endif // TOUCHVG_RECORDWRITER_H_
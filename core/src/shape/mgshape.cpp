@@ -106,6 +106,18 @@ bool MgShape::save(MgStorage* s) const
 }
 
 bool MgShape::load(MgShapeFactory* factory, MgStorage* s)
+{
+    loadAttributes(s);
+
+    bool ret = shape()->load(factory, s);
+    if (ret) {
+        shape()->update();
+    }
+
+    return ret;
+}
+
+void MgShape::loadAttributes(MgStorage* s)
 {
     setTag(s->readInt("tag", getTag()));
 
@@ -115,11 +127,4 @@ bool MgShape::load(MgShapeFactory* factory, MgStorage* s)
     ctx.setLineColor(GiColor(s->readInt("lineColor", 0xFF000000), true));
     ctx.setFillColor(GiColor(s->readInt("fillColor", 0), true));
     setContext(ctx);
-
-    bool ret = shape()->load(factory, s);
-    if (ret) {
-        shape()->update();
-    }
-
-    return ret;
 }
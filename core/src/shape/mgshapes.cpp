@@ -6,8 +6,47 @@
 #include "mgspfactory.h"
 #include "mglog.h"
 #include "mgcomposite.h"
+#include "githread.h"
 #include <list>
 #include <map>
+#include <vector>
+
+struct MgBulkTransform;
+struct MgParallelLoad;
+
+//! 延迟加载几何数据的图形，由共享这些图形的图形列表(例如浅拷贝得到的前端文档)共用
+struct MgLazyShapes
+{
+    MgStorage*              s;          // 位于图形列表节点的克隆读取对象
+    MgShapeFactory*         factory;
+    const MgShapes*         owner;      // 加载图形的列表，清除时停止后台加载
+    std::vector<MgShape*>   shapes;     // 各序号的图形节点对应的未加载图形(有引用)，已加载的为NULL
+    std::map<const MgShape*, int> indexes;  // 未加载图形对应的图形节点序号
+    GiThread                thread;
+    volatile long           pending;    // 未加载的图形数
+    GiMutex                 mutex;      // 加载图形时锁定
+    bool                    stopping;   // 锁定时读写
+    volatile long           refcount;
+    
+    static MgLazyShapes* create(const MgShapes* owner, MgShapeFactory* factory, MgStorage* s);
+    void addRef() { giAtomicIncrement(&refcount); }
+    void release() { if (giAtomicDecrement(&refcount) == 0) delete this; }
+    
+    bool loaded() { return giAtomicCompareAndSwap(&pending, 0, 0); }  // 带内存屏障，为真时可直接读图形
+    void add(MgShape* sp, int index);
+    void loadShape(const MgShape* sp);
+    Box2d extentOf(const MgShape* sp);
+    void loadAll();
+    void start();
+    void stop();
+    
+private:
+    MgLazyShapes() : s(NULL), factory(NULL), owner(NULL)
+        , pending(0), stopping(false), refcount(1) {}
+    ~MgLazyShapes();
+    void loadAt(int index);
+    static void run(void* data);
+};
 
 struct MgShapes::I
 {
@@ -22,9 +61,33 @@ struct MgShapes::I
     int         index;
     int         newShapeID;
     volatile long refcount;
+    MgLazyShapes* lazy;         // 延迟加载时尚有图形未加载几何数据
+    std::vector<int> journal;   // 改动日志，增删改过的图形ID，录制时只需比较这些图形
+    long        journalBase;    // journal[0] 的日志位置
+    long        journalId;      // 日志标识，浅拷贝的图形列表沿用原列表的
     
     MgShape* findShape(int sid) const;
     int getNewID(int sid);
+    void logChange(int sid);
+    void resetJournal();
+    int bulkReplace(MgShapes* owner, MgBulkTransform& t);
+    int loadParallel(MgShapes* owner, MgShapeFactory* factory, MgStorage* s,
+                     int n, bool addOnly, int& index, bool& ret);
+    int mergeParallel(MgShapes* owner, MgParallelLoad& t, bool addOnly,
+                      int& index, bool& ret, bool& stopped);
+    int loadLazily(MgShapes* owner, MgLazyShapes* p, MgStorage* s, int& index);
+    
+    //! 确保已加载图形的几何数据，返回该图形，之后才能读其几何数据和标志
+    const MgShape* ready(const MgShape* sp) const {
+        if (sp && lazy && !lazy->loaded())
+            lazy->loadShape(sp);
+        return sp;
+    }
+    
+    //! 返回图形的包络框，未加载的图形为保存的包络框，不触发加载
+    Box2d extentOf(const MgShape* sp) const {
+        return lazy && !lazy->loaded() ? lazy->extentOf(sp) : sp->shapec()->getExtent();
+    }
     
     iterator findPosition(int sid) {
         iterator it = shapes.begin();
@@ -39,6 +102,10 @@ MgShapes* MgShapes::create(MgObject* owner, int index)
 }
 
 //static volatile long _n = 0;
+static volatile long _journalCount = 0;
+static const size_t JOURNAL_MIN = 256;  // 日志超过此长度和图形数时丢弃，使用者改为全部比较
+static const int PARALLEL_BATCH = 4096;     // 并行加载的首批图形数
+static const int PARALLEL_BATCH_MAX = 1 << 20;
 
 MgShapes::MgShapes(MgObject* owner, int index)
 {
@@ -48,6 +115,9 @@ MgShapes::MgShapes(MgObject* owner, int index)
     im->index = index;
     im->newShapeID = 1;
     im->refcount = 1;
+    im->lazy = NULL;
+    im->journalBase = 0;
+    im->journalId = giAtomicIncrement(&_journalCount);
 }
 
 MgShapes::~MgShapes()
@@ -92,12 +162,33 @@ int MgShapes::copyShapes(const MgShapes* src, bool deeply, bool needClear)
         clear();
     
     int ret = 0;
-    MgShapeIterator it(src);
     
-    while (MgShape* sp = const_cast<MgShape*>(it.getNext())) {
-        if (deeply) {
+    if (!deeply && needClear) {         // 快照沿用原列表的改动日志
+        im->journal = src->im->journal;
+        im->journalBase = src->im->journalBase;
+        im->journalId = src->im->journalId;
+    } else {
+        im->resetJournal();
+    }
+    
+    if (deeply) {
+        MgShapeIterator it(src);
+        while (const MgShape* sp = it.getNext()) {
             ret += addShape(*sp) ? 1 : 0;
-        } else {
+        }
+    }
+    else {
+        if (src->im->lazy) {            // 共用未加载的图形，不必在复制时加载
+            if (!im->lazy) {
+                im->lazy = src->im->lazy;
+                im->lazy->addRef();
+            }
+            else if (im->lazy != src->im->lazy) {
+                src->im->lazy->loadAll();
+            }
+        }
+        for (I::citerator it = src->im->shapes.begin(); it != src->im->shapes.end(); ++it) {
+            MgShape* sp = *it;
             sp->addRef();
             im->shapes.push_back(sp);
             im->id2shape[sp->getID()] = sp;
@@ -127,13 +218,27 @@ void MgShapes::clear()
     }
     im->shapes.clear();
     im->id2shape.clear();
+    im->resetJournal();
+    if (im->lazy) {
+        if (im->lazy->owner == this) {
+            im->lazy->stop();
+        }
+        im->lazy->release();
+        im->lazy = NULL;
+    }
 }
 
 void MgShapes::clearCachedData()
 {
+    if (im->lazy) {                     // 不与后台加载同时改变图形
+        im->lazy->mutex.lock();
+    }
     for (I::iterator it = im->shapes.begin(); it != im->shapes.end(); ++it) {
         (*it)->shape()->clearCachedData();
     }
+    if (im->lazy) {
+        im->lazy->mutex.unlock();
+    }
 }
 
 MgObject* MgShapes::getOwner() const
@@ -157,25 +262,97 @@ bool MgShapes::updateShape(MgShape* shape, bool force)
             *it = shape;
             shape->setParent(this, shape->getID());
             im->id2shape[shape->getID()] = shape;
+            im->logChange(shape->getID());
             return true;
         }
     }
     return false;
 }
 
-void MgShapes::transform(const Matrix2d& mat)
+//! 批量变形或平移图形的任务数据，各线程只写入自己序号范围内的新图形
+struct MgBulkTransform {
+    std::vector<MgShape*>   shapes;     // 原图形，顺序同图形列表
+    std::vector<MgShape*>   newsps;     // 新图形，未改变的为NULL
+    const Matrix2d*         mat;
+    Vector2d                vec;
+};
+
+static void bulkTransform(int from, int to, void* data)
 {
-    for (I::iterator it = im->shapes.begin(); it != im->shapes.end(); ++it) {
-        MgShape* newsp = (*it)->cloneShape();
-        newsp->shape()->transform(mat);
-        if (!updateShape(newsp, true))
+    MgBulkTransform* t = (MgBulkTransform*)data;
+
+    for (int i = from; i < to; i++) {
+        const MgShape* oldsp = t->shapes[i];
+        MgShape* newsp = oldsp->cloneShape();
+
+        if (t->mat) {
+            newsp->shape()->transform(*t->mat);
+        } else if (!newsp->shape()->offset(t->vec, -1)) {
             MgObject::release_pointer(newsp);
+        }
+        if (newsp) {    // 重置改变计数时也更新了包络框
+            newsp->shape()->resetChangeCount(oldsp->shapec()->getChangeCount() + 1);
+        }
+        t->newsps[i] = newsp;
+    }
+}
+
+int MgShapes::I::bulkReplace(MgShapes* owner, MgBulkTransform& t)
+{
+    if (shapes.empty())
+        return 0;
+    if (lazy) {
+        lazy->loadAll();
+    }
+
+    t.shapes.assign(shapes.begin(), shapes.end());
+    t.newsps.resize(t.shapes.size(), (MgShape*)0);
+    giParallelFor((int)t.shapes.size(), 64, bulkTransform, &t);
+
+    int n = 0;
+    iterator it = shapes.begin();
+
+    for (size_t i = 0; i < t.newsps.size(); i++, ++it) {
+        MgShape* newsp = t.newsps[i];
+        if (newsp) {
+            (*it)->release();
+            *it = newsp;
+            newsp->setParent(owner, newsp->getID());
+            id2shape[newsp->getID()] = newsp;
+            n++;
+        }
+    }
+    if (n > 0) {
+        resetJournal();
     }
+
+    return n;
+}
+
+int MgShapes::transform(const Matrix2d& mat)
+{
+    if (mat.kind() == kMgMatIdentity)
+        return 0;
+
+    MgBulkTransform t;
+    t.mat = &mat;
+    return im->bulkReplace(this, t);
+}
+
+int MgShapes::offset(const Vector2d& vec)
+{
+    if (vec.isZeroVector())
+        return 0;
+
+    MgBulkTransform t;
+    t.mat = NULL;
+    t.vec = vec;
+    return im->bulkReplace(this, t);
 }
 
 MgShape* MgShapes::cloneShape(int sid) const
 {
-    const MgShape* p = im->findShape(sid);
+    const MgShape* p = im->ready(im->findShape(sid));
     return p ? p->cloneShape() : NULL;
 }
 
@@ -186,6 +363,7 @@ MgShape* MgShapes::addShape(const MgShape& src)
         p->setParent(this, im->getNewID(src.getID()));
         im->shapes.push_back(p);
         im->id2shape[p->getID()] = p;
+        im->logChange(p->getID());
     }
     return p;
 }
@@ -197,6 +375,7 @@ bool MgShapes::addShapeDirect(MgShape* shape, bool force)
         shape->setParent(this, im->getNewID(0));
         im->shapes.push_back(shape);
         im->id2shape[shape->getID()] = shape;
+        im->logChange(shape->getID());
         return true;
     }
     return false;
@@ -210,6 +389,7 @@ bool MgShapes::removeShape(int sid)
         MgShape* shape = *it;
         im->shapes.erase(it);
         im->id2shape.erase(shape->getID());
+        im->logChange(sid);
         shape->release();
         return true;
     }
@@ -222,10 +402,11 @@ bool MgShapes::moveShapeTo(int sid, MgShapes* dest)
     I::iterator it = im->findPosition(sid);
     
     if (dest && dest != this && it != im->shapes.end()) {
-        MgShape* newsp = (*it)->cloneShape();
+        MgShape* newsp = im->ready(*it)->cloneShape();
         newsp->setParent(dest, dest->im->getNewID(newsp->getID()));
         dest->im->shapes.push_back(newsp);
         dest->im->id2shape[newsp->getID()] = newsp;
+        dest->im->logChange(newsp->getID());
         
         return removeShape(sid);
     }
@@ -233,14 +414,53 @@ bool MgShapes::moveShapeTo(int sid, MgShapes* dest)
     return false;
 }
 
+int MgShapes::spliceShapes(MgShapes* src, bool replace)
+{
+    int count = 0;
+    
+    if (!src || src == this)
+        return 0;
+    if (src->im->lazy) {
+        src->im->lazy->loadAll();
+    }
+    im->resetJournal();                 // 同 load()，不逐个记录移入的图形
+    
+    for (I::iterator it = src->im->shapes.begin(); it != src->im->shapes.end(); ++it) {
+        MgShape* newsp = *it;
+        const int sid = newsp->getID();
+        const MgShape* oldsp = replace && sid ? findShape(sid) : NULL;
+        
+        if (oldsp && oldsp->shapec()->getType() != newsp->shapec()->getType()) {
+            oldsp = NULL;
+        }
+        count++;
+        if (oldsp) {
+            newsp->setParent(this, sid);
+            im->id2shape[sid] = newsp;
+            updateShape(newsp);
+        }
+        else {
+            newsp->setParent(this, im->getNewID(sid));
+            im->id2shape[newsp->getID()] = newsp;
+            im->shapes.push_back(newsp);
+        }
+    }
+    src->im->shapes.clear();            // 图形的引用已转给本列表
+    src->im->id2shape.clear();
+    src->im->resetJournal();
+    
+    return count;
+}
+
 void MgShapes::copyShapesTo(MgShapes* dest) const
 {
     if (dest && dest != this) {
         for (I::iterator it = im->shapes.begin(); it != im->shapes.end(); ++it) {
-            MgShape* newsp = (*it)->cloneShape();
+            MgShape* newsp = im->ready(*it)->cloneShape();
             newsp->setParent(dest, dest->im->getNewID(newsp->getID()));
             dest->im->shapes.push_back(newsp);
             dest->im->id2shape[newsp->getID()] = newsp;
+            dest->im->logChange(newsp->getID());
         }
     }
 }
@@ -279,7 +499,7 @@ const MgShape* MgShapes::getFirstShape(void*& it) const
         return NULL;
     }
     it = (void*)(new I::citerator(im->shapes.begin()));
-    return im->shapes.empty() ? NULL : im->shapes.front();
+    return im->shapes.empty() ? NULL : im->ready(im->shapes.front());
 }
 
 const MgShape* MgShapes::getNextShape(void*& it) const
@@ -288,24 +508,24 @@ const MgShape* MgShapes::getNextShape(void*& it) const
     if (pit && *pit != im->shapes.end()) {
         ++(*pit);
         if (*pit != im->shapes.end())
-            return *(*pit);
+            return im->ready(*(*pit));
     }
     return NULL;
 }
 
 const MgShape* MgShapes::getHeadShape() const
 {
-    return (!this || im->shapes.empty()) ? NULL : im->shapes.front();
+    return (!this || im->shapes.empty()) ? NULL : im->ready(im->shapes.front());
 }
 
 const MgShape* MgShapes::getLastShape() const
 {
-    return (!this || im->shapes.empty()) ? NULL : im->shapes.back();
+    return (!this || im->shapes.empty()) ? NULL : im->ready(im->shapes.back());
 }
 
 const MgShape* MgShapes::findShape(int sid) const
 {
-    return im->findShape(sid);
+    return im->ready(im->findShape(sid));
 }
 
 const MgShape* MgShapes::findShapeByTag(int tag) const
@@ -314,7 +534,7 @@ const MgShape* MgShapes::findShapeByTag(int tag) const
         return NULL;
     for (I::citerator it = im->shapes.begin(); it != im->shapes.end(); ++it) {
         if ((*it)->getTag() == tag)
-            return *it;
+            return im->ready(*it);
     }
     return NULL;
 }
@@ -337,7 +557,7 @@ const MgShape* MgShapes::findShapeByType(int type) const
         return NULL;
     for (I::citerator it = im->shapes.begin(); it != im->shapes.end(); ++it) {
         if ((*it)->shapec()->getType() == type)
-            return *it;
+            return im->ready(*it);
     }
     return NULL;
 }
@@ -348,7 +568,7 @@ const MgShape* MgShapes::findShapeByTypeAndTag(int type, int tag) const
         return NULL;
     for (I::citerator it = im->shapes.begin(); it != im->shapes.end(); ++it) {
         if ((*it)->shapec()->getType() == type && (*it)->getTag() == tag)
-            return *it;
+            return im->ready(*it);
     }
     return NULL;
 }
@@ -358,7 +578,7 @@ int MgShapes::traverseByType(int type, void (*c)(const MgShape*, void*), void* d
     int count = 0;
     
     for (I::citerator it = im->shapes.begin(); it != im->shapes.end(); ++it) {
-        const MgBaseShape* shape = (*it)->shapec();
+        const MgBaseShape* shape = im->ready(*it)->shapec();
         if (type == 0 || shape->isKindOf(type)) {
             (*c)(*it, d);
             count++;
@@ -386,7 +606,7 @@ Box2d MgShapes::getExtent() const
 {
     Box2d extent;
     for (I::citerator it = im->shapes.begin(); it != im->shapes.end(); ++it) {
-        extent.unionWith((*it)->shapec()->getExtent());
+        extent.unionWith(im->extentOf(*it));
     }
     
     return extent;
@@ -400,12 +620,13 @@ const MgShape* MgShapes::hitTest(const Box2d& limits, MgHitResult& res,
     res.dist = limits.width();
     for (I::citerator it = im->shapes.begin(); it != im->shapes.end(); ++it) {
         const MgBaseShape* shape = (*it)->shapec();
-        Box2d extent(shape->getExtent());
         
-        if ((filter || !shape->getFlag(kMgLocked))
-            && extent.isIntersect(limits)
+        if (im->extentOf(*it).isIntersect(limits)
+            && im->ready(*it)                       // 加载后才能读标志和几何数据
+            && (filter || !shape->getFlag(kMgLocked))
             && (!filter || filter(*it, data)))
         {
+            Box2d extent(shape->getExtent());
             MgHitResult tmpRes;
             float  tol = (!(*it)->hasFillColor() ? limits.width() / 2
                           : mgMax(extent.width(), extent.height()));
@@ -447,8 +668,8 @@ int MgShapes::dyndraw(int mode, GiGraphics& gs, const GiContext *ctx,
                 }
             }
         }
-        if (sp && sp->shapec()->getExtent().isIntersect(clip)) {
-            if (sp->draw(mode, gs, ctx, segment))
+        if (sp && im->extentOf(sp).isIntersect(clip)) {
+            if (im->ready(sp)->draw(mode, gs, ctx, segment))
                 count++;
         }
     }
@@ -473,7 +694,7 @@ bool MgShapes::save(MgStorage* s, int startIndex) const
         {
             if (index < startIndex)
                 continue;
-            ret = saveShape(s, *it, index - startIndex);
+            ret = saveShape(s, im->ready(*it), index - startIndex);
         }
         s->writeNode("shapes", im->index, true);
     }
@@ -499,7 +720,7 @@ bool MgShapes::saveShape(MgStorage* s, const MgShape* shape, int index) const
     return ret;
 }
 
-int MgShapes::load(MgShapeFactory* factory, MgStorage* s, bool addOnly)
+int MgShapes::load(MgShapeFactory* factory, MgStorage* s, bool addOnly, bool lazy)
 {
     Box2d rect;
     int index = 0, count = 0;
@@ -508,11 +729,19 @@ int MgShapes::load(MgShapeFactory* factory, MgStorage* s, bool addOnly)
     if (ret) {
         if (!addOnly)
             clear();
+        im->resetJournal();             // 不逐个记录加载的图形
         
         ret = loadExtra(s);
         s->readFloatArray("extent", &rect.xmin, 4, false);
         int n = s->readInt("count", 0);
+        MgLazyShapes* p = ret && lazy && !addOnly ? MgLazyShapes::create(this, factory, s) : NULL;
         
+        if (p) {
+            count = im->loadLazily(this, p, s, index);
+        }
+        else if (ret && n >= 128 && giProcessorCount() > 1) {
+            count = im->loadParallel(this, factory, s, n, addOnly, index, ret);
+        }
         for (; ret && s->readNode("shape", index, false); n--) {
             const int type = s->readInt("type", 0);
             const int sid = s->readInt("id", 0);
@@ -557,6 +786,288 @@ int MgShapes::load(MgShapeFactory* factory, MgStorage* s, bool addOnly)
     return ret ? count : (count > 0 ? -count : -1);
 }
 
+//! 并行加载图形的任务数据，各线程只写入自己序号范围内的图形
+struct MgParallelLoad {
+    struct Item {
+        MgShape*    shape;      // 新图形，类型未知时为NULL
+        int         type;
+        int         sid;
+        bool        found;      // 有此序号的图形节点
+        bool        loaded;
+    };
+    std::vector<Item>   items;      // 本批的图形，序号从 base 开始
+    int                 base;
+    MgShapeFactory*     factory;
+    MgStorage*          s;
+    MgShapes*           owner;
+};
+
+static void loadShapes(int from, int to, void* data)
+{
+    MgParallelLoad* t = (MgParallelLoad*)data;
+    MgStorage* s = t->s->cloneForRead();    // 各块用自己的读取对象
+    Box2d rect;
+    
+    for (int i = from; s && i < to && s->readNode("shape", t->base + i, false); i++) {
+        MgParallelLoad::Item& item = t->items[i];
+        
+        item.found = true;
+        item.type = s->readInt("type", 0);
+        item.sid = s->readInt("id", 0);
+        s->readFloatArray("extent", &rect.xmin, 4, false);
+        item.shape = t->factory->createShape(item.type);
+        if (item.shape) {
+            item.shape->setParent(t->owner, item.sid);  // 合并时再分配新ID
+            item.shape->shape()->setExtent(rect);
+            item.loaded = item.shape->load(t->factory, s);
+        }
+        s->readNode("shape", t->base + i, true);
+    }
+    if (s) {
+        s->release();
+    }
+}
+
+// 在多个线程中创建和加载前n个图形节点，再按原顺序合并到图形列表，结果与逐个加载的相同。
+// n 来自文件中的 count，不一定可信，所以分批加载且每批加倍，在缺少的节点处停止，不按 n 一次分配
+int MgShapes::I::loadParallel(MgShapes* owner, MgShapeFactory* factory, MgStorage* s,
+                              int n, bool addOnly, int& index, bool& ret)
+{
+    MgStorage* test = s->cloneForRead();
+    if (!test)
+        return 0;
+    test->release();
+    
+    MgParallelLoad t;
+    MgParallelLoad::Item empty = { NULL, 0, 0, false, false };
+    int count = 0;
+    bool stopped = false;
+    
+    t.factory = factory;
+    t.s = s;
+    t.owner = owner;
+    
+    for (int from = 0, batch = PARALLEL_BATCH; !stopped && from < n; ) {
+        const int m = n - from < batch ? n - from : batch;
+        
+        t.base = from;
+        t.items.assign(m, empty);
+        giParallelFor(m, 64, loadShapes, &t);
+        count += mergeParallel(owner, t, addOnly, index, ret, stopped);
+        from += m;
+        batch = batch < PARALLEL_BATCH_MAX ? batch * 2 : batch;
+    }
+    
+    return count;
+}
+
+// 按原顺序合并一批并行加载的图形，在缺少的节点或加载失败的图形处停止
+int MgShapes::I::mergeParallel(MgShapes* owner, MgParallelLoad& t, bool addOnly,
+                               int& index, bool& ret, bool& stopped)
+{
+    int count = 0;
+    
+    for (int i = 0; i < (int)t.items.size(); i++) {
+        MgParallelLoad::Item& item = t.items[i];
+        MgShape* newsp = item.shape;
+        
+        if (stopped || !item.found) {
+            stopped = true;
+            MgObject::release_pointer(newsp);
+            continue;
+        }
+        index = t.base + i + 1;
+        if (!newsp) {
+            LOGE("Ignore unknown shape type %d, id=%d", item.type, item.sid);
+        }
+        else if (!item.loaded) {
+            newsp->release();
+            LOGE("Fail to load shape (id=%d, type=%d)", item.sid, item.type);
+            stopped = true;
+            ret = false;
+        }
+        else {
+            const MgShape* oldsp = addOnly && item.sid ? findShape(item.sid) : NULL;
+            
+            if (oldsp && oldsp->shapec()->getType() != item.type) {
+                oldsp = NULL;
+            }
+            if (!oldsp) {
+                newsp->setParent(owner, getNewID(item.sid));
+            }
+            count++;
+            newsp->shape()->setFlag(kMgClosed, newsp->shape()->isClosed());
+            id2shape[newsp->getID()] = newsp;
+            if (oldsp) {
+                owner->updateShape(newsp);
+            }
+            else {
+                shapes.push_back(newsp);
+            }
+        }
+    }
+    
+    return count;
+}
+
+MgLazyShapes* MgLazyShapes::create(const MgShapes* owner, MgShapeFactory* factory, MgStorage* s)
+{
+    MgStorage* clone = s->cloneForRead();
+    if (!clone)
+        return NULL;
+    
+    MgLazyShapes* p = new MgLazyShapes();
+    p->s = clone;
+    p->factory = factory;
+    p->owner = owner;
+    return p;
+}
+
+MgLazyShapes::~MgLazyShapes()
+{
+    stop();
+    for (size_t i = 0; i < shapes.size(); i++) {
+        MgObject::release_pointer(shapes[i]);
+    }
+    s->release();
+}
+
+void MgLazyShapes::add(MgShape* sp, int index)
+{
+    if (shapes.size() <= (size_t)index) {
+        shapes.resize(index + 1, (MgShape*)0);
+    }
+    sp->addRef();
+    shapes[index] = sp;
+    indexes[sp] = index;
+    giAtomicIncrement(&pending);
+}
+
+void MgLazyShapes::loadShape(const MgShape* sp)
+{
+    mutex.lock();
+    std::map<const MgShape*, int>::iterator it = indexes.find(sp);
+    if (it != indexes.end()) {
+        int index = it->second;
+        indexes.erase(it);
+        loadAt(index);
+    }
+    mutex.unlock();
+}
+
+// 与加载互斥，加载中的图形要等加载完，不会读到改了一半的包络框
+Box2d MgLazyShapes::extentOf(const MgShape* sp)
+{
+    mutex.lock();
+    Box2d rect(sp->shapec()->getExtent());
+    mutex.unlock();
+    return rect;
+}
+
+void MgLazyShapes::loadAll()
+{
+    mutex.lock();
+    for (size_t i = 0; i < shapes.size() && !loaded(); i++) {
+        if (shapes[i]) {
+            indexes.erase(shapes[i]);
+            loadAt((int)i);
+        }
+    }
+    mutex.unlock();
+}
+
+// 已锁定时读取给定序号的图形节点的几何数据，然后释放对该图形的引用
+void MgLazyShapes::loadAt(int index)
+{
+    MgShape* sp = shapes[index];
+    
+    shapes[index] = NULL;
+    
+    if (s->readNode("shape", index, false)) {
+        if (sp->shape()->load(factory, s)) {
+            sp->shape()->update();
+            sp->shape()->setFlag(kMgClosed, sp->shape()->isClosed());
+        }
+        else {
+            LOGE("Fail to load shape (id=%d, type=%d)", sp->getID(), sp->shapec()->getType());
+        }
+        s->readNode("shape", index, true);
+    }
+    sp->release();
+    giAtomicDecrement(&pending);        // 加载完才计数，loaded() 为真时各图形都已写好
+}
+
+void MgLazyShapes::start()
+{
+    if (!thread.start(run, this)) {
+        LOGE("Fail to start the lazy loading thread");
+    }
+}
+
+void MgLazyShapes::stop()
+{
+    mutex.lock();
+    stopping = true;
+    mutex.unlock();
+    thread.join();
+}
+
+// 后台线程按节点顺序逐个加载其余图形，每次只短暂锁定，以便显示时优先加载可见图形
+void MgLazyShapes::run(void* data)
+{
+    MgLazyShapes* p = (MgLazyShapes*)data;
+    
+    bool stopping = false;
+    
+    for (size_t i = 0; i < p->shapes.size() && !stopping && !p->loaded(); i++) {
+        p->mutex.lock();
+        stopping = p->stopping;
+        if (!stopping && p->shapes[i]) {
+            p->indexes.erase(p->shapes[i]);
+            p->loadAt((int)i);
+        }
+        p->mutex.unlock();
+    }
+}
+
+// 只读入各图形的类型、ID、包络框、标记和显示属性，几何数据在访问到图形时再读取
+int MgShapes::I::loadLazily(MgShapes* owner, MgLazyShapes* p, MgStorage* s, int& index)
+{
+    Box2d rect;
+    int count = 0;
+    
+    for (; s->readNode("shape", index, false); index++) {
+        const int type = s->readInt("type", 0);
+        const int sid = s->readInt("id", 0);
+        s->readFloatArray("extent", &rect.xmin, 4, false);
+        
+        MgShape* newsp = p->factory->createShape(type);
+        if (newsp) {
+            newsp->setParent(owner, getNewID(sid));
+            newsp->shape()->setExtent(rect);
+            newsp->loadAttributes(s);
+            p->add(newsp, index);
+            id2shape[newsp->getID()] = newsp;
+            shapes.push_back(newsp);
+            count++;
+        } else {
+            LOGE("Ignore unknown shape type %d, id=%d", type, sid);
+        }
+        s->readNode("shape", index, true);
+    }
+    
+    if (p->pending > 0) {
+        lazy = p;
+        if (giProcessorCount() > 1) {
+            p->start();
+        }
+    } else {
+        p->release();
+    }
+    
+    return count;
+}
+
 void MgShapes::setNewShapeID(int sid)
 {
     im->newShapeID = sid;
@@ -570,6 +1081,36 @@ MgShape* MgShapes::I::findShape(int sid) const
     return it != id2shape.end() ? it->second : NULL;
 }
 
+void MgShapes::I::logChange(int sid)
+{
+    if (journal.size() >= JOURNAL_MIN && journal.size() > shapes.size()) {
+        journalBase += (long)journal.size();
+        journal.clear();
+    }
+    journal.push_back(sid);
+}
+
+// 日志位置跳过一个，之前的位置都不能再由日志得到改动
+void MgShapes::I::resetJournal()
+{
+    journalBase += (long)journal.size() + 1;
+    journal.clear();
+}
+
+bool MgShapes::getChangedIDs(long& journal, long& pos, std::vector<int>& ids) const
+{
+    const long end = im->journalBase + (long)im->journal.size();
+    bool ret = (journal == im->journalId && pos >= im->journalBase && pos <= end);
+    
+    if (ret) {
+        ids.insert(ids.end(), im->journal.begin() + (pos - im->journalBase), im->journal.end());
+    }
+    journal = im->journalId;
+    pos = end;
+    
+    return ret;
+}
+
 int MgShapes::I::getNewID(int sid)
 {
     if (0 == sid || findShape(sid)) {
@@ -181,6 +181,28 @@ void MgShapeDoc::clearCachedData()
     }
 }
 
+int MgShapeDoc::transform(const Matrix2d& mat)
+{
+    int n = 0;
+
+    for (unsigned i = 0; i < im->layers.size(); i++) {
+        n += im->layers[i]->transform(mat);
+    }
+
+    return n;
+}
+
+int MgShapeDoc::offset(const Vector2d& vec)
+{
+    int n = 0;
+
+    for (unsigned i = 0; i < im->layers.size(); i++) {
+        n += im->layers[i]->offset(vec);
+    }
+
+    return n;
+}
+
 Box2d MgShapeDoc::getExtent() const
 {
     Box2d rect;
@@ -319,7 +341,7 @@ bool MgShapeDoc::save(MgStorage* s, int startIndex) const
     return ret;
 }
 
-bool MgShapeDoc::load(MgShapeFactory* factory, MgStorage* s, bool addOnly)
+bool MgShapeDoc::load(MgShapeFactory* factory, MgStorage* s, bool addOnly, bool lazy)
 {
     bool ret = false;
     Box2d rect;
@@ -342,11 +364,11 @@ bool MgShapeDoc::load(MgShapeFactory* factory, MgStorage* s, bool addOnly)
 
     for (int i = 0; i < 99; i++) {
         if (i < getLayerCount()) {
-            ret = im->layers[i]->load(factory, s, addOnly) >= 0 || ret;
+            ret = im->layers[i]->load(factory, s, addOnly, lazy) >= 0 || ret;
         }
         else {
             MgLayer* layer = MgLayer::create(this, i);
-            if (layer->load(factory, s, addOnly) >= 0) {
+            if (layer->load(factory, s, addOnly, lazy) >= 0) {
                 im->layers.push_back(layer);
                 ret = true;
             }
@@ -372,12 +394,12 @@ bool MgShapeDoc::saveAll(MgStorage* s, const GiTransform* xform)
     return save(s, 0);
 }
 
-bool MgShapeDoc::loadAll(MgShapeFactory* factory, MgStorage* s, GiTransform* xform)
+bool MgShapeDoc::loadAll(MgShapeFactory* factory, MgStorage* s, GiTransform* xform, bool lazy)
 {
     im->rectW.set(0.f, 0.f, 1024.f, 768.f);
     im->viewScale = 1.f;
     
-    bool ret = load(factory, s, false);
+    bool ret = load(factory, s, false, lazy);
     if (ret && xform) {
         xform->setModelTransform(im->xf);
         xform->zoomTo(im->rectWInitial.isEmpty() ? im->rectW : im->rectWInitial);
@@ -0,0 +1,885 @@
+﻿// perftest.cpp: 内核性能测试和自检程序，在 core/src/test 中用 make check 运行
+// Copyright (c) 2004-2014, Zhang Yungui
+// License: LGPL, https://github.com/touchvg/vgcore
+//
+// 依次测试包络框计算、JSON和二进制存取(DOM、流式、映射文件)、互斥量、并行处理、
+// 批量变形、延迟加载和录制容器，输出各项耗时，结果不对时输出 FAIL 并返回非零值。
+// 用法: perftest [每种图形的个数]，默认为2000。
+
+#include "RandomShape.h"
+#include "mgshapedoc.h"
+#include "spfactoryimpl.h"
+#include "mgjsonstorage.h"
+#include "mgbinstorage.h"
+#include "mgstorage.h"
+#include "mgnear.h"
+#include "githread.h"
+#include "gilock.h"
+#include "recordfile.h"
+#include "recordshapes.h"
+#include "mglines.h"
+#include "mgsplines.h"
+#include "mgfitter.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#if defined(__WINDOWS__) || defined(WIN32)
+#include <windows.h>
+#include <direct.h>
+#define makeDir(path)   _mkdir(path)
+#define removeDir(path) _rmdir(path)
+static long tickMs() { return (long)GetTickCount(); }
+#else
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define makeDir(path)   mkdir(path, 0755)
+#define removeDir(path) rmdir(path)
+#define PERFTEST_RUSAGE                 // 统计每次加载的内存峰值和缺页次数
+static long tickMs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec * 1000L + tv.tv_usec / 1000L;
+}
+#endif
+
+static const char* const kJsonFile = "perftest.tmp.json";
+static const char* const kBinFile = "perftest.tmp.vgb";
+static const char* const kRecordFile = "perftest.tmp.vgr";
+static const char* const kRefFile = "perftest.tmp.ref.json";
+static const char* const kUndoFile = "perftest.tmp.undo.vgc";
+static const char* const kPlayFile = "perftest.tmp.play.vgc";
+static const char* const kPlayDir = "perftest.tmp.play/";
+
+static int _failed = 0;
+static const char* _exe = "perftest";  // 本程序的路径，用于在新进程中测试加载
+
+static void check(bool ok, const char* what)
+{
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        _failed++;
+    }
+}
+
+static void report(const char* what, long start, int count)
+{
+    printf("%-36s %6ld ms  (%d)\n", what, tickMs() - start, count);
+}
+
+//! 输出耗时和每秒处理的点数(百万)
+static void reportRate(const char* what, long start, double points)
+{
+    long ms = tickMs() - start;
+    printf("%-36s %6ld ms  %8.1f Mpts/s\n", what, ms, ms > 0 ? points / ms / 1e3 : 0.0);
+}
+
+//! 进程的内存峰值和缺页次数，没有 getrusage 时都为0
+struct MemUsage {
+    long    peakKB;
+    long    minflt;
+    long    majflt;
+
+    MemUsage() {
+#ifdef PERFTEST_RUSAGE
+        struct rusage u;
+        getrusage(RUSAGE_SELF, &u);
+#ifdef __APPLE__
+        peakKB = u.ru_maxrss / 1024;    // macOS 以字节为单位
+#else
+        peakKB = u.ru_maxrss;
+#endif
+        minflt = u.ru_minflt;
+        majflt = u.ru_majflt;
+#else
+        peakKB = minflt = majflt = 0;
+#endif
+    }
+};
+
+// 输出耗时、自 from 以来的内存峰值增量和缺页次数
+static void report(const char* what, long start, int count, const MemUsage& from)
+{
+    MemUsage to;
+    printf("%-36s %6ld ms %8ld KB %8ld %6ld  (%d)\n", what, tickMs() - start,
+           to.peakKB - from.peakKB, to.minflt - from.minflt, to.majflt - from.majflt, count);
+}
+
+static bool sameBox(const Box2d& a, const Box2d& b, float tol = 1e-2f)
+{
+    return a.isEqualTo(b, Tol(tol));
+}
+
+//----------------------------------------------------------------------
+// 点数组和贝塞尔曲线的包络框
+
+static Box2d scalarBox(int count, const Point2d* pts)
+{
+    Box2d box(pts[0].x, pts[0].y, pts[0].x, pts[0].y);
+    for (int i = 1; i < count; i++) {
+        box.unionWith(pts[i]);
+    }
+    return box;
+}
+
+static void testExtents()
+{
+    std::vector<Point2d> pts(100001);
+    for (size_t i = 0; i < pts.size(); i++) {
+        pts[i].set(RandomParam::RandF(-5000, 5000), RandomParam::RandF(-5000, 5000));
+    }
+
+    for (int n = 1; n < 40; n++) {
+        Box2d box;
+        check(sameBox(Box2d(n, &pts[7]), scalarBox(n, &pts[7]), 0)
+              && sameBox(box.set(n, &pts[3]), scalarBox(n, &pts[3]), 0), "Box2d of point array");
+    }
+
+    Box2d box;
+    int n = (int)pts.size() - 1;
+    long start = tickMs();
+    for (int i = 0; i < 200; i++) {
+        box.set(n, &pts[i & 1]);
+    }
+    reportRate("Box2d::set 200 x 100000 points", start, 200.0 * n);
+    check(sameBox(box, scalarBox(n, &pts[1]), 0), "Box2d::set large array");
+
+    start = tickMs();
+    for (int i = 0; i < 200; i++) {
+        box = scalarBox(n, &pts[i & 1]);
+    }
+    reportRate("scalar min/max 200 x 100000 points", start, 200.0 * n);
+
+    Box2d ref;
+    n = 3 * 2000 + 1;
+    mgnear::beziersBox(box, n, &pts[0]);
+    for (int i = 0; i + 3 < n; i += 3) {
+        ref.unionWith(mgnear::bezierBox1(&pts[i]));
+    }
+    check(sameBox(box, ref, 1e-1f), "mgnear::beziersBox");
+
+    start = tickMs();
+    for (int i = 0; i < 200; i++) {
+        mgnear::beziersBox(box, n, &pts[i & 1]);
+    }
+    reportRate("mgnear::beziersBox 200 x 6001 points", start, 200.0 * n);
+
+    start = tickMs();
+    for (int i = 0; i < 200; i++) {
+        ref.empty();
+        for (int j = i & 1; j + 3 < n; j += 3) {
+            ref.unionWith(mgnear::bezierBox1(&pts[j]));
+        }
+    }
+    reportRate("bezierBox1 200 x 6001 points", start, 200.0 * n);
+}
+
+//----------------------------------------------------------------------
+// 随手画的曲线
+
+struct FreehandTest {
+    MgSplines*  shape;
+    int         fixed;      // 已定型的型值点数
+
+    static void append(void* data, const Point2d curve[4]) {
+        FreehandTest* p = (FreehandTest*)data;
+        p->shape->trimKnots(p->fixed);
+        p->shape->addBezier(curve);
+        p->fixed = p->shape->getPointCount();
+    }
+};
+
+// 按随手画命令的方式逐点拟合并更新图形，增量折线化的结果应与整体折线化的相同
+static void testFreehand(int count)
+{
+    MgSplines shape;
+    MgCurveFitter fitter;
+    Point2d fitpts[64], curve[4];
+    double params[128];
+    FreehandTest t = { &shape, 0 };
+    long start = tickMs();
+
+    shape.resize(1);
+    shape.setPoint(0, Point2d());
+    fitter.begin(fitpts, params, 64, 0.5f, FreehandTest::append, &t);
+    for (int i = 0; i < count; i++) {
+        fitter.addPoint(Point2d(i * 2.f, 100.f * sinf(i * 0.02f) + RandomParam::RandF(0, 4)));
+        if (fitter.getTail(curve)) {
+            shape.trimKnots(t.fixed);
+            shape.addBezier(curve);
+        }
+        shape.update();
+    }
+    fitter.end();
+    shape.update();
+    report("freehand fit and flatten per point", start, count);
+
+    const MgFlattenBeziers* flat = shape.getFlatten();
+    MgFlattenBeziers ref;
+    bool same = flat && ref.setSplines(shape.getPointCount(), shape.getPoints(), shape.getVectors(),
+                                       false, false, flat->getTolerance()) == flat->getCount()
+        && sameBox(flat->getExtent(), ref.getExtent(), 0);
+
+    for (int i = 0; same && i < ref.getCount(); i++) {
+        same = flat->getPoints()[i] == ref.getPoints()[i] && flat->getSegment(i) == ref.getSegment(i);
+    }
+    check(same, "freehand incremental flatten");
+}
+
+//----------------------------------------------------------------------
+// 文档存取
+
+static MgShapeDoc* createRandomDoc(int n)
+{
+    MgShapeDoc* doc = MgShapeDoc::createDoc();
+    RandomParam(n).addShapes(doc->getCurrentShapes());
+    return doc;
+}
+
+static std::string saveJson(MgShapeDoc* doc)
+{
+    MgJsonStorage js;
+    std::string content;
+
+    if (doc->save(js.storageForWrite(), 0)) {
+        content = js.stringify();
+    }
+    return content;
+}
+
+static bool writeFile(const char* filename, const std::string& content)
+{
+    FILE* fp = mgopenfile(filename, "wb");
+    bool ret = fp && fwrite(content.c_str(), 1, content.size(), fp) == content.size();
+    if (fp) fclose(fp);
+    return ret;
+}
+
+static std::string readFile(const char* filename)
+{
+    std::string content;
+    FILE* fp = mgopenfile(filename, "rb");
+    char buf[4096];
+    size_t n;
+
+    while (fp && (n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        content.append(buf, n);
+    }
+    if (fp) fclose(fp);
+    return content;
+}
+
+// JSON文件转为二进制文件再转回JSON后，文本应不变
+static bool sameAfterConvert(const char* jsonfile)
+{
+    std::string binfile(std::string(jsonfile) + ".vgb");
+    std::string json2(std::string(jsonfile) + ".2");
+    bool ret = MgBinStorage::jsonToBinary(jsonfile, binfile.c_str())
+        && MgBinStorage::binaryToJson(binfile.c_str(), json2.c_str())
+        && readFile(json2.c_str()) == readFile(jsonfile);
+
+    remove(binfile.c_str());
+    remove(json2.c_str());
+    return ret;
+}
+
+//! 加载方式
+enum LoadKind { kJsonDom, kJsonStream, kJsonMapped, kBinMapped };
+
+//! 按加载方式打开文件并返回存取接口对象，fp 为DOM和流式读取时打开的文件
+static MgStorage* openStorage(LoadKind kind, MgJsonStorage& js, MgBinStorage& bs, FILE*& fp)
+{
+    switch (kind) {
+    case kJsonDom:
+        fp = mgopenfile(kJsonFile, "rt");
+        return fp ? js.storageForRead(fp) : NULL;
+    case kJsonStream:
+        fp = mgopenfile(kJsonFile, "rt");
+        return fp ? js.storageForStreamRead(fp) : NULL;
+    case kJsonMapped:
+        return js.loadFile(kJsonFile);
+    default:
+        return bs.loadFile(kBinFile);
+    }
+}
+
+static const char* const kLoadNames[] = {
+    "load JSON (DOM)", "load JSON (SAX stream)", "load JSON (mmap in situ)", "load binary (mmap)"
+};
+
+// 丢弃文件在页缓存中的内容，使之后的加载为冷打开，读入或映射的页要从磁盘读取
+static bool dropCache(const char* filename)
+{
+#ifdef POSIX_FADV_DONTNEED
+    int fd = open(filename, O_RDONLY);
+    bool ret = fd >= 0 && fdatasync(fd) == 0 && posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    if (fd >= 0) close(fd);
+    return ret;
+#else
+    return !filename;
+#endif
+}
+
+// 在新进程中从文件加载，耗时和内存包括解析或映射文件，保存后应与基准文本相同，返回检查失败数
+static int loadInProcess(LoadKind kind, bool lazy, bool cold)
+{
+    if (cold && !dropCache(kind == kBinMapped ? kBinFile : kJsonFile)) {
+        return 0;                       // 不能丢弃页缓存时不测冷打开
+    }
+    
+    MemUsage from;
+    long start = tickMs();
+    MgShapeFactoryImpl factory;
+    MgJsonStorage js;
+    MgBinStorage bs;
+    FILE* fp = NULL;
+    MgShapeDoc* doc = MgShapeDoc::createDoc();
+    MgStorage* s = openStorage(kind, js, bs, fp);
+    bool ret = s && doc->load(&factory, s, false, lazy);
+    std::string what(std::string(cold ? "cold " : "") + (lazy ? "lazy " : "") + kLoadNames[kind]);
+
+    report(what.c_str(), start, doc->getShapeCount(), from);
+    check(ret, what.c_str());
+    check(saveJson(doc) == readFile(kRefFile), what.c_str());   // 延迟加载的图形在保存时读取几何数据
+    doc->release();
+    if (fp) fclose(fp);
+
+    return _failed;
+}
+
+// 在新进程中加载，使内存峰值增量和缺页次数只含本次加载，检查失败数由退出码返回
+static void measureLoad(LoadKind kind, bool lazy = false, bool cold = false)
+{
+    char cmd[1024];
+
+#if defined(_MSC_VER) && _MSC_VER >= 1400 // VC8
+    sprintf_s(cmd, sizeof(cmd), "\"%s\" --load %d %d %d", _exe, (int)kind, lazy ? 1 : 0, cold ? 1 : 0);
+#else
+    snprintf(cmd, sizeof(cmd), "\"%s\" --load %d %d %d", _exe, (int)kind, lazy ? 1 : 0, cold ? 1 : 0);
+#endif
+    fflush(stdout);
+
+    int ret = system(cmd);
+#ifdef PERFTEST_RUSAGE
+    ret = ret != -1 && WIFEXITED(ret) ? WEXITSTATUS(ret) : -1;
+#endif
+    if (ret < 0) {
+        check(false, kLoadNames[kind]);
+    } else {
+        _failed += ret;
+    }
+}
+
+static void testStorage(MgShapeFactory* factory, MgShapeDoc* src)
+{
+    long start = tickMs();
+    std::string content(saveJson(src));
+    report("save JSON (DOM writer)", start, (int)content.size());
+    check(!content.empty() && writeFile(kJsonFile, content), "save JSON");
+
+    MgJsonStorage js;
+    start = tickMs();
+    bool ret = src->save(js.storageForStreamWrite(), 0);
+    int size = ret ? (int)strlen(js.stringify()) : 0;
+    report("save JSON (stream writer)", start, size);
+    check(size > 0, "save JSON stream");
+
+    MgBinStorage bs;
+    start = tickMs();
+    size = 0;
+    ret = src->save(bs.storageForWrite(), 0) && bs.getData(size) && bs.saveFile(kBinFile);
+    report("save binary", start, size);
+    check(ret, "save binary");
+    check(MgBinStorage::isBinaryFile(kBinFile) && !MgBinStorage::isBinaryFile(kJsonFile),
+          "MgBinStorage::isBinaryFile");
+
+    // 加载时会设置闭合标志，JSON中的数值也有舍入，以DOM加载后保存的文本作为各种加载方式的比较基准，
+    // 二进制文件也由此文档保存
+    FILE* fp = NULL;
+    MgShapeDoc* doc = MgShapeDoc::createDoc();
+    MgBinStorage bs2;
+    ret = doc->load(factory, openStorage(kJsonDom, js, bs, fp), false)
+        && doc->getShapeCount() == src->getShapeCount()
+        && sameBox(doc->getExtent(), src->getExtent());
+    check(ret && writeFile(kRefFile, saveJson(doc))
+          && doc->save(bs2.storageForWrite(), 0) && bs2.saveFile(kBinFile), "reference JSON");
+    doc->release();
+    if (fp) fclose(fp);
+
+    // 图形数字段过大时只加载实有的图形，并行加载不按它一次分配
+    MgJsonStorage js3;
+    std::string bad(content);
+    size_t pos = bad.find("\"count\":", bad.find("\"shapes1\""));
+    if (pos != std::string::npos) {
+        pos += 8;
+        bad.replace(pos, bad.find_first_not_of("0123456789", pos) - pos, "2000000000");
+    }
+    doc = MgShapeDoc::createDoc();
+    check(pos != std::string::npos && doc->load(factory, js3.storageForRead(bad.c_str()), false)
+          && doc->getShapeCount() == src->getShapeCount(), "load with a bogus shape count");
+    doc->release();
+
+    // 从内存中的二进制内容延迟加载，清掉并释放该内容后未加载的图形仍可读取
+    std::string* bin = new std::string(readFile(kBinFile));
+    MgBinStorage bs3;
+    doc = MgShapeDoc::createDoc();
+    ret = doc->load(factory, bs3.storageForRead(bin->c_str(), (int)bin->size()), false, true);
+    bin->assign(bin->size(), '\0');
+    delete bin;
+    check(ret && saveJson(doc) == readFile(kRefFile), "lazy load binary from memory");
+    doc->release();
+
+    printf("%-36s %9s %11s %8s %6s\n", "", "time", "peak RSS+", "minflt", "majflt");
+    measureLoad(kJsonDom);
+    measureLoad(kJsonStream);
+    measureLoad(kJsonMapped);
+    measureLoad(kBinMapped);
+    measureLoad(kJsonMapped, true);
+    measureLoad(kBinMapped, true);
+    measureLoad(kJsonDom, false, true);
+    measureLoad(kJsonMapped, false, true);
+    measureLoad(kBinMapped, false, true);
+    measureLoad(kBinMapped, true, true);
+
+    std::string json2(std::string(kJsonFile) + ".2");
+    check(sameAfterConvert(kJsonFile), "document JSON to binary and back");
+    check(writeFile(json2.c_str(), "{\"a\":1.23457,\"b\":0.1,\"n\":{\"lineWidth\":-1.5,\"c\":[1,2.5]},"
+                    "\"i\":[1,2,3],\"big\":[1,1e+06,0.5],\"s\":\"x\"}")
+          && sameAfterConvert(json2.c_str()), "numbers JSON to binary and back");
+    remove(json2.c_str());
+}
+
+//----------------------------------------------------------------------
+// 多线程
+
+struct MutexTest {
+    GiMutex mutex;
+    long    value;
+};
+
+static void mutexProc(void* data)
+{
+    MutexTest* t = (MutexTest*)data;
+    for (int i = 0; i < 100000; i++) {
+        t->mutex.lock();
+        t->value++;
+        t->mutex.unlock();
+    }
+}
+
+static void countItems(int from, int to, void* data)
+{
+    for (int i = from; i < to; i++) {
+        ((int*)data)[i]++;
+    }
+}
+
+static void nestedItems(int from, int to, void* data)
+{
+    int local[256] = { 0 };
+
+    countItems(from, to, data);
+    giParallelFor(256, 1, countItems, local);   // 嵌套调用在本线程中依次处理
+    for (int i = 0; i < 256; i++) {
+        if (local[i] != 1)
+            ((int*)data)[from] = -1000;
+    }
+}
+
+static void testThreads(MgShapeDoc* src)
+{
+    MutexTest mt;
+    mt.value = 0;
+    long start = tickMs();
+    {
+        GiThread threads[4];
+        for (int i = 0; i < 4; i++) {
+            threads[i].start(mutexProc, &mt);
+        }
+    }
+    report("GiMutex 4 x 100000 locks", start, (int)mt.value);
+    check(mt.value == 400000, "GiMutex");
+
+    std::vector<int> items(100000, 0);
+    start = tickMs();
+    for (int i = 0; i < 500; i++) {
+        giParallelFor((int)items.size(), 64, i % 10 ? countItems : nestedItems, &items[0]);
+    }
+    report("giParallelFor 500 x 100000 items", start, giProcessorCount());
+    for (size_t i = 0; i < items.size(); i++) {
+        if (items[i] != 500) {
+            check(false, "giParallelFor");
+            break;
+        }
+    }
+
+    MgShapeDoc* doc = src->shallowCopy();  // 批量变形替换图形对象，不影响原文档
+    const Box2d saved(src->getExtent());
+    Box2d box(saved);
+    start = tickMs();
+    int n = doc->offset(Vector2d(100, 200));
+    n += doc->transform(Matrix2d::scaling(2, Point2d(100, 200)));
+    report("bulk offset and scaling", start, n);
+    check(n == 2 * src->getShapeCount(), "bulk transform count");
+    box.offset(100, 200);
+    box *= Matrix2d::scaling(2, Point2d(100, 200));
+    check(sameBox(doc->getExtent(), box, 1.f), "bulk transform extent");
+    doc->release();
+    check(sameBox(src->getExtent(), saved), "bulk transform source");
+}
+
+//----------------------------------------------------------------------
+// 录制容器
+
+static void testRecordFile(int steps)
+{
+    std::string data;
+    long start = tickMs();
+    {
+        MgRecordFile f;
+        check(f.create(kRecordFile, 1), "MgRecordFile::create");
+        for (int i = 0; i < steps; i++) {
+            data.assign(64 + i % 512, (char)('a' + i % 26));
+            check(f.write(i, i % 3, data.c_str(), (int)data.size(), i * 10, i), "MgRecordFile::write");
+        }
+        check(f.remove(1, 1), "MgRecordFile::remove");
+    }
+    report("write record file", start, steps);
+
+    start = tickMs();
+    {
+        MgRecordFile f;
+        check(f.open(kRecordFile, false) && f.getType() == 1, "MgRecordFile::open");
+        for (int i = 0; i < steps; i++) {
+            int tick = 0, flags = 0;
+            bool ret = f.read(i, i % 3, data);
+            if (i == 1) {
+                check(!ret, "MgRecordFile removed record");
+            } else {
+                check(ret && (int)data.size() == 64 + i % 512 && data[0] == (char)('a' + i % 26)
+                      && f.getInfo(i, i % 3, &tick, &flags) && tick == i * 10 && flags == i,
+                      "MgRecordFile::read");
+            }
+        }
+    }
+    report("read record file", start, steps);
+
+    {
+        MgRecordFile f;                 // 继续录制时保留已有的记录
+        check(f.open(kRecordFile, true) && f.write(steps, 0, "end", 3), "MgRecordFile resume");
+    }
+    {
+        MgRecordFile f;
+        check(f.open(kRecordFile, false) && f.read(0, 0, data) && f.read(steps, 0, data)
+              && data == "end", "MgRecordFile resumed records");
+    }
+    {
+        MgRecordFile f;                 // 文件号远超文件长度的记录不写入
+        check(f.create(kRecordFile, 1) && f.write(0, 0, "x", 1)
+              && !f.write(2000000000, 0, "x", 1), "MgRecordFile rejects a huge index");
+    }
+    if (FILE* fp = fopen(kRecordFile, "r+b")) {
+        unsigned char bad[] = { 0, 0x94, 0x35, 0x77 };  // 第一个记录头的文件号改为2000000000
+        fseek(fp, 16 + 4, SEEK_SET);
+        fwrite(bad, 1, 4, fp);
+        fseek(fp, -16, SEEK_END);       // 破坏文件尾，打开时逐个扫描记录
+        fwrite("XXXX", 1, 4, fp);
+        fclose(fp);
+
+        MgRecordFile f;
+        check(f.open(kRecordFile, false) && f.getCount(0) == 0 && !f.read(2000000000, 0, data),
+              "MgRecordFile skips a record with a huge index");
+    }
+    remove(kRecordFile);
+}
+
+//----------------------------------------------------------------------
+// 录制、撤销重做和播放
+
+// 两个图形列表的图形ID、类型、点数和包络框都相同，不计顺序和JSON中数值的舍入
+static bool sameShapes(const MgShapes* a, const MgShapes* b)
+{
+    MgShapeIterator it(a);
+    int n = 0;
+
+    while (const MgShape* sp = it.getNext()) {
+        const MgShape* sp2 = b->findShape(sp->getID());
+        if (!sp2 || sp2->getType() != sp->getType()
+            || sp2->shapec()->getPointCount() != sp->shapec()->getPointCount()
+            || !sameBox(sp2->shapec()->getExtent(), sp->shapec()->getExtent())) {
+            return false;
+        }
+        n++;
+    }
+    return n == b->getShapeCount();
+}
+
+// 依次新增、平移和删除图形，每步后的图形由 snaps 记下
+static void editShapes(MgShapeDoc* doc, int i, std::vector<MgShapes*>& snaps)
+{
+    MgShapes* shapes = doc->getCurrentShapes();
+
+    if (i % 3 != 1 || shapes->getShapeCount() < 2) {
+        RandomParam(1).addShapes(shapes);
+    } else if (i % 2) {
+        MgShape* sp = shapes->getLastShape()->cloneShape();
+        sp->shape()->offset(Vector2d(10.f, (float)i), -1);
+        sp->shape()->update();
+        shapes->updateShape(sp);
+    } else {
+        shapes->removeShape(shapes->getLastShape()->getID());
+    }
+    snaps.push_back(shapes->shallowCopy());     // 改变图形时替换为新的图形对象，可共用
+}
+
+static void releaseSnaps(std::vector<MgShapes*>& snaps)
+{
+    for (size_t i = 0; i < snaps.size(); i++) {
+        snaps[i]->release();
+    }
+    snaps.clear();
+}
+
+// 录制撤销步后全部撤销再全部重做，每步都应与录制时的文档相同，budget 为0时从文件撤销重做
+static void testUndoRedo(MgShapeFactory* factory, int steps, int budget)
+{
+    std::vector<MgShapes*> snaps;
+    MgShapeDoc* doc = MgShapeDoc::createDoc();
+    MgRecordShapes* recorder = new MgRecordShapes(kUndoFile, doc->shallowCopy(), true, 0);
+    std::string filename;
+    long changeCount = 0;
+    int written = 0;
+
+    remove(kUndoFile);
+    recorder->setMemoryBudget(budget);
+    recorder->setWriteQueue(4);
+    snaps.push_back(doc->getCurrentShapes()->shallowCopy());
+
+    long start = tickMs();
+    for (int i = 1; i <= steps; i++) {
+        editShapes(doc, i, snaps);
+        changeCount++;
+        recorder->recordStep(i * 50, changeCount - 1, changeCount, doc->shallowCopy(),
+                             NULL, std::vector<MgShapes*>());
+        while (recorder->takeWrittenFile(filename)) {
+            written++;
+        }
+    }
+    recorder->flush();
+    while (recorder->takeWrittenFile(filename)) {
+        written++;
+    }
+    report(budget ? "record undo steps (memory)" : "record undo steps (files)", start, steps);
+    check(written == steps && recorder->canUndo() && !recorder->canRedo(), "record undo steps");
+
+    start = tickMs();
+    for (int i = steps - 1; i >= 0; i--) {
+        check(recorder->undo(factory, doc, &changeCount) && changeCount == i
+              && sameShapes(doc->getCurrentShapes(), snaps[i]), "undo");
+        recorder->resetDoc(doc->shallowCopy());
+    }
+    check(!recorder->canUndo() && recorder->canRedo(), "undo all steps");
+    for (int i = 1; i <= steps; i++) {
+        check(recorder->redo(factory, doc, &changeCount) && changeCount == i
+              && sameShapes(doc->getCurrentShapes(), snaps[i]), "redo");
+        recorder->resetDoc(doc->shallowCopy());
+    }
+    report(budget ? "undo and redo (memory)" : "undo and redo (files)", start, steps * 2);
+    check(recorder->canUndo() && !recorder->canRedo(), "redo all steps");
+
+    delete recorder;
+    doc->release();
+    releaseSnaps(snaps);
+    remove(kUndoFile);
+}
+
+// 录制 from 到 to 帧，每4帧改变一次文档，其余帧只在手绘线后追加点(写为 dyninc)，snaps 和 dynSnaps 记下每帧后的图形
+static void recordFrames(MgShapeFactory* factory, MgRecordShapes* recorder, MgShapeDoc* doc, int from, int to,
+                         std::vector<MgShapes*>& snaps, std::vector<MgShapes*>& dynSnaps)
+{
+    MgShape* stroke = NULL;
+
+    for (int i = from; i <= to; i++) {
+        MgShapes* dyns = MgShapes::create();
+
+        if (i % 4 == 0) {
+            editShapes(doc, i, snaps);
+            MgObject::release_pointer(stroke);
+        } else {
+            MgShape* sp = stroke ? stroke->cloneShape() : factory->createShape(MgLines::Type());
+            MgObject::release_pointer(stroke);
+            stroke = sp;                // 复制的手绘线共用只增的顶点存储
+            ((MgBaseLines*)stroke->shape())->addPoint(Point2d((float)i * 3.f, (float)(i % 7) * 10.f));
+            stroke->shape()->update();
+            dyns->addShapeDirect(stroke->cloneShape());
+            snaps.push_back(doc->getCurrentShapes()->shallowCopy());
+        }
+        dynSnaps.push_back(dyns->shallowCopy());
+        recorder->recordStep(i * 50, i - 1, i, doc->shallowCopy(), dyns, std::vector<MgShapes*>());
+    }
+    MgObject::release_pointer(stroke);
+}
+
+// 按文件号顺序播放，每帧前清空动态图形，每帧后的图形都应与录制时的相同
+static bool replayFrames(MgShapeFactory* factory, MgRecordShapes* player, int frames,
+                         const std::vector<MgShapes*>& snaps, const std::vector<MgShapes*>& dynSnaps)
+{
+    MgShapeDoc* doc = MgShapeDoc::createDoc();
+    MgShapes* dyns = MgShapes::create();
+    bool ret = player->applyFirstFile(factory, doc) && sameShapes(doc->getCurrentShapes(), snaps[0]);
+
+    for (int i = 1; ret && i <= frames; i++) {
+        dyns->clear();
+        ret = player->applyRedoFile(factory, doc, dyns, i) != 0
+            && sameShapes(doc->getCurrentShapes(), snaps[i]) && sameShapes(dyns, dynSnaps[i]);
+    }
+    doc->release();
+    dyns->release();
+
+    return ret;
+}
+
+// 定位到 tick 时刻，文档和动态图形都应与不晚于该时刻的最后一帧的相同
+static bool seekFrame(MgShapeFactory* factory, MgRecordShapes* player, MgShapeDoc* doc, MgShapes* dyns,
+                      int tick, const std::vector<MgShapes*>& snaps, const std::vector<MgShapes*>& dynSnaps)
+{
+    const int i = mgMin(tick / 50, (int)snaps.size() - 1);
+
+    player->seek(factory, doc, dyns, tick);
+    return sameShapes(doc->getCurrentShapes(), snaps[i]) && sameShapes(dyns, dynSnaps[i]);
+}
+
+static void removePlayFiles(const char* path, int frames)
+{
+    const char* const exts[] = { ".vg", ".vgr", ".vgu", ".vgk" };
+    char filename[256];
+
+    if (MgRecordShapes(path, NULL, false, 0).isContainer()) {
+        remove(path);
+        return;
+    }
+    for (int i = 0; i <= frames; i++) {
+        for (int k = 0; k < 4; k++) {
+#if defined(_MSC_VER) && _MSC_VER >= 1400 // VC8
+            sprintf_s(filename, sizeof(filename), "%s%d%s", path, i, exts[k]);
+#else
+            snprintf(filename, sizeof(filename), "%s%d%s", path, i, exts[k]);
+#endif
+            remove(filename);
+        }
+    }
+    remove((std::string(path) + "records.idx").c_str());
+    remove((std::string(path) + "records.json").c_str());
+    removeDir(path);
+}
+
+// 录制一半后停止并继续录制(path 为容器文件或目录)，再顺序播放、预解码播放和按时刻定位
+static void testPlayback(MgShapeFactory* factory, int frames, const char* path)
+{
+    const bool container = MgRecordShapes(path, NULL, false, 0).isContainer();
+    std::vector<MgShapes*> snaps, dynSnaps;
+    MgShapeDoc* doc = MgShapeDoc::createDoc();
+    std::string what(container ? " (container)" : " (directory)");
+
+    removePlayFiles(path, frames);
+    if (!container) {
+        makeDir(path);
+    }
+
+    long start = tickMs();
+    MgRecordShapes* recorder = new MgRecordShapes(path, doc->shallowCopy(), false, 0);
+    recorder->setKeyframeInterval(25, 0);
+    recorder->setWriteQueue(4);
+    check(recorder->saveFirstFile(), "record the first frame");
+    snaps.push_back(doc->getCurrentShapes()->shallowCopy());
+    dynSnaps.push_back(MgShapes::create());
+    recordFrames(factory, recorder, doc, 1, frames / 2, snaps, dynSnaps);
+    recorder->flush();
+
+    const int index = recorder->getFileCount();     // 停止后从下一帧继续录制
+    delete recorder;
+    recorder = new MgRecordShapes(path, doc->shallowCopy(), false, 0);
+    recorder->setKeyframeInterval(25, 0);
+    recorder->restore(index, 0, (index - 1) * 50, 0);
+    recordFrames(factory, recorder, doc, index, frames, snaps, dynSnaps);
+    delete recorder;
+    report(("record and resume frames" + what).c_str(), start, frames);
+
+    MgRecordShapes player(path, NULL, false, 0);
+    std::vector<int> arr;
+    check((int)snaps.size() == frames + 1 && MgRecordShapes::loadFrameIndex(path, arr)
+          && (int)arr.size() == frames * 3, ("frame index after resume" + what).c_str());
+
+    start = tickMs();
+    check(replayFrames(factory, &player, frames, snaps, dynSnaps), ("replay frames" + what).c_str());
+    report(("replay frames" + what).c_str(), start, frames);
+
+    player.setPrefetch(8);
+    start = tickMs();
+    check(replayFrames(factory, &player, frames, snaps, dynSnaps), ("prefetch and replay" + what).c_str());
+    report(("prefetch and replay" + what).c_str(), start, frames);
+
+    MgRecordShapes seeker(path, NULL, false, 0);    // 定位时的文档应为播放器当前的文档
+    MgShapeDoc* sdoc = MgShapeDoc::createDoc();
+    MgShapes* sdyns = MgShapes::create();
+    start = tickMs();
+    check(seekFrame(factory, &seeker, sdoc, sdyns, frames * 50, snaps, dynSnaps), "seek to the last frame");
+    report(("seek to the last frame" + what).c_str(), start, 1);
+
+    start = tickMs();
+    for (int k = 0; k < 100; k++) {
+        const int tick = (k * 7919) % (frames * 50 + 50);
+        check(seekFrame(factory, &seeker, sdoc, sdyns, tick, snaps, dynSnaps), ("seek" + what).c_str());
+    }
+    report(("seek to random ticks" + what).c_str(), start, 100);
+    sdoc->release();
+    sdyns->release();
+
+    doc->release();
+    releaseSnaps(snaps);
+    releaseSnaps(dynSnaps);
+    removePlayFiles(path, frames);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 4 && strcmp(argv[1], "--load") == 0) {  // 由 measureLoad 启动
+        return loadInProcess((LoadKind)atoi(argv[2]), atoi(argv[3]) != 0, atoi(argv[4]) != 0);
+    }
+
+    int n = argc > 1 ? atoi(argv[1]) : 2000;
+    _exe = argv[0];
+
+    RandomParam::init();
+    srand(9999);                        // 每次运行使用相同的随机图形
+
+    MgShapeFactoryImpl factory;
+    MgShapeDoc* doc = createRandomDoc(n > 0 ? n : 2000);
+
+    printf("%d shapes, %d processors\n", doc->getShapeCount(), giProcessorCount());
+    testExtents();
+    testFreehand(20000);
+    testStorage(&factory, doc);
+    testThreads(doc);
+    testRecordFile(n > 0 ? n : 2000);
+    testUndoRedo(&factory, 200, 16 * 1024 * 1024);
+    testUndoRedo(&factory, 200, 0);
+    testPlayback(&factory, 400, kPlayFile);
+    testPlayback(&factory, 400, kPlayDir);
+
+    doc->release();
+    remove(kJsonFile);
+    remove(kBinFile);
+    remove(kRefFile);
+
+    printf(_failed ? "%d checks failed\n" : "All checks passed\n", _failed);
+    return _failed ? 1 : 0;
+}
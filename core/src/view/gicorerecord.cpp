@@ -6,7 +6,8 @@
 #include "gicoreviewimpl.h"
 #include <algorithm>
 
-static const bool VG_PRETTY = false;
+static const int RECORD_QUEUE_SIZE = 8;     // 录制线程的队列长度
+static const int PLAY_PREFETCH = 8;         // 播放时预先解码的帧数
 
 long GiCoreView::getRecordTick(bool forUndo, long curTick)
 {
@@ -22,13 +23,21 @@ bool GiCoreView::startRecord(const char* path, long doc, bool forUndo,
                              long curTick, MgStringCallback* c)
 {
     MgRecordShapes* p = new MgRecordShapes(path, MgShapeDoc::fromHandle(doc), forUndo, curTick);
+    p->setMemoryBudget(impl->getOptionInt("undoMemoryBudget", p->getMemoryBudget()));
+    p->setWriteQueue(impl->getOptionInt("recordQueueSize", RECORD_QUEUE_SIZE));
+    p->setHistoryLimit(impl->getOptionInt("undoMaxSteps", -1), impl->getOptionInt("undoMaxBytes", -1),
+                       impl->getOptionInt("undoMaxAge", -1));
+    p->setSquashInterval(impl->getOptionInt("undoSquashTicks", 0));
+    if (!forUndo && !doc) {
+        p->setPrefetch(impl->getOptionInt("playPrefetch", PLAY_PREFETCH));
+    }
     impl->setRecorder(forUndo, p);
     
     if (isPlaying() || forUndo) {
         return true;
     }
     
-    if (!saveToFile(doc, p->getFileName(false, 0).c_str(), VG_PRETTY)) {
+    if (!p->saveFirstFile()) {
         return false;
     }
     
@@ -57,6 +66,7 @@ bool GiCoreView::recordShapes(bool forUndo, long tick, long changeCount, long do
     MgRecordShapes* recorder = impl->recorder(forUndo);
     int ret = 0;
     std::vector<MgShapes*> arr;
+    std::string filename;
     int i;
     
     for (i = 0; i < (exts ? exts->count() : 0); i++) {
@@ -70,8 +80,10 @@ bool GiCoreView::recordShapes(bool forUndo, long tick, long changeCount, long do
         ret = recorder->recordStep(tick, changeCount, impl->changeCount,
                                    MgShapeDoc::fromHandle(doc),
                                    MgShapes::fromHandle(shapes), arr) ? 2 : 1;
-        if (ret > 1 && c) {
-            c->onGetString(recorder->getFileName(false, recorder->getFileCount() - 1).c_str());
+        while (recorder->takeWrittenFile(filename)) {   // 录制线程已写完的步，不等待本步写完
+            if (c) {
+                c->onGetString(filename.c_str());
+            }
         }
     } else {
         GiPlaying::releaseDoc(doc);
@@ -92,6 +104,11 @@ bool GiCoreView::restoreRecord(int type, const char* path, long doc, long change
         return false;
     
     recorder = new MgRecordShapes(path, MgShapeDoc::fromHandle(doc), type == 0, curTick);
+    recorder->setMemoryBudget(impl->getOptionInt("undoMemoryBudget", recorder->getMemoryBudget()));
+    recorder->setWriteQueue(impl->getOptionInt("recordQueueSize", RECORD_QUEUE_SIZE));
+    recorder->setHistoryLimit(impl->getOptionInt("undoMaxSteps", -1), impl->getOptionInt("undoMaxBytes", -1),
+                              impl->getOptionInt("undoMaxAge", -1));
+    recorder->setSquashInterval(impl->getOptionInt("undoSquashTicks", 0));
     recorder->restore(index, count, tick, curTick);
     impl->setRecorder(type == 0, recorder);
     
@@ -215,6 +232,25 @@ int GiCoreView::getFrameFlags()
     return impl->recorder(false) ? impl->recorder(false)->getFileFlags() : 0;
 }
 
+int GiCoreView::seekFrame(long tick)
+{
+    MgRecordShapes* player = impl->recorder(false);
+    GiPlaying* playing = impl->play.playing;
+    int ret = 0;
+    
+    if (player && player->isPlaying() && playing) {
+        ret = player->seek(impl->getShapeFactory(), playing->getBackDoc(),
+                           playing->getBackShapes(true), (int)tick);
+        if (ret) {
+            playing->submitBackDoc();
+            playing->submitBackShapes();
+            impl->regenAll(true);
+        }
+    }
+    
+    return ret;
+}
+
 bool GiCoreView::isPaused() const
 {
     return impl->startPauseTick != 0;
@@ -13,6 +13,7 @@
 #include "../corever.h"
 #include "mgimagesp.h"
 #include "mglocal.h"
+#include "mgbinstorage.h"
 #include <sstream>
 
 static volatile long _viewCount = 0;    // 总视图数
@@ -872,6 +873,38 @@ int GiCoreView::addShapesForTest(int n)
     return n;
 }
 
+// 批量变形后只通知视图重新构建显示一次，不逐个发出图形改变通知
+// mat 为NULL时平移 vec
+static int transformDoc(GiCoreViewImpl* impl, const Matrix2d* mat, const Vector2d& vec)
+{
+    DrawLocker locker(impl);
+    int n = 0;
+
+    if (!impl->doc()->isReadOnly()) {
+        MgCommand* cmd = impl->getCommand();
+        if (cmd) cmd->cancel(impl->motion());   // 图形对象将被替换，不保留选择和拖动状态
+        impl->hideContextActions();
+
+        n = mat ? impl->doc()->transform(*mat) : impl->doc()->offset(vec);
+        if (n > 0) {
+            impl->regenAll(true);
+        }
+    }
+
+    return n;
+}
+
+int GiCoreView::scaleShapes(float sx, float sy, float cx, float cy)
+{
+    Matrix2d mat(Matrix2d::scaling(sx, sy, Point2d(cx, cy)));
+    return transformDoc(impl, &mat, Vector2d());
+}
+
+int GiCoreView::offsetShapes(float dx, float dy)
+{
+    return transformDoc(impl, NULL, Vector2d(dx, dy));
+}
+
 int GiCoreView::getShapeCount()
 {
     return impl->doc()->getShapeCount();
@@ -927,6 +960,11 @@ int GiCoreView::getSelectedShapeType()
 }
 
 bool GiCoreView::loadShapes(MgStorage* s, bool readOnly)
+{
+    return loadShapes(s, readOnly, false);
+}
+
+bool GiCoreView::loadShapes(MgStorage* s, bool readOnly, bool lazy)
 {
     DrawLocker locker(impl);
     bool ret = false;
@@ -937,7 +975,7 @@ bool GiCoreView::loadShapes(MgStorage* s, bool readOnly)
     impl->hideContextActions();
 
     if (s) {
-        ret = impl->doc()->loadAll(impl->getShapeFactory(), s, impl->xform());
+        ret = impl->doc()->loadAll(impl->getShapeFactory(), s, impl->xform(), lazy);
         impl->doc()->setReadOnly(readOnly);
         LOGD("Load %d shapes and %d layers",
              impl->doc()->getShapeCount(), impl->doc()->getLayerCount());
@@ -1004,7 +1042,7 @@ void GiCoreView::clear()
 const char* GiCoreView::getContent(long doc)
 {
     const char* content = "";
-    if (saveShapes(doc, impl->defaultStorage.storageForWrite())) {
+    if (saveShapes(doc, impl->defaultStorage.storageForStreamWrite())) {
         content = impl->defaultStorage.stringify();
     }
     return content; // has't free defaultStorage's string buffer
@@ -1024,14 +1062,34 @@ bool GiCoreView::setContent(const char* content)
 
 bool GiCoreView::loadFromFile(const char* vgfile, bool readOnly)
 {
+    return loadFromFile(vgfile, readOnly, false);
+}
+
+bool GiCoreView::loadFromFile(const char* vgfile, bool readOnly, bool lazy)
+{
+    if (MgBinStorage::isBinaryFile(vgfile)) {   // 二进制文件映射后直接读取
+        MgBinStorage s;
+        bool ret = loadShapes(s.loadFile(vgfile), readOnly, lazy);
+        LOGD("loadFromFile: %d, %s", ret, vgfile);
+        return ret;
+    }
+    if (lazy) {                                 // 延迟加载时保留映射后原地解析的DOM
+        MgJsonStorage s;
+        bool ret = loadShapes(s.loadFile(vgfile), readOnly, lazy);
+        LOGD("loadFromFile: %d, %s", ret, vgfile);
+        return ret;
+    }
+    
     FILE *fp = mgopenfile(vgfile, "rt");
     if (!fp) {
         LOGE("Fail to open file: %s", vgfile);
         return loadShapes(NULL, readOnly) && fp;
     }
     
+    // 边解析边读取的峰值内存小，但较慢且不能多线程加载，由选项 streamLoad 开启
     MgJsonStorage s;
-    bool ret = loadShapes(s.storageForRead(fp), readOnly);
+    bool stream = impl->getOptionBool("streamLoad", false);
+    bool ret = loadShapes(stream ? s.storageForStreamRead(fp) : s.storageForRead(fp), readOnly);
 
     fclose(fp);
     LOGD("loadFromFile: %d, %s", ret, vgfile);
@@ -1044,7 +1102,7 @@ bool GiCoreView::saveToFile(long doc, const char* vgfile, bool pretty)
     FILE *fp = doc ? mgopenfile(vgfile, "wt") : NULL;
     MgJsonStorage s;
     bool ret = (fp != NULL
-                && saveShapes(doc, s.storageForWrite())
+                && saveShapes(doc, s.storageForStreamWrite(fp, pretty))
                 && s.save(fp, pretty));
     
     if (fp) {